@@ -0,0 +1,101 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef MYSQL_HARNESS_CANCELLATION_EVENT_INCLUDED
+#define MYSQL_HARNESS_CANCELLATION_EVENT_INCLUDED
+
+#include <atomic>
+#include <chrono>
+
+#include "harness_export.h"
+
+namespace mysql_harness {
+
+/** @class CancellationEvent
+ * @brief Wakes up threads blocked in poll() when something is stopped
+ *
+ * Wraps an eventfd (Linux), a pipe (other Unices) or a connected loopback
+ * socket pair (Windows). Once cancel() was called, native_handle() stays
+ * readable, so it can be added to the poll set of any number of threads:
+ * all of them get woken up immediately, instead of checking a stop flag
+ * every now and then.
+ *
+ * Example:
+ *
+ * @code
+ * struct pollfd fds[] = {
+ *   { sock, POLLIN, 0 },
+ *   { stop_event.native_handle(), POLLIN, 0 },
+ * };
+ * poll(fds, 2, -1);
+ * if (fds[1].revents != 0) return;  // we got cancelled
+ * @endcode
+ */
+class HARNESS_EXPORT CancellationEvent {
+ public:
+  /** @brief Constructor
+   *
+   * @throws std::system_error if the OS resources could not be allocated
+   */
+  CancellationEvent();
+
+  ~CancellationEvent();
+
+  CancellationEvent(const CancellationEvent&) = delete;
+  CancellationEvent& operator=(const CancellationEvent&) = delete;
+
+  /** @brief Signals the event and wakes up all waiters
+   *
+   * Calling it more than once has no further effect.
+   */
+  void cancel() noexcept;
+
+  /** @brief Returns whether cancel() was called (since the last reset()) */
+  bool is_cancelled() const noexcept {
+    return cancelled_.load();
+  }
+
+  /** @brief Clears the event, so it can be used again */
+  void reset() noexcept;
+
+  /** @brief Blocks until the event gets signaled or the timeout expires
+   *
+   * Replacement for sleep_for() in loops which have to be stoppable.
+   *
+   * @param timeout how long to wait at most
+   * @return true if the event was signaled
+   */
+  bool wait_for(std::chrono::milliseconds timeout) noexcept;
+
+  /** @brief Returns the descriptor to add to a poll set
+   *
+   * The descriptor becomes readable (POLLIN) when the event gets signaled.
+   * It must only be polled, never read from.
+   */
+  int native_handle() const noexcept {
+    return read_fd_;
+  }
+
+ private:
+  std::atomic<bool> cancelled_;
+  int read_fd_;
+  int write_fd_;
+};
+
+} // namespace mysql_harness
+
+#endif // MYSQL_HARNESS_CANCELLATION_EVENT_INCLUDED
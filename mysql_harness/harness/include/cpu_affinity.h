@@ -0,0 +1,73 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef MYSQL_HARNESS_CPU_AFFINITY_INCLUDED
+#define MYSQL_HARNESS_CPU_AFFINITY_INCLUDED
+
+#include <string>
+#include <vector>
+
+#include "harness_export.h"
+
+namespace mysql_harness {
+
+/** @brief Sorted list of CPU numbers */
+using CpuSet = std::vector<unsigned>;
+
+/** @brief Parses a CPU list as used by taskset(1)
+ *
+ * Example: "0-3,8,10-11"
+ *
+ * @param value comma separated list of CPU numbers and ranges
+ * @return sorted CPU numbers without duplicates; empty if value is empty
+ * @throws std::invalid_argument if value is not a valid CPU list
+ */
+CpuSet HARNESS_EXPORT parse_cpu_set(const std::string &value);
+
+/** @brief Formats a CPU set the way parse_cpu_set() reads it */
+std::string HARNESS_EXPORT cpu_set_to_string(const CpuSet &cpus);
+
+/** @brief Restricts the calling thread to the given CPUs
+ *
+ * Threads created afterwards by the calling thread inherit the setting.
+ *
+ * @param cpus CPUs the thread may run on
+ * @return false if not supported on this platform or the call failed
+ */
+bool HARNESS_EXPORT set_thread_affinity(const CpuSet &cpus);
+
+/** @brief Returns the CPUs the calling thread may run on
+ *
+ * @return the CPUs; empty if not supported on this platform
+ */
+CpuSet HARNESS_EXPORT get_thread_affinity();
+
+/** @brief Returns the NUMA node a CPU belongs to
+ *
+ * @return node number, or -1 if unknown
+ */
+int HARNESS_EXPORT get_numa_node_of_cpu(unsigned cpu);
+
+/** @brief Returns the NUMA node all of the given CPUs belong to
+ *
+ * @return node number, or -1 if the CPUs span several nodes or it is unknown
+ */
+int HARNESS_EXPORT get_numa_node_of_cpus(const CpuSet &cpus);
+
+} // namespace mysql_harness
+
+#endif // MYSQL_HARNESS_CPU_AFFINITY_INCLUDED
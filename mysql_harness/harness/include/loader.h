@@ -219,7 +219,9 @@ class HARNESS_EXPORT Loader {
    * Initialize and start all loaded plugins.
    *
    * All registered plugins will be initialized in proper order and
-   * started (if they have a `start` callback).
+   * started (if they have a `start` callback). On SIGINT or SIGTERM the
+   * plugins get stopped. Returns after all of them finished and got
+   * deinitialized.
    */
   void start();
 
@@ -334,6 +336,9 @@ class HARNESS_EXPORT Loader {
   std::mutex done_mutex_;
   std::condition_variable done_cond_;
 
+  // serializes stop_all() calls
+  std::mutex stop_mutex_;
+
   /**
    * Initialization order.
    */
@@ -0,0 +1,177 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef MYSQL_HARNESS_TIMER_WHEEL_INCLUDED
+#define MYSQL_HARNESS_TIMER_WHEEL_INCLUDED
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "harness_export.h"
+
+namespace mysql_harness {
+
+/** @class TimerWheel
+ * @brief Hierarchical timer wheel shared by all users of the harness
+ *
+ * Keeps a large number of coarse-grained deadlines (connect timeouts, idle
+ * timeouts, ...) without waking up the threads owning them. Adding and
+ * cancelling a timer is O(1); timers are stored in 4 levels of 64 slots each,
+ * timers on the outer levels are cascaded down as the wheel turns.
+ *
+ * The timer thread only wakes up when a slot with pending timers becomes
+ * due; if no timer is pending, it sleeps until a new one is added.
+ *
+ * Callbacks are executed in the timer thread and should be short (e.g.
+ * shutdown() a socket to wake up the thread blocked on it).
+ */
+class HARNESS_EXPORT TimerWheel {
+ public:
+  using clock_type = std::chrono::steady_clock;
+  using TimerId = uint64_t;
+  using Callback = std::function<void()>;
+
+  /** @brief id that never refers to a scheduled timer */
+  static constexpr TimerId kInvalidTimerId = 0;
+
+  /** @brief Constructor
+   *
+   * @param tick resolution of the wheel; deadlines are rounded up to it
+   */
+  explicit TimerWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(100));
+
+  /** @brief Destructor; stops the timer thread, pending timers don't fire */
+  ~TimerWheel();
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  /** @brief Returns the wheel shared by the whole process
+   *
+   * The timer thread of the shared instance is started on first use.
+   */
+  static TimerWheel& instance();
+
+  /** @brief Starts the timer thread (noop if already running) */
+  void start();
+
+  /** @brief Stops and joins the timer thread */
+  void stop();
+
+  /** @brief Schedules a callback
+   *
+   * @param timeout time after which callback is executed
+   * @param callback function to execute when the timer expires
+   * @return id of the timer, to be passed to cancel()
+   */
+  TimerId add(std::chrono::milliseconds timeout, Callback callback);
+
+  /** @brief Cancels a timer
+   *
+   * If the callback is being executed at the time of the call, waits until
+   * it finished (unless called from the callback itself), so that after
+   * cancel() returns the callback is guaranteed not to run anymore.
+   *
+   * @param id id returned by add()
+   * @return true if the timer was still pending, false if it already fired
+   */
+  bool cancel(TimerId id);
+
+  /** @brief Executes all callbacks that are due at the given time point
+   *
+   * Called by the timer thread; exposed to allow driving the wheel
+   * without the thread (e.g. in tests). Must not be called concurrently.
+   *
+   * @param now point in time to move the wheel to
+   * @return number of callbacks executed
+   */
+  size_t expire(clock_type::time_point now);
+
+  /** @brief Returns number of pending timers */
+  size_t size() const;
+
+ private:
+  static constexpr unsigned kLevels = 4;
+  static constexpr unsigned kSlotBits = 6;
+  static constexpr uint64_t kSlots = 1u << kSlotBits;
+  static constexpr uint64_t kSlotMask = kSlots - 1;
+
+  struct Timer {
+    TimerId id;
+    uint64_t expires;  // in ticks
+    Callback callback;
+  };
+
+  using Slot = std::list<Timer>;
+
+  struct Position {
+    unsigned level;
+    uint64_t slot;
+    Slot::iterator it;
+  };
+
+  uint64_t to_tick(clock_type::time_point tp) const;
+
+  clock_type::time_point to_time_point(uint64_t tick) const;
+
+  // moves timer from its current list into the slot matching its expiry,
+  // relative to current_tick_
+  void place(Slot &from, Slot::iterator it);
+
+  // moves all timers of the given slot one level down
+  void cascade(unsigned level, uint64_t slot);
+
+  // next tick that may have something to do; only valid if !timers_.empty()
+  uint64_t next_tick() const;
+
+  void run();
+
+  const std::chrono::milliseconds tick_;
+  const clock_type::time_point epoch_;
+
+  mutable std::mutex mtx_;
+  std::condition_variable cond_;
+  std::condition_variable cond_callback_done_;
+
+  std::array<std::array<Slot, kSlots>, kLevels> wheel_;
+  std::unordered_map<TimerId, Position> timers_;
+
+  // timers taken off the wheel by expire() which didn't run yet; cancel()
+  // still removes them from here
+  Slot due_;
+
+  // next tick to be processed
+  uint64_t current_tick_;
+  TimerId next_id_;
+
+  TimerId running_id_;
+  std::thread::id running_thread_;
+
+  bool stopping_;
+  std::thread thread_;
+};
+
+} // namespace mysql_harness
+
+#endif // MYSQL_HARNESS_TIMER_WHEEL_INCLUDED
@@ -0,0 +1,191 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "cancellation_event.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#  include <winsock2.h>
+#  include <ws2tcpip.h>
+#else
+#  include <fcntl.h>
+#  include <poll.h>
+#  include <unistd.h>
+#  ifdef __linux__
+#    include <sys/eventfd.h>
+#  endif
+#endif
+
+namespace mysql_harness {
+
+namespace {
+
+#ifdef _WIN32
+int last_error() {
+  return WSAGetLastError();
+}
+
+void close_fd(int fd) {
+  closesocket(static_cast<SOCKET>(fd));
+}
+
+// there are no pipes which can be used with WSAPoll(); use a pair of
+// connected loopback sockets instead
+void make_socket_pair(int &read_fd, int &write_fd) {
+  SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (listener == INVALID_SOCKET) {
+    throw std::system_error(last_error(), std::system_category(), "socket() failed");
+  }
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  int addr_len = sizeof(addr);
+
+  SOCKET writer = INVALID_SOCKET;
+  SOCKET reader = INVALID_SOCKET;
+  if (bind(listener, reinterpret_cast<struct sockaddr*>(&addr), addr_len) == 0 &&
+      getsockname(listener, reinterpret_cast<struct sockaddr*>(&addr), &addr_len) == 0 &&
+      listen(listener, 1) == 0 &&
+      (writer = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) != INVALID_SOCKET &&
+      connect(writer, reinterpret_cast<struct sockaddr*>(&addr), addr_len) == 0) {
+    reader = accept(listener, nullptr, nullptr);
+  }
+  const int err = last_error();
+  closesocket(listener);
+
+  if (reader == INVALID_SOCKET) {
+    if (writer != INVALID_SOCKET) closesocket(writer);
+    throw std::system_error(err, std::system_category(), "creating socket pair failed");
+  }
+
+  u_long non_blocking = 1;
+  ioctlsocket(reader, FIONBIO, &non_blocking);
+
+  read_fd = static_cast<int>(reader);
+  write_fd = static_cast<int>(writer);
+}
+#else
+int last_error() {
+  return errno;
+}
+
+void close_fd(int fd) {
+  ::close(fd);
+}
+#endif
+
+} // namespace
+
+CancellationEvent::CancellationEvent()
+    : cancelled_(false), read_fd_(-1), write_fd_(-1) {
+#if defined(_WIN32)
+  make_socket_pair(read_fd_, write_fd_);
+#elif defined(__linux__)
+  read_fd_ = write_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (read_fd_ == -1) {
+    throw std::system_error(last_error(), std::system_category(), "eventfd() failed");
+  }
+#else
+  int fds[2];
+  if (pipe(fds) == -1) {
+    throw std::system_error(last_error(), std::system_category(), "pipe() failed");
+  }
+  for (int fd: fds) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+  read_fd_ = fds[0];
+  write_fd_ = fds[1];
+#endif
+}
+
+CancellationEvent::~CancellationEvent() {
+  if (write_fd_ != read_fd_) {
+    close_fd(write_fd_);
+  }
+  close_fd(read_fd_);
+}
+
+void CancellationEvent::cancel() noexcept {
+  if (cancelled_.exchange(true)) {
+    return;
+  }
+
+  // the descriptor stays readable until reset()
+#if defined(_WIN32)
+  const char c = 1;
+  send(static_cast<SOCKET>(write_fd_), &c, 1, 0);
+#elif defined(__linux__)
+  const uint64_t one = 1;
+  while (::write(write_fd_, &one, sizeof(one)) == -1 && errno == EINTR) {}
+#else
+  const char c = 1;
+  while (::write(write_fd_, &c, 1) == -1 && errno == EINTR) {}
+#endif
+}
+
+void CancellationEvent::reset() noexcept {
+  if (!cancelled_.exchange(false)) {
+    return;
+  }
+
+#if defined(_WIN32)
+  char buf[16];
+  while (recv(static_cast<SOCKET>(read_fd_), buf, sizeof(buf), 0) > 0) {}
+#elif defined(__linux__)
+  uint64_t value;
+  while (::read(read_fd_, &value, sizeof(value)) == -1 && errno == EINTR) {}
+#else
+  char buf[16];
+  while (::read(read_fd_, buf, sizeof(buf)) > 0) {}
+#endif
+}
+
+bool CancellationEvent::wait_for(std::chrono::milliseconds timeout) noexcept {
+  using clock_type = std::chrono::steady_clock;
+  const auto deadline = clock_type::now() + timeout;
+
+  while (!is_cancelled()) {
+    const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock_type::now());
+    if (remaining.count() <= 0) {
+      break;
+    }
+
+    struct pollfd fds[] = {
+      { read_fd_, POLLIN, 0 },
+    };
+#ifdef _WIN32
+    const int res = WSAPoll(fds, 1, static_cast<INT>(remaining.count()));
+#else
+    const int res = ::poll(fds, 1, static_cast<int>(remaining.count()));
+#endif
+    if (res == -1 && last_error() != EINTR) {
+      break;
+    }
+  }
+
+  return is_cancelled();
+}
+
+} // namespace mysql_harness
@@ -0,0 +1,189 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "cpu_affinity.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <pthread.h>
+#  ifdef __linux__
+#    include <dirent.h>
+#    include <sched.h>
+#  endif
+#endif
+
+namespace mysql_harness {
+
+namespace {
+
+// highest CPU number we accept; matches the default CPU_SETSIZE of glibc
+const unsigned kMaxCpu = 1023;
+
+unsigned parse_cpu(const std::string &value, const std::string &all) {
+  if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos) {
+    throw std::invalid_argument("invalid CPU list '" + all + "'");
+  }
+  const unsigned long cpu = std::strtoul(value.c_str(), nullptr, 10);
+  if (cpu > kMaxCpu) {
+    throw std::invalid_argument("CPU number " + value + " too large in '" + all + "'");
+  }
+  return static_cast<unsigned>(cpu);
+}
+
+} // namespace
+
+CpuSet parse_cpu_set(const std::string &value) {
+  CpuSet cpus;
+  if (value.empty()) {
+    return cpus;
+  }
+
+  size_t pos = 0;
+  while (pos <= value.size()) {
+    size_t end = value.find(',', pos);
+    if (end == std::string::npos) end = value.size();
+    const std::string item = value.substr(pos, end - pos);
+
+    const size_t dash = item.find('-');
+    if (dash == std::string::npos) {
+      cpus.push_back(parse_cpu(item, value));
+    } else {
+      const unsigned first = parse_cpu(item.substr(0, dash), value);
+      const unsigned last = parse_cpu(item.substr(dash + 1), value);
+      if (first > last) {
+        throw std::invalid_argument("invalid CPU range '" + item + "' in '" + value + "'");
+      }
+      for (unsigned cpu = first; cpu <= last; ++cpu) {
+        cpus.push_back(cpu);
+      }
+    }
+    pos = end + 1;
+  }
+
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return cpus;
+}
+
+std::string cpu_set_to_string(const CpuSet &cpus) {
+  std::string result;
+  for (size_t i = 0; i < cpus.size(); ) {
+    size_t j = i;
+    while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+
+    if (!result.empty()) result += ",";
+    result += std::to_string(cpus[i]);
+    if (j > i) result += "-" + std::to_string(cpus[j]);
+    i = j + 1;
+  }
+  return result;
+}
+
+bool set_thread_affinity(const CpuSet &cpus) {
+  if (cpus.empty()) {
+    return false;
+  }
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (unsigned cpu: cpus) {
+    CPU_SET(cpu, &set);
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+  // without processor groups only the first 64 CPUs can be addressed
+  DWORD_PTR mask = 0;
+  for (unsigned cpu: cpus) {
+    if (cpu < sizeof(mask) * 8) mask |= static_cast<DWORD_PTR>(1) << cpu;
+  }
+  return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+  return false;
+#endif
+}
+
+CpuSet get_thread_affinity() {
+  CpuSet cpus;
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+  }
+#elif defined(_WIN32)
+  DWORD_PTR process_mask, system_mask;
+  if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) {
+    for (unsigned cpu = 0; cpu < sizeof(process_mask) * 8; ++cpu) {
+      if (process_mask & (static_cast<DWORD_PTR>(1) << cpu)) cpus.push_back(cpu);
+    }
+  }
+#endif
+  return cpus;
+}
+
+int get_numa_node_of_cpu(unsigned cpu) {
+#if defined(__linux__)
+  // the CPU's directory contains a "node<N>" link to its node
+  const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+  DIR *dir = opendir(path.c_str());
+  if (dir == nullptr) {
+    return -1;
+  }
+  int node = -1;
+  while (struct dirent *entry = readdir(dir)) {
+    const std::string name = entry->d_name;
+    if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+        name.find_first_not_of("0123456789", 4) == std::string::npos) {
+      node = std::atoi(name.c_str() + 4);
+      break;
+    }
+  }
+  closedir(dir);
+  return node;
+#elif defined(_WIN32)
+  UCHAR node;
+  if (cpu > 255 || !GetNumaProcessorNode(static_cast<UCHAR>(cpu), &node) || node == 0xFF) {
+    return -1;
+  }
+  return node;
+#else
+  (void)cpu;
+  return -1;
+#endif
+}
+
+int get_numa_node_of_cpus(const CpuSet &cpus) {
+  int node = -1;
+  for (unsigned cpu: cpus) {
+    const int cpu_node = get_numa_node_of_cpu(cpu);
+    if (cpu_node == -1 || (node != -1 && cpu_node != node)) {
+      return -1;
+    }
+    node = cpu_node;
+  }
+  return node;
+}
+
+} // namespace mysql_harness
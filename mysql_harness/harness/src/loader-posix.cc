@@ -17,17 +17,35 @@
 
 #include "loader.h"
 
+#include "cancellation_event.h"
 #include "exception.h"
 #include "filesystem.h"
 
 #include <dlfcn.h>
+#include <pthread.h>
+#include <signal.h>
 #include <unistd.h>
 
 #include <cassert>
+#include <chrono>
+#include <exception>
 #include <sstream>
+#include <thread>
 
 namespace mysql_harness {
 
+namespace {
+
+// whether SIGINT or SIGTERM is pending for the process
+bool stop_signal_pending() {
+  sigset_t pending;
+  sigemptyset(&pending);
+  return sigpending(&pending) == 0 &&
+         (sigismember(&pending, SIGINT) == 1 || sigismember(&pending, SIGTERM) == 1);
+}
+
+} // namespace
+
 ////////////////////////////////////////////////////////////////
 // class Loader
 
@@ -35,7 +53,61 @@ void Loader::start() {
   for (auto& name : available())
     load(name.first, name.second);
   init_all();
-  start_all();
+
+  // SIGINT and SIGTERM stop the plugins, which lets them shut down
+  // gracefully (e.g. drain their connections). The signals are blocked
+  // before the plugin threads are started: these inherit the mask and the
+  // signals only get delivered to the thread waiting for them.
+  sigset_t stop_signals;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  sigset_t old_mask;
+  pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+
+  // sigwait() can only be interrupted by another signal, which could hide
+  // a real one: look for pending stop signals until the plugins are done
+  CancellationEvent plugins_done;
+  std::thread signal_thread([this, &stop_signals, &plugins_done] {
+    while (!plugins_done.wait_for(std::chrono::milliseconds(100))) {
+      if (stop_signal_pending()) {
+        int sig = 0;
+        sigwait(&stop_signals, &sig);
+        stop_all();
+        return;
+      }
+    }
+  });
+
+  std::exception_ptr except;
+  try {
+    start_all();
+  } catch (...) {
+    except = std::current_exception();
+  }
+
+  plugins_done.cancel();
+  signal_thread.join();
+
+  // a second SIGINT or SIGTERM (e.g. Ctrl-C while the connections drain)
+  // stays pending: keep it blocked until the plugins are deinitialized,
+  // then drop it instead of letting it kill the process
+  std::exception_ptr deinit_except;
+  try {
+    deinit_all();
+  } catch (...) {
+    deinit_except = std::current_exception();
+  }
+  while (stop_signal_pending()) {
+    int sig = 0;
+    sigwait(&stop_signals, &sig);
+  }
+  pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+
+  if (deinit_except)
+    std::rethrow_exception(deinit_except);
+  if (except)
+    std::rethrow_exception(except);
 }
 
 ////////////////////////////////////////////////////////////////
@@ -23,6 +23,7 @@
 #include <Windows.h>
 
 #include <cassert>
+#include <exception>
 #include <sstream>
 
 namespace mysql_harness {
@@ -36,7 +37,18 @@ void Loader::start() {
   for (auto& name : available())
     load(name.first, name.second);
   init_all();
-  start_all();
+
+  std::exception_ptr except;
+  try {
+    start_all();
+  } catch (...) {
+    except = std::current_exception();
+  }
+
+  deinit_all();
+
+  if (except)
+    std::rethrow_exception(except);
 }
 
 
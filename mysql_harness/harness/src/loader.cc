@@ -240,7 +240,7 @@ void Loader::init_all() {
 
 void Loader::start_all() {
   // Start all the threads
-  int stoppable_jobs = 0;
+  int running_jobs = 0;
   for (const ConfigSection* section : config_.sections()) {
     PluginInfo& plugin = plugins_.at(section->name);
     void (*fptr)(const ConfigSection*) = plugin.plugin->start;
@@ -265,13 +265,13 @@ void Loader::start_all() {
       std::future<std::exception_ptr> fut =
           std::async(std::launch::async, dispatch, sessions_.size());
       sessions_.push_back(std::move(fut));
-      if (plugin.plugin->stop == nullptr)
-        ++stoppable_jobs;
+      ++running_jobs;
     }
   }
 
   std::exception_ptr except;
-  while (stoppable_jobs-- > 0) {
+  // wait for all threads, including the ones stopped by stop_all()
+  while (running_jobs-- > 0) {
     std::unique_lock<std::mutex> lock(done_mutex_);
     done_cond_.wait(lock, [this]{ return done_sessions_.size() > 0; });
     auto idx = done_sessions_.front();
@@ -283,6 +283,12 @@ void Loader::start_all() {
     }
   }
 
+  // the routes may all have ended on their own (e.g. bind failure); plugins
+  // whose start() only launched background work, like the metadata cache's
+  // refresh thread, keep it running until they get stopped
+  if (!except)
+    stop_all();
+
   // We just throw the first exception that was raised. If there are
   // other exceptions, they are ignored.
   if (except)
@@ -290,6 +296,8 @@ void Loader::start_all() {
 }
 
 void Loader::stop_all() {
+  // called by the signal thread and when a plugin fails
+  std::lock_guard<std::mutex> lock(stop_mutex_);
   for (auto&& section : config_.sections()) {
     PluginInfo& plugin = plugins_.at(section->name);
     void (*fptr)(const ConfigSection*) = plugin.plugin->stop;
@@ -0,0 +1,263 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "timer_wheel.h"
+#include "common.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace mysql_harness {
+
+constexpr TimerWheel::TimerId TimerWheel::kInvalidTimerId;
+constexpr unsigned TimerWheel::kLevels;
+constexpr unsigned TimerWheel::kSlotBits;
+constexpr uint64_t TimerWheel::kSlots;
+constexpr uint64_t TimerWheel::kSlotMask;
+
+TimerWheel::TimerWheel(std::chrono::milliseconds tick)
+    : tick_(tick.count() > 0 ? tick : std::chrono::milliseconds(1)),
+      epoch_(clock_type::now()),
+      current_tick_(0),
+      next_id_(kInvalidTimerId),
+      running_id_(kInvalidTimerId),
+      stopping_(false) {}
+
+TimerWheel::~TimerWheel() {
+  stop();
+}
+
+/*static*/
+TimerWheel& TimerWheel::instance() {
+  static TimerWheel wheel;
+  wheel.start();
+
+  return wheel;
+}
+
+void TimerWheel::start() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (thread_.joinable()) {
+    return;
+  }
+  stopping_ = false;
+  thread_ = std::thread(&TimerWheel::run, this);
+}
+
+void TimerWheel::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    stopping_ = true;
+  }
+  cond_.notify_all();
+
+  if (thread_.joinable() && thread_.get_id() != std::this_thread::get_id()) {
+    thread_.join();
+  }
+}
+
+uint64_t TimerWheel::to_tick(clock_type::time_point tp) const {
+  if (tp <= epoch_) {
+    return 0;
+  }
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(tp - epoch_) / tick_);
+}
+
+TimerWheel::clock_type::time_point TimerWheel::to_time_point(uint64_t tick) const {
+  return epoch_ + tick_ * tick;
+}
+
+TimerWheel::TimerId TimerWheel::add(std::chrono::milliseconds timeout, Callback callback) {
+  const auto now = clock_type::now();
+
+  std::unique_lock<std::mutex> lock(mtx_);
+  if (timers_.empty()) {
+    // nothing was pending: the wheel didn't need to turn in the meantime
+    current_tick_ = std::max(current_tick_, to_tick(now));
+  }
+
+  // round up to the next tick: a timer may fire late, but never early
+  const TimerId id = ++next_id_;
+  Slot pending;
+  pending.push_back(Timer{id, to_tick(now + timeout) + 1, std::move(callback)});
+  place(pending, pending.begin());
+  lock.unlock();
+
+  cond_.notify_all();
+
+  return id;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+  std::unique_lock<std::mutex> lock(mtx_);
+
+  auto it = timers_.find(id);
+  if (it != timers_.end()) {
+    wheel_[it->second.level][it->second.slot].erase(it->second.it);
+    timers_.erase(it);
+    return true;
+  }
+
+  // due, but expire() didn't get to run it yet
+  auto due_it = std::find_if(due_.begin(), due_.end(),
+                             [id](const Timer &timer) { return timer.id == id; });
+  if (due_it != due_.end()) {
+    due_.erase(due_it);
+    return true;
+  }
+
+  // already fired. If it is still executing, wait for it to finish
+  if (running_thread_ != std::this_thread::get_id()) {
+    cond_callback_done_.wait(lock, [this, id] { return running_id_ != id; });
+  }
+
+  return false;
+}
+
+size_t TimerWheel::size() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return timers_.size();
+}
+
+void TimerWheel::place(Slot &from, Slot::iterator it) {
+  const uint64_t expires = std::max(it->expires, current_tick_);
+  uint64_t delta = expires - current_tick_;
+
+  unsigned level = 0;
+  while (level < kLevels - 1 && delta >= (uint64_t{1} << (kSlotBits * (level + 1)))) {
+    ++level;
+  }
+
+  uint64_t slot_tick = expires;
+  const uint64_t max_delta = (uint64_t{1} << (kSlotBits * kLevels)) - 1;
+  if (delta > max_delta) {
+    // beyond the range of the wheel: park it in the outermost slot, it
+    // gets re-placed when cascaded
+    slot_tick = current_tick_ + max_delta;
+  }
+
+  const uint64_t slot = (slot_tick >> (kSlotBits * level)) & kSlotMask;
+
+  Slot &target = wheel_[level][slot];
+  target.splice(target.end(), from, it);
+  timers_[it->id] = Position{level, slot, it};
+}
+
+void TimerWheel::cascade(unsigned level, uint64_t slot) {
+  Slot &source = wheel_[level][slot];
+  while (!source.empty()) {
+    place(source, source.begin());
+  }
+}
+
+uint64_t TimerWheel::next_tick() const {
+  const uint64_t t = current_tick_;
+
+  if ((t & kSlotMask) == 0) {
+    // the outer levels have to be cascaded
+    return t;
+  }
+
+  const uint64_t block_end = (t | kSlotMask) + 1;
+  for (uint64_t tick = t; tick < block_end; ++tick) {
+    if (!wheel_[0][tick & kSlotMask].empty()) {
+      return tick;
+    }
+  }
+
+  return block_end;
+}
+
+size_t TimerWheel::expire(clock_type::time_point now) {
+  const uint64_t target = to_tick(now);
+  size_t fired = 0;
+
+  std::unique_lock<std::mutex> lock(mtx_);
+  while (current_tick_ <= target) {
+    if (timers_.empty()) {
+      current_tick_ = target + 1;
+      break;
+    }
+
+    const uint64_t t = next_tick();
+    if (t > target) {
+      current_tick_ = target + 1;
+      break;
+    }
+    current_tick_ = t;
+
+    // cascade the outer levels down, outermost first
+    for (unsigned level = kLevels - 1; level > 0; --level) {
+      const uint64_t mask = (uint64_t{1} << (kSlotBits * level)) - 1;
+      if ((t & mask) == 0) {
+        cascade(level, (t >> (kSlotBits * level)) & kSlotMask);
+      }
+    }
+
+    // the batch stays visible to cancel() until each callback runs
+    due_.splice(due_.end(), wheel_[0][t & kSlotMask]);
+    for (const auto &timer : due_) {
+      timers_.erase(timer.id);
+    }
+    current_tick_ = t + 1;
+
+    // callbacks may call add() or cancel(), run them unlocked
+    while (!due_.empty()) {
+      Callback callback = std::move(due_.front().callback);
+      running_id_ = due_.front().id;
+      running_thread_ = std::this_thread::get_id();
+      due_.pop_front();
+      lock.unlock();
+
+      callback();
+      ++fired;
+
+      lock.lock();
+      running_id_ = kInvalidTimerId;
+      running_thread_ = std::thread::id();
+      cond_callback_done_.notify_all();
+    }
+  }
+
+  return fired;
+}
+
+void TimerWheel::run() {
+  mysql_harness::rename_thread("TimerWheel");
+
+  std::unique_lock<std::mutex> lock(mtx_);
+  while (!stopping_) {
+    if (timers_.empty()) {
+      // nothing to do, sleep until a timer gets added
+      cond_.wait(lock);
+      continue;
+    }
+
+    const auto deadline = to_time_point(next_tick());
+    if (clock_type::now() < deadline) {
+      cond_.wait_until(lock, deadline);
+      continue;
+    }
+
+    lock.unlock();
+    expire(clock_type::now());
+    lock.lock();
+  }
+}
+
+} // namespace mysql_harness
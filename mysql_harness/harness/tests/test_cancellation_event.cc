@@ -0,0 +1,104 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "gtest/gtest.h"
+
+#include "cancellation_event.h"
+
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#  include <winsock2.h>
+#else
+#  include <poll.h>
+#endif
+
+using mysql_harness::CancellationEvent;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+static int poll_fd(int fd, milliseconds timeout) {
+  struct pollfd fds[] = {
+    { fd, POLLIN, 0 },
+  };
+#ifdef _WIN32
+  return WSAPoll(fds, 1, static_cast<INT>(timeout.count()));
+#else
+  return poll(fds, 1, static_cast<int>(timeout.count()));
+#endif
+}
+
+TEST(CancellationEventTest, not_cancelled) {
+  CancellationEvent event;
+
+  EXPECT_FALSE(event.is_cancelled());
+  EXPECT_EQ(0, poll_fd(event.native_handle(), milliseconds(0)));
+  EXPECT_FALSE(event.wait_for(milliseconds(10)));
+}
+
+TEST(CancellationEventTest, cancel_stays_readable) {
+  CancellationEvent event;
+
+  event.cancel();
+  event.cancel();
+
+  EXPECT_TRUE(event.is_cancelled());
+  EXPECT_EQ(1, poll_fd(event.native_handle(), milliseconds(0)));
+  EXPECT_EQ(1, poll_fd(event.native_handle(), milliseconds(0)));
+  EXPECT_TRUE(event.wait_for(milliseconds(0)));
+}
+
+TEST(CancellationEventTest, reset) {
+  CancellationEvent event;
+
+  event.cancel();
+  event.reset();
+
+  EXPECT_FALSE(event.is_cancelled());
+  EXPECT_EQ(0, poll_fd(event.native_handle(), milliseconds(0)));
+
+  event.cancel();
+  EXPECT_EQ(1, poll_fd(event.native_handle(), milliseconds(0)));
+}
+
+TEST(CancellationEventTest, wakes_up_waiters) {
+  CancellationEvent event;
+
+  std::thread waiter1([&event] { EXPECT_TRUE(event.wait_for(seconds(30))); });
+  std::thread waiter2([&event] { EXPECT_EQ(1, poll_fd(event.native_handle(), seconds(30))); });
+
+  const auto start = std::chrono::steady_clock::now();
+  event.cancel();
+  waiter1.join();
+  waiter2.join();
+
+  EXPECT_LT(std::chrono::steady_clock::now() - start, seconds(10));
+}
+
+int main(int argc, char *argv[]) {
+#ifdef _WIN32
+  WSADATA wsaData;
+  if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+    return 1;
+  }
+#endif
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,68 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "gtest/gtest.h"
+
+#include "cpu_affinity.h"
+
+#include <stdexcept>
+#include <thread>
+
+using mysql_harness::CpuSet;
+using mysql_harness::cpu_set_to_string;
+using mysql_harness::get_thread_affinity;
+using mysql_harness::parse_cpu_set;
+using mysql_harness::set_thread_affinity;
+
+TEST(CpuAffinityTest, parse_cpu_set) {
+  EXPECT_EQ(CpuSet(), parse_cpu_set(""));
+  EXPECT_EQ(CpuSet({ 3 }), parse_cpu_set("3"));
+  EXPECT_EQ(CpuSet({ 0, 1, 2, 3, 8, 10, 11 }), parse_cpu_set("0-3,8,10-11"));
+  EXPECT_EQ(CpuSet({ 1, 2, 3 }), parse_cpu_set("3,1-2,2"));
+}
+
+TEST(CpuAffinityTest, parse_cpu_set_invalid) {
+  for (const char *value: { ",", "1,", "a", "-1", "1-", "3-1", "1 ,2", "0-4096" }) {
+    EXPECT_THROW(parse_cpu_set(value), std::invalid_argument) << value;
+  }
+}
+
+TEST(CpuAffinityTest, cpu_set_to_string) {
+  EXPECT_EQ("", cpu_set_to_string(CpuSet()));
+  EXPECT_EQ("0-3,8,10-11", cpu_set_to_string(parse_cpu_set("0-3,8,10-11")));
+  EXPECT_EQ("1,3,5", cpu_set_to_string(parse_cpu_set("5,3,1")));
+}
+
+TEST(CpuAffinityTest, set_thread_affinity) {
+  const CpuSet allowed = get_thread_affinity();
+  if (allowed.empty()) {
+    return;  // not supported on this platform
+  }
+
+  // pinning a thread to one CPU is inherited by threads it creates
+  std::thread([&allowed] {
+    ASSERT_TRUE(set_thread_affinity(CpuSet({ allowed.front() })));
+    EXPECT_EQ(CpuSet({ allowed.front() }), get_thread_affinity());
+
+    std::thread([&allowed] {
+      EXPECT_EQ(CpuSet({ allowed.front() }), get_thread_affinity());
+    }).join();
+  }).join();
+
+  // other threads are not affected
+  EXPECT_EQ(allowed, get_thread_affinity());
+}
@@ -0,0 +1,332 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "gtest/gtest.h"
+
+#include "config_parser.h"
+#include "filesystem.h"
+#include "logger.h"
+#include "mysql/harness/plugin.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+using mysql_harness::AppInfo;
+using mysql_harness::Config;
+using mysql_harness::Path;
+
+extern "C" {
+  extern mysql_harness::Plugin logger;
+}
+
+namespace {
+
+const char *const kProgram = "test_logger";
+
+// initializes the logger plugin with the given [logger] options; messages
+// go to <tmp dir>/test_logger.log
+class LoggerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    tmp_dir_ = mysql_harness::get_tmp_dir("logger");
+    log_file_ = Path::make_path(tmp_dir_, kProgram, "log").str();
+  }
+
+  void TearDown() override {
+    if (initialized_) {
+      deinit();
+    }
+    mysql_harness::delete_dir_recursive(tmp_dir_);
+  }
+
+  void init(const std::map<std::string, std::string> &options) {
+    auto &section = config_.add("logger", "");
+    for (const auto &option : options) {
+      section.add(option.first, option.second);
+    }
+
+    app_info_.program = kProgram;
+    app_info_.logging_folder = tmp_dir_.c_str();
+    app_info_.config = &config_;
+    ASSERT_EQ(0, logger.init(&app_info_));
+    initialized_ = true;
+  }
+
+  void deinit() {
+    initialized_ = false;
+    logger.deinit(&app_info_);
+  }
+
+  // number of lines of the log file containing the text
+  size_t count_lines(const std::string &text) const {
+    std::ifstream file(log_file_);
+    size_t count = 0;
+    for (std::string line; std::getline(file, line);) {
+      if (line.find(text) != std::string::npos) {
+        ++count;
+      }
+    }
+    return count;
+  }
+
+  std::string tmp_dir_;
+  std::string log_file_;
+  Config config_;
+  AppInfo app_info_{};
+  bool initialized_ = false;
+};
+
+} // namespace
+
+TEST_F(LoggerTest, async_deinit_writes_queued_messages) {
+  init({{"async", "1"}});
+
+  for (int i = 0; i < 1000; ++i) {
+    log_info("message %d", i);
+  }
+  deinit();
+
+  EXPECT_EQ(1000u, count_lines("INFO"));
+  EXPECT_EQ(1u, count_lines("message 999"));
+}
+
+TEST_F(LoggerTest, async_deinit_while_logging) {
+  init({{"async", "1"}});
+
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&stop] {
+      while (!stop) {
+        log_info("concurrent");
+      }
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  // the writer must not be deleted under the threads' feet
+  deinit();
+  stop = true;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_LT(0u, count_lines("concurrent"));
+}
+
+TEST_F(LoggerTest, async_bad_options) {
+  app_info_.program = kProgram;
+  app_info_.logging_folder = tmp_dir_.c_str();
+  app_info_.config = &config_;
+  auto &section = config_.add("logger", "");
+  section.add("async", "1");
+  section.add("async_overflow", "wait");
+
+  EXPECT_THROW(logger.init(&app_info_), std::invalid_argument);
+}
+
+TEST_F(LoggerTest, module_levels) {
+  init({{"level", "WARNING"}, {"level_routing", "debug"}});
+
+  EXPECT_TRUE(log_level_is_enabled(LOG_MODULE_ROUTING, LOG_LEVEL_DEBUG));
+  // modules without a level of their own follow the global one
+  EXPECT_TRUE(log_level_is_enabled(LOG_MODULE_METADATA_CACHE, LOG_LEVEL_WARNING));
+  EXPECT_FALSE(log_level_is_enabled(LOG_MODULE_METADATA_CACHE, LOG_LEVEL_INFO));
+  EXPECT_FALSE(log_level_is_enabled(LOG_MODULE_DEFAULT, LOG_LEVEL_INFO));
+
+  log_module_debug(LOG_MODULE_ROUTING, "routing %d", 1);
+  log_module_debug(LOG_MODULE_PROTOCOL, "protocol %d", 1);
+  deinit();
+
+  EXPECT_EQ(1u, count_lines("routing 1"));
+  EXPECT_EQ(0u, count_lines("protocol 1"));
+}
+
+TEST_F(LoggerTest, module_level_invalid) {
+  app_info_.program = kProgram;
+  app_info_.logging_folder = tmp_dir_.c_str();
+  app_info_.config = &config_;
+  config_.add("logger", "").add("level_metadata_cache", "verbose");
+
+  EXPECT_THROW(logger.init(&app_info_), std::invalid_argument);
+}
+
+TEST_F(LoggerTest, set_module_level) {
+  init({{"level", "INFO"}});
+
+  EXPECT_EQ(0, log_set_module_level("protocol", "DEBUG"));
+  EXPECT_TRUE(log_level_is_enabled(LOG_MODULE_PROTOCOL, LOG_LEVEL_DEBUG));
+  EXPECT_FALSE(log_level_is_enabled(LOG_MODULE_ROUTING, LOG_LEVEL_DEBUG));
+
+  // back to the global level, which can be changed too
+  EXPECT_EQ(0, log_set_module_level("protocol", nullptr));
+  EXPECT_FALSE(log_level_is_enabled(LOG_MODULE_PROTOCOL, LOG_LEVEL_DEBUG));
+  EXPECT_EQ(0, log_set_module_level(nullptr, "error"));
+  EXPECT_FALSE(log_level_is_enabled(LOG_MODULE_PROTOCOL, LOG_LEVEL_WARNING));
+
+  EXPECT_EQ(-1, log_set_module_level("unknown", "DEBUG"));
+  EXPECT_EQ(-1, log_set_module_level("routing", "verbose"));
+  EXPECT_EQ(-1, log_set_module_level(nullptr, nullptr));
+  EXPECT_FALSE(log_level_is_enabled(LOG_MODULE_ROUTING, LOG_LEVEL_WARNING));
+}
+
+TEST(LogRateLimitTest, suppresses_within_interval) {
+  static LogRateLimit limit;
+  unsigned long long suppressed = 42;
+
+  EXPECT_TRUE(log_rate_limit_pass(limit, 100, suppressed));
+  EXPECT_EQ(0u, suppressed);
+
+  EXPECT_FALSE(log_rate_limit_pass(limit, 100, suppressed));
+  EXPECT_FALSE(log_rate_limit_pass(limit, 100, suppressed));
+
+  // the next message reports the ones suppressed in between
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  EXPECT_TRUE(log_rate_limit_pass(limit, 100, suppressed));
+  EXPECT_EQ(2u, suppressed);
+}
+
+TEST_F(LoggerTest, warning_limited) {
+  init({});
+
+  for (int i = 0; i < 10; ++i) {
+    log_module_warning_limited(LOG_MODULE_ROUTING, 60000, "limited %d", i);
+  }
+  deinit();
+
+  EXPECT_EQ(1u, count_lines("limited"));
+  EXPECT_EQ(1u, count_lines("limited 0"));
+}
+
+#ifndef _WIN32
+// The log file is a FIFO nobody reads from until read_fifo() is called: the
+// writer thread gets stuck once the pipe is full, so the queue fills up.
+class AsyncLoggerOverflowTest : public LoggerTest {
+ protected:
+  void SetUp() override {
+    LoggerTest::SetUp();
+    ASSERT_EQ(0, mkfifo(log_file_.c_str(), 0600));
+    // the logger's fopen() would block until there is a reader
+    reader_ = open(log_file_.c_str(), O_RDONLY | O_NONBLOCK);
+    ASSERT_LE(0, reader_);
+  }
+
+  void TearDown() override {
+    if (initialized_) {
+      if (!reader_thread_.joinable()) {
+        read_fifo();  // unblocks the writer thread
+      }
+      deinit();
+    }
+    if (reader_thread_.joinable()) {
+      reader_thread_.join();
+    }
+    if (reader_ >= 0) {
+      close(reader_);
+    }
+    LoggerTest::TearDown();
+  }
+
+  // reads what the logger writes until deinit() closes the FIFO
+  void read_fifo() {
+    fcntl(reader_, F_SETFL, fcntl(reader_, F_GETFL) & ~O_NONBLOCK);
+    reader_thread_ = std::thread([this] {
+      char buf[4096];
+      ssize_t res;
+      while ((res = read(reader_, buf, sizeof(buf))) > 0) {
+        output_.append(buf, static_cast<size_t>(res));
+      }
+    });
+  }
+
+  // the output, once deinit() was called
+  const std::string &output() {
+    if (reader_thread_.joinable()) {
+      reader_thread_.join();
+    }
+    return output_;
+  }
+
+  int reader_ = -1;
+  std::thread reader_thread_;
+  std::string output_;
+};
+
+TEST_F(AsyncLoggerOverflowTest, drop_counts_dropped_messages) {
+  init({{"async", "1"}, {"async_queue_size", "4"}, {"async_overflow", "drop"}});
+  const unsigned long long dropped_before = log_get_dropped_messages();
+
+  // fills the pipe and then the queue
+  const std::string padding(200, 'x');
+  int logged = 0;
+  while (log_get_dropped_messages() == dropped_before && logged < 1000000) {
+    log_info("message %d %s", logged++, padding.c_str());
+  }
+  const unsigned long long dropped = log_get_dropped_messages() - dropped_before;
+  ASSERT_LT(0u, dropped);
+
+  read_fifo();
+  deinit();
+
+  // the writer reports the dropped messages, they stay counted
+  EXPECT_NE(std::string::npos, output().find("messages dropped, the log queue was full"));
+  EXPECT_EQ(dropped, log_get_dropped_messages() - dropped_before);
+}
+
+TEST_F(AsyncLoggerOverflowTest, block_waits_for_free_space) {
+  init({{"async", "1"}, {"async_queue_size", "4"}, {"async_overflow", "block"}});
+  const unsigned long long dropped_before = log_get_dropped_messages();
+
+  const int kMessages = 2000;
+  std::atomic<int> logged{0};
+  std::thread producer([&logged] {
+    const std::string padding(200, 'x');
+    for (int i = 0; i < kMessages; ++i) {
+      log_info("message %d %s", i, padding.c_str());
+      ++logged;
+    }
+  });
+
+  // more than fits into the pipe and the queue: the producer waits
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  EXPECT_GT(kMessages, logged.load());
+
+  read_fifo();
+  producer.join();
+  deinit();
+
+  EXPECT_EQ(std::string::npos, output().find("messages dropped"));
+  EXPECT_NE(std::string::npos, output().find("message 1999 "));
+  EXPECT_EQ(dropped_before, log_get_dropped_messages());
+}
+#endif
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
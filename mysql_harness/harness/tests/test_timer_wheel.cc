@@ -0,0 +1,158 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "gtest/gtest.h"
+
+#include "timer_wheel.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+using mysql_harness::TimerWheel;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+namespace {
+const milliseconds kTick(10);
+}
+
+TEST(TimerWheelTest, fires_after_timeout) {
+  TimerWheel wheel(kTick);
+  const auto start = TimerWheel::clock_type::now();
+
+  int fired = 0;
+  TimerWheel::TimerId id = wheel.add(milliseconds(100), [&fired] { ++fired; });
+  EXPECT_NE(TimerWheel::kInvalidTimerId, id);
+  EXPECT_EQ(1u, wheel.size());
+
+  // never fires early
+  EXPECT_EQ(0u, wheel.expire(start));
+  EXPECT_EQ(0, fired);
+
+  // fires at most one tick late
+  EXPECT_EQ(1u, wheel.expire(start + milliseconds(100) + 2 * kTick));
+  EXPECT_EQ(1, fired);
+  EXPECT_EQ(0u, wheel.size());
+
+  // fires only once
+  EXPECT_EQ(0u, wheel.expire(start + seconds(10)));
+  EXPECT_EQ(1, fired);
+}
+
+TEST(TimerWheelTest, cancel) {
+  TimerWheel wheel(kTick);
+  const auto start = TimerWheel::clock_type::now();
+
+  int fired = 0;
+  TimerWheel::TimerId id = wheel.add(milliseconds(100), [&fired] { ++fired; });
+
+  EXPECT_TRUE(wheel.cancel(id));
+  EXPECT_FALSE(wheel.cancel(id));
+  EXPECT_EQ(0u, wheel.size());
+
+  EXPECT_EQ(0u, wheel.expire(start + seconds(1)));
+  EXPECT_EQ(0, fired);
+}
+
+TEST(TimerWheelTest, cancel_after_fired) {
+  TimerWheel wheel(kTick);
+  const auto start = TimerWheel::clock_type::now();
+
+  TimerWheel::TimerId id = wheel.add(milliseconds(0), [] {});
+  EXPECT_EQ(1u, wheel.expire(start + seconds(1)));
+  EXPECT_FALSE(wheel.cancel(id));
+}
+
+// timers on the outer levels of the wheel have to be cascaded down
+// and fire in order of their deadline
+TEST(TimerWheelTest, cascading_keeps_order) {
+  TimerWheel wheel(kTick);
+  const auto start = TimerWheel::clock_type::now();
+
+  std::vector<int> order;
+  const std::vector<int> timeouts_ms{ 50000, 5, 700, 3000000, 640, 650, 41000 };
+  for (int timeout_ms: timeouts_ms) {
+    wheel.add(milliseconds(timeout_ms), [&order, timeout_ms] { order.push_back(timeout_ms); });
+  }
+
+  // move the wheel forward in steps of 1 second
+  for (auto now = start; now <= start + seconds(3001); now += seconds(1)) {
+    wheel.expire(now);
+  }
+
+  EXPECT_EQ(std::vector<int>({ 5, 640, 650, 700, 41000, 50000, 3000000 }), order);
+  EXPECT_EQ(0u, wheel.size());
+}
+
+TEST(TimerWheelTest, callback_may_add_and_cancel) {
+  TimerWheel wheel(kTick);
+  const auto start = TimerWheel::clock_type::now();
+
+  int fired = 0;
+  TimerWheel::TimerId id = TimerWheel::kInvalidTimerId;
+  id = wheel.add(milliseconds(10), [&] {
+    ++fired;
+    EXPECT_FALSE(wheel.cancel(id));
+    wheel.add(seconds(5), [&fired] { ++fired; });
+  });
+
+  EXPECT_EQ(1u, wheel.expire(start + seconds(1)));
+  EXPECT_EQ(1u, wheel.size());
+  EXPECT_EQ(1u, wheel.expire(TimerWheel::clock_type::now() + seconds(10)));
+  EXPECT_EQ(2, fired);
+}
+
+// timers taken off the wheel together can still be cancelled until they run
+TEST(TimerWheelTest, cancel_due_timer) {
+  TimerWheel wheel(kTick);
+  const auto start = TimerWheel::clock_type::now();
+
+  int fired = 0;
+  TimerWheel::TimerId second = TimerWheel::kInvalidTimerId;
+  wheel.add(milliseconds(10), [&] {
+    ++fired;
+    EXPECT_TRUE(wheel.cancel(second));
+  });
+  second = wheel.add(milliseconds(10), [&fired] { ++fired; });
+
+  EXPECT_EQ(1u, wheel.expire(start + seconds(1)));
+  EXPECT_EQ(1, fired);
+  EXPECT_FALSE(wheel.cancel(second));
+}
+
+TEST(TimerWheelTest, timer_thread) {
+  TimerWheel wheel(kTick);
+  wheel.start();
+
+  std::mutex mtx;
+  std::condition_variable cond;
+  bool fired = false;
+
+  wheel.add(milliseconds(50), [&] {
+    std::lock_guard<std::mutex> lock(mtx);
+    fired = true;
+    cond.notify_all();
+  });
+
+  std::unique_lock<std::mutex> lock(mtx);
+  EXPECT_TRUE(cond.wait_for(lock, seconds(10), [&fired] { return fired; }));
+
+  wheel.stop();
+}
@@ -32,6 +32,34 @@
 #  define LOGGER_API
 #endif
 
+#if defined(__GNUC__) || defined(__clang__)
+#  define LOGGER_PRINTF_FORMAT(fmt_ndx, args_ndx) \
+  __attribute__((format(printf, fmt_ndx, args_ndx)))
+#else
+#  define LOGGER_PRINTF_FORMAT(fmt_ndx, args_ndx)
+#endif
+
+/**
+ * Parts of the router which can get a log level of their own, set with
+ * level_<module> in the [logger] section (e.g. level_routing = DEBUG).
+ * Modules without a level of their own use the global level.
+ */
+enum LogModule {
+  LOG_MODULE_DEFAULT,
+  LOG_MODULE_ROUTING,
+  LOG_MODULE_METADATA_CACHE,
+  LOG_MODULE_PROTOCOL,
+  LOG_MODULE_COUNT
+};
+
+enum LogLevel {
+  LOG_LEVEL_FATAL,
+  LOG_LEVEL_ERROR,
+  LOG_LEVEL_WARNING,
+  LOG_LEVEL_INFO,
+  LOG_LEVEL_DEBUG
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -41,6 +69,38 @@ void LOGGER_API log_warning(const char *fmt, ...);
 void LOGGER_API log_info(const char *fmt, ...);
 void LOGGER_API log_debug(const char *fmt, ...);
 
+/**
+ * Number of messages dropped because the queue of the asynchronous
+ * logger was full (only with [logger] async = 1 and async_overflow = drop).
+ */
+unsigned long long LOGGER_API log_get_dropped_messages(void);
+
+/**
+ * Returns non-zero if messages of the given level are written for the
+ * module. Cheap enough to guard the computation of log arguments with.
+ */
+int LOGGER_API log_level_is_enabled(enum LogModule module, enum LogLevel level);
+
+/**
+ * Changes the log level of a module at runtime.
+ *
+ * @param module name of the module ("routing", "metadata_cache",
+ *        "protocol"), or NULL to change the global level
+ * @param level name of the level ("ERROR", ..., "DEBUG", case-insensitive),
+ *        or NULL to make the module use the global level again
+ * @return 0 on success, -1 if module or level is unknown
+ */
+int LOGGER_API log_set_module_level(const char *module, const char *level);
+
+/**
+ * Writes a message of a module, if its level is enabled.
+ *
+ * Use the log_module_*() macros instead, they don't evaluate the arguments
+ * if the level is disabled.
+ */
+void LOGGER_API log_module_message(enum LogModule module, enum LogLevel level,
+                                   const char *fmt, ...) LOGGER_PRINTF_FORMAT(3, 4);
+
 #ifdef WITH_DEBUG
 #define log_debug2(args) log_debug args
 #define log_debug3(args) log_debug args
@@ -53,4 +113,73 @@ void LOGGER_API log_debug(const char *fmt, ...);
 }
 #endif
 
+/*
+ * Logging in a module; the format string is checked against the
+ * arguments at compile time and the arguments are only evaluated if the
+ * level is enabled for the module:
+ *
+ *   log_module_debug(LOG_MODULE_ROUTING, "[%s] fd=%d connected %s",
+ *                    name.c_str(), client, addr.str().c_str());
+ */
+#define log_module_level(module, level, ...) \
+  do { \
+    if (log_level_is_enabled(module, level)) \
+      log_module_message(module, level, __VA_ARGS__); \
+  } while (0)
+
+#define log_module_error(module, ...) \
+  log_module_level(module, LOG_LEVEL_ERROR, __VA_ARGS__)
+#define log_module_warning(module, ...) \
+  log_module_level(module, LOG_LEVEL_WARNING, __VA_ARGS__)
+#define log_module_info(module, ...) \
+  log_module_level(module, LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_module_debug(module, ...) \
+  log_module_level(module, LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#ifdef __cplusplus
+#include <atomic>
+
+/**
+ * State of a rate limited log call site, see log_module_warning_limited().
+ * Objects with static storage duration need no initialization.
+ */
+struct LogRateLimit {
+  std::atomic<long long> next_allowed_ms;
+  std::atomic<unsigned long long> suppressed;
+};
+
+/**
+ * Decides if a rate limited message may be written now.
+ *
+ * @param limit state of the call site
+ * @param interval_ms minimum time between two messages of the call site
+ * @param suppressed set to the number of messages suppressed since the
+ *        last one written, if true is returned
+ * @return true if the message should be written
+ */
+bool LOGGER_API log_rate_limit_pass(LogRateLimit &limit, unsigned interval_ms,
+                                    unsigned long long &suppressed);
+
+/*
+ * Writes at most one message per interval_ms from the call site, e.g. for
+ * warnings which can be triggered by every incoming connection. How many
+ * messages got suppressed is reported with the next one written.
+ */
+#define log_module_level_limited(module, level, interval_ms, ...) \
+  do { \
+    static LogRateLimit log_rate_limit_; \
+    unsigned long long log_suppressed_; \
+    if (log_level_is_enabled(module, level) && \
+        log_rate_limit_pass(log_rate_limit_, interval_ms, log_suppressed_)) { \
+      if (log_suppressed_ > 0) \
+        log_module_message(module, level, "%llu similar messages suppressed", \
+                           log_suppressed_); \
+      log_module_message(module, level, __VA_ARGS__); \
+    } \
+  } while (0)
+
+#define log_module_warning_limited(module, interval_ms, ...) \
+  log_module_level_limited(module, LOG_LEVEL_WARNING, interval_ms, __VA_ARGS__)
+#endif
+
 #endif /* MYSQL_HARNESS_LOGGER_INCLUDED */
@@ -25,14 +25,22 @@
 #include <atomic>
 #include <cassert>
 #include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <cstdarg>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <vector>
 
 using mysql_harness::ARCHITECTURE_DESCRIPTOR;
 using mysql_harness::AppInfo;
@@ -69,9 +77,345 @@ static const std::map<std::string, Level> map_level_str = {
     {level_str[4], LVL_DEBUG},
 };
 
+static_assert(LOG_LEVEL_FATAL == static_cast<int>(LVL_FATAL) &&
+              LOG_LEVEL_DEBUG == static_cast<int>(LVL_DEBUG),
+              "LogLevel and Level must have the same values");
+
+// names of the LogModule values, used in the level_<module> options
+static const char *const module_str[] = {
+  "", "routing", "metadata_cache", "protocol"
+};
+
+static_assert(sizeof(module_str) / sizeof(module_str[0]) == LOG_MODULE_COUNT,
+              "a name is needed for each LogModule");
+
 static std::atomic<FILE*> g_log_file(stdout);
 static std::atomic<int> g_log_level(LVL_DEBUG);
 
+// level of each module, -1 if the module uses g_log_level
+static std::atomic<int> g_module_levels[LOG_MODULE_COUNT] = {
+  {-1}, {-1}, {-1}, {-1}
+};
+
+// number of messages the writer thread can fall behind by default
+static const size_t kDefaultAsyncQueueSize = 8192;
+
+// size of the message part of a log line; longer messages are truncated
+static const size_t kMaxMessageSize = 256;
+
+// returns the Level matching the name (case-insensitive), or -1
+static int parse_level(std::string name) {
+  std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+  auto level = map_level_str.find(name);
+  return level == map_level_str.end() ? -1 : level->second;
+}
+
+static void format_time(time_t now, char (&time_buf)[20]) {
+  struct tm tm_now;
+#ifdef _WIN32
+  localtime_s(&tm_now, &now);
+#else
+  localtime_r(&now, &tm_now);
+#endif
+  strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", &tm_now);
+}
+
+static std::string format_thread_id(std::thread::id id) {
+  std::stringstream ss;
+  ss << std::hex << std::noshowbase << id;
+  return ss.str();
+}
+
+// writes the formatted log lines to the log file (or stdout)
+static void write_log_lines(FILE *outfp, const char *lines, size_t length) {
+  // note that outfp can be NULL if fopen() fails, therefore not equivalent to
+  // testing for stdout.  TODO review this, it is a hack!!!
+  if (outfp != stdout) {
+    fwrite(lines, 1, length, outfp ? outfp : stdout);
+    fflush(outfp);
+  } else {
+    // For unit tests, we need to use cout, so we can use its rdbuf() mechanism
+    // to intercept the output.
+    std::cout.write(lines, static_cast<std::streamsize>(length)) << std::flush;
+  }
+}
+
+namespace {
+
+// message waiting in the queue of the writer thread; everything but the
+// message itself is formatted by the writer thread
+struct LogRecord {
+  Level level;
+  time_t time;
+  std::thread::id thread_id;
+  char message[kMaxMessageSize];
+};
+
+// bounded lock-free queue for many producers and a single consumer.
+//
+// Each slot has a sequence number telling whether it is free for the
+// producer which reserved that position, or filled for the consumer
+// (D. Vyukov's bounded MPMC queue, with a single consumer).
+class LogRecordQueue {
+ public:
+  // size is rounded up to a power of 2
+  explicit LogRecordQueue(size_t size)
+      : slots_(round_up_to_power_of_2(size)), mask_(slots_.size() - 1) {
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // fills a free slot with fill(LogRecord&); returns false if the queue is full
+  template<class Fill>
+  bool try_push(Fill fill) {
+    size_t pos = pos_.enqueue.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+      slot = &slots_[pos & mask_];
+      const size_t seq = slot->sequence.load(std::memory_order_acquire);
+      const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (pos_.enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = pos_.enqueue.load(std::memory_order_relaxed);
+      }
+    }
+
+    fill(slot->record);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // passes the oldest record to consume(const LogRecord&) and frees its
+  // slot; returns false if the queue is empty. Only one thread may pop.
+  template<class Consume>
+  bool try_pop(Consume consume) {
+    Slot &slot = slots_[pos_.dequeue & mask_];
+    if (slot.sequence.load(std::memory_order_acquire) != pos_.dequeue + 1) {
+      return false;
+    }
+
+    consume(slot.record);
+    slot.sequence.store(pos_.dequeue + mask_ + 1, std::memory_order_release);
+    ++pos_.dequeue;
+    return true;
+  }
+
+  bool empty() const {
+    const Slot &slot = slots_[pos_.dequeue & mask_];
+    return slot.sequence.load(std::memory_order_acquire) != pos_.dequeue + 1;
+  }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    LogRecord record;
+  };
+
+  static size_t round_up_to_power_of_2(size_t size) {
+    size_t result = 2;
+    while (result < size) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+  std::vector<Slot> slots_;
+  const size_t mask_;
+
+  // producers and consumer on different cache lines
+  struct Positions {
+    Positions(): enqueue(0), dequeue(0) {}
+
+    std::atomic<size_t> enqueue;
+    char padding[64];
+    size_t dequeue;
+  } pos_;
+};
+
+// formats and writes the log records in a background thread, so the
+// threads logging don't wait for the disk
+class AsyncLogWriter {
+ public:
+  AsyncLogWriter(size_t queue_size, bool block_on_overflow)
+      : queue_(queue_size), block_on_overflow_(block_on_overflow),
+        dropped_(0), stopping_(false), writer_sleeping_(false),
+        thread_(&AsyncLogWriter::run, this) {}
+
+  // writes everything still queued before returning
+  ~AsyncLogWriter() {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      stopping_ = true;
+    }
+    cond_.notify_one();
+    thread_.join();
+  }
+
+  AsyncLogWriter(const AsyncLogWriter&) = delete;
+  AsyncLogWriter& operator=(const AsyncLogWriter&) = delete;
+
+  void log(Level level, const char *fmt, va_list ap) {
+    auto fill = [&](LogRecord &record) {
+      record.level = level;
+      record.time = time(nullptr);
+      record.thread_id = std::this_thread::get_id();
+      va_list args;
+      va_copy(args, ap);
+      vsnprintf(record.message, sizeof(record.message), fmt, args);
+      va_end(args);
+    };
+
+    while (!queue_.try_push(fill)) {
+      if (!block_on_overflow_) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      wake_up_writer();
+      std::this_thread::yield();
+    }
+
+    wake_up_writer();
+  }
+
+  uint64_t get_dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // lines written with one write
+  static const size_t kMaxBatchSize = 512;
+
+  void wake_up_writer() {
+    if (writer_sleeping_.load()) {
+      std::lock_guard<std::mutex> lock(mtx_);
+      cond_.notify_one();
+    }
+  }
+
+  void run() {
+    std::string batch;
+    batch.reserve(kMaxBatchSize * (kMaxMessageSize + 64));
+
+    // the time and thread id strings are the same for most records
+    time_t last_time = 0;
+    char time_buf[20] = "";
+    std::thread::id last_thread_id;
+    std::string thread_id = format_thread_id(last_thread_id);
+    uint64_t reported_dropped = 0;
+
+    auto append_line = [&](Level level, time_t now, std::thread::id id, const char *message) {
+      if (now != last_time) {
+        format_time(now, time_buf);
+        last_time = now;
+      }
+      if (id != last_thread_id) {
+        thread_id = format_thread_id(id);
+        last_thread_id = id;
+      }
+
+      char line[kMaxMessageSize + 64];
+      const int len = snprintf(line, sizeof(line), "%-19s %-7s [%s] %s\n",
+                               time_buf, level_str[level], thread_id.c_str(), message);
+      batch.append(line, std::min(static_cast<size_t>(len), sizeof(line) - 1));
+    };
+
+    while (true) {
+      batch.clear();
+      size_t count = 0;
+      while (count < kMaxBatchSize && queue_.try_pop([&](const LogRecord &record) {
+               append_line(record.level, record.time, record.thread_id, record.message);
+             })) {
+        ++count;
+      }
+
+      const uint64_t dropped = get_dropped();
+      if (dropped != reported_dropped) {
+        char message[kMaxMessageSize];
+        snprintf(message, sizeof(message), "logger: %llu messages dropped, the log queue was full",
+                 static_cast<unsigned long long>(dropped - reported_dropped));
+        append_line(LVL_WARNING, time(nullptr), std::this_thread::get_id(), message);
+        reported_dropped = dropped;
+      }
+
+      if (!batch.empty()) {
+        write_log_lines(g_log_file.load(std::memory_order_consume), batch.data(), batch.size());
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(mtx_);
+      if (stopping_) {
+        break;
+      }
+      // producers only notify while we sleep; check the queue once more
+      // after announcing it, to not miss a record pushed in between
+      writer_sleeping_.store(true);
+      if (queue_.empty()) {
+        cond_.wait_for(lock, std::chrono::milliseconds(100));
+      }
+      writer_sleeping_.store(false);
+    }
+  }
+
+  LogRecordQueue queue_;
+  const bool block_on_overflow_;
+  std::atomic<uint64_t> dropped_;
+
+  std::mutex mtx_;
+  std::condition_variable cond_;
+  bool stopping_;
+  std::atomic<bool> writer_sleeping_;
+
+  std::thread thread_;
+};
+
+} // namespace
+
+// set if [logger] async is enabled
+static std::atomic<AsyncLogWriter*> g_async_writer(nullptr);
+static std::atomic<uint64_t> g_dropped_messages(0);
+// threads logging, counted in the slot of the epoch they started in:
+// deinit() only waits for the ones which may still use the writer or the
+// log file it is about to free
+static std::atomic<unsigned> g_log_epoch(0);
+static std::atomic<int> g_log_users[2];
+
+namespace {
+
+// counts the calling thread as a user of the writer and the log file
+class LogUser {
+ public:
+  LogUser(): slot_(g_log_epoch.load() & 1) {
+    ++g_log_users[slot_];
+  }
+
+  ~LogUser() {
+    --g_log_users[slot_];
+  }
+
+  LogUser(const LogUser&) = delete;
+  LogUser& operator=(const LogUser&) = delete;
+
+ private:
+  const unsigned slot_;
+};
+
+// waits for the threads which may have loaded what was just replaced;
+// the ones starting from now on see the new value
+void wait_for_log_users() {
+  const unsigned slot = g_log_epoch.fetch_add(1) & 1;
+  while (g_log_users[slot].load() > 0) {
+    std::this_thread::yield();
+  }
+}
+
+} // namespace
+
 static int init(const AppInfo* info) {
   g_log_level = LVL_INFO;  // Default log level is INFO
 
@@ -82,19 +426,58 @@ static int init(const AppInfo* info) {
     }
     auto section = sections.front();
 
-    if (section->has("level")) {
-      auto level_value = section->get("level");
-      std::transform(level_value.begin(), level_value.end(),
-                     level_value.begin(), ::toupper);
-      auto level = map_level_str.find(level_value);
-      // Invalid values are reported as error
-      if (level == map_level_str.end()) {
+    // Invalid values are reported as error
+    auto get_level = [&section](const std::string &option) {
+      const std::string level_value = section->get(option);
+      const int level = parse_level(level_value);
+      if (level < 0) {
         throw std::invalid_argument(
             "Log level '" + level_value + "' is not valid; valid are " +
             level_str[0] + ", " + level_str[1] + ", " + level_str[2] +
             ", " + level_str[3] + ", or " + level_str[4]);
       }
-      g_log_level = level->second;
+      return level;
+    };
+
+    if (section->has("level")) {
+      g_log_level = get_level("level");
+    }
+
+    for (int module = LOG_MODULE_DEFAULT + 1; module < LOG_MODULE_COUNT; ++module) {
+      const std::string option = std::string("level_") + module_str[module];
+      g_module_levels[module] = section->has(option) ? get_level(option) : -1;
+    }
+
+    if (section->has("async") && section->get("async") != "0") {
+      if (section->get("async") != "1") {
+        throw std::invalid_argument("Option async in [logger] needs value 0 or 1; was '" +
+                                    section->get("async") + "'");
+      }
+
+      size_t queue_size = kDefaultAsyncQueueSize;
+      if (section->has("async_queue_size")) {
+        const std::string value = section->get("async_queue_size");
+        char *rest = nullptr;
+        const unsigned long long size = strtoull(value.c_str(), &rest, 10);
+        if (value.empty() || *rest != '\0' || size < 2 || size > (1ULL << 20)) {
+          throw std::invalid_argument("Option async_queue_size in [logger] needs value between 2 and " +
+                                      std::to_string(1ULL << 20) + " inclusive; was '" + value + "'");
+        }
+        queue_size = static_cast<size_t>(size);
+      }
+
+      bool block_on_overflow = true;
+      if (section->has("async_overflow")) {
+        auto overflow = section->get("async_overflow");
+        std::transform(overflow.begin(), overflow.end(), overflow.begin(), ::tolower);
+        if (overflow != "block" && overflow != "drop") {
+          throw std::invalid_argument("Option async_overflow in [logger] needs value block or drop; was '" +
+                                      section->get("async_overflow") + "'");
+        }
+        block_on_overflow = overflow == "block";
+      }
+
+      g_async_writer.store(new AsyncLogWriter(queue_size, block_on_overflow));
     }
   }
   // We allow the log directory to be NULL or empty, meaning that all
@@ -118,46 +501,46 @@ static int init(const AppInfo* info) {
 }
 
 static int deinit(const AppInfo*) {
+  // writes what is still queued
+  if (AsyncLogWriter *writer = g_async_writer.exchange(nullptr)) {
+    // threads which got the writer before may still be logging
+    wait_for_log_users();
+    g_dropped_messages += writer->get_dropped();
+    delete writer;
+  }
+
   assert(g_log_file.load());
-  return fclose(g_log_file.exchange(nullptr, std::memory_order_acq_rel));
+  FILE *log_file = g_log_file.exchange(nullptr, std::memory_order_acq_rel);
+  wait_for_log_users();
+  return fclose(log_file);
 }
 
 static void log_message(Level level, const char* fmt, va_list ap) {
   assert(level < LEVEL_COUNT);
 
+  LogUser user;
+  if (AsyncLogWriter *writer = g_async_writer.load()) {
+    writer->log(level, fmt, ap);
+    return;
+  }
+
   // Format the message
-  char message[256];
+  char message[kMaxMessageSize];
   vsnprintf(message, sizeof(message), fmt, ap);
 
   // Format the time (19 characters)
   char time_buf[20];
-  time_t now;
-  time(&now);
-  strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", localtime(&now));
+  format_time(time(nullptr), time_buf);
 
   // Get the thread ID
-  std::stringstream ss;
-  ss << std::hex << std::noshowbase << std::this_thread::get_id();
-
-  std::string thread_id = ss.str();
+  std::string thread_id = format_thread_id(std::this_thread::get_id());
 
   // Emit a message on log file (or stdout).
-  FILE *outfp = g_log_file.load(std::memory_order_consume);
-
-  // note that outfp can be NULL if fopen() fails, therefore not equivalent to
-  // testing for stdout.  TODO review this, it is a hack!!!
-  if (outfp != stdout) {
-    fprintf(outfp ? outfp : stdout, "%-19s %-7s [%s] %s\n",
-            time_buf, level_str[level], thread_id.c_str(), message);
-    fflush(outfp);
-  } else {
-    // For unit tests, we need to use cout, so we can use its rdbuf() mechanism
-    // to intercept the output.
-    char buf[1024];
-    snprintf(buf, sizeof(buf), "%-19s %-7s [%s] %s\n",
-            time_buf, level_str[level], thread_id.c_str(), message);
-    std::cout << buf << std::flush;
-  }
+  char buf[1024];
+  const int len = snprintf(buf, sizeof(buf), "%-19s %-7s [%s] %s\n",
+                           time_buf, level_str[level], thread_id.c_str(), message);
+  write_log_lines(g_log_file.load(std::memory_order_consume), buf,
+                  std::min(static_cast<size_t>(len), sizeof(buf) - 1));
 }
 
 
@@ -204,6 +587,79 @@ void log_debug(const char *fmt, ...) {
 }
 
 
+int log_level_is_enabled(LogModule module, LogLevel level) {
+  int module_level = -1;
+  if (module > LOG_MODULE_DEFAULT && module < LOG_MODULE_COUNT) {
+    module_level = g_module_levels[module].load(std::memory_order_relaxed);
+  }
+  if (module_level < 0) {
+    module_level = g_log_level.load(std::memory_order_relaxed);
+  }
+  return level <= module_level;
+}
+
+
+int log_set_module_level(const char *module, const char *level) {
+  int new_level = -1;
+  if (level != nullptr && (new_level = parse_level(level)) < 0) {
+    return -1;
+  }
+
+  if (module == nullptr) {
+    if (new_level < 0) {
+      return -1;  // the global level can't be unset
+    }
+    g_log_level = new_level;
+    return 0;
+  }
+
+  for (int ndx = LOG_MODULE_DEFAULT + 1; ndx < LOG_MODULE_COUNT; ++ndx) {
+    if (strcmp(module, module_str[ndx]) == 0) {
+      g_module_levels[ndx] = new_level;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+
+void log_module_message(LogModule module, LogLevel level, const char *fmt, ...) {
+  if (!log_level_is_enabled(module, level))
+    return;
+  va_list args;
+  va_start(args, fmt);
+  log_message(static_cast<Level>(level), fmt, args);
+  va_end(args);
+}
+
+
+bool log_rate_limit_pass(LogRateLimit &limit, unsigned interval_ms,
+                         unsigned long long &suppressed) {
+  using namespace std::chrono;
+  const long long now_ms =
+      duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+
+  long long next_allowed_ms = limit.next_allowed_ms.load(std::memory_order_relaxed);
+  // only one of the threads racing for the same call site wins
+  if (now_ms < next_allowed_ms ||
+      !limit.next_allowed_ms.compare_exchange_strong(next_allowed_ms, now_ms + interval_ms,
+                                                      std::memory_order_relaxed)) {
+    limit.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  suppressed = limit.suppressed.exchange(0, std::memory_order_relaxed);
+  return true;
+}
+
+
+unsigned long long log_get_dropped_messages() {
+  LogUser user;
+  const AsyncLogWriter *writer = g_async_writer.load();
+  return g_dropped_messages.load() + (writer ? writer->get_dropped() : 0);
+}
+
+
 extern "C" {
   Plugin LOGGER_API logger = {
     PLUGIN_ABI_VERSION,
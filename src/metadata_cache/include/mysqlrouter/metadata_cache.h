@@ -18,8 +18,11 @@
 #ifndef MYSQLROUTER_METADATA_CACHE_INCLUDED
 #define MYSQLROUTER_METADATA_CACHE_INCLUDED
 
+#include <chrono>
+#include <cstdint>
 #include <stdexcept>
 #include <exception>
+#include <memory>
 #include <vector>
 #include <map>
 #include <string>
@@ -97,6 +100,9 @@ public:
   unsigned int port;
   /** The X protocol port number in which the server is running */
   unsigned int xport;
+  /** @brief Transactions the server received from the group but didn't
+   *         apply yet; 0 if unknown (needs MySQL 8.0) */
+  uint64_t apply_backlog;
 };
 
 /** @class ManagedReplicaSet
@@ -142,18 +148,109 @@ public:
     what_arg) { }
 };
 
+/** @class Topology
+ *
+ * Snapshot of the replicasets of the cluster. A published snapshot is never
+ * modified: each refresh that finds a change publishes a new one, so
+ * readers can use it without any locking.
+ */
+class METADATA_API Topology {
+public:
+  /** @brief Incremented with every snapshot the cache publishes */
+  uint64_t generation = 0;
+  /** @brief The replicasets, keyed by name */
+  std::map<std::string, ManagedReplicaSet> replicasets;
+  /** @brief Not confirmed by the metadata servers: loaded from the topology
+   *         file at startup, or kept while the metadata servers are
+   *         unreachable */
+  bool stale = false;
+};
+
+/** @class FailoverStats
+ *
+ * Statistics about replicasets losing and regaining their primary.
+ */
+class METADATA_API FailoverStats {
+public:
+  /** @brief Number of times a lost primary was replaced by a new one */
+  uint64_t failovers = 0;
+  /** @brief Time from the primary being reported lost until the new one was
+   *         routable, of the last failover (in ms) */
+  uint64_t last_failover_ms = 0;
+  /** @brief Same, longest failover so far (in ms) */
+  uint64_t max_failover_ms = 0;
+};
+
+/** @class TopologyChange
+ *
+ * Difference of a single instance between two topology snapshots.
+ */
+class METADATA_API TopologyChange {
+public:
+  enum class Type {
+    InstanceAdded,
+    InstanceRemoved,
+    ModeChanged  // e.g. secondary became the new primary
+  };
+
+  /** @brief What changed */
+  Type type;
+  /** @brief The instance as in the new snapshot (old one if removed) */
+  ManagedInstance instance;
+  /** @brief Mode of the instance in the old snapshot (if ModeChanged) */
+  ServerMode previous_mode;
+};
+
+/** @class TopologyListener
+ *
+ * Interface of objects which want to be notified about topology changes
+ * instead of polling the cache.
+ */
+class METADATA_API TopologyListener {
+public:
+  virtual ~TopologyListener() {}
+
+  /** @brief Called after a refresh published a changed topology
+   *
+   * Called from the refresh thread, must not block and must not add or
+   * remove listeners.
+   *
+   * @param topology the new snapshot
+   * @param changes differences to the previous snapshot
+   */
+  virtual void topology_changed(const std::shared_ptr<const Topology> &topology,
+                                const std::vector<TopologyChange> &changes) = 0;
+};
+
 /** @class LookupResult
  *
  * Class holding result after looking up data in the cache.
+ *
+ * Refers to the instances inside of the topology snapshot, which is kept
+ * alive as long as the result exists.
  */
 class METADATA_API LookupResult {
 public:
-  /** @brief Constructor */
-  LookupResult(const std::vector<ManagedInstance> &instance_vector_) :
-  instance_vector(instance_vector_) { }
+  /** @brief Constructor
+   *
+   * @param topology snapshot the instances belong to
+   * @param instance_vector_ instances of the replicaset (inside of topology)
+   */
+  LookupResult(std::shared_ptr<const Topology> topology,
+               const std::vector<ManagedInstance> &instance_vector_) :
+  instance_vector(instance_vector_), topology_(std::move(topology)) { }
+
+  /** @brief Generation of the snapshot the result comes from */
+  uint64_t generation() const { return topology_->generation; }
+
+  /** @brief Whether the snapshot the result comes from is stale */
+  bool stale() const { return topology_->stale; }
 
   /** @brief List of ManagedInstance objects */
-  const std::vector<metadata_cache::ManagedInstance> instance_vector;
+  const std::vector<metadata_cache::ManagedInstance> &instance_vector;
+
+private:
+  std::shared_ptr<const Topology> topology_;
 };
 
 /** @brief Initialize a MetadataCache object and start caching
@@ -180,10 +277,42 @@ public:
  *                            metadata.
  * @param ssl_options SSL relatd options for connection
  * @param cluster_name The name of the cluster to be used.
+ * @param use_gr_notifications refresh as soon as the members push a Group
+ *                             Replication state change notice (needs the
+ *                             X protocol on the members)
+ * @param topology_file file the last known topology is saved in and loaded
+ *                      from at startup; empty for none
+ * @param max_topology_staleness for how long (in seconds) a topology not
+ *                               confirmed by the metadata servers may be
+ *                               used; 0 to clear it as soon as they can't
+ *                               be reached
+ * @param router_id id of the router in the metadata; spreads the refreshes
+ *                  of the routers over the TTL, 0 for no spreading
+ * @param ttl_jitter percentage by which the time between two refreshes
+ *                   randomly varies
+ * @param fleet_size number of routers using the same metadata servers
+ * @param fleet_refresh_budget refreshes per minute the metadata servers get
+ *                             from all routers together at most, 0 for no
+ *                             limit; refreshes after the loss of a primary
+ *                             are not limited
  */
 void METADATA_API cache_init(const std::vector<mysqlrouter::TCPAddress> &bootstrap_servers,
                 const std::string &user, const std::string &password,
-                unsigned int ttl, const mysqlrouter::SSLOptions &ssl_options, const std::string &cluster_name);
+                unsigned int ttl, const mysqlrouter::SSLOptions &ssl_options, const std::string &cluster_name,
+                bool use_gr_notifications = false,
+                const std::string &topology_file = "",
+                unsigned int max_topology_staleness = 0,
+                uint32_t router_id = 0,
+                unsigned int ttl_jitter = 0,
+                unsigned int fleet_size = 1,
+                unsigned int fleet_refresh_budget = 0);
+
+/** @brief Stop refreshing the cache
+ *
+ * Stops the refresh thread started by cache_init(). The cached data stays
+ * available for lookups.
+ */
+void METADATA_API cache_stop() noexcept;
 
 /** @brief Returns list of managed server in a HA replicaset
  *
@@ -195,6 +324,30 @@ void METADATA_API cache_init(const std::vector<mysqlrouter::TCPAddress> &bootstr
  */
 LookupResult METADATA_API lookup_replicaset(const std::string &replicaset_name);
 
+/** @brief Returns the current snapshot of the cluster's topology
+ *
+ * Doesn't block: refreshes publish a new snapshot instead of modifying it.
+ *
+ * @return the snapshot, never null
+ */
+std::shared_ptr<const Topology> METADATA_API get_topology();
+
+/** @brief Registers a listener for topology changes
+ *
+ * @param listener notified until remove_topology_listener() is called
+ * @throws std::runtime_error if the cache is not initialized
+ */
+void METADATA_API add_topology_listener(TopologyListener *listener);
+
+/** @brief Unregisters a listener added with add_topology_listener()
+ *
+ * Once it returns, the listener is not called anymore (waits for a running
+ * notification to finish).
+ *
+ * @param listener the listener to remove
+ */
+void METADATA_API remove_topology_listener(TopologyListener *listener) noexcept;
+
 
 /** @brief Update the status of the instance
  *
@@ -211,7 +364,8 @@ void METADATA_API mark_instance_reachability(const std::string &instance_id,
 /** @brief Wait until there's a primary member in the replicaset
  *
  * To be called when the master of a single-master replicaset is down and
- * we want to wait until one becomes elected.
+ * we want to wait until one becomes elected. Returns as soon as a refresh
+ * found the new primary.
  *
  * @param timeout - amount of time to wait for a failover, in seconds
  * @return true if a primary member exists
@@ -219,6 +373,69 @@ void METADATA_API mark_instance_reachability(const std::string &instance_id,
 bool METADATA_API wait_primary_failover(const std::string &replicaset_name,
                                         int timeout);
 
+/** @brief Wait until a server applied the given GTIDs
+ *
+ * Asks the server with the credentials of the Metadata Cache, over a
+ * connection of its own: nothing is sent in the sessions of the clients.
+ *
+ * @param instance_id - the mysql_server_uuid that identifies the server instance
+ * @param gtids - GTID set the server needs to have applied
+ * @param timeout - how long the server may take
+ * @return true if the server applied the GTIDs in time
+ * @throws std::runtime_error if the cache is not initialized
+ */
+bool METADATA_API wait_for_gtids(const std::string &instance_id,
+                                 const std::string &gtids,
+                                 std::chrono::milliseconds timeout);
+
+/** @brief Returns statistics about the failovers seen by the cache
+ *
+ * @throws std::runtime_error if the cache is not initialized
+ */
+FailoverStats METADATA_API get_failover_stats();
+
+/** @class MetadataCacheAPIBase
+ * @brief Base class to allow multiple implementations of the functions
+ *        above used by the routes (at least one "real" and one mock for
+ *        testing purposes)
+ */
+class METADATA_API MetadataCacheAPIBase {
+ public:
+  virtual ~MetadataCacheAPIBase() = default;
+  virtual std::shared_ptr<const Topology> get_topology() = 0;
+  virtual void add_topology_listener(TopologyListener *listener) = 0;
+  virtual void remove_topology_listener(TopologyListener *listener) noexcept = 0;
+  virtual void mark_instance_reachability(const std::string &instance_id,
+                                          InstanceStatus status) = 0;
+  virtual bool wait_primary_failover(const std::string &replicaset_name,
+                                     int timeout) = 0;
+  virtual bool wait_for_gtids(const std::string &instance_id,
+                              const std::string &gtids,
+                              std::chrono::milliseconds timeout) = 0;
+};
+
+/** @class MetadataCacheAPI
+ * @brief "Real" implementation, calls the functions above
+ */
+class METADATA_API MetadataCacheAPI : public MetadataCacheAPIBase {
+ public:
+  static MetadataCacheAPI* instance();
+
+  std::shared_ptr<const Topology> get_topology() override;
+  void add_topology_listener(TopologyListener *listener) override;
+  void remove_topology_listener(TopologyListener *listener) noexcept override;
+  void mark_instance_reachability(const std::string &instance_id,
+                                  InstanceStatus status) override;
+  bool wait_primary_failover(const std::string &replicaset_name,
+                             int timeout) override;
+  bool wait_for_gtids(const std::string &instance_id,
+                      const std::string &gtids,
+                      std::chrono::milliseconds timeout) override;
+
+ private:
+  MetadataCacheAPI() = default;
+};
+
 } // namespace metadata_cache
 
 #endif // MYSQLROUTER_METADATA_CACHE_INCLUDED
@@ -21,6 +21,7 @@
 
 #include "cluster_metadata.h"
 
+#include <algorithm>
 #include <map>
 #include <memory>
 
@@ -46,18 +47,62 @@ const std::string kDefaultMetadataCluster = ""; // blank cluster name means pick
  * @param ttl The ttl for the contents of the cache
  * @param ssl_options SSL related options for connections
  * @param cluster_name The name of the cluster from the metadata schema
+ * @param use_gr_notifications refresh on GR state change notices
+ * @param topology_file file the last known topology is saved in
+ * @param max_topology_staleness for how long an unconfirmed topology is used
+ * @param router_id id of the router, determines its refresh phase
+ * @param ttl_jitter percentage by which the TTL randomly varies
+ * @param fleet_size number of routers using the same metadata servers
+ * @param fleet_refresh_budget refreshes per minute of the whole fleet
  */
 void cache_init(const std::vector<mysqlrouter::TCPAddress> &bootstrap_servers,
                   const std::string &user,
                   const std::string &password,
                   unsigned int ttl,
                   const mysqlrouter::SSLOptions &ssl_options,
-                  const std::string &cluster_name) {
+                  const std::string &cluster_name,
+                  bool use_gr_notifications,
+                  const std::string &topology_file,
+                  unsigned int max_topology_staleness,
+                  uint32_t router_id,
+                  unsigned int ttl_jitter,
+                  unsigned int fleet_size,
+                  unsigned int fleet_refresh_budget) {
+  std::unique_ptr<GRNotificationListener> gr_notifications;
+  if (use_gr_notifications) {
+    gr_notifications.reset(new GRNotificationListener(user, password));
+  }
+
+  RefreshSchedule refresh_schedule;
+  refresh_schedule.jitter = ttl_jitter;
+  if (fleet_refresh_budget > 0) {
+    // each router may refresh once while the whole fleet uses up the budget
+    refresh_schedule.min_interval = std::chrono::milliseconds(
+      60000ULL * std::max(fleet_size, 1u) / fleet_refresh_budget);
+    if (refresh_schedule.min_interval > std::chrono::seconds(ttl)) {
+      log_info("Refreshing the metadata every %lld ms instead of every %u s to stay within "
+               "the refresh budget of %u routers",
+               static_cast<long long>(refresh_schedule.min_interval.count()), ttl, fleet_size);
+    }
+  }
+  if (router_id > 0) {
+    refresh_schedule.phase_offset = refresh_phase_offset(router_id,
+      std::max<std::chrono::milliseconds>(std::chrono::seconds(ttl), refresh_schedule.min_interval));
+  }
+
   g_metadata_cache.reset(new MetadataCache(bootstrap_servers,
-    get_instance(user, password, 1, 1, ttl, ssl_options), ttl, ssl_options, cluster_name));
+    get_instance(user, password, 1, 1, ttl, ssl_options), ttl, ssl_options, cluster_name,
+    std::move(gr_notifications), topology_file, std::chrono::seconds(max_topology_staleness),
+    refresh_schedule));
   g_metadata_cache->start();
 }
 
+void cache_stop() noexcept {
+  if (g_metadata_cache) {
+    g_metadata_cache->stop();
+  }
+}
+
 /**
  * Lookup the servers that belong to the given replicaset.
  *
@@ -73,7 +118,29 @@ LookupResult lookup_replicaset(const std::string &replicaset_name) {
     throw std::runtime_error("Metadata Cache not initialized");
   }
 
-  return LookupResult(g_metadata_cache->replicaset_lookup(replicaset_name));
+  return g_metadata_cache->lookup(replicaset_name);
+}
+
+std::shared_ptr<const Topology> get_topology() {
+  if (g_metadata_cache == nullptr) {
+    throw std::runtime_error("Metadata Cache not initialized");
+  }
+
+  return g_metadata_cache->topology();
+}
+
+void add_topology_listener(TopologyListener *listener) {
+  if (g_metadata_cache == nullptr) {
+    throw std::runtime_error("Metadata Cache not initialized");
+  }
+
+  g_metadata_cache->add_listener(listener);
+}
+
+void remove_topology_listener(TopologyListener *listener) noexcept {
+  if (g_metadata_cache) {
+    g_metadata_cache->remove_listener(listener);
+  }
 }
 
 
@@ -93,4 +160,54 @@ bool wait_primary_failover(const std::string &replicaset_name, int timeout) {
 
   return g_metadata_cache->wait_primary_failover(replicaset_name, timeout);
 }
+
+bool wait_for_gtids(const std::string &instance_id, const std::string &gtids,
+                    std::chrono::milliseconds timeout) {
+  if (g_metadata_cache == nullptr) {
+    throw std::runtime_error("Metadata Cache not initialized");
+  }
+
+  return g_metadata_cache->wait_for_gtids(instance_id, gtids, timeout);
+}
+
+FailoverStats get_failover_stats() {
+  if (g_metadata_cache == nullptr) {
+    throw std::runtime_error("Metadata Cache not initialized");
+  }
+
+  return g_metadata_cache->failover_stats();
+}
+
+MetadataCacheAPI* MetadataCacheAPI::instance() {
+  static MetadataCacheAPI instance_;
+  return &instance_;
+}
+
+std::shared_ptr<const Topology> MetadataCacheAPI::get_topology() {
+  return metadata_cache::get_topology();
+}
+
+void MetadataCacheAPI::add_topology_listener(TopologyListener *listener) {
+  metadata_cache::add_topology_listener(listener);
+}
+
+void MetadataCacheAPI::remove_topology_listener(TopologyListener *listener) noexcept {
+  metadata_cache::remove_topology_listener(listener);
+}
+
+void MetadataCacheAPI::mark_instance_reachability(const std::string &instance_id,
+                                                  InstanceStatus status) {
+  metadata_cache::mark_instance_reachability(instance_id, status);
+}
+
+bool MetadataCacheAPI::wait_primary_failover(const std::string &replicaset_name,
+                                             int timeout) {
+  return metadata_cache::wait_primary_failover(replicaset_name, timeout);
+}
+
+bool MetadataCacheAPI::wait_for_gtids(const std::string &instance_id,
+                                      const std::string &gtids,
+                                      std::chrono::milliseconds timeout) {
+  return metadata_cache::wait_for_gtids(instance_id, gtids, timeout);
+}
 } // namespace metadata_cache
@@ -28,6 +28,9 @@
 #include <cassert>
 #include <chrono>
 #include <cstdlib>
+#include <exception>
+#include <set>
+#include <thread>
 #include <vector>
 #include <sstream>
 #include <stdio.h>
@@ -40,6 +43,17 @@
 using mysqlrouter::MySQLSession;
 using mysqlrouter::strtoi_checked;
 
+// a refresh doesn't try further servers of a replicaset after that many
+// connection timeouts
+static const int kRefreshTimeoutInConnectionTimeouts = 3;
+
+// after failed connection attempts, a server is tried last for 1, 2, 4, ...
+// refresh intervals, at most for 2^kMaxReconnectBackoffShift of them
+static const unsigned int kMaxReconnectBackoffShift = 3;
+
+// idle connections of wait_for_gtids() kept per instance
+static const size_t kMaxIdleGtidConnections = 4;
+
 /**
  * Return a string representation of the input character string.
  *
@@ -55,6 +69,11 @@ std::string get_string(const char *input_str) {
   return std::string(input_str);
 }
 
+// host:port as used by MySQLSession::get_address()
+static std::string get_address(const metadata_cache::ManagedInstance &mi) {
+  return (mi.host == "localhost" ? "127.0.0.1" : mi.host) + ":" + std::to_string(mi.port);
+}
+
 ClusterMetadata::ClusterMetadata(const std::string &user,
                                  const std::string &password,
                                  int connection_timeout,
@@ -114,10 +133,25 @@ bool ClusterMetadata::do_connect(MySQLSession& connection, const metadata_cache:
 bool ClusterMetadata::connect(const std::vector<metadata_cache::ManagedInstance>
                            & metadata_servers) noexcept {
 
-  // Get a clean metadata server connection object
-  // (RAII will close the old one if needed).
+  // keep the connection of the last refresh as long as it's alive
+  if (metadata_connection_) {
+    if (metadata_connection_->ping()) {
+      return true;
+    }
+    log_warning("Lost connection with metadata server %s", metadata_connection_->get_address().c_str());
+    disconnect();
+  }
+
+  // the signature depends on which server we are connected to
+  topology_signature_.clear();
+  signature_covers_topology_ = false;
+  // the servers may have been upgraded
+  member_backlog_unsupported_ = false;
+
+  // one session is used for all connection attempts
+  std::shared_ptr<MySQLSession> session;
   try {
-    metadata_connection_ = mysql_harness::DIM::instance().new_MySQLSession();
+    session = mysql_harness::DIM::instance().new_MySQLSession();
   } catch (const std::logic_error& e) {
     // defensive programming, shouldn't really happen
     log_error("Failed connecting with Metadata Server: %s", e.what());
@@ -127,56 +161,260 @@ bool ClusterMetadata::connect(const std::vector<metadata_cache::ManagedInstance>
   // Iterate through the list of servers in the metadata replicaset
   // to fetch a valid connection from which the metadata can be
   // fetched.
-  for (const metadata_cache::ManagedInstance& mi : metadata_servers) {
-    if (do_connect(*metadata_connection_, mi)) {
+  for (size_t ndx : connection_order(metadata_servers)) {
+    const metadata_cache::ManagedInstance& mi = metadata_servers[ndx];
+    std::string error;
+    metadata_connection_ = get_connection(mi, session, &error);
+    if (metadata_connection_) {
       log_info("Connected with metadata server running on %s:%i", mi.host.c_str(), mi.port);
-      break;
-    } else {
-      log_error("Failed connecting with Metadata Server %s:%d: %s (%i)",
-                mi.host.c_str(), mi.port,
-                metadata_connection_->last_error(),
-                metadata_connection_->last_errno());
+      return true;
     }
+    log_error("Failed connecting with Metadata Server %s:%d: %s",
+              mi.host.c_str(), mi.port, error.c_str());
   }
 
-  if (metadata_connection_->is_connected()) {
-    return true;
-  } else {
-    log_error("Failed connecting with any of the bootstrap servers");
+  log_error("Failed connecting with any of the bootstrap servers");
+  return false;
+}
+
+void ClusterMetadata::disconnect() noexcept {
+  if (metadata_connection_) {
+    release_connection(metadata_connection_);
     metadata_connection_.reset();
+  }
+}
+
+// throws metadata_cache::metadata_error
+static std::shared_ptr<MySQLSession> new_session() {
+  try {
+    return mysql_harness::DIM::instance().new_MySQLSession();
+  } catch (const std::logic_error& e) {
+    // defensive programming, shouldn't really happen. If it does, there's nothing we can do really, we give up
+    log_error("While updating metadata, could not initialise MySQL connetion structure");
+    throw metadata_cache::metadata_error(e.what());
+  }
+}
+
+std::shared_ptr<MySQLSession> ClusterMetadata::get_connection(
+    const metadata_cache::ManagedInstance &mi,
+    std::shared_ptr<MySQLSession> session,
+    std::string *error) { // throws metadata_cache::metadata_error
+  const std::string addr = get_address(mi);
+
+  std::shared_ptr<MySQLSession> pooled;
+  {
+    std::lock_guard<std::mutex> lock(connections_mtx_);
+    auto it = connections_.find(addr);
+    if (it != connections_.end()) {
+      pooled = it->second.session;
+    }
+  }
+  if (pooled) {
+    // the server may have closed it (restart, wait_timeout, ...) since the last refresh
+    if (pooled->ping()) {
+      return pooled;
+    }
+    log_module_debug(LOG_MODULE_METADATA_CACHE, "Connection to %s got lost, reconnecting", addr.c_str());
+  }
+
+  if (!session) {
+    session = new_session(); // throws metadata_cache::metadata_error
+  }
+  const bool connected = do_connect(*session, mi);
+  if (!connected && error) {
+    const char *msg = session->last_error();
+    *error = std::string(msg ? msg : "") + " (" + std::to_string(session->last_errno()) + ")";
+  }
+
+  std::lock_guard<std::mutex> lock(connections_mtx_);
+  PooledConnection &entry = connections_[addr];
+  if (connected) {
+    entry.session = session;
+    entry.failures = 0;
+    entry.retry_after = std::chrono::steady_clock::time_point();
+    return session;
+  }
+
+  entry.session.reset();
+  entry.failures++;
+  entry.retry_after = std::chrono::steady_clock::now() +
+      std::chrono::seconds(std::max(ttl_, 1u)) *
+      (1u << std::min(entry.failures - 1, kMaxReconnectBackoffShift));
+  return nullptr;
+}
+
+void ClusterMetadata::release_connection(const std::shared_ptr<MySQLSession> &session) noexcept {
+  std::lock_guard<std::mutex> lock(connections_mtx_);
+  for (auto &entry : connections_) {
+    if (entry.second.session == session) {
+      entry.second.session.reset();
+    }
+  }
+}
+
+bool ClusterMetadata::wait_for_gtids(const metadata_cache::ManagedInstance &instance,
+                                     const std::string &gtids,
+                                     std::chrono::milliseconds timeout) noexcept {
+  const std::string addr = get_address(instance);
+
+  std::shared_ptr<MySQLSession> session;
+  {
+    std::lock_guard<std::mutex> lock(gtid_connections_mtx_);
+    auto it = gtid_connections_.find(addr);
+    if (it != gtid_connections_.end()) {
+      session = it->second;
+      gtid_connections_.erase(it);
+    }
+  }
+
+  try {
+    if (!session || !session->ping()) {
+      session = new_session(); // throws metadata_cache::metadata_error
+      if (!do_connect(*session, instance)) {
+        log_warning("Failed connecting to %s to check the GTIDs it applied: %s",
+                    addr.c_str(), session->last_error());
+        return false;
+      }
+    }
+
+    // 0 if the GTIDs got applied, 1 on timeout
+    char timeout_seconds[32];
+    snprintf(timeout_seconds, sizeof(timeout_seconds), "%.3f", static_cast<double>(timeout.count()) / 1000);
+    bool applied = false;
+    session->query("SELECT WAIT_FOR_EXECUTED_GTID_SET(" + session->quote(gtids) + ", " + timeout_seconds + ")",
+                   [&applied](const MySQLSession::Row &row) {
+      applied = row.size() == 1 && row[0] && std::string(row[0]) == "0";
+      return false;
+    });
+
+    std::lock_guard<std::mutex> lock(gtid_connections_mtx_);
+    if (gtid_connections_.count(addr) < kMaxIdleGtidConnections) {
+      gtid_connections_.emplace(addr, session);
+    }
+    return applied;
+  } catch (const std::exception &e) {
+    log_warning("Failed checking the GTIDs %s applied: %s", addr.c_str(), e.what());
     return false;
   }
 }
 
+std::vector<size_t> ClusterMetadata::connection_order(
+    const std::vector<metadata_cache::ManagedInstance> &instances) {
+  std::vector<size_t> order;
+  std::vector<size_t> backed_off;
+  const auto now = std::chrono::steady_clock::now();
+
+  std::lock_guard<std::mutex> lock(connections_mtx_);
+  for (size_t ndx = 0; ndx < instances.size(); ++ndx) {
+    auto it = connections_.find(get_address(instances[ndx]));
+    if (it != connections_.end() && it->second.retry_after > now) {
+      backed_off.push_back(ndx);
+    } else {
+      order.push_back(ndx);
+    }
+  }
+  order.insert(order.end(), backed_off.begin(), backed_off.end());
+
+  return order;
+}
+
+std::vector<std::shared_ptr<MySQLSession>> ClusterMetadata::connect_members(
+    const std::vector<metadata_cache::ManagedInstance> &members,
+    const std::vector<size_t> &indexes) {
+  std::vector<std::shared_ptr<MySQLSession>> connections(members.size());
+
+  // the sessions are created in order, only connecting them happens in
+  // parallel; pooled connections are only checked
+  std::vector<size_t> to_connect;
+  std::vector<std::shared_ptr<MySQLSession>> sessions(members.size());
+  for (size_t ndx : indexes) {
+    if (get_address(members[ndx]) != metadata_connection_->get_address()) {
+      bool pooled;
+      {
+        std::lock_guard<std::mutex> lock(connections_mtx_);
+        auto it = connections_.find(get_address(members[ndx]));
+        pooled = it != connections_.end() && it->second.session;
+      }
+      if (!pooled) {
+        sessions[ndx] = new_session(); // throws metadata_cache::metadata_error
+      }
+      to_connect.push_back(ndx);
+    }
+  }
+
+  auto connect_member = [this, &members, &connections, &sessions](size_t ndx) {
+    try {
+      connections[ndx] = get_connection(members[ndx], sessions[ndx]);
+    } catch (const metadata_cache::metadata_error&) {
+      // logged by new_session(), leaves the member unconnected
+    }
+  };
+
+  // the last one is connected by this thread
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i + 1 < to_connect.size(); ++i) {
+    threads.emplace_back(connect_member, to_connect[i]);
+  }
+  if (!to_connect.empty()) {
+    connect_member(to_connect.back());
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  return connections;
+}
+
 void ClusterMetadata::update_replicaset_status(const std::string &name,
-    metadata_cache::ManagedReplicaSet &replicaset) { // throws metadata_cache::metadata_error
-  log_debug("Updating replicaset status from GR for '%s'", name.c_str());
+    metadata_cache::ManagedReplicaSet &replicaset,
+    std::chrono::steady_clock::time_point deadline) { // throws metadata_cache::metadata_error
+  log_module_debug(LOG_MODULE_METADATA_CACHE, "Updating replicaset status from GR for '%s'", name.c_str());
   // iterate over all cadidate nodes until we find the node that is part of quorum
   bool found_quorum = false;
 
+  // once a node couldn't be connected to, the remaining ones get connected
+  // at once, so that every further unreachable node doesn't cost another
+  // connection timeout
+  std::vector<std::shared_ptr<MySQLSession>> connections;
+  bool connected_ahead = false;
+
+  const std::vector<size_t> order = connection_order(replicaset.members);
+
   std::shared_ptr<MySQLSession> gr_member_connection;
-  for (const metadata_cache::ManagedInstance& mi : replicaset.members) {
-    std::string mi_addr = (mi.host == "localhost" ? "127.0.0.1" : mi.host) + ":" + std::to_string(mi.port);
+  for (size_t pos = 0; pos < order.size(); ++pos) {
+    const size_t ndx = order[pos];
+    const metadata_cache::ManagedInstance& mi = replicaset.members[ndx];
+    std::string mi_addr = get_address(mi);
 
     // this function could test these in an if() instead of assert(),
     // but so far the logic that calls this function ensures this
     assert(metadata_connection_->is_connected());
 
+    if (std::chrono::steady_clock::now() > deadline) {
+      log_warning("Metadata refresh took too long, not trying the remaining servers of replicaset '%s'",
+                  name.c_str());
+      break;
+    }
+
     // connect to node
     if (mi_addr == metadata_connection_->get_address()) { // optimisation: if node is the same as metadata server,
       gr_member_connection = metadata_connection_;        //               share the established connection
-    } else {
-      try {
-        gr_member_connection = mysql_harness::DIM::instance().new_MySQLSession();
-      } catch (const std::logic_error& e) {
-        // defensive programming, shouldn't really happen. If it does, there's nothing we can do really, we give up
-        log_error("While updating metadata, could not initialise MySQL connetion structure");
-        throw metadata_cache::metadata_error(e.what());
+    } else if (connected_ahead) {
+      gr_member_connection = connections[ndx];
+      if (!gr_member_connection) {
+        log_error("While updating metadata, could not establish a connection to replicaset '%s' through %s",
+                  name.c_str(), mi_addr.c_str());
+        continue; // server down, next!
       }
+    } else {
+      gr_member_connection = get_connection(mi); // throws metadata_cache::metadata_error
 
-      if (!do_connect(*gr_member_connection, mi)) {
+      if (!gr_member_connection) {
         log_error("While updating metadata, could not establish a connection to replicaset '%s' through %s",
                   name.c_str(), mi_addr.c_str());
+        connections = connect_members(replicaset.members,
+            std::vector<size_t>(order.begin() + static_cast<std::ptrdiff_t>(pos) + 1, order.end())); // throws metadata_cache::metadata_error
+        connected_ahead = true;
         continue; // server down, next!
       }
     }
@@ -190,8 +428,8 @@ void ClusterMetadata::update_replicaset_status(const std::string &name,
       std::map<std::string, GroupReplicationMember> member_status =
           fetch_group_replication_members(*gr_member_connection,
                                           single_primary_mode); // throws metadata_cache::metadata_error
-      log_debug("Replicaset '%s' has %i members in metadata, %i in status table",
-                name.c_str(), replicaset.members.size(), member_status.size());
+      log_module_debug(LOG_MODULE_METADATA_CACHE, "Replicaset '%s' has %i members in metadata, %i in status table",
+                name.c_str(), static_cast<int>(replicaset.members.size()), static_cast<int>(member_status.size()));
 
       // check status of all nodes; updates instances ------------------vvvvvvvvvvvvvvvvvv
       metadata_cache::ReplicasetStatus status = check_replicaset_status(replicaset.members, member_status);
@@ -209,12 +447,18 @@ void ClusterMetadata::update_replicaset_status(const std::string &name,
 
       if (found_quorum) {
         replicaset.single_primary_mode = single_primary_mode;
+        update_apply_backlog(*gr_member_connection, replicaset.members);
         break; // break out of the member iteration loop
       }
 
     } catch (const metadata_cache::metadata_error& e) {
       log_warning("Unable to fetch live group_replication member data from %s from replicaset '%s': %s",
                   mi_addr.c_str(), name.c_str(), e.what());
+      // don't reuse the connection, it may be broken (the metadata
+      // connection gets checked by the next connect())
+      if (gr_member_connection != metadata_connection_) {
+        release_connection(gr_member_connection);
+      }
       continue; // faulty server, next!
     } catch (...) {
       assert(0);  // unexpected exception
@@ -223,7 +467,7 @@ void ClusterMetadata::update_replicaset_status(const std::string &name,
     }
 
   } // for (const metadata_cache::ManagedInstance& mi : instances)
-  log_debug("End updating replicaset for '%s'", name.c_str());
+  log_module_debug(LOG_MODULE_METADATA_CACHE, "End updating replicaset for '%s'", name.c_str());
 
   if (!found_quorum) {
     std::string msg("Unable to fetch live group_replication member data from any server in replicaset '");
@@ -236,6 +480,54 @@ void ClusterMetadata::update_replicaset_status(const std::string &name,
   }
 }
 
+void ClusterMetadata::update_apply_backlog(MySQLSession &connection,
+    std::vector<metadata_cache::ManagedInstance> &members) noexcept {
+  if (member_backlog_unsupported_) {
+    return;
+  }
+
+  std::map<std::string, uint64_t> backlog = fetch_member_backlog(connection);
+  for (auto &mi : members) {
+    auto it = backlog.find(mi.mysql_server_uuid);
+    if (it != backlog.end()) {
+      mi.apply_backlog = it->second;
+    }
+  }
+}
+
+std::map<std::string, uint64_t> ClusterMetadata::fetch_member_backlog(MySQLSession &connection) noexcept {
+  try {
+    return fetch_group_replication_member_backlog(connection); // throws metadata_cache::metadata_error, MySQLSession::Error
+  } catch (const MySQLSession::Error &e) {
+    if (e.code() == 1054) { // Unknown column: before MySQL 8.0
+      log_info("Apply backlog of the members not available, replication lag is not taken into account: %s",
+               e.what());
+      member_backlog_unsupported_ = true;
+    } else {
+      log_warning("Failed fetching the apply backlog of the members: %s", e.what());
+    }
+  } catch (const metadata_cache::metadata_error &e) {
+    log_warning("Failed fetching the apply backlog of the members: %s", e.what());
+  }
+  return {};
+}
+
+// backlogs below this are reported as 0: a member applying normally goes up
+// and down within it, which shouldn't cause a full refresh every time
+static const uint64_t kMinSignificantBacklog = 64;
+
+// number of significant bits: changes when the backlog doubles or halves
+static unsigned int backlog_magnitude(uint64_t backlog) {
+  if (backlog < kMinSignificantBacklog) {
+    return 0;
+  }
+  unsigned int bits = 0;
+  for (; backlog != 0; backlog >>= 1) {
+    ++bits;
+  }
+  return bits;
+}
+
 metadata_cache::ReplicasetStatus ClusterMetadata::check_replicaset_status(
     std::vector<metadata_cache::ManagedInstance> &instances,
     const std::map<std::string, GroupReplicationMember> &member_status) const noexcept {
@@ -328,7 +620,7 @@ metadata_cache::ReplicasetStatus ClusterMetadata::check_replicaset_status(
 // throws metadata_cache::metadata_error
 ClusterMetadata::ReplicaSetsByName ClusterMetadata::fetch_instances(
     const std::string &cluster_name) {
-  log_debug("Updating metadata information for cluster '%s'", cluster_name.c_str());
+  log_module_debug(LOG_MODULE_METADATA_CACHE, "Updating metadata information for cluster '%s'", cluster_name.c_str());
 
   assert(metadata_connection_->is_connected());
 
@@ -338,15 +630,155 @@ ClusterMetadata::ReplicaSetsByName ClusterMetadata::fetch_instances(
   if (replicasets.empty())
     log_warning("No replicasets defined for cluster '%s'", cluster_name.c_str());
 
+  // forget the pooled connections of servers which were removed from the cluster
+  {
+    std::set<std::string> addresses;
+    for (const auto &rs : replicasets) {
+      for (const auto &mi : rs.second.members) {
+        addresses.insert(get_address(mi));
+      }
+    }
+    std::lock_guard<std::mutex> lock(connections_mtx_);
+    for (auto it = connections_.begin(); it != connections_.end();) {
+      if (addresses.count(it->first) == 0 && it->second.session != metadata_connection_) {
+        it = connections_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
   // now connect to each replicaset and query it for the list and status of its members.
   // (more precisely, foreach replicaset: search and connect to a member which is part of quorum to retrieve this data)
-  for (auto &&rs : replicasets) {
-    update_replicaset_status(rs.first, rs.second);  // throws metadata_cache::metadata_error
+  // Replicasets are queried in parallel, so unreachable servers of one
+  // replicaset don't delay the others.
+  const auto deadline = std::chrono::steady_clock::now() +
+      std::chrono::seconds(kRefreshTimeoutInConnectionTimeouts * std::max(connection_timeout_, 1));
+  if (replicasets.size() == 1) {
+    update_replicaset_status(replicasets.begin()->first, replicasets.begin()->second, deadline);  // throws metadata_cache::metadata_error
+  } else {
+    std::vector<std::thread> threads;
+    std::vector<std::exception_ptr> errors(replicasets.size());
+    size_t ndx = 0;
+    for (auto &&rs : replicasets) {
+      threads.emplace_back([this, &rs, &errors, ndx, deadline] {
+        try {
+          update_replicaset_status(rs.first, rs.second, deadline);
+        } catch (...) {
+          errors[ndx] = std::current_exception();
+        }
+      });
+      ++ndx;
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    for (const auto &error : errors) {
+      if (error) {
+        std::rethrow_exception(error);  // throws metadata_cache::metadata_error
+      }
+    }
   }
 
+  // the signature only tells about the GR state of the replicasets which the
+  // metadata server is an online member of
+  const std::string &metadata_server = metadata_connection_->get_address();
+  signature_covers_topology_ = !replicasets.empty() &&
+      std::all_of(replicasets.begin(), replicasets.end(), [&metadata_server](const ReplicaSetsByName::value_type &rs) {
+        const auto &members = rs.second.members;
+        return std::any_of(members.begin(), members.end(), [&metadata_server](const metadata_cache::ManagedInstance &mi) {
+          return mi.mode != metadata_cache::ServerMode::Unavailable && get_address(mi) == metadata_server;
+        });
+      });
+  topology_signature_ = signature_covers_topology_ ? pending_topology_signature_ : "";
+  pending_topology_signature_.clear();
+
   return replicasets;
 }
 
+// throws metadata_cache::metadata_error
+bool ClusterMetadata::topology_changed(const std::string &cluster_name) {
+  if (!signature_covers_topology_) {
+    return true;
+  }
+
+  std::string signature = fetch_topology_signature(cluster_name); // throws metadata_cache::metadata_error
+  if (!topology_signature_.empty() && signature == topology_signature_) {
+    return false;
+  }
+
+  log_module_debug(LOG_MODULE_METADATA_CACHE, "Topology of cluster '%s' changed", cluster_name.c_str());
+  pending_topology_signature_ = std::move(signature);
+  return true;
+}
+
+// throws metadata_cache::metadata_error
+std::string ClusterMetadata::fetch_topology_signature(const std::string &cluster_name) {
+
+  // One round trip instead of the metadata query plus a connection and
+  // 2 queries per replicaset: a checksum over everything the metadata query
+  // returns, and the GR view id, member states and primary member as
+  // seen by the metadata server. The view id changes whenever a member
+  // joins or leaves the group, the member states also catch members which
+  // finished recovery.
+  std::string query("SELECT "
+                    "(SELECT CONCAT(COUNT(*), '/', COALESCE(SUM(CRC32(CONCAT_WS('/', "
+                    "R.replicaset_name, I.mysql_server_uuid, I.role, I.weight, "
+                    "I.version_token, H.location, I.addresses))), 0)) "
+                    "FROM "
+                    "mysql_innodb_cluster_metadata.clusters AS F "
+                    "JOIN mysql_innodb_cluster_metadata.replicasets AS R "
+                    "ON F.cluster_id = R.cluster_id "
+                    "JOIN mysql_innodb_cluster_metadata.instances AS I "
+                    "ON R.replicaset_id = I.replicaset_id "
+                    "JOIN mysql_innodb_cluster_metadata.hosts AS H "
+                    "ON I.host_id = H.host_id "
+                    "WHERE F.cluster_name = " + metadata_connection_->quote(cluster_name) + "), "
+                    "(SELECT view_id FROM performance_schema.replication_group_member_stats "
+                    "WHERE member_id = @@server_uuid), "
+                    "(SELECT GROUP_CONCAT(member_id, ':', member_state ORDER BY member_id) "
+                    "FROM performance_schema.replication_group_members "
+                    "WHERE channel_name = 'group_replication_applier'), "
+                    "(SELECT variable_value FROM performance_schema.global_status "
+                    "WHERE variable_name = 'group_replication_primary_member'), "
+                    "@@group_replication_single_primary_mode");
+
+  std::string signature;
+  unsigned rows = 0;
+  auto result_processor = [&signature, &rows](const MySQLSession::Row& row) -> bool {
+    for (const char *field : row) {
+      signature += field ? field : "NULL";
+      signature += '\n';
+    }
+    ++rows;
+    return true;
+  };
+
+  assert(metadata_connection_->is_connected());
+
+  try {
+    metadata_connection_->query(query, result_processor);
+  } catch (const MySQLSession::Error& e) {
+    throw metadata_cache::metadata_error(e.what());
+  }
+
+  if (rows != 1) {
+    throw metadata_cache::metadata_error("Unexpected number of rows in the resultset. "
+                                         "Expected = 1, got = " + std::to_string(rows));
+  }
+
+  // members falling behind (or catching up) need a full refresh to update
+  // their backlog; only its magnitude goes into the signature, otherwise
+  // it changes on every refresh under load
+  if (!member_backlog_unsupported_) {
+    for (const auto &member : fetch_member_backlog(*metadata_connection_)) {
+      signature += member.first + ':' + std::to_string(backlog_magnitude(member.second)) + '\n';
+    }
+  }
+
+  return signature;
+}
+
 // throws metadata_cache::metadata_error
 ClusterMetadata::ReplicaSetsByName ClusterMetadata::fetch_instances_from_metadata_server(
     const std::string &cluster_name) {
@@ -408,6 +840,7 @@ ClusterMetadata::ReplicaSetsByName ClusterMetadata::fetch_instances_from_metadat
     s.role = get_string(row[2]);
     s.weight = row[3] ? std::strtof(row[3], nullptr) : 0;
     s.version_token = row[4] ? static_cast<unsigned int>(strtoi_checked(row[4])) : 0;
+    s.apply_backlog = 0;
     s.location = get_string(row[5]);
     try {
       std::string uri = get_string(row[6]);
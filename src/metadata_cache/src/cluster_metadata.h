@@ -23,9 +23,12 @@
 #include "mysqlrouter/mysql_session.h"
 #include "metadata.h"
 
+#include <atomic>
+#include <chrono>
 #include <vector>
 #include <memory>
 #include <map>
+#include <mutex>
 #include <string>
 #include <string.h>
 
@@ -76,6 +79,38 @@ class METADATA_API ClusterMetadata : public MetaData {
    */
   ReplicaSetsByName fetch_instances(const std::string &cluster_name) override; // throws metadata_cache::metadata_error
 
+  /** @brief Checks if the topology changed since the last fetch_instances()
+   *
+   * Runs a single query on the metadata server, returning a signature of
+   * the cluster's metadata (checksum of its instances) and of the group
+   * replication state seen by the metadata server (view id, member states,
+   * primary member). As the signature only covers the replicasets the
+   * metadata server is an online member of, true is returned without any
+   * query if the last fetch_instances() found other replicasets.
+   *
+   * @param cluster_name the name of the cluster to query
+   * @return false if the result of the last fetch_instances() is still current
+   * @throws metadata_cache::metadata_error
+   */
+  bool topology_changed(const std::string &cluster_name) override; // throws metadata_cache::metadata_error
+
+  /** @brief Waits until an instance applied the given GTIDs
+   *
+   * Runs WAIT_FOR_EXECUTED_GTID_SET() on the instance, with the credentials
+   * of the Metadata Cache. Called by the connection threads of the routes:
+   * the connections used for it are kept apart from the ones of the
+   * refresh, each call uses one of its own.
+   *
+   * @param instance the instance to ask
+   * @param gtids GTID set the instance needs to have applied
+   * @param timeout how long the instance may take
+   * @return true if the instance applied the GTIDs in time; false if it
+   *         didn't or couldn't be asked
+   */
+  bool wait_for_gtids(const metadata_cache::ManagedInstance &instance,
+                      const std::string &gtids,
+                      std::chrono::milliseconds timeout) noexcept override;
+
 #if 0 // not used so far
   /** @brief Returns the refresh interval provided by the metadata server.
    *
@@ -92,6 +127,9 @@ class METADATA_API ClusterMetadata : public MetaData {
    * Connections to servers are attempted in order provided by the list.
    * If no connection succeeded, returns false, else true.
    * (handle to the successful connection will be set in metadata_connection_)
+   * The connection is kept until it fails the health check (a ping) or
+   * disconnect() is called. Servers which recently couldn't be connected to
+   * are tried last.
    *
    * @param metadata_servers the set of servers from which the metadata
    *                         information is fetched.
@@ -103,21 +141,56 @@ class METADATA_API ClusterMetadata : public MetaData {
 
   /** @brief Disconnects from the Metadata server
    *
-   * This is a no-op, as MySQLSession object used underneath for
-   * connection handling employs RAII, making this method unnecessary.
+   * Releases the connection (MySQLSession closes it on destruction), so
+   * that the next connect() establishes a new one.
    */
-  void disconnect() noexcept override {}
+  void disconnect() noexcept override;
 
  private:
   /** Connects a MYSQL connection to the given instance
    */
   bool do_connect(mysqlrouter::MySQLSession& connection, const metadata_cache::ManagedInstance &mi);
 
+  /** @brief Returns a connection to the given instance
+   *
+   * Reuses the connection kept from an earlier refresh if it still answers
+   * a ping. Otherwise connects `session` (a new session if null) and keeps
+   * it for the next refreshes. A failed attempt puts the instance into
+   * backoff, see connection_order().
+   *
+   * @param mi the instance to connect to
+   * @param session session to connect if there's no usable pooled one
+   * @param error set to the error message if connecting failed
+   * @return the connection, or null if connecting failed
+   */
+  std::shared_ptr<mysqlrouter::MySQLSession> get_connection(
+      const metadata_cache::ManagedInstance &mi,
+      std::shared_ptr<mysqlrouter::MySQLSession> session = nullptr,
+      std::string *error = nullptr); // throws metadata_cache::metadata_error
+
+  /** @brief Removes a connection from the pool, e.g. after a query on it failed
+   */
+  void release_connection(const std::shared_ptr<mysqlrouter::MySQLSession> &session) noexcept;
+
+  /** @brief Returns the order in which instances should be tried
+   *
+   * Instances in backoff (connecting to them failed recently) come last,
+   * otherwise the order is kept.
+   *
+   * @return indexes into instances
+   */
+  std::vector<size_t> connection_order(
+      const std::vector<metadata_cache::ManagedInstance> &instances);
+
   /** @brief Queries the metadata server for the list of instances and
    * replicasets that belong to the desired cluster.
    */
   ReplicaSetsByName fetch_instances_from_metadata_server(const std::string &cluster_name);
 
+  /** @brief Queries the signature of the topology, see topology_changed()
+   */
+  std::string fetch_topology_signature(const std::string &cluster_name); // throws metadata_cache::metadata_error
+
   /** Query the GR performance_schema tables for live information about a replicaset.
    *
    * update_replicaset_status() calls check_replicaset_status() for some of its processing.
@@ -127,9 +200,44 @@ class METADATA_API ClusterMetadata : public MetaData {
    * - get other metadata about the replicaset
    *
    * The information is pulled from GR maintained performance_schema tables.
+   *
+   * Nodes are tried one after another, the ones in backoff last; once one
+   * can't be connected to, all remaining ones are connected to in parallel.
+   * No further node is tried after the deadline. Connections are kept for
+   * the next refresh.
    */
   void update_replicaset_status(const std::string &name,
-      metadata_cache::ManagedReplicaSet &replicaset); // throws metadata_cache::metadata_error
+      metadata_cache::ManagedReplicaSet &replicaset,
+      std::chrono::steady_clock::time_point deadline =
+          std::chrono::steady_clock::time_point::max()); // throws metadata_cache::metadata_error
+
+  /** @brief Sets the apply backlog of the members, as seen by a member
+   *
+   * Servers which don't report it (before MySQL 8.0) aren't asked again
+   * until the next reconnect to the metadata server.
+   */
+  void update_apply_backlog(mysqlrouter::MySQLSession &connection,
+      std::vector<metadata_cache::ManagedInstance> &members) noexcept;
+
+  /** @brief Fetches the apply backlog of the members, as seen by a member
+   *
+   * @return backlog by mysql_server_uuid; empty if the query failed. If it
+   *         failed because the server doesn't report the backlog,
+   *         `member_backlog_unsupported_` gets set.
+   */
+  std::map<std::string, uint64_t> fetch_member_backlog(mysqlrouter::MySQLSession &connection) noexcept;
+
+  /** @brief Connects to the given members in parallel
+   *
+   * The metadata server is skipped, its connection is shared.
+   *
+   * @param members the members of a replicaset
+   * @param indexes indexes of the members to connect to
+   * @return connections indexed like members; null if not connected
+   */
+  std::vector<std::shared_ptr<mysqlrouter::MySQLSession>> connect_members(
+      const std::vector<metadata_cache::ManagedInstance> &members,
+      const std::vector<size_t> &indexes); // throws metadata_cache::metadata_error
 
   /** @brief Hard to summarise, please read the full description
    *
@@ -173,6 +281,41 @@ class METADATA_API ClusterMetadata : public MetaData {
   // connection to metadata server (it may also be shared with GR status queries for optimisation purposes)
   std::shared_ptr<mysqlrouter::MySQLSession> metadata_connection_;
 
+  // connection to a metadata server or GR member, kept between refreshes
+  struct PooledConnection {
+    std::shared_ptr<mysqlrouter::MySQLSession> session;
+
+    // number of failed connection attempts in a row
+    unsigned int failures = 0;
+
+    // the instance is tried last until then
+    std::chrono::steady_clock::time_point retry_after;
+  };
+
+  // pooled connections by host:port; replicasets are refreshed in parallel
+  std::map<std::string, PooledConnection> connections_;
+  std::mutex connections_mtx_;
+
+  // idle connections of wait_for_gtids() by host:port; taken out while used
+  std::multimap<std::string, std::shared_ptr<mysqlrouter::MySQLSession>> gtid_connections_;
+  std::mutex gtid_connections_mtx_;
+
+  // signature of the topology returned by the last fetch_instances(); empty
+  // if unknown or if it doesn't cover all replicasets
+  std::string topology_signature_;
+
+  // signature read by the last topology_changed(); becomes topology_signature_
+  // when the following fetch_instances() succeeds
+  std::string pending_topology_signature_;
+
+  // whether the metadata server was an online member of all replicasets in
+  // the last fetch_instances()
+  bool signature_covers_topology_ = false;
+
+  // the servers don't report the apply backlog of the members; set by the
+  // (parallel) replicaset updates
+  std::atomic<bool> member_backlog_unsupported_{false};
+
 #if 0 // not used so far
   // How many times we tried to reconnected (for logging purposes)
   size_t reconnect_tries_;
@@ -192,6 +335,11 @@ class METADATA_API ClusterMetadata : public MetaData {
   FRIEND_TEST(MetadataTest, UpdateReplicasetStatus_Status_FailQueryOnNode1);
   FRIEND_TEST(MetadataTest, UpdateReplicasetStatus_Status_FailQueryOnAllNodes);
   FRIEND_TEST(MetadataTest, UpdateReplicasetStatus_SimpleSunnyDayScenario);
+  FRIEND_TEST(MetadataTest, UpdateReplicasetStatus_ConnectsAheadAfterUnreachableNode);
+  FRIEND_TEST(MetadataTest, UpdateReplicasetStatus_DeadlinePassed);
+  FRIEND_TEST(MetadataTest, UpdateReplicasetStatus_ReusesConnections);
+  FRIEND_TEST(MetadataTest, UpdateReplicasetStatus_BackoffAfterFailedConnect);
+  FRIEND_TEST(MetadataTest, UpdateReplicasetStatus_ApplyBacklog);
 #endif
 };
 
@@ -0,0 +1,546 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "gr_notifications.h"
+#include "common.h"
+#include "logger.h"
+#include "mysqlrouter/sha1.h"
+
+#include "mysqlx.pb.h"
+#include "mysqlx_datatypes.pb.h"
+#include "mysqlx_notice.pb.h"
+#include "mysqlx_session.pb.h"
+#include "mysqlx_sql.pb.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#  include <winsock2.h>
+#  include <ws2tcpip.h>
+#else
+#  include <fcntl.h>
+#  include <netdb.h>
+#  include <netinet/in.h>
+#  include <netinet/tcp.h>
+#  include <poll.h>
+#  include <sys/socket.h>
+#  include <sys/time.h>
+#  include <unistd.h>
+#endif
+
+namespace {
+
+// 4 bytes payload size (including the type byte) and 1 byte message type
+constexpr size_t kHeaderSize = 5;
+
+// the messages we get are small, anything bigger than this is garbage
+constexpr uint32_t kMaxMessageSize = 1024 * 1024;
+
+// Mysqlx.Notice.Frame.type of GroupReplicationStateChanged
+constexpr uint32_t kFrameGroupReplicationStateChanged = 4;
+
+const char *const kNoticeName = "group_replication_state_changed";
+
+// for connecting and for every read while handshaking
+const std::chrono::milliseconds kConnectTimeout(2000);
+
+// how often opening missing sessions is retried
+const std::chrono::milliseconds kReconnectInterval(1000);
+
+#ifdef _WIN32
+int socket_errno() {
+  return WSAGetLastError();
+}
+
+void close_socket(int fd) {
+  closesocket(static_cast<SOCKET>(fd));
+}
+
+int poll_fds(struct pollfd *fds, size_t count, int timeout_ms) {
+  return WSAPoll(fds, static_cast<ULONG>(count), timeout_ms);
+}
+
+void set_blocking(int fd, bool blocking) {
+  u_long non_blocking = blocking ? 0 : 1;
+  ioctlsocket(static_cast<SOCKET>(fd), FIONBIO, &non_blocking);
+}
+
+void set_receive_timeout(int fd, std::chrono::milliseconds timeout) {
+  DWORD ms = static_cast<DWORD>(timeout.count());
+  setsockopt(static_cast<SOCKET>(fd), SOL_SOCKET, SO_RCVTIMEO,
+             reinterpret_cast<const char*>(&ms), sizeof(ms));
+}
+#else
+int socket_errno() {
+  return errno;
+}
+
+void close_socket(int fd) {
+  ::close(fd);
+}
+
+int poll_fds(struct pollfd *fds, size_t count, int timeout_ms) {
+  return ::poll(fds, static_cast<nfds_t>(count), timeout_ms);
+}
+
+void set_blocking(int fd, bool blocking) {
+  const int flags = fcntl(fd, F_GETFL);
+  fcntl(fd, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+}
+
+void set_receive_timeout(int fd, std::chrono::milliseconds timeout) {
+  struct timeval tv;
+  tv.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+  tv.tv_usec = static_cast<suseconds_t>((timeout.count() % 1000) * 1000);
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+#endif
+
+std::runtime_error socket_error(const std::string &what) {
+  return std::runtime_error(what + ": " + mysql_harness::get_strerror(socket_errno()));
+}
+
+// MYSQL41 response to the challenge:
+// '*' + hex(SHA1(password) XOR SHA1(salt + SHA1(SHA1(password))))
+std::string mysql41_scramble(const std::string &salt, const std::string &password) {
+  uint8_t stage1[SHA1_HASH_SIZE];
+  uint8_t stage2[SHA1_HASH_SIZE];
+  uint8_t hash[SHA1_HASH_SIZE];
+
+  my_sha1::compute_sha1_hash(stage1, password.data(), password.size());
+  my_sha1::compute_sha1_hash(stage2, reinterpret_cast<const char*>(stage1), SHA1_HASH_SIZE);
+  my_sha1::compute_sha1_hash_multi(hash, salt.data(), static_cast<int>(salt.size()),
+                                   reinterpret_cast<const char*>(stage2), SHA1_HASH_SIZE);
+
+  static const char kHexDigits[] = "0123456789ABCDEF";
+  std::string result("*");
+  for (size_t i = 0; i < SHA1_HASH_SIZE; ++i) {
+    const uint8_t c = static_cast<uint8_t>(hash[i] ^ stage1[i]);
+    result += kHexDigits[c >> 4];
+    result += kHexDigits[c & 0x0f];
+  }
+  return result;
+}
+
+} // namespace
+
+/** @class GRNotificationListener::XSession
+ *
+ * X protocol session with the GR state change notice enabled. Only does
+ * what is needed for that: MYSQL41 authentication (works without TLS),
+ * enabling the notice and reading messages.
+ */
+class GRNotificationListener::XSession {
+public:
+  /** @brief Connects, authenticates and enables the notice
+   *
+   * @throws std::runtime_error on any failure
+   */
+  XSession(const mysqlrouter::TCPAddress &address,
+           const std::string &user, const std::string &password)
+      : address_(address), fd_(-1) {
+    connect();
+    try {
+      authenticate(user, password);
+      enable_notice();
+    } catch (...) {
+      close_socket(fd_);
+      throw;
+    }
+  }
+
+  ~XSession() {
+    close_socket(fd_);
+  }
+
+  XSession(const XSession&) = delete;
+  XSession& operator=(const XSession&) = delete;
+
+  const mysqlrouter::TCPAddress &address() const { return address_; }
+
+  int fd() const { return fd_; }
+
+  /** @brief Reads one message, to be called when fd() is readable
+   *
+   * @return true if it was a GR state change notice
+   * @throws std::runtime_error if the connection got closed or broken
+   */
+  bool read_notice() {
+    std::string payload;
+    const uint8_t type = read_message(payload);
+    if (type == Mysqlx::ServerMessages::ERROR) {
+      // e.g. the server closes idle sessions with a fatal error
+      throw error_from(payload);
+    }
+    if (type != Mysqlx::ServerMessages::NOTICE) {
+      return false;
+    }
+
+    Mysqlx::Notice::Frame frame;
+    if (!frame.ParseFromString(payload) ||
+        frame.type() != kFrameGroupReplicationStateChanged) {
+      return false;
+    }
+
+    Mysqlx::Notice::GroupReplicationStateChanged change;
+    if (change.ParseFromString(frame.payload())) {
+      log_module_debug(LOG_MODULE_METADATA_CACHE, "GR state change notice from %s (type %u, view '%s')",
+                       address_.str().c_str(), change.type(), change.view_id().c_str());
+    }
+    return true;
+  }
+
+private:
+  void connect() {
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *servinfo = nullptr;
+    const int err = getaddrinfo(address_.addr.c_str(), std::to_string(address_.port).c_str(),
+                                &hints, &servinfo);
+    if (err != 0) {
+      throw std::runtime_error("resolving " + address_.addr + " failed: " + gai_strerror(err));
+    }
+    std::shared_ptr<void> exit_guard(nullptr, [servinfo](void*) { freeaddrinfo(servinfo); });
+
+    std::string error("no address");
+    for (struct addrinfo *info = servinfo; info != nullptr; info = info->ai_next) {
+      int fd = static_cast<int>(::socket(info->ai_family, info->ai_socktype, info->ai_protocol));
+      if (fd < 0) {
+        error = socket_error("socket() failed").what();
+        continue;
+      }
+
+      if (connect_with_timeout(fd, info->ai_addr, static_cast<socklen_t>(info->ai_addrlen), error)) {
+        set_receive_timeout(fd, kConnectTimeout);
+        int opt_nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
+                   reinterpret_cast<const char*>(&opt_nodelay), sizeof(opt_nodelay));
+        fd_ = fd;
+        return;
+      }
+      close_socket(fd);
+    }
+    throw std::runtime_error("connecting failed: " + error);
+  }
+
+  static bool connect_with_timeout(int fd, const struct sockaddr *addr, socklen_t addr_len,
+                                   std::string &error) {
+    set_blocking(fd, false);
+    if (::connect(fd, addr, addr_len) < 0) {
+      const int err = socket_errno();
+#ifdef _WIN32
+      const bool in_progress = (err == WSAEWOULDBLOCK || err == WSAEINPROGRESS);
+#else
+      const bool in_progress = (err == EINPROGRESS);
+#endif
+      if (!in_progress) {
+        error = mysql_harness::get_strerror(err);
+        return false;
+      }
+
+      struct pollfd fds[] = {
+        { fd, POLLOUT, 0 },
+      };
+      const int res = poll_fds(fds, 1, static_cast<int>(kConnectTimeout.count()));
+      if (res <= 0) {
+        error = res == 0 ? "timeout" : mysql_harness::get_strerror(socket_errno());
+        return false;
+      }
+
+      int so_error = 0;
+      socklen_t so_error_len = static_cast<socklen_t>(sizeof(so_error));
+      if (getsockopt(fd, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&so_error), &so_error_len) != 0 ||
+          so_error != 0) {
+        error = mysql_harness::get_strerror(so_error ? so_error : socket_errno());
+        return false;
+      }
+    }
+    set_blocking(fd, true);
+    return true;
+  }
+
+  void authenticate(const std::string &user, const std::string &password) {
+    Mysqlx::Session::AuthenticateStart start;
+    start.set_mech_name("MYSQL41");
+    send_message(Mysqlx::ClientMessages::SESS_AUTHENTICATE_START, start);
+
+    Mysqlx::Session::AuthenticateContinue challenge;
+    challenge.ParseFromString(expect(Mysqlx::ServerMessages::SESS_AUTHENTICATE_CONTINUE));
+
+    // schema (none), user and scrambled password, separated by \0
+    std::string auth_data;
+    auth_data += '\0';
+    auth_data += user;
+    auth_data += '\0';
+    if (!password.empty()) {
+      auth_data += mysql41_scramble(challenge.auth_data(), password);
+    }
+    Mysqlx::Session::AuthenticateContinue response;
+    response.set_auth_data(auth_data);
+    send_message(Mysqlx::ClientMessages::SESS_AUTHENTICATE_CONTINUE, response);
+
+    expect(Mysqlx::ServerMessages::SESS_AUTHENTICATE_OK);
+  }
+
+  void enable_notice() {
+    // mysqlx.enable_notices({"notice": ["group_replication_state_changed"]})
+    Mysqlx::Sql::StmtExecute stmt;
+    stmt.set_namespace_("mysqlx");
+    stmt.set_stmt("enable_notices");
+
+    Mysqlx::Datatypes::Any *arg = stmt.add_args();
+    arg->set_type(Mysqlx::Datatypes::Any::OBJECT);
+    Mysqlx::Datatypes::Object::ObjectField *field = arg->mutable_obj()->add_fld();
+    field->set_key("notice");
+    field->mutable_value()->set_type(Mysqlx::Datatypes::Any::ARRAY);
+    Mysqlx::Datatypes::Any *name = field->mutable_value()->mutable_array()->add_value();
+    name->set_type(Mysqlx::Datatypes::Any::SCALAR);
+    name->mutable_scalar()->set_type(Mysqlx::Datatypes::Scalar::V_STRING);
+    name->mutable_scalar()->mutable_v_string()->set_value(kNoticeName);
+
+    send_message(Mysqlx::ClientMessages::SQL_STMT_EXECUTE, stmt);
+    expect(Mysqlx::ServerMessages::SQL_STMT_EXECUTE_OK);
+  }
+
+  // reads until a message of the given type arrives, skipping notices and
+  // resultsets; throws on Mysqlx.Error
+  std::string expect(uint8_t expected_type) {
+    std::string payload;
+    for (;;) {
+      const uint8_t type = read_message(payload);
+      if (type == expected_type) {
+        return payload;
+      }
+      if (type == Mysqlx::ServerMessages::ERROR) {
+        throw error_from(payload);
+      }
+    }
+  }
+
+  static std::runtime_error error_from(const std::string &payload) {
+    Mysqlx::Error error;
+    if (!error.ParseFromString(payload)) {
+      return std::runtime_error("server sent an invalid error message");
+    }
+    return std::runtime_error(error.msg() + " (" + std::to_string(error.code()) + ")");
+  }
+
+  void send_message(uint8_t type, const google::protobuf::MessageLite &msg) {
+    const std::string payload = msg.SerializeAsString();
+    const uint32_t size = static_cast<uint32_t>(payload.size() + 1);
+
+    std::string buffer(kHeaderSize, '\0');
+    for (size_t i = 0; i < 4; ++i) {
+      buffer[i] = static_cast<char>((size >> (8 * i)) & 0xff);
+    }
+    buffer[4] = static_cast<char>(type);
+    buffer += payload;
+
+    size_t sent = 0;
+    while (sent < buffer.size()) {
+      const auto res = ::send(fd_, buffer.data() + sent, static_cast<int>(buffer.size() - sent), 0);
+      if (res < 0) {
+        if (socket_errno() == EINTR) continue;
+        throw socket_error("send() failed");
+      }
+      sent += static_cast<size_t>(res);
+    }
+  }
+
+  uint8_t read_message(std::string &payload) {
+    uint8_t header[kHeaderSize];
+    read_all(reinterpret_cast<char*>(header), kHeaderSize);
+
+    const uint32_t size = static_cast<uint32_t>(header[0]) |
+                          static_cast<uint32_t>(header[1]) << 8 |
+                          static_cast<uint32_t>(header[2]) << 16 |
+                          static_cast<uint32_t>(header[3]) << 24;
+    if (size < 1 || size > kMaxMessageSize) {
+      throw std::runtime_error("invalid message size " + std::to_string(size));
+    }
+
+    payload.resize(size - 1);
+    if (!payload.empty()) {
+      read_all(&payload[0], payload.size());
+    }
+    return header[4];
+  }
+
+  void read_all(char *buffer, size_t length) {
+    size_t received = 0;
+    while (received < length) {
+      const auto res = ::recv(fd_, buffer + received, static_cast<int>(length - received), 0);
+      if (res == 0) {
+        throw std::runtime_error("connection closed by the server");
+      }
+      if (res < 0) {
+        if (socket_errno() == EINTR) continue;
+        throw socket_error("recv() failed");
+      }
+      received += static_cast<size_t>(res);
+    }
+  }
+
+  const mysqlrouter::TCPAddress address_;
+  int fd_;
+};
+
+GRNotificationListener::GRNotificationListener(const std::string &user,
+                                               const std::string &password)
+    : user_(user), password_(password) {
+}
+
+GRNotificationListener::~GRNotificationListener() {
+  stop();
+}
+
+void GRNotificationListener::start(NotificationCallback callback) {
+  callback_ = std::move(callback);
+  terminate_.reset();
+  thread_ = std::thread(&GRNotificationListener::run, this);
+}
+
+void GRNotificationListener::stop() {
+  terminate_.cancel();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void GRNotificationListener::set_topology(const metadata_cache::Topology &topology) {
+  MembersByReplicaset members;
+  for (const auto &rs : topology.replicasets) {
+    auto &addresses = members[rs.first];
+    for (const auto &mi : rs.second.members) {
+      if (mi.mode != metadata_cache::ServerMode::Unavailable && mi.xport != 0) {
+        addresses.push_back(mysqlrouter::TCPAddress(mi.host, mi.xport));
+      }
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(members_mtx_);
+    if (members == members_) {
+      return;
+    }
+    members_ = std::move(members);
+  }
+  members_changed_.cancel();
+}
+
+bool GRNotificationListener::update_sessions() {
+  MembersByReplicaset members;
+  {
+    std::lock_guard<std::mutex> lock(members_mtx_);
+    members = members_;
+  }
+
+  for (auto it = sessions_.begin(); it != sessions_.end();) {
+    auto rs = members.find(it->first);
+    if (rs == members.end() ||
+        std::find(rs->second.begin(), rs->second.end(), it->second->address()) == rs->second.end()) {
+      it = sessions_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  bool complete = true;
+  for (const auto &rs : members) {
+    if (sessions_.count(rs.first) > 0) {
+      continue;
+    }
+    for (const auto &address : rs.second) {
+      if (terminate_.is_cancelled()) {
+        return false;
+      }
+      try {
+        sessions_[rs.first].reset(new XSession(address, user_, password_));
+        failed_members_.erase(address.str());
+        log_info("Listening for GR notices of replicaset '%s' on %s",
+                 rs.first.c_str(), address.str().c_str());
+        break;
+      } catch (const std::exception &exc) {
+        sessions_.erase(rs.first);
+        if (failed_members_.insert(address.str()).second) {
+          log_warning("Failed enabling GR notices on %s: %s",
+                      address.str().c_str(), exc.what());
+        }
+      }
+    }
+    if (sessions_.count(rs.first) == 0) {
+      complete = false;
+    }
+  }
+  return complete;
+}
+
+void GRNotificationListener::run() {
+  mysql_harness::rename_thread("GR Notices");
+
+  std::vector<struct pollfd> fds;
+  std::vector<std::string> replicasets;
+  while (!terminate_.is_cancelled()) {
+    members_changed_.reset();
+    const bool complete = update_sessions();
+
+    fds.clear();
+    replicasets.clear();
+    fds.push_back({ terminate_.native_handle(), POLLIN, 0 });
+    fds.push_back({ members_changed_.native_handle(), POLLIN, 0 });
+    for (const auto &session : sessions_) {
+      fds.push_back({ session.second->fd(), POLLIN, 0 });
+      replicasets.push_back(session.first);
+    }
+
+    const int timeout_ms = complete ? -1 : static_cast<int>(kReconnectInterval.count());
+    if (poll_fds(fds.data(), fds.size(), timeout_ms) <= 0) {
+      continue;
+    }
+
+    for (size_t i = 2; i < fds.size(); ++i) {
+      if (fds[i].revents == 0) {
+        continue;
+      }
+      const std::string &replicaset = replicasets[i - 2];
+      bool notify;
+      try {
+        notify = sessions_[replicaset]->read_notice();
+      } catch (const std::exception &exc) {
+        // most likely the member went away: let the cache check
+        log_warning("Lost GR notices session of replicaset '%s' to %s: %s",
+                    replicaset.c_str(), sessions_[replicaset]->address().str().c_str(), exc.what());
+        sessions_.erase(replicaset);
+        notify = true;
+      }
+      if (notify) {
+        callback_(replicaset);
+      }
+    }
+  }
+
+  sessions_.clear();
+}
@@ -0,0 +1,116 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef METADATA_CACHE_GR_NOTIFICATIONS_INCLUDED
+#define METADATA_CACHE_GR_NOTIFICATIONS_INCLUDED
+
+#include "mysqlrouter/metadata_cache.h"
+#include "cancellation_event.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** @class GRNotificationListener
+ * @brief Listens for Group Replication state change notices
+ *
+ * Keeps an X protocol session to one member of each replicaset, with the
+ * group_replication_state_changed notice enabled. The members push that
+ * notice when the group view, the primary or the state of a member changes;
+ * the listener then calls the callback with the name of the replicaset, so
+ * that the metadata cache can refresh right away instead of after the TTL.
+ *
+ * Losing the session to a member is reported the same way, as most likely
+ * the member went down.
+ *
+ * Needs MySQL Server 8.0 with the X plugin on the members. Members which
+ * don't support the notice are just skipped; the cache falls back to
+ * refreshing every TTL.
+ */
+class METADATA_API GRNotificationListener {
+public:
+  using NotificationCallback = std::function<void(const std::string &replicaset_name)>;
+
+  /** @brief Constructor
+   *
+   * @param user user to authenticate the X protocol sessions with
+   * @param password password of the user
+   */
+  GRNotificationListener(const std::string &user, const std::string &password);
+
+  /** @brief Destructor; stops the listener thread */
+  ~GRNotificationListener();
+
+  GRNotificationListener(const GRNotificationListener&) = delete;
+  GRNotificationListener& operator=(const GRNotificationListener&) = delete;
+
+  /** @brief Starts the listener thread
+   *
+   * @param callback called from the listener thread for every notice, with
+   *        the name of the replicaset the notice is about
+   */
+  void start(NotificationCallback callback);
+
+  /** @brief Stops and joins the listener thread, closes the sessions */
+  void stop();
+
+  /** @brief Sets the members the sessions are opened to
+   *
+   * Called whenever the cache published a new topology. Members which are
+   * not Unavailable are candidates; sessions to members which aren't
+   * anymore get closed.
+   *
+   * @param topology the topology snapshot
+   */
+  void set_topology(const metadata_cache::Topology &topology);
+
+private:
+  class XSession;
+
+  using MembersByReplicaset = std::map<std::string, std::vector<mysqlrouter::TCPAddress>>;
+
+  void run();
+
+  // closes the sessions to members which are gone, opens the missing ones;
+  // returns false if some replicaset still has no session
+  bool update_sessions();
+
+  const std::string user_;
+  const std::string password_;
+  NotificationCallback callback_;
+
+  // set by set_topology(), read by the listener thread
+  MembersByReplicaset members_;
+  std::mutex members_mtx_;
+
+  // owned by the listener thread
+  std::map<std::string, std::unique_ptr<XSession>> sessions_;
+  // members we failed to open a session to, to warn only once
+  std::set<std::string> failed_members_;
+
+  mysql_harness::CancellationEvent terminate_;
+  // signaled by set_topology() if the members changed
+  mysql_harness::CancellationEvent members_changed_;
+  std::thread thread_;
+};
+
+#endif // METADATA_CACHE_GR_NOTIFICATIONS_INCLUDED
@@ -177,3 +177,33 @@ std::map<std::string, GroupReplicationMember> fetch_group_replication_members(
 
   return members;
 }
+
+// throws metadata_cache::metadata_error
+std::map<std::string, uint64_t> fetch_group_replication_member_backlog(
+    MySQLSession& connection) {
+
+  std::map<std::string, uint64_t> backlog;
+
+  auto result_processor = [&backlog](const MySQLSession::Row& row) -> bool {
+    if (row.size() != 2) {
+      throw metadata_cache::metadata_error("Unexpected number of fields in resultset from group_replication query. "
+                                           "Expected = 2, got = " + std::to_string(row.size()));
+    }
+
+    // a member which didn't report its stats yet shows NULL
+    if (row[0] && row[1]) {
+      backlog[row[0]] = std::strtoull(row[1], nullptr, 10);
+    }
+    return true;
+  };
+
+  // errors are passed on with their code, the caller needs to tell an
+  // older server from a failing one
+  connection.query(
+    "SELECT member_id, count_transactions_remote_in_applier_queue"
+    " FROM performance_schema.replication_group_member_stats"
+    " WHERE channel_name = 'group_replication_applier'",
+    result_processor);
+
+  return backlog;
+}
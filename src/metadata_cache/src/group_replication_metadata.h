@@ -18,6 +18,7 @@
 #ifndef GROUP_REPLICATION_METADATA_INCLUDED
 #define GROUP_REPLICATION_METADATA_INCLUDED
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <map>
@@ -52,4 +53,15 @@ struct GroupReplicationMember {
 std::map<std::string, GroupReplicationMember>
 fetch_group_replication_members(mysqlrouter::MySQLSession& connection, bool &single_master);
 
+/** Fetches the number of transactions each member of the group received but
+ * didn't apply yet, as known to the instance of the given connection.
+ *
+ * Needs MySQL 8.0, older servers don't report it for the other members and
+ * fail the query with ER_BAD_FIELD_ERROR (1054).
+ *
+ * throws metadata_cache::metadata_error, MySQLSession::Error
+ */
+std::map<std::string, uint64_t>
+fetch_group_replication_member_backlog(mysqlrouter::MySQLSession& connection);
+
 #endif
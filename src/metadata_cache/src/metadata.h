@@ -20,6 +20,7 @@
 
 #include "mysqlrouter/metadata_cache.h"
 
+#include <chrono>
 #include <vector>
 #include <map>
 #include <string>
@@ -37,6 +38,26 @@ public:
 #endif
   virtual ReplicaSetsByName fetch_instances(const std::string &cluster_name) = 0;
 
+  /** @brief Returns false if the result of the last fetch_instances() is
+   * known to be still current
+   *
+   * Implementations which can't tell cheaply return true, so that the
+   * topology gets fetched on every refresh.
+   */
+  virtual bool topology_changed(const std::string &/*cluster_name*/) {
+    return true;
+  }
+
+  /** @brief Waits until an instance applied the given GTIDs
+   *
+   * Implementations which can't ask the instances return false.
+   */
+  virtual bool wait_for_gtids(const metadata_cache::ManagedInstance &/*instance*/,
+                              const std::string &/*gtids*/,
+                              std::chrono::milliseconds /*timeout*/) {
+    return false;
+  }
+
   virtual bool connect(const std::vector<metadata_cache::ManagedInstance>
                        & metadata_servers) = 0;
   virtual void disconnect() = 0;
@@ -18,10 +18,21 @@
 #include "common.h"
 #include "metadata_cache.h"
 
+#include <algorithm>
 #include <cassert>
+#include <map>
 #include <vector>
 #include <memory>
-#include <cmath>  // fabs()
+#include <cmath>  // fabs(), fmod()
+
+// while a replicaset has no primary, the refresh interval starts at this and
+// doubles up to kMaxFailoverRefreshInterval
+static const std::chrono::milliseconds kMinFailoverRefreshInterval(100);
+static const std::chrono::milliseconds kMaxFailoverRefreshInterval(1000);
+
+// an unchanged topology is saved again after this, to keep the time it was
+// last confirmed in the file up to date
+static const std::chrono::seconds kTopologyFileResaveInterval(60);
 
 /**
  * Initialize a connection to the MySQL Metadata server.
@@ -31,13 +42,27 @@
  * @param ttl The TTL of the cached data.
  * @param ssl_options SSL related options for connection
  * @param cluster The name of the desired cluster in the metadata server
+ * @param gr_notifications listener for GR state change notices, or nullptr
+ * @param topology_file file to save the topology in and to load it from at
+ *                      startup, or empty
+ * @param max_topology_staleness for how long a topology not confirmed by the
+ *                               metadata servers is used
+ * @param refresh_schedule staggers the refreshes of the routers of a fleet
  */
 MetadataCache::MetadataCache(
   const std::vector<mysqlrouter::TCPAddress> &bootstrap_servers,
   std::shared_ptr<MetaData> cluster_metadata, // this could be changed to UniquePtr
   unsigned int ttl,
   const mysqlrouter::SSLOptions &ssl_options,
-  const std::string &cluster) {
+  const std::string &cluster,
+  std::unique_ptr<GRNotificationListener> gr_notifications,
+  const std::string &topology_file,
+  std::chrono::seconds max_topology_staleness,
+  const RefreshSchedule &refresh_schedule)
+    : gr_notifications_(std::move(gr_notifications)),
+      max_topology_staleness_(max_topology_staleness),
+      refresh_schedule_(refresh_schedule),
+      random_(std::random_device()()) {
   std::string host;
   for (auto s : bootstrap_servers) {
     metadata_cache::ManagedInstance bootstrap_server_instance;
@@ -48,10 +73,18 @@ MetadataCache::MetadataCache(
   }
   ttl_ = ttl;
   cluster_name_ = cluster;
-  terminate_ = false;
   meta_data_ = cluster_metadata;
   ssl_options_ = ssl_options;
-  refresh();
+  topology_ = std::make_shared<metadata_cache::Topology>();
+  if (!topology_file.empty()) {
+    topology_file_.reset(new TopologyFile(topology_file));
+  }
+
+  // with a saved topology, start routing right away; the refresh thread
+  // replaces it as soon as the metadata servers respond
+  if (!load_topology()) {
+    refresh();
+  }
 }
 
 /**
@@ -69,32 +102,90 @@ void MetadataCache::start() {
   auto refresh_loop = [this] {
     mysql_harness::rename_thread("MDC Refresh");
 
-    while (!terminate_) {
+    auto failover_refresh_interval = kMinFailoverRefreshInterval;
+    bool phase_pending = refresh_schedule_.phase_offset.count() > 0;
+    while (!terminate_.is_cancelled()) {
       refresh();
+      const auto refreshed_at = std::chrono::steady_clock::now();
 
-      // wait for up to TTL until next refresh, unless some replicaset
-      // loses the primary server.. in that case, we refresh every 1s
-      // until we detect a new one was elected
-      unsigned int seconds_waited = 0;
-      while (seconds_waited < ttl_) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-        seconds_waited++;
-        {
-          std::lock_guard<std::mutex> lock(lost_primary_replicasets_mutex_);
-          if (!lost_primary_replicasets_.empty())
-            break;
+      std::unique_lock<std::mutex> lock(lost_primary_replicasets_mutex_);
+      if (!lost_primary_replicasets_.empty()) {
+        // some replicaset lost its primary server: refresh often (backing
+        // off from 100ms to 1s) until we detect that a new one was elected
+        lost_primary_cond_.wait_for(lock, failover_refresh_interval, [this] {
+          return terminate_.is_cancelled() || gr_state_changed_;
+        });
+        failover_refresh_interval = std::min(failover_refresh_interval * 2, kMaxFailoverRefreshInterval);
+      } else {
+        // wait for up to TTL until next refresh, unless some replicaset
+        // loses the primary server or a GR notice arrives; the first wait
+        // only lasts until the router's phase offset
+        failover_refresh_interval = kMinFailoverRefreshInterval;
+        const auto wait = phase_pending ? refresh_schedule_.phase_offset : next_refresh_wait();
+        phase_pending = false;
+        lost_primary_cond_.wait_until(lock, refreshed_at + wait, [this] {
+          return terminate_.is_cancelled() || !lost_primary_replicasets_.empty() ||
+                 gr_state_changed_;
+        });
+        // GR notices reach all routers of a fleet at once: keep to the
+        // refresh budget, unless a primary gets lost meanwhile
+        if (gr_state_changed_) {
+          lost_primary_cond_.wait_until(lock, refreshed_at + refresh_schedule_.min_interval, [this] {
+            return terminate_.is_cancelled() || !lost_primary_replicasets_.empty();
+          });
         }
       }
     }
   };
+
+  if (gr_notifications_) {
+    // a notice makes the refresh thread refresh right away
+    gr_notifications_->start([this](const std::string &replicaset_name) {
+      log_module_debug(LOG_MODULE_METADATA_CACHE, "GR state of replicaset '%s' changed, refreshing",
+                       replicaset_name.c_str());
+      std::lock_guard<std::mutex> lock(lost_primary_replicasets_mutex_);
+      gr_state_changed_ = true;
+      lost_primary_cond_.notify_all();
+    });
+  }
   refresh_thread_ = std::thread(refresh_loop);
 }
 
+std::chrono::milliseconds MetadataCache::next_refresh_wait() {
+  std::chrono::milliseconds wait = std::chrono::seconds(ttl_);
+  if (refresh_schedule_.jitter > 0) {
+    const auto spread = wait.count() * refresh_schedule_.jitter / 100;
+    std::uniform_int_distribution<std::chrono::milliseconds::rep> distribution(-spread, spread);
+    wait += std::chrono::milliseconds(distribution(random_));
+  }
+  return std::max(wait, refresh_schedule_.min_interval);
+}
+
+std::chrono::milliseconds refresh_phase_offset(uint32_t router_id, std::chrono::milliseconds period) {
+  if (period.count() <= 0) {
+    return std::chrono::milliseconds(0);
+  }
+  // the fractional parts of the multiples of the golden ratio are spread
+  // evenly over [0, 1), for any number of routers
+  const double kGoldenRatioConjugate = 0.6180339887498949;
+  const double fraction = std::fmod(router_id * kGoldenRatioConjugate, 1.0);
+  return std::chrono::milliseconds(
+    static_cast<std::chrono::milliseconds::rep>(fraction * static_cast<double>(period.count())));
+}
+
 /**
  * Stop the refresh thread.
  */
 void MetadataCache::stop() {
-  terminate_ = true;
+  if (gr_notifications_) {
+    gr_notifications_->stop();
+  }
+  terminate_.cancel();
+  {
+    // the refresh thread and waiters check terminate_ with the mutex held
+    std::lock_guard<std::mutex> lock(lost_primary_replicasets_mutex_);
+  }
+  lost_primary_cond_.notify_all();
   if (refresh_thread_.joinable()) {
     refresh_thread_.join();
   }
@@ -107,14 +198,102 @@ void MetadataCache::stop() {
  */
 std::vector<metadata_cache::ManagedInstance> MetadataCache::replicaset_lookup(
   const std::string &replicaset_name) {
-  std::lock_guard<std::mutex> lock(cache_refreshing_mutex_);
-  auto replicaset = replicaset_data_.find(replicaset_name);
+  return lookup(replicaset_name).instance_vector;
+}
+
+metadata_cache::LookupResult MetadataCache::lookup(const std::string &replicaset_name) {
+  static const std::vector<metadata_cache::ManagedInstance> no_instances;
 
-  if (replicaset == replicaset_data_.end()) {
+  auto snapshot = topology();
+  auto replicaset = snapshot->replicasets.find(replicaset_name);
+  if (replicaset == snapshot->replicasets.end()) {
     log_warning("Replicaset '%s' not available", replicaset_name.c_str());
-    return {};
+    return metadata_cache::LookupResult(snapshot, no_instances);
+  }
+  const auto &members = replicaset->second.members;
+  return metadata_cache::LookupResult(std::move(snapshot), members);
+}
+
+// differences between the replicasets of two snapshots; instances are
+// matched by their uuid
+static std::vector<metadata_cache::TopologyChange> diff_topology(
+    const MetaData::ReplicaSetsByName &old_replicasets,
+    const MetaData::ReplicaSetsByName &new_replicasets) {
+  using metadata_cache::TopologyChange;
+
+  std::map<std::string, const metadata_cache::ManagedInstance*> old_instances;
+  for (const auto &rs : old_replicasets) {
+    for (const auto &mi : rs.second.members) {
+      old_instances[mi.mysql_server_uuid] = &mi;
+    }
   }
-  return replicaset_data_[replicaset_name].members;
+
+  std::vector<TopologyChange> changes;
+  for (const auto &rs : new_replicasets) {
+    for (const auto &mi : rs.second.members) {
+      auto it = old_instances.find(mi.mysql_server_uuid);
+      if (it == old_instances.end()) {
+        changes.push_back(TopologyChange{TopologyChange::Type::InstanceAdded, mi, mi.mode});
+        continue;
+      }
+
+      const metadata_cache::ManagedInstance &old = *it->second;
+      if (old.replicaset_name != mi.replicaset_name || old.host != mi.host ||
+          old.port != mi.port || old.xport != mi.xport) {
+        // moved: for listeners it's a different server
+        changes.push_back(TopologyChange{TopologyChange::Type::InstanceRemoved, old, old.mode});
+        changes.push_back(TopologyChange{TopologyChange::Type::InstanceAdded, mi, mi.mode});
+      } else if (old.mode != mi.mode) {
+        changes.push_back(TopologyChange{TopologyChange::Type::ModeChanged, mi, old.mode});
+      }
+      old_instances.erase(it);
+    }
+  }
+  for (const auto &it : old_instances) {
+    changes.push_back(TopologyChange{TopologyChange::Type::InstanceRemoved, *it.second, it.second->mode});
+  }
+
+  return changes;
+}
+
+void MetadataCache::publish(MetaData::ReplicaSetsByName replicasets, bool stale) {
+  auto old_snapshot = topology();
+  auto snapshot = std::make_shared<metadata_cache::Topology>();
+  snapshot->generation = old_snapshot->generation + 1;
+  snapshot->replicasets = std::move(replicasets);
+  snapshot->stale = stale;
+  std::shared_ptr<const metadata_cache::Topology> published(std::move(snapshot));
+  std::atomic_store(&topology_, published);
+
+  if (gr_notifications_) {
+    gr_notifications_->set_topology(*published);
+  }
+
+  std::lock_guard<std::mutex> lock(listeners_mutex_);
+  if (listeners_.empty()) {
+    return;
+  }
+  auto changes = diff_topology(old_snapshot->replicasets, published->replicasets);
+  if (changes.empty()) {
+    return;
+  }
+  for (auto listener : listeners_) {
+    try {
+      listener->topology_changed(published, changes);
+    } catch (const std::exception &exc) {
+      log_error("Failed notifying about topology change: %s", exc.what());
+    }
+  }
+}
+
+void MetadataCache::add_listener(metadata_cache::TopologyListener *listener) {
+  std::lock_guard<std::mutex> lock(listeners_mutex_);
+  listeners_.push_back(listener);
+}
+
+void MetadataCache::remove_listener(metadata_cache::TopologyListener *listener) noexcept {
+  std::lock_guard<std::mutex> lock(listeners_mutex_);
+  listeners_.erase(std::remove(listeners_.begin(), listeners_.end(), listener), listeners_.end());
 }
 
 bool metadata_cache::ManagedInstance::operator==(const ManagedInstance& other) const {
@@ -149,6 +328,21 @@ inline bool compare_instance_lists(const MetaData::ReplicaSetsByName &map_a,
   return true;
 }
 
+// compares the apply backlog of the members of lists compare_instance_lists()
+// found equal
+inline bool compare_apply_backlog(const MetaData::ReplicaSetsByName &map_a,
+                                  const MetaData::ReplicaSetsByName &map_b) {
+  auto bi = map_b.begin();
+  for (auto ai = map_a.begin(); ai != map_a.end(); ++ai, ++bi) {
+    auto b = bi->second.members.begin();
+    for (auto a = ai->second.members.begin(); a != ai->second.members.end(); ++a, ++b) {
+      if (a->apply_backlog != b->apply_backlog)
+        return false;
+    }
+  }
+  return true;
+}
+
 static const char *str_mode(metadata_cache::ServerMode mode) {
   switch (mode) {
     case metadata_cache::ServerMode::ReadWrite: return "RW";
@@ -170,45 +364,63 @@ void MetadataCache::refresh() {
     // TODO: connect() could really be called from inside of metadata_->fetch_instances()
     if (!meta_data_->connect(metadata_servers_)) { // metadata_servers_ come from config file
       log_error("Failed connecting to metadata servers");
-      bool clearing;
-      {
-        std::lock_guard<std::mutex> lock(cache_refreshing_mutex_);
-        clearing = !replicaset_data_.empty();
-        if (clearing)
-          replicaset_data_.clear();
+      auto snapshot = topology();
+      if (!snapshot->replicasets.empty()) {
+        const auto age = std::chrono::duration_cast<std::chrono::seconds>(
+            TopologyFile::clock_type::now() - confirmed_at_);
+        if (age < max_topology_staleness_) {
+          if (!snapshot->stale) {
+            publish(snapshot->replicasets, true);
+            log_warning("... using the last known topology for up to %lld more seconds",
+                        static_cast<long long>((max_topology_staleness_ - age).count()));
+          }
+        } else {
+          publish({});
+          log_info("... cleared current routing table as a precaution");
+        }
       }
-      if (clearing)
-        log_info("... cleared current routing table as a precaution");
       return;
     }
   }
 
   try {
+    // Skip the full fetch (which connects to every replicaset) if a cheap
+    // check tells that nothing changed. While a replicaset lost its primary,
+    // always do the full fetch until a new primary is found; same after a
+    // GR notice, the metadata server may not have seen the change yet.
+    const bool have_topology = !topology()->replicasets.empty();
+    bool full_fetch_needed;
+    {
+      std::lock_guard<std::mutex> lock(lost_primary_replicasets_mutex_);
+      full_fetch_needed = !lost_primary_replicasets_.empty() || gr_state_changed_;
+      gr_state_changed_ = false;
+    }
+    if (have_topology && !full_fetch_needed &&
+        !meta_data_->topology_changed(cluster_name_)) {
+      topology_confirmed(false);
+      return;
+    }
+
     // Fetch the metadata and store it in a temporary variable.
     std::map<std::string, metadata_cache::ManagedReplicaSet>
       replicaset_data_temp = meta_data_->fetch_instances(cluster_name_);
-    bool changed = false;
-
-    {
-      // Ensure that the refresh does not result in an inconsistency during the
-      // lookup.
-      std::lock_guard<std::mutex> lock(cache_refreshing_mutex_);
-      if (!compare_instance_lists(replicaset_data_, replicaset_data_temp)) {
-        replicaset_data_ = replicaset_data_temp;
-        changed = true;
-      }
-    }
 
+    // lookups keep using the old snapshot until the new one is published
+    const bool changed = !compare_instance_lists(topology()->replicasets, replicaset_data_temp);
     if (changed) {
+      publish(std::move(replicaset_data_temp));
+      auto snapshot = topology();
+      const auto &replicasets = snapshot->replicasets;
+
       log_info("Changes detected in cluster '%s' after metadata refresh",
           cluster_name_.c_str());
       // dump some informational/debugging information about the replicasets
-      if (replicaset_data_.empty())
+      if (replicasets.empty())
         log_error("Metadata for cluster '%s' is empty!", cluster_name_.c_str());
       else {
         log_info("Metadata for cluster '%s' has %i replicasets:",
-          cluster_name_.c_str(), (int)replicaset_data_.size());
-        for (auto &rs : replicaset_data_) {
+          cluster_name_.c_str(), (int)replicasets.size());
+        for (auto &rs : replicasets) {
           log_info("'%s' (%i members, %s)", rs.first.c_str(),
                     (int)rs.second.members.size(),
                     rs.second.single_primary_mode ? "single-master" : "multi-master");
@@ -222,17 +434,31 @@ void MetadataCache::refresh() {
               std::lock_guard<std::mutex> lock(lost_primary_replicasets_mutex_);
               auto lost_primary = lost_primary_replicasets_.find(rs.first);
               if (lost_primary != lost_primary_replicasets_.end()) {
-                log_info("Replicaset '%s' has a new Primary %s:%i [%s].",
+                const uint64_t failover_ms = static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - lost_primary->second).count());
+                log_info("Replicaset '%s' has a new Primary %s:%i [%s] (%llu ms after the old one was lost).",
                          rs.first.c_str(),
                          mi.host.c_str(), mi.port,
-                         mi.mysql_server_uuid.c_str());
+                         mi.mysql_server_uuid.c_str(),
+                         static_cast<unsigned long long>(failover_ms));
+                failover_stats_.failovers++;
+                failover_stats_.last_failover_ms = failover_ms;
+                failover_stats_.max_failover_ms = std::max(failover_stats_.max_failover_ms, failover_ms);
                 lost_primary_replicasets_.erase(lost_primary);
+                // the new snapshot is published already, wake up the waiting clients
+                lost_primary_cond_.notify_all();
               }
             }
           }
         }
       }
+    } else if (!compare_apply_backlog(topology()->replicasets, replicaset_data_temp)) {
+      // routes need to see the new backlog, but it is no change of the
+      // topology: nothing to log or save
+      publish(std::move(replicaset_data_temp), topology()->stale);
     }
+    topology_confirmed(changed);
 
     /* Not sure about this, the metadata server could be stored elsewhere
 
@@ -248,6 +474,63 @@ void MetadataCache::refresh() {
     }*/
   } catch (const std::runtime_error &exc) {
     log_error("Failed fetching metadata: %s", exc.what());
+    // the connection may be broken, get a new one on the next refresh
+    meta_data_->disconnect();
+  }
+}
+
+bool MetadataCache::load_topology() {
+  if (!topology_file_ || max_topology_staleness_.count() <= 0) {
+    return false;
+  }
+
+  MetaData::ReplicaSetsByName replicasets;
+  TopologyFile::clock_type::time_point confirmed_at;
+  try {
+    if (!topology_file_->load(cluster_name_, replicasets, confirmed_at) ||
+        replicasets.empty()) {
+      return false;
+    }
+  } catch (const std::exception &exc) {
+    log_warning("Failed loading the saved topology: %s", exc.what());
+    return false;
+  }
+
+  const auto age = std::chrono::duration_cast<std::chrono::seconds>(
+      TopologyFile::clock_type::now() - confirmed_at);
+  if (age >= max_topology_staleness_) {
+    log_info("Not using the topology saved in '%s', it is %lld seconds old",
+             topology_file_->path().c_str(), static_cast<long long>(age.count()));
+    return false;
+  }
+
+  confirmed_at_ = saved_at_ = confirmed_at;
+  publish(std::move(replicasets), true);
+  log_info("Using the topology of cluster '%s' saved %lld seconds ago until the metadata servers respond",
+           cluster_name_.c_str(), static_cast<long long>(age.count()));
+  return true;
+}
+
+void MetadataCache::topology_confirmed(bool changed) {
+  confirmed_at_ = TopologyFile::clock_type::now();
+
+  auto snapshot = topology();
+  if (snapshot->stale) {
+    publish(snapshot->replicasets);
+    log_info("Topology of cluster '%s' confirmed by the metadata servers",
+             cluster_name_.c_str());
+    changed = true;
+  }
+
+  if (!topology_file_ ||
+      (!changed && confirmed_at_ - saved_at_ < kTopologyFileResaveInterval)) {
+    return;
+  }
+  try {
+    topology_file_->save(cluster_name_, topology()->replicasets, confirmed_at_);
+    saved_at_ = confirmed_at_;
+  } catch (const std::exception &exc) {
+    log_warning("Failed saving the topology: %s", exc.what());
   }
 }
 
@@ -256,11 +539,11 @@ void MetadataCache::mark_instance_reachability(const std::string &instance_id,
   // If the status is that the primary instance is physically unreachable,
   // we temporarily increase the refresh rate to 1/s until the replicaset
   // is back to having a primary instance.
-  std::lock_guard<std::mutex> lock(cache_refreshing_mutex_);
+  auto snapshot = topology();
   // the replicaset that the given instance belongs to
-  metadata_cache::ManagedInstance *instance = nullptr;
-  metadata_cache::ManagedReplicaSet *replicaset = nullptr;
-  for (auto &rs : replicaset_data_) {
+  const metadata_cache::ManagedInstance *instance = nullptr;
+  const metadata_cache::ManagedReplicaSet *replicaset = nullptr;
+  for (auto &rs : snapshot->replicasets) {
     for (auto &inst : rs.second.members) {
       if (inst.mysql_server_uuid == instance_id) {
         instance = &inst;
@@ -283,13 +566,15 @@ void MetadataCache::mark_instance_reachability(const std::string &instance_id,
         log_warning("Primary instance '%s:%i' [%s] of replicaset '%s' is invalid. Increasing metadata cache refresh frequency.",
                     instance->host.c_str(), instance->port, instance_id.c_str(),
                     replicaset->name.c_str());
-        lost_primary_replicasets_.insert(replicaset->name);
+        lost_primary_replicasets_.emplace(replicaset->name, std::chrono::steady_clock::now());
+        lost_primary_cond_.notify_all();  // refresh right away
         break;
       case metadata_cache::InstanceStatus::Unreachable:
         log_warning("Primary instance '%s:%i' [%s] of replicaset '%s' is unreachable. Increasing metadata cache refresh frequency.",
                     instance->host.c_str(), instance->port, instance_id.c_str(),
                     replicaset->name.c_str());
-        lost_primary_replicasets_.insert(replicaset->name);
+        lost_primary_replicasets_.emplace(replicaset->name, std::chrono::steady_clock::now());
+        lost_primary_cond_.notify_all();  // refresh right away
         break;
       case metadata_cache::InstanceStatus::Unusable:
         break;
@@ -299,17 +584,31 @@ void MetadataCache::mark_instance_reachability(const std::string &instance_id,
 
 bool MetadataCache::wait_primary_failover(const std::string &replicaset_name,
                                           int timeout) {
-  log_debug("Waiting for failover to happen in '%s' for %is",
+  log_module_debug(LOG_MODULE_METADATA_CACHE, "Waiting for failover to happen in '%s' for %is",
             replicaset_name.c_str(), timeout);
-  time_t stime = std::time(NULL);
-  while (std::time(NULL) - stime <= timeout) {
-    {
-      std::lock_guard<std::mutex> lock(cache_refreshing_mutex_);
-      if (lost_primary_replicasets_.find(replicaset_name) == lost_primary_replicasets_.end()) {
-        return true;
+  std::unique_lock<std::mutex> lock(lost_primary_replicasets_mutex_);
+  // woken up by the refresh as soon as it found the new primary
+  lost_primary_cond_.wait_for(lock, std::chrono::seconds(timeout), [this, &replicaset_name] {
+    return terminate_.is_cancelled() ||
+           lost_primary_replicasets_.find(replicaset_name) == lost_primary_replicasets_.end();
+  });
+  return lost_primary_replicasets_.find(replicaset_name) == lost_primary_replicasets_.end();
+}
+
+bool MetadataCache::wait_for_gtids(const std::string &instance_id, const std::string &gtids,
+                                   std::chrono::milliseconds timeout) {
+  auto snapshot = topology();
+  for (const auto &rs : snapshot->replicasets) {
+    for (const auto &mi : rs.second.members) {
+      if (mi.mysql_server_uuid == instance_id) {
+        return meta_data_->wait_for_gtids(mi, gtids, timeout);
       }
     }
-    std::this_thread::sleep_for(std::chrono::seconds(1));
   }
   return false;
 }
+
+metadata_cache::FailoverStats MetadataCache::failover_stats() {
+  std::lock_guard<std::mutex> lock(lost_primary_replicasets_mutex_);
+  return failover_stats_;
+}
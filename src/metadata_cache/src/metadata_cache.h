@@ -19,13 +19,20 @@
 #define METADATA_CACHE_METADATA_CACHE_INCLUDED
 
 #include "mysqlrouter/metadata_cache.h"
+#include "cancellation_event.h"
+#include "gr_notifications.h"
 #include "metadata.h"
+#include "topology_file.h"
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <ctime>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <random>
 #include <string>
 #include <thread>
 #include <set>
@@ -34,6 +41,32 @@
 
 class ClusterMetadata;
 
+/** @brief When the refresh thread refreshes, besides every TTL
+ *
+ * Routers of a fleet which were started together would otherwise all
+ * query the metadata servers at the same time.
+ */
+struct RefreshSchedule {
+  /** @brief Wait before the first periodic refresh, spreads the routers
+   *         over the TTL; 0 for none */
+  std::chrono::milliseconds phase_offset{0};
+  /** @brief Percentage by which each wait for the TTL randomly varies */
+  unsigned int jitter = 0;
+  /** @brief Minimum time between two refreshes which were not triggered by
+   *         a lost primary; keeps the fleet within its refresh budget */
+  std::chrono::milliseconds min_interval{0};
+};
+
+/** @brief Returns the phase offset of a router
+ *
+ * Routers with consecutive ids get offsets spread evenly over the period.
+ *
+ * @param router_id id of the router in the metadata
+ * @param period time between two refreshes
+ * @return offset in [0, period)
+ */
+std::chrono::milliseconds refresh_phase_offset(uint32_t router_id, std::chrono::milliseconds period);
+
 /** @class MetadataCache
  *
  * The MetadataCache manages cached information fetched from the
@@ -47,7 +80,11 @@ public:
   MetadataCache(const std::vector<mysqlrouter::TCPAddress> &bootstrap_servers,
                 std::shared_ptr<MetaData> cluster_metadata,
                 unsigned int ttl, const mysqlrouter::SSLOptions &ssl_options,
-                const std::string &cluster_name);
+                const std::string &cluster_name,
+                std::unique_ptr<GRNotificationListener> gr_notifications = nullptr,
+                const std::string &topology_file = "",
+                std::chrono::seconds max_topology_staleness = std::chrono::seconds(0),
+                const RefreshSchedule &refresh_schedule = RefreshSchedule());
 
   /** @brief Destructor */
   ~MetadataCache();
@@ -74,6 +111,24 @@ public:
   std::vector<metadata_cache::ManagedInstance> replicaset_lookup(
     const std::string &replicaset_name);
 
+  /** @brief Returns the instances of a replicaset without copying them
+   *
+   * @param replicaset_name The ID of the replicaset being looked up
+   * @return the instances, referring into the current topology snapshot
+   */
+  metadata_cache::LookupResult lookup(const std::string &replicaset_name);
+
+  /** @brief Registers a listener notified about topology changes */
+  void add_listener(metadata_cache::TopologyListener *listener);
+
+  /** @brief Unregisters a listener, waits for a running notification */
+  void remove_listener(metadata_cache::TopologyListener *listener) noexcept;
+
+  /** @brief Returns the current topology snapshot (never null) */
+  std::shared_ptr<const metadata_cache::Topology> topology() const {
+    return std::atomic_load(&topology_);
+  }
+
   /** @brief Update the status of the instance
    *
    * Called when an instance from a replicaset cannot be reached for one reason or
@@ -96,6 +151,20 @@ public:
    * @return true if a primary member exists
    */
   bool wait_primary_failover(const std::string &replicaset_name, int timeout);
+
+  /** @brief Waits until an instance applied the given GTIDs
+   *
+   * @param instance_id the mysql_server_uuid of the instance
+   * @param gtids GTID set the instance needs to have applied
+   * @param timeout how long the instance may take
+   * @return true if the instance applied the GTIDs in time; false if it
+   *         didn't, couldn't be asked or isn't part of the topology
+   */
+  bool wait_for_gtids(const std::string &instance_id, const std::string &gtids,
+                      std::chrono::milliseconds timeout);
+
+  /** @brief Returns statistics about the failovers seen so far */
+  metadata_cache::FailoverStats failover_stats();
 private:
 
   /** @brief Refreshes the cache
@@ -104,9 +173,36 @@ private:
    */
   void refresh();
 
-  // Stores the list replicasets and their server instances.
-  // Keyed by replicaset name
-  std::map<std::string, metadata_cache::ManagedReplicaSet> replicaset_data_;
+  /** @brief Publishes a new topology snapshot, replacing the current one
+   *
+   * Listeners get notified about the differences to the old one.
+   */
+  void publish(MetaData::ReplicaSetsByName replicasets, bool stale = false);
+
+  /** @brief Publishes the topology from the topology file, if not too old
+   *
+   * @return true if a topology was published
+   */
+  bool load_topology();
+
+  /** @brief Called when the metadata servers confirmed the topology
+   *
+   * Publishes it as not stale anymore, saves it to the topology file.
+   *
+   * @param changed whether the refresh published a new topology
+   */
+  void topology_confirmed(bool changed);
+
+  /** @brief Returns the time until the next periodic refresh
+   *
+   * The TTL, varied by the jitter, but not less than the minimum interval.
+   */
+  std::chrono::milliseconds next_refresh_wait();
+
+  // The replicasets and their server instances, keyed by replicaset name.
+  // Only written by the refresh, accessed through std::atomic_load() and
+  // std::atomic_store() so that lookups don't block.
+  std::shared_ptr<const metadata_cache::Topology> topology_;
 
   // The name of the cluster in the topology.
   std::string cluster_name_;
@@ -129,29 +225,72 @@ private:
   // Handle to the thread that refreshes the information in the metadata cache.
   std::thread refresh_thread_;
 
-  // This mutex is used to ensure that a lookup of the metadata is consistent
-  // with the changes in the metadata due to a cache refresh.
-  std::mutex cache_refreshing_mutex_;
-
   #if 0 // not used so far
   // This mutex ensures that a refresh of the servers that contain the metadata
   // is consistent with the use of the server list.
   std::mutex metadata_servers_mutex_;
   #endif
 
-  // Contains a set of replicaset names that have no primary
-  std::set<std::string> lost_primary_replicasets_;
+  // Contains the names of the replicasets that have no primary, with the
+  // time since when
+  std::map<std::string, std::chrono::steady_clock::time_point> lost_primary_replicasets_;
 
   std::mutex lost_primary_replicasets_mutex_;
 
-  // Flag used to terminate the refresh thread.
-  bool terminate_;
+  // Signaled when a replicaset loses its primary or a GR notice arrived
+  // (wakes up the refresh thread), when a replicaset got a new primary
+  // (wakes up wait_primary_failover()) and on stop()
+  std::condition_variable lost_primary_cond_;
+
+  // Guarded by lost_primary_replicasets_mutex_
+  metadata_cache::FailoverStats failover_stats_;
+
+  // Set when a GR notice arrived, makes the next refresh fetch the status
+  // of all replicasets. Guarded by lost_primary_replicasets_mutex_
+  bool gr_state_changed_ = false;
+
+  // Listens for GR state change notices, if enabled
+  std::unique_ptr<GRNotificationListener> gr_notifications_;
+
+  // Where the topology is saved, if enabled
+  std::unique_ptr<TopologyFile> topology_file_;
+
+  // For how long a topology which is not confirmed by the metadata servers
+  // is used; 0 to not use it at all
+  std::chrono::seconds max_topology_staleness_;
+
+  // When the metadata servers last confirmed the topology, and when it was
+  // last saved. Only used by the refresh.
+  TopologyFile::clock_type::time_point confirmed_at_;
+  TopologyFile::clock_type::time_point saved_at_;
+
+  // Staggers the refreshes of the routers of a fleet
+  RefreshSchedule refresh_schedule_;
+
+  // Draws the jitter; only used by the refresh thread
+  std::mt19937 random_;
+
+  // Notified by publish(); the mutex is held while notifying
+  std::vector<metadata_cache::TopologyListener*> listeners_;
+  std::mutex listeners_mutex_;
+
+  // Event used to terminate the refresh thread, also wakes it up from its
+  // wait between two refreshes.
+  mysql_harness::CancellationEvent terminate_;
 
 #ifdef FRIEND_TEST
   FRIEND_TEST(FailoverTest, basics);
   FRIEND_TEST(FailoverTest, primary_failover);
+  FRIEND_TEST(FailoverTest, wait_primary_failover_wakes_up_on_refresh);
   FRIEND_TEST(MetadataCacheTest2, basic_test);
   FRIEND_TEST(MetadataCacheTest2, metadata_server_connection_failures);
+  FRIEND_TEST(MetadataCacheTest2, lookup_result_outlives_refresh);
+  FRIEND_TEST(MetadataCacheTest2, listeners_get_changes);
+  FRIEND_TEST(MetadataCacheTest2, stale_topology_during_outage);
+  FRIEND_TEST(MetadataCacheTest2, warm_start_from_topology_file);
+  FRIEND_TEST(MetadataCacheTest2, apply_backlog_changes_get_published);
+  FRIEND_TEST(MetadataCacheTest2, apply_backlog_changes_are_not_saved);
+  FRIEND_TEST(MetadataCacheTest2, refresh_wait_jitter_and_budget);
 #endif
 };
 
@@ -26,6 +26,7 @@
 #  include <unistd.h>
 #endif
 
+#include "filesystem.h"
 #include "keyring/keyring_manager.h"
 #include "mysqlrouter/datatypes.h"
 #include "mysqlrouter/utils.h"
@@ -87,6 +88,24 @@ static mysqlrouter::SSLOptions make_ssl_options(
   return options;
 }
 
+/**
+ * Default location of the topology file: next to the keyring, which is in
+ * the data folder unless configured otherwise.
+ */
+static std::string default_topology_file(const mysql_harness::ConfigSection *section,
+                                         const std::string &cluster) {
+  std::string folder;
+  if (section->has("keyring_path") && !section->get("keyring_path").empty()) {
+    folder = mysql_harness::Path(section->get("keyring_path")).dirname().str();
+  } else if (g_app_info && g_app_info->data_folder) {
+    folder = g_app_info->data_folder;
+  }
+  if (folder.empty()) {
+    return "";
+  }
+  return mysql_harness::Path(folder).join(cluster + "_topology.json").str();
+}
+
 /**
  * Initialize the metadata cache for fetching the information from the
  * metadata servers.
@@ -104,6 +123,9 @@ static void start(const mysql_harness::ConfigSection *section) {
     metadata_cluster = metadata_cluster.empty()?
       metadata_cache::kDefaultMetadataCluster : metadata_cluster;
 
+    std::string topology_file = config.topology_file.empty() ?
+      default_topology_file(section, metadata_cluster) : config.topology_file;
+
     std::string password = mysql_harness::get_keyring() ?
       mysql_harness::get_keyring()->fetch(config.user,
                                           kKeyringAttributePassword) : "";
@@ -114,7 +136,14 @@ static void start(const mysql_harness::ConfigSection *section) {
     metadata_cache::cache_init(config.bootstrap_addresses, config.user,
                                password, ttl,
                                make_ssl_options(section),
-                               metadata_cluster);
+                               metadata_cluster,
+                               config.use_gr_notifications,
+                               topology_file,
+                               config.max_topology_staleness,
+                               config.router_id,
+                               config.ttl_jitter,
+                               config.fleet_size,
+                               config.fleet_refresh_budget);
   } catch (const std::runtime_error &exc) { // metadata_cache::metadata_error inherits from runtime_error
     log_error(exc.what());
   } catch (const std::invalid_argument &exc) {
@@ -123,6 +152,15 @@ static void start(const mysql_harness::ConfigSection *section) {
   }
 }
 
+/**
+ * Stop refreshing the metadata cache.
+ *
+ * @param section An object encapsulating the metadata cache configuration.
+ */
+static void stop(const mysql_harness::ConfigSection *) {
+  metadata_cache::cache_stop();
+}
+
 extern "C" {
 
 mysql_harness::Plugin METADATA_API harness_plugin_metadata_cache = {
@@ -135,7 +173,7 @@ mysql_harness::Plugin METADATA_API harness_plugin_metadata_cache = {
     init,
     NULL,
     start,                                       // start
-    NULL                                         // stop
+    stop                                         // stop
 };
 
 }
@@ -38,6 +38,12 @@ std::string MetadataCachePluginConfig::get_default(const std::string &option) {
   static const std::map<std::string, std::string> defaults{
       {"address",  metadata_cache::kDefaultMetadataAddress},
       {"ttl", to_string(metadata_cache::kDefaultMetadataTTL)},
+      {"use_gr_notifications", "0"},
+      {"max_topology_staleness", "3600"},
+      {"router_id", "0"},
+      {"ttl_jitter", "0"},
+      {"fleet_size", "1"},
+      {"fleet_refresh_budget", "0"},
   };
   auto it = defaults.find(option);
   if (it == defaults.end()) {
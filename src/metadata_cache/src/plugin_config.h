@@ -48,7 +48,14 @@ public:
                               metadata_cache::kDefaultMetadataPort)),
         user(get_option_string(section, "user")),
         ttl(get_uint_option<unsigned int>(section, "ttl")),
-        metadata_cluster(get_option_string(section, "metadata_cluster"))
+        metadata_cluster(get_option_string(section, "metadata_cluster")),
+        use_gr_notifications(get_uint_option<unsigned int>(section, "use_gr_notifications", 0, 1) == 1),
+        topology_file(get_option_string(section, "topology_file")),
+        max_topology_staleness(get_uint_option<unsigned int>(section, "max_topology_staleness")),
+        router_id(get_uint_option<uint32_t>(section, "router_id")),
+        ttl_jitter(get_uint_option<unsigned int>(section, "ttl_jitter", 0, 50)),
+        fleet_size(get_uint_option<unsigned int>(section, "fleet_size", 1)),
+        fleet_refresh_budget(get_uint_option<unsigned int>(section, "fleet_refresh_budget"))
         { }
 
   /**
@@ -65,6 +72,20 @@ public:
   const unsigned int ttl;
   /** @brief Cluster in the metadata */
   const std::string metadata_cluster;
+  /** @brief Refresh on Group Replication state change notices */
+  const bool use_gr_notifications;
+  /** @brief File the last known topology is saved in (empty for default) */
+  const std::string topology_file;
+  /** @brief Seconds a topology not confirmed by the metadata servers is used */
+  const unsigned int max_topology_staleness;
+  /** @brief Id of the router in the metadata, as written by bootstrap */
+  const uint32_t router_id;
+  /** @brief Percentage by which the TTL randomly varies */
+  const unsigned int ttl_jitter;
+  /** @brief Number of routers using the same metadata servers */
+  const unsigned int fleet_size;
+  /** @brief Refreshes per minute of all routers together (0 for no limit) */
+  const unsigned int fleet_refresh_budget;
 
 private:
   /** @brief Gets a list of metadata servers.
@@ -0,0 +1,251 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "topology_file.h"
+#include "common.h"
+#include "filesystem.h"
+
+#define RAPIDJSON_HAS_STDSTRING 1
+
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#endif
+
+using metadata_cache::ManagedInstance;
+using metadata_cache::ManagedReplicaSet;
+using metadata_cache::ServerMode;
+
+// bumped on incompatible changes of the format; files with another version
+// are ignored
+static const unsigned kFormatVersion = 1;
+
+static const char *mode_to_string(ServerMode mode) {
+  switch (mode) {
+    case ServerMode::ReadWrite: return "RW";
+    case ServerMode::ReadOnly: return "RO";
+    default: return "n/a";
+  }
+}
+
+static ServerMode mode_from_string(const std::string &mode) {
+  if (mode == "RW") return ServerMode::ReadWrite;
+  if (mode == "RO") return ServerMode::ReadOnly;
+  return ServerMode::Unavailable;
+}
+
+void TopologyFile::save(const std::string &cluster_name,
+                        const MetaData::ReplicaSetsByName &replicasets,
+                        clock_type::time_point confirmed_at) const {
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+  writer.StartObject();
+  writer.String("version");
+  writer.Uint(kFormatVersion);
+  writer.String("cluster");
+  writer.String(cluster_name);
+  writer.String("confirmed_at");
+  writer.Int64(std::chrono::duration_cast<std::chrono::seconds>(
+      confirmed_at.time_since_epoch()).count());
+  writer.String("replicasets");
+  writer.StartArray();
+  for (const auto &rs : replicasets) {
+    writer.StartObject();
+    writer.String("name");
+    writer.String(rs.second.name);
+    writer.String("single_primary_mode");
+    writer.Bool(rs.second.single_primary_mode);
+    writer.String("members");
+    writer.StartArray();
+    for (const auto &mi : rs.second.members) {
+      writer.StartObject();
+      writer.String("uuid");
+      writer.String(mi.mysql_server_uuid);
+      writer.String("role");
+      writer.String(mi.role);
+      writer.String("mode");
+      writer.String(mode_to_string(mi.mode));
+      writer.String("weight");
+      writer.Double(mi.weight);
+      writer.String("version_token");
+      writer.Uint(mi.version_token);
+      writer.String("location");
+      writer.String(mi.location);
+      writer.String("host");
+      writer.String(mi.host);
+      writer.String("port");
+      writer.Uint(mi.port);
+      writer.String("xport");
+      writer.Uint(mi.xport);
+      writer.EndObject();
+    }
+    writer.EndArray();
+    writer.EndObject();
+  }
+  writer.EndArray();
+  writer.EndObject();
+
+  const std::string tmp_path = path_ + ".tmp";
+  {
+    std::ofstream f(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!f) {
+      throw std::runtime_error("Could not open '" + tmp_path + "' for writing: " +
+                               mysql_harness::get_strerror(errno));
+    }
+    // it tells which servers the router uses
+    mysql_harness::make_file_private(tmp_path);
+    f.write(buffer.GetString(), static_cast<std::streamsize>(buffer.GetSize()));
+    f.close();
+    if (!f) {
+      std::remove(tmp_path.c_str());
+      throw std::runtime_error("Could not write '" + tmp_path + "'");
+    }
+  }
+
+#ifdef _WIN32
+  if (!MoveFileExA(tmp_path.c_str(), path_.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+    const int err = static_cast<int>(GetLastError());
+#else
+  if (std::rename(tmp_path.c_str(), path_.c_str()) != 0) {
+    const int err = errno;
+#endif
+    std::remove(tmp_path.c_str());
+    throw std::runtime_error("Could not rename '" + tmp_path + "' to '" + path_ + "': " +
+                             mysql_harness::get_strerror(err));
+  }
+}
+
+// throws std::runtime_error if the member is missing or has the wrong type
+static const rapidjson::Value &get_member(const rapidjson::Value &object, const char *name) {
+  if (!object.IsObject()) {
+    throw std::runtime_error("expected an object");
+  }
+  auto it = object.FindMember(name);
+  if (it == object.MemberEnd()) {
+    throw std::runtime_error(std::string("'") + name + "' missing");
+  }
+  return it->value;
+}
+
+static std::string get_string(const rapidjson::Value &object, const char *name) {
+  const rapidjson::Value &value = get_member(object, name);
+  if (!value.IsString()) {
+    throw std::runtime_error(std::string("'") + name + "' is not a string");
+  }
+  return std::string(value.GetString(), value.GetStringLength());
+}
+
+static unsigned get_uint(const rapidjson::Value &object, const char *name) {
+  const rapidjson::Value &value = get_member(object, name);
+  if (!value.IsUint()) {
+    throw std::runtime_error(std::string("'") + name + "' is not an unsigned integer");
+  }
+  return value.GetUint();
+}
+
+bool TopologyFile::load(const std::string &cluster_name,
+                        MetaData::ReplicaSetsByName &replicasets,
+                        clock_type::time_point &confirmed_at) const {
+  if (!mysql_harness::Path(path_).exists()) {
+    return false;
+  }
+
+  std::ifstream f(path_, std::ios::binary);
+  if (!f) {
+    throw std::runtime_error("Could not open '" + path_ + "': " +
+                             mysql_harness::get_strerror(errno));
+  }
+  std::stringstream content;
+  content << f.rdbuf();
+
+  rapidjson::Document doc;
+  doc.Parse(content.str().c_str());
+  if (doc.HasParseError()) {
+    throw std::runtime_error("Could not parse '" + path_ + "'");
+  }
+
+  try {
+    if (get_uint(doc, "version") != kFormatVersion ||
+        get_string(doc, "cluster") != cluster_name) {
+      return false;
+    }
+
+    const rapidjson::Value &confirmed = get_member(doc, "confirmed_at");
+    if (!confirmed.IsInt64()) {
+      throw std::runtime_error("'confirmed_at' is not an integer");
+    }
+
+    const rapidjson::Value &rs_array = get_member(doc, "replicasets");
+    if (!rs_array.IsArray()) {
+      throw std::runtime_error("'replicasets' is not an array");
+    }
+
+    MetaData::ReplicaSetsByName result;
+    for (rapidjson::SizeType i = 0; i < rs_array.Size(); ++i) {
+      const rapidjson::Value &rs_value = rs_array[i];
+      ManagedReplicaSet rs;
+      rs.name = get_string(rs_value, "name");
+      const rapidjson::Value &single_primary = get_member(rs_value, "single_primary_mode");
+      if (!single_primary.IsBool()) {
+        throw std::runtime_error("'single_primary_mode' is not a boolean");
+      }
+      rs.single_primary_mode = single_primary.GetBool();
+
+      const rapidjson::Value &members = get_member(rs_value, "members");
+      if (!members.IsArray()) {
+        throw std::runtime_error("'members' is not an array");
+      }
+      for (rapidjson::SizeType j = 0; j < members.Size(); ++j) {
+        const rapidjson::Value &mi_value = members[j];
+        ManagedInstance mi;
+        mi.replicaset_name = rs.name;
+        mi.mysql_server_uuid = get_string(mi_value, "uuid");
+        mi.role = get_string(mi_value, "role");
+        mi.mode = mode_from_string(get_string(mi_value, "mode"));
+        const rapidjson::Value &weight = get_member(mi_value, "weight");
+        if (!weight.IsNumber()) {
+          throw std::runtime_error("'weight' is not a number");
+        }
+        mi.weight = static_cast<float>(weight.GetDouble());
+        mi.version_token = get_uint(mi_value, "version_token");
+        mi.apply_backlog = 0;  // not saved, outdated by the time it's loaded
+        mi.location = get_string(mi_value, "location");
+        mi.host = get_string(mi_value, "host");
+        mi.port = get_uint(mi_value, "port");
+        mi.xport = get_uint(mi_value, "xport");
+        rs.members.push_back(std::move(mi));
+      }
+      result[rs.name] = std::move(rs);
+    }
+
+    replicasets = std::move(result);
+    confirmed_at = clock_type::time_point(std::chrono::seconds(confirmed.GetInt64()));
+  } catch (const std::runtime_error &exc) {
+    throw std::runtime_error("Invalid topology file '" + path_ + "': " + exc.what());
+  }
+  return true;
+}
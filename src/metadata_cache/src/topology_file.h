@@ -0,0 +1,77 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef METADATA_CACHE_TOPOLOGY_FILE_INCLUDED
+#define METADATA_CACHE_TOPOLOGY_FILE_INCLUDED
+
+#include "metadata.h"
+
+#include <chrono>
+#include <string>
+
+/** @class TopologyFile
+ * @brief Persists the last known topology of a cluster
+ *
+ * Lets a restarting router route right away with the topology it saw last,
+ * instead of waiting for the metadata servers (which may be slow or down).
+ *
+ * The file is compact JSON. It gets replaced atomically: written to a
+ * temporary file next to it, which is then renamed over the old one, so
+ * that a crash never leaves a partial file behind.
+ */
+class METADATA_API TopologyFile {
+public:
+  using clock_type = std::chrono::system_clock;
+
+  /** @brief Constructor
+   *
+   * @param path path of the file
+   */
+  explicit TopologyFile(const std::string &path) : path_(path) { }
+
+  /** @brief Returns the path of the file */
+  const std::string &path() const { return path_; }
+
+  /** @brief Writes the topology to the file
+   *
+   * @param cluster_name name of the cluster the topology belongs to
+   * @param replicasets the topology
+   * @param confirmed_at when the topology was last confirmed by the
+   *                     metadata servers
+   * @throws std::runtime_error if the file could not be written
+   */
+  void save(const std::string &cluster_name,
+            const MetaData::ReplicaSetsByName &replicasets,
+            clock_type::time_point confirmed_at) const;
+
+  /** @brief Reads the topology from the file
+   *
+   * @param cluster_name name of the cluster the topology has to belong to
+   * @param[out] replicasets the topology
+   * @param[out] confirmed_at when the topology was last confirmed
+   * @return false if there is no file, or it belongs to another cluster
+   * @throws std::runtime_error if the file could not be read or parsed
+   */
+  bool load(const std::string &cluster_name,
+            MetaData::ReplicaSetsByName &replicasets,
+            clock_type::time_point &confirmed_at) const;
+
+private:
+  const std::string path_;
+};
+
+#endif // METADATA_CACHE_TOPOLOGY_FILE_INCLUDED
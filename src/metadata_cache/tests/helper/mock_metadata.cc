@@ -52,6 +52,7 @@ MockNG::MockNG(const std::string &user, const std::string &password,
   ms1.role = "master";
   ms1.weight = 1;
   ms1.version_token = 0;
+  ms1.apply_backlog = 0;
 
   ms2.replicaset_name = "replicaset-1";
   ms2.mysql_server_uuid = "instance-2";
@@ -63,6 +64,7 @@ MockNG::MockNG(const std::string &user, const std::string &password,
   ms2.role = "master";
   ms2.weight = 1;
   ms2.version_token = 0;
+  ms2.apply_backlog = 0;
 
   ms3.replicaset_name = "replicaset-1";
   ms3.mysql_server_uuid = "instance-3";
@@ -74,6 +76,7 @@ MockNG::MockNG(const std::string &user, const std::string &password,
   ms3.role = "scale-out";
   ms3.weight = 1;
   ms3.version_token = 0;
+  ms3.apply_backlog = 0;
 
   ms4.replicaset_name = "replicaset-2";
   ms4.mysql_server_uuid = "instance-4";
@@ -85,6 +88,7 @@ MockNG::MockNG(const std::string &user, const std::string &password,
   ms4.role = "master";
   ms4.weight = 1;
   ms4.version_token = 0;
+  ms4.apply_backlog = 0;
 
   ms5.replicaset_name = "replicaset-2";
   ms5.mysql_server_uuid = "instance-5";
@@ -96,6 +100,7 @@ MockNG::MockNG(const std::string &user, const std::string &password,
   ms5.role = "master";
   ms5.weight = 1;
   ms5.version_token = 0;
+  ms5.apply_backlog = 0;
 
   ms6.replicaset_name = "replicaset-2";
   ms6.mysql_server_uuid = "instance-6";
@@ -107,6 +112,7 @@ MockNG::MockNG(const std::string &user, const std::string &password,
   ms6.role = "scale-out";
   ms6.weight = 1;
   ms6.version_token = 0;
+  ms6.apply_backlog = 0;
 
   ms7.replicaset_name = "replicaset-3";
   ms7.mysql_server_uuid = "instance-7";
@@ -118,6 +124,7 @@ MockNG::MockNG(const std::string &user, const std::string &password,
   ms7.role = "master";
   ms7.weight = 1;
   ms7.version_token = 0;
+  ms7.apply_backlog = 0;
 
   ms8.replicaset_name = "replicaset-3";
   ms8.mysql_server_uuid = "instance-8";
@@ -129,6 +136,7 @@ MockNG::MockNG(const std::string &user, const std::string &password,
   ms7.role = "master";
   ms7.weight = 1;
   ms7.version_token = 0;
+  ms7.apply_backlog = 0;
 
   ms9.replicaset_name = "replicaset-3";
   ms9.mysql_server_uuid = "instance-9";
@@ -140,6 +148,7 @@ MockNG::MockNG(const std::string &user, const std::string &password,
   ms9.role = "scale-out";
   ms9.weight = 1;
   ms9.version_token = 0;
+  ms9.apply_backlog = 0;
 
   replicaset_1_vector.push_back(ms1);
   replicaset_1_vector.push_back(ms2);
@@ -29,6 +29,9 @@
 
 #include "mysqlrouter/datatypes.h"
 
+#include <chrono>
+#include <thread>
+
 using namespace metadata_cache;
 
 class FailoverTest : public ::testing::Test {
@@ -89,6 +92,20 @@ public:
         {m.string_or_null("uuid-server2"), m.string_or_null("somehost"), m.string_or_null("3001"), m.string_or_null("ONLINE"), m.string_or_null("1")},
         {m.string_or_null("uuid-server3"), m.string_or_null("somehost"), m.string_or_null("3002"), m.string_or_null("ONLINE"), m.string_or_null("1")}
       });
+    expect_member_backlog_1();
+  }
+
+  // make queries on PFS.replication_group_member_stats return no backlog
+  void expect_member_backlog_1() {
+    MySQLSessionReplayer &m = *session;
+
+    m.expect_query("SELECT member_id, count_transactions_remote_in_applier_queue FROM performance_schema.replication_group_member_stats WHERE channel_name = 'group_replication_applier'");
+    m.then_return(2, {
+        // member_id, count_transactions_remote_in_applier_queue
+        {m.string_or_null("uuid-server1"), m.string_or_null("0")},
+        {m.string_or_null("uuid-server2"), m.string_or_null("0")},
+        {m.string_or_null("uuid-server3"), m.string_or_null("0")}
+      });
   }
 
   // make queries on PFS.replication_group_members return primary in the given state
@@ -118,6 +135,7 @@ public:
           {m.string_or_null("uuid-server3"), m.string_or_null("somehost"), m.string_or_null("3002"), m.string_or_null("ONLINE"), m.string_or_null("1")}
         });
     }
+    expect_member_backlog_1();
   }
 
 };
@@ -243,3 +261,39 @@ TEST_F(FailoverTest, primary_failover) {
   EXPECT_EQ("uuid-server3", instances[2].mysql_server_uuid);
   EXPECT_EQ(ServerMode::ReadOnly, instances[2].mode);
 }
+
+
+TEST_F(FailoverTest, wait_primary_failover_wakes_up_on_refresh) {
+  expect_metadata_1();
+  expect_group_members_1();
+  init_cache();
+
+  cache->mark_instance_reachability("uuid-server1",
+                                    metadata_cache::InstanceStatus::Unreachable);
+  EXPECT_EQ(0u, cache->failover_stats().failovers);
+
+  // the waiter has to be woken up by the refresh which finds the new primary,
+  // long before its timeout expires
+  std::chrono::steady_clock::duration waited;
+  bool failover_done = false;
+  std::thread waiter([this, &waited, &failover_done] {
+    const auto start = std::chrono::steady_clock::now();
+    failover_done = cache->wait_primary_failover("default", 30);
+    waited = std::chrono::steady_clock::now() - start;
+  });
+
+  expect_metadata_1();
+  expect_group_members_1_primary_fail(nullptr, "uuid-server2");
+  cache->refresh();
+  waiter.join();
+
+  EXPECT_TRUE(failover_done);
+  EXPECT_LT(waited, std::chrono::seconds(10));
+
+  FailoverStats stats = cache->failover_stats();
+  EXPECT_EQ(1u, stats.failovers);
+  EXPECT_EQ(stats.last_failover_ms, stats.max_failover_ms);
+  EXPECT_LT(stats.last_failover_ms, 10000u);
+
+  ASSERT_FALSE(session->print_expected());
+}
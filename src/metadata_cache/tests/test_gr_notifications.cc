@@ -0,0 +1,382 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * Tests the listener for GR state change notices against a mock X protocol
+ * server.
+ */
+
+#include "gr_notifications.h"
+#include "mysqlrouter/sha1.h"
+
+#include "mysqlx.pb.h"
+#include "mysqlx_datatypes.pb.h"
+#include "mysqlx_notice.pb.h"
+#include "mysqlx_session.pb.h"
+#include "mysqlx_sql.pb.h"
+
+#include "gmock/gmock.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#  include <winsock2.h>
+#  include <ws2tcpip.h>
+#else
+#  include <arpa/inet.h>
+#  include <netinet/in.h>
+#  include <poll.h>
+#  include <sys/socket.h>
+#  include <unistd.h>
+#endif
+
+using metadata_cache::ManagedInstance;
+using metadata_cache::ServerMode;
+using std::chrono::seconds;
+
+static void close_socket(int fd) {
+#ifdef _WIN32
+  closesocket(static_cast<SOCKET>(fd));
+#else
+  ::close(fd);
+#endif
+}
+
+/**
+ * X protocol server side of the handshake the listener does, and sending
+ * notices. Runs in the thread of the test, the listener connects from its
+ * own thread.
+ */
+class MockXServer {
+public:
+  MockXServer(const std::string &user, const std::string &password)
+      : user_(user), password_(password), session_fd_(-1), accepted_(0) {
+    listen_fd_ = static_cast<int>(socket(AF_INET, SOCK_STREAM, 0));
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    if (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), addr_len) != 0 ||
+        getsockname(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), &addr_len) != 0 ||
+        listen(listen_fd_, 5) != 0) {
+      throw std::runtime_error("setting up the mock server failed");
+    }
+    port_ = ntohs(addr.sin_port);
+  }
+
+  ~MockXServer() {
+    close_session();
+    close_socket(listen_fd_);
+  }
+
+  uint16_t port() const { return port_; }
+
+  /** @brief Number of connections accepted so far */
+  int accepted() const { return accepted_; }
+
+  /** @brief Accepts a connection and handles the handshake
+   *
+   * @param accept_credentials whether authentication succeeds
+   * @return true if the client enabled the GR notice
+   */
+  bool accept_session(bool accept_credentials = true) {
+    close_session();
+
+    struct pollfd fds[] = {
+      { listen_fd_, POLLIN, 0 },
+    };
+#ifdef _WIN32
+    if (WSAPoll(fds, 1, 10000) != 1) return false;
+#else
+    if (poll(fds, 1, 10000) != 1) return false;
+#endif
+    session_fd_ = static_cast<int>(accept(listen_fd_, nullptr, nullptr));
+    if (session_fd_ < 0) return false;
+    ++accepted_;
+
+    std::string payload;
+    if (read_message(payload) != Mysqlx::ClientMessages::SESS_AUTHENTICATE_START) return false;
+    Mysqlx::Session::AuthenticateStart start;
+    if (!start.ParseFromString(payload) || start.mech_name() != "MYSQL41") return false;
+
+    const std::string salt("01234567890123456789");
+    Mysqlx::Session::AuthenticateContinue challenge;
+    challenge.set_auth_data(salt);
+    send_message(Mysqlx::ServerMessages::SESS_AUTHENTICATE_CONTINUE, challenge);
+
+    if (read_message(payload) != Mysqlx::ClientMessages::SESS_AUTHENTICATE_CONTINUE) return false;
+    Mysqlx::Session::AuthenticateContinue response;
+    if (!response.ParseFromString(payload)) return false;
+    if (!accept_credentials ||
+        response.auth_data() != std::string(1, '\0') + user_ + '\0' + scramble(salt)) {
+      Mysqlx::Error error;
+      error.set_code(1045);
+      error.set_sql_state("HY000");
+      error.set_msg("Invalid user or password");
+      send_message(Mysqlx::ServerMessages::ERROR, error);
+      return false;
+    }
+
+    // notices may come before the reply
+    send_notice(3, Mysqlx::Notice::Frame::LOCAL, "");
+    send_message(Mysqlx::ServerMessages::SESS_AUTHENTICATE_OK, Mysqlx::Session::AuthenticateOk());
+
+    if (read_message(payload) != Mysqlx::ClientMessages::SQL_STMT_EXECUTE) return false;
+    Mysqlx::Sql::StmtExecute stmt;
+    if (!stmt.ParseFromString(payload) ||
+        stmt.namespace_() != "mysqlx" || stmt.stmt() != "enable_notices" ||
+        stmt.args_size() != 1 || stmt.args(0).obj().fld_size() != 1 ||
+        stmt.args(0).obj().fld(0).key() != "notice" ||
+        stmt.args(0).obj().fld(0).value().array().value_size() != 1 ||
+        stmt.args(0).obj().fld(0).value().array().value(0).scalar().v_string().value() !=
+          "group_replication_state_changed") {
+      return false;
+    }
+    send_message(Mysqlx::ServerMessages::SQL_STMT_EXECUTE_OK, Mysqlx::Sql::StmtExecuteOk());
+    return true;
+  }
+
+  void send_gr_notice(Mysqlx::Notice::GroupReplicationStateChanged::Type type) {
+    Mysqlx::Notice::GroupReplicationStateChanged change;
+    change.set_type(type);
+    change.set_view_id("15000000000000000:2");
+    send_notice(4, Mysqlx::Notice::Frame::GLOBAL, change.SerializeAsString());
+  }
+
+  void send_notice(uint32_t type, Mysqlx::Notice::Frame::Scope scope, const std::string &payload) {
+    Mysqlx::Notice::Frame frame;
+    frame.set_type(type);
+    frame.set_scope(scope);
+    frame.set_payload(payload);
+    send_message(Mysqlx::ServerMessages::NOTICE, frame);
+  }
+
+  /** @brief Waits until the client closed the session */
+  bool wait_session_closed() {
+    struct pollfd fds[] = {
+      { session_fd_, POLLIN, 0 },
+    };
+#ifdef _WIN32
+    if (WSAPoll(fds, 1, 10000) != 1) return false;
+#else
+    if (poll(fds, 1, 10000) != 1) return false;
+#endif
+    char c;
+    return recv(session_fd_, &c, 1, 0) == 0;
+  }
+
+  void close_session() {
+    if (session_fd_ >= 0) {
+      close_socket(session_fd_);
+      session_fd_ = -1;
+    }
+  }
+
+private:
+  std::string scramble(const std::string &salt) {
+    if (password_.empty()) return "";
+
+    uint8_t stage1[SHA1_HASH_SIZE], stage2[SHA1_HASH_SIZE], hash[SHA1_HASH_SIZE];
+    my_sha1::compute_sha1_hash(stage1, password_.data(), password_.size());
+    my_sha1::compute_sha1_hash(stage2, reinterpret_cast<const char*>(stage1), SHA1_HASH_SIZE);
+    my_sha1::compute_sha1_hash_multi(hash, salt.data(), static_cast<int>(salt.size()),
+                                     reinterpret_cast<const char*>(stage2), SHA1_HASH_SIZE);
+    std::string result("*");
+    char hex[3];
+    for (size_t i = 0; i < SHA1_HASH_SIZE; ++i) {
+      snprintf(hex, sizeof(hex), "%02X", hash[i] ^ stage1[i]);
+      result += hex;
+    }
+    return result;
+  }
+
+  void send_message(uint8_t type, const google::protobuf::MessageLite &msg) {
+    std::string payload = msg.SerializeAsString();
+    const uint32_t size = static_cast<uint32_t>(payload.size() + 1);
+    std::string buffer;
+    for (size_t i = 0; i < 4; ++i) {
+      buffer += static_cast<char>((size >> (8 * i)) & 0xff);
+    }
+    buffer += static_cast<char>(type);
+    buffer += payload;
+    send(session_fd_, buffer.data(), static_cast<int>(buffer.size()), 0);
+  }
+
+  int read_message(std::string &payload) {
+    uint8_t header[5];
+    if (!read_all(reinterpret_cast<char*>(header), sizeof(header))) return -1;
+    const uint32_t size = static_cast<uint32_t>(header[0]) | static_cast<uint32_t>(header[1]) << 8 |
+                          static_cast<uint32_t>(header[2]) << 16 | static_cast<uint32_t>(header[3]) << 24;
+    payload.resize(size - 1);
+    if (size > 1 && !read_all(&payload[0], payload.size())) return -1;
+    return header[4];
+  }
+
+  bool read_all(char *buffer, size_t length) {
+    size_t received = 0;
+    while (received < length) {
+      const auto res = recv(session_fd_, buffer + received, static_cast<int>(length - received), 0);
+      if (res <= 0) return false;
+      received += static_cast<size_t>(res);
+    }
+    return true;
+  }
+
+  const std::string user_;
+  const std::string password_;
+  int listen_fd_;
+  int session_fd_;
+  int accepted_;
+  uint16_t port_;
+};
+
+class GRNotificationsTest : public ::testing::Test {
+public:
+  // collects the callbacks of the listener
+  void notified(const std::string &replicaset_name) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    notifications_.push_back(replicaset_name);
+    cond_.notify_all();
+  }
+
+  // waits until there are at least count notifications
+  std::vector<std::string> wait_notifications(size_t count) {
+    std::unique_lock<std::mutex> lock(mtx_);
+    cond_.wait_for(lock, seconds(10), [this, count] { return notifications_.size() >= count; });
+    return notifications_;
+  }
+
+  static metadata_cache::Topology make_topology(uint16_t xport, ServerMode mode) {
+    ManagedInstance instance;
+    instance.replicaset_name = "default";
+    instance.mysql_server_uuid = "uuid-server1";
+    instance.host = "127.0.0.1";
+    instance.port = 3306;
+    instance.xport = xport;
+    instance.mode = mode;
+
+    metadata_cache::Topology topology;
+    topology.replicasets["default"].name = "default";
+    topology.replicasets["default"].members.push_back(instance);
+    return topology;
+  }
+
+  GRNotificationListener::NotificationCallback callback() {
+    return [this](const std::string &replicaset_name) { notified(replicaset_name); };
+  }
+
+private:
+  std::mutex mtx_;
+  std::condition_variable cond_;
+  std::vector<std::string> notifications_;
+};
+
+TEST_F(GRNotificationsTest, notice_triggers_callback) {
+  MockXServer server("admin", "secret");
+  GRNotificationListener listener("admin", "secret");
+  listener.set_topology(make_topology(server.port(), ServerMode::ReadWrite));
+  listener.start(callback());
+
+  ASSERT_TRUE(server.accept_session());
+
+  // other notices are ignored
+  server.send_notice(1, Mysqlx::Notice::Frame::GLOBAL, "");
+  server.send_gr_notice(Mysqlx::Notice::GroupReplicationStateChanged::MEMBER_ROLE_CHANGE);
+  EXPECT_EQ(std::vector<std::string>{"default"}, wait_notifications(1));
+
+  server.send_gr_notice(Mysqlx::Notice::GroupReplicationStateChanged::MEMBERSHIP_VIEW_CHANGE);
+  EXPECT_EQ(std::vector<std::string>({"default", "default"}), wait_notifications(2));
+
+  listener.stop();
+}
+
+TEST_F(GRNotificationsTest, lost_session_triggers_callback_and_reconnect) {
+  MockXServer server("admin", "");
+  GRNotificationListener listener("admin", "");
+  listener.set_topology(make_topology(server.port(), ServerMode::ReadOnly));
+  listener.start(callback());
+
+  ASSERT_TRUE(server.accept_session());
+  server.close_session();
+  EXPECT_EQ(std::vector<std::string>{"default"}, wait_notifications(1));
+
+  // the listener opens a new session to the member
+  ASSERT_TRUE(server.accept_session());
+  server.send_gr_notice(Mysqlx::Notice::GroupReplicationStateChanged::MEMBER_STATE_CHANGE);
+  EXPECT_EQ(std::vector<std::string>({"default", "default"}), wait_notifications(2));
+
+  listener.stop();
+}
+
+TEST_F(GRNotificationsTest, failed_authentication_is_retried) {
+  MockXServer server("admin", "secret");
+  GRNotificationListener listener("admin", "wrong");
+  listener.set_topology(make_topology(server.port(), ServerMode::ReadWrite));
+  listener.start(callback());
+
+  // wrong password
+  EXPECT_FALSE(server.accept_session());
+  ASSERT_EQ(1, server.accepted());
+
+  // the listener comes back after the rejection (accept_session() waits
+  // up to 10 seconds for it), and again after the next one
+  EXPECT_FALSE(server.accept_session(false));
+  ASSERT_EQ(2, server.accepted());
+  EXPECT_FALSE(server.accept_session(false));
+  ASSERT_EQ(3, server.accepted());
+
+  listener.stop();
+  EXPECT_TRUE(wait_notifications(0).empty());
+}
+
+TEST_F(GRNotificationsTest, unavailable_members_are_skipped) {
+  MockXServer server("admin", "secret");
+  GRNotificationListener listener("admin", "secret");
+  listener.set_topology(make_topology(server.port(), ServerMode::Unavailable));
+  listener.start(callback());
+
+  // becomes usable
+  listener.set_topology(make_topology(server.port(), ServerMode::ReadOnly));
+  ASSERT_TRUE(server.accept_session());
+  server.send_gr_notice(Mysqlx::Notice::GroupReplicationStateChanged::MEMBERSHIP_QUORUM_LOSS);
+  EXPECT_EQ(std::vector<std::string>{"default"}, wait_notifications(1));
+
+  // and leaves again: the session gets closed without a notification
+  listener.set_topology(make_topology(server.port(), ServerMode::Unavailable));
+  EXPECT_TRUE(server.wait_session_closed());
+  listener.stop();
+  EXPECT_EQ(1u, wait_notifications(1).size());
+}
+
+int main(int argc, char *argv[]) {
+#ifdef _WIN32
+  WSADATA wsaData;
+  if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+    return 1;
+  }
+#endif
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -49,6 +49,7 @@
 
 
 using ::testing::_;
+using ::testing::AnyNumber;
 using ::testing::Assign;
 using ::testing::Invoke;
 using ::testing::InvokeWithoutArgs;
@@ -108,6 +109,16 @@ std::string query_status = "SELECT "
     "FROM performance_schema.replication_group_members "
     "WHERE channel_name = 'group_replication_applier'";
 
+// query run by topology_changed() - fetches a signature of metadata and GR state
+std::string query_signature = "SELECT (SELECT CONCAT(COUNT(*), '/', ";
+
+// query #4 (after query #3 found a quorum, and by topology_changed()) - fetches
+// the apply backlog of the members
+std::string query_backlog = "SELECT "
+    "member_id, count_transactions_remote_in_applier_queue "
+    "FROM performance_schema.replication_group_member_stats "
+    "WHERE channel_name = 'group_replication_applier'";
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -122,6 +133,11 @@ class MockMySQLSession: public MySQLSession {
   MOCK_METHOD2(flag_succeed, void(const std::string&, unsigned int));
   MOCK_METHOD2(flag_fail, void(const std::string&, unsigned int));
 
+  MockMySQLSession() {
+    // returns no rows (backlog unknown) unless a test expects otherwise
+    EXPECT_CALL(*this, query(StartsWith(query_backlog), _)).Times(AnyNumber());
+  }
+
   void connect(const std::string& host,
                unsigned int port,
                const std::string&,
@@ -138,6 +154,10 @@ class MockMySQLSession: public MySQLSession {
       connect_fail(host, port); // throws Error
   }
 
+  bool ping() noexcept override {
+    return connected_;
+  }
+
   void set_good_conns(std::set<std::string>&& conns) {
     good_conns_ = std::move(conns);
   }
@@ -286,9 +306,9 @@ class MetadataTest : public ::testing::Test {
   void connect_to_first_metadata_server() {
 
     std::vector<ManagedInstance> metadata_servers {
-      {"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100},
-      {"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "127.0.0.1", 3320, 33200},
-      {"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300},
+      {"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100, 0},
+      {"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "127.0.0.1", 3320, 33200, 0},
+      {"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300, 0},
     };
     session_factory.get(0).set_good_conns({"127.0.0.1:3310", "127.0.0.1:3320", "127.0.0.1:3330"});
 
@@ -351,9 +371,9 @@ class MetadataTest : public ::testing::Test {
   const ManagedReplicaSet typical_replicaset {
     "replicaset-1", {
       // will be set ----------------------vvvvvvvvvvvvvvvvvvvvvvv  v--v--vv--- ignored at the time of writing
-      {"replicaset-1", "instance-1", "HA", ServerMode::Unavailable, 0, 0, "", "localhost", 3310, 33100},
-      {"replicaset-1", "instance-2", "HA", ServerMode::Unavailable, 0, 0, "", "localhost", 3320, 33200},
-      {"replicaset-1", "instance-3", "HA", ServerMode::Unavailable, 0, 0, "", "localhost", 3330, 33300},
+      {"replicaset-1", "instance-1", "HA", ServerMode::Unavailable, 0, 0, "", "localhost", 3310, 33100, 0},
+      {"replicaset-1", "instance-2", "HA", ServerMode::Unavailable, 0, 0, "", "localhost", 3320, 33200, 0},
+      {"replicaset-1", "instance-3", "HA", ServerMode::Unavailable, 0, 0, "", "localhost", 3330, 33300, 0},
       // ignored at time of writing -^^^^--------------------------------------------------------^^^^^
       // TODO: ok to ignore xport?
     },
@@ -372,9 +392,9 @@ class MetadataTest : public ::testing::Test {
 TEST_F(MetadataTest, ConnectToMetadataServer_1st) {
 
   std::vector<ManagedInstance> metadata_servers {
-    {"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100},  // good
-    {"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "127.0.0.1", 3320, 33200},
-    {"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300},
+    {"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100, 0},  // good
+    {"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "127.0.0.1", 3320, 33200, 0},
+    {"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300, 0},
   };
   session_factory.get(0).set_good_conns({"127.0.0.1:3310"});
 
@@ -391,9 +411,9 @@ TEST_F(MetadataTest, ConnectToMetadataServer_1st) {
 TEST_F(MetadataTest, ConnectToMetadataServer_2nd) {
 
   std::vector<ManagedInstance> metadata_servers {
-    {"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100},  // bad
-    {"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "127.0.0.1", 3320, 33200},  // good
-    {"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300},
+    {"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100, 0},  // bad
+    {"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "127.0.0.1", 3320, 33200, 0},  // good
+    {"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300, 0},
   };
   session_factory.get(0).set_good_conns({"127.0.0.1:3320"});
 
@@ -410,9 +430,9 @@ TEST_F(MetadataTest, ConnectToMetadataServer_2nd) {
 TEST_F(MetadataTest, ConnectToMetadataServer_3rd) {
 
   std::vector<ManagedInstance> metadata_servers {
-    {"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100},  // bad
-    {"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "127.0.0.1", 3320, 33200},  // bad
-    {"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300},  // good
+    {"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100, 0},  // bad
+    {"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "127.0.0.1", 3320, 33200, 0},  // bad
+    {"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300, 0},  // good
   };
   session_factory.get(0).set_good_conns({"127.0.0.1:3330"});
 
@@ -431,9 +451,9 @@ TEST_F(MetadataTest, ConnectToMetadataServer_3rd) {
 TEST_F(MetadataTest, ConnectToMetadataServer_none) {
 
   std::vector<ManagedInstance> metadata_servers {
-    {"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100},  // bad
-    {"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "127.0.0.1", 3320, 33200},  // bad
-    {"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300},  // bad
+    {"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100, 0},  // bad
+    {"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "127.0.0.1", 3320, 33200, 0},  // bad
+    {"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300, 0},  // bad
   };
   session_factory.get(0).set_good_conns({});
 
@@ -478,10 +498,10 @@ TEST_F(MetadataTest, FetchInstancesFromMetadataServer) {
 
     EXPECT_EQ(1u, rs.size());
     EXPECT_EQ(4u, rs.at("replicaset-1").members.size()); // not set/checked -------------------vvvvvvvvvvvvvvvvvvvvvvv
-    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-1", "instance-1", "HA",               ServerMode::Unavailable, 0.2f, 0, "location1", "localhost", 3310, 33100}, rs.at("replicaset-1").members.at(0)));
-    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-1", "instance-2", "arbitrary_string", ServerMode::Unavailable, 1.5f, 1, "s.o_loc",   "localhost", 3320, 33200}, rs.at("replicaset-1").members.at(1)));
-    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-1", "instance-3", "",                 ServerMode::Unavailable, 0.0f, 99, "",         "localhost", 3306, 33060}, rs.at("replicaset-1").members.at(2)));
-    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-1", "instance-4", "",                 ServerMode::Unavailable, 0.0f, 0, "",          "", 3306, 33060}, rs.at("replicaset-1").members.at(3)));
+    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-1", "instance-1", "HA",               ServerMode::Unavailable, 0.2f, 0, "location1", "localhost", 3310, 33100, 0}, rs.at("replicaset-1").members.at(0)));
+    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-1", "instance-2", "arbitrary_string", ServerMode::Unavailable, 1.5f, 1, "s.o_loc",   "localhost", 3320, 33200, 0}, rs.at("replicaset-1").members.at(1)));
+    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-1", "instance-3", "",                 ServerMode::Unavailable, 0.0f, 99, "",         "localhost", 3306, 33060, 0}, rs.at("replicaset-1").members.at(2)));
+    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-1", "instance-4", "",                 ServerMode::Unavailable, 0.0f, 0, "",          "", 3306, 33060, 0}, rs.at("replicaset-1").members.at(3)));
     // TODO is this really right behavior? ---------------------------------------------------------------------------------------------------^^
   }
 
@@ -516,14 +536,14 @@ TEST_F(MetadataTest, FetchInstancesFromMetadataServer) {
 
     EXPECT_EQ(3u, rs.size());
     EXPECT_EQ(3u, rs.at("replicaset-1").members.size());
-    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-1", "instance-1", "HA", ServerMode::Unavailable, 0, 0, "", "localhost1", 1111, 11110}, rs.at("replicaset-1").members.at(0)));
-    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-1", "instance-2", "HA", ServerMode::Unavailable, 0, 0, "", "localhost1", 2222, 22220}, rs.at("replicaset-1").members.at(1)));
-    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-1", "instance-3", "HA", ServerMode::Unavailable, 0, 0, "", "localhost1", 3333, 33330}, rs.at("replicaset-1").members.at(2)));
+    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-1", "instance-1", "HA", ServerMode::Unavailable, 0, 0, "", "localhost1", 1111, 11110, 0}, rs.at("replicaset-1").members.at(0)));
+    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-1", "instance-2", "HA", ServerMode::Unavailable, 0, 0, "", "localhost1", 2222, 22220, 0}, rs.at("replicaset-1").members.at(1)));
+    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-1", "instance-3", "HA", ServerMode::Unavailable, 0, 0, "", "localhost1", 3333, 33330, 0}, rs.at("replicaset-1").members.at(2)));
     EXPECT_EQ(1u, rs.at("replicaset-2").members.size());
-    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-2", "instance-4", "HA", ServerMode::Unavailable, 0, 0, "", "localhost2", 3333, 33330}, rs.at("replicaset-2").members.at(0)));
+    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-2", "instance-4", "HA", ServerMode::Unavailable, 0, 0, "", "localhost2", 3333, 33330, 0}, rs.at("replicaset-2").members.at(0)));
     EXPECT_EQ(2u, rs.at("replicaset-3").members.size());
-    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-3", "instance-5", "HA", ServerMode::Unavailable, 0, 0, "", "localhost3", 3333, 33330}, rs.at("replicaset-3").members.at(0)));
-    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-3", "instance-6", "HA", ServerMode::Unavailable, 0, 0, "", "localhost3", 3333, 33330}, rs.at("replicaset-3").members.at(1)));
+    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-3", "instance-5", "HA", ServerMode::Unavailable, 0, 0, "", "localhost3", 3333, 33330, 0}, rs.at("replicaset-3").members.at(0)));
+    EXPECT_TRUE(cmp_mi_FIFMS(ManagedInstance{"replicaset-3", "instance-6", "HA", ServerMode::Unavailable, 0, 0, "", "localhost3", 3333, 33330, 0}, rs.at("replicaset-3").members.at(1)));
   }
 
   // query fails
@@ -559,9 +579,9 @@ TEST_F(MetadataTest, CheckReplicasetStatus_3NodeSetup) {
 
   std::vector<ManagedInstance> expected_servers {
     // ServerMode doesn't matter ------vvvvvvvvvvv
-    {"", "instance-1", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
-    {"", "instance-2", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
-    {"", "instance-3", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
+    {"", "instance-1", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
+    {"", "instance-2", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
+    {"", "instance-3", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
   };
 
   // typical
@@ -784,13 +804,13 @@ TEST_F(MetadataTest, CheckReplicasetStatus_VariableNodeSetup) {
   {
     std::vector<ManagedInstance> expected_servers {
       // ServerMode doesn't matter ------vvvvvvvvvvv
-      {"", "instance-1", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
-      {"", "instance-2", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
-      {"", "instance-3", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
-      {"", "instance-4", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
-      {"", "instance-5", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
-      {"", "instance-6", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
-      {"", "instance-7", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
+      {"", "instance-1", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
+      {"", "instance-2", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
+      {"", "instance-3", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
+      {"", "instance-4", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
+      {"", "instance-5", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
+      {"", "instance-6", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
+      {"", "instance-7", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
     };
     EXPECT_EQ(RS::AvailableWritable, metadata.check_replicaset_status(expected_servers, server_status));
     EXPECT_EQ(ServerMode::ReadWrite,   expected_servers.at(0).mode);
@@ -803,10 +823,10 @@ TEST_F(MetadataTest, CheckReplicasetStatus_VariableNodeSetup) {
   // 4-node setup according to metadata
   {
     std::vector<ManagedInstance> expected_servers {
-      {"", "instance-1", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
-      {"", "instance-2", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
-      {"", "instance-3", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
-      {"", "instance-4", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
+      {"", "instance-1", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
+      {"", "instance-2", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
+      {"", "instance-3", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
+      {"", "instance-4", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
     };
     EXPECT_EQ(RS::AvailableWritable, metadata.check_replicaset_status(expected_servers, server_status));
     EXPECT_EQ(ServerMode::ReadWrite,   expected_servers.at(0).mode);
@@ -828,8 +848,8 @@ TEST_F(MetadataTest, CheckReplicasetStatus_VariableNodeSetup) {
   // 2-node setup according to metadata -> quorum requires 3 nodes, 2 nodes count
   {
     std::vector<ManagedInstance> expected_servers {
-      {"", "instance-1", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
-      {"", "instance-2", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
+      {"", "instance-1", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
+      {"", "instance-2", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
     };
     EXPECT_EQ(RS::AvailableWritable, metadata.check_replicaset_status(expected_servers, server_status));
     EXPECT_EQ(ServerMode::ReadWrite,   expected_servers.at(0).mode);
@@ -840,7 +860,7 @@ TEST_F(MetadataTest, CheckReplicasetStatus_VariableNodeSetup) {
   // 1-node setup according to metadata -> quorum requires 3 nodes, 1 node counts
   {
     std::vector<ManagedInstance> expected_servers {
-      {"", "instance-1", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
+      {"", "instance-1", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
     };
     EXPECT_EQ(RS::Unavailable, metadata.check_replicaset_status(expected_servers, server_status));
     EXPECT_EQ(ServerMode::ReadWrite,   expected_servers.at(0).mode);
@@ -863,9 +883,9 @@ TEST_F(MetadataTest, CheckReplicasetStatus_VariousStatuses) {
 
   std::vector<ManagedInstance> expected_servers {
     // ServerMode doesn't matter ------vvvvvvvvvvv
-    {"", "instance-1", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
-    {"", "instance-2", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
-    {"", "instance-3", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0},
+    {"", "instance-1", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
+    {"", "instance-2", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
+    {"", "instance-3", "", ServerMode::Unavailable, 0, 0, "", "", 0, 0, 0},
   };
 
   for (State state : {State::Offline, State::Recovering, State::Unreachable, State::Other}) {
@@ -949,9 +969,9 @@ TEST_F(MetadataTest, UpdateReplicasetStatus_PrimaryMember_FailConnectOnNode2) {
   metadata.update_replicaset_status("replicaset-1", replicaset);
 
   EXPECT_EQ(3u, replicaset.members.size());
-  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100}, replicaset.members.at(0)));
-  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3320, 33200}, replicaset.members.at(1)));
-  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300}, replicaset.members.at(2)));
+  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100, 0}, replicaset.members.at(0)));
+  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3320, 33200, 0}, replicaset.members.at(1)));
+  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300, 0}, replicaset.members.at(2)));
 
   EXPECT_EQ(3, session_factory.create_cnt());          // +2 from new connections to localhost:3320 and :3330
 }
@@ -987,6 +1007,118 @@ TEST_F(MetadataTest, UpdateReplicasetStatus_PrimaryMember_FailConnectOnAllNodes)
   EXPECT_EQ(3, session_factory.create_cnt());          // +2 from new connections to localhost:3320 and :3330
 }
 
+TEST_F(MetadataTest, UpdateReplicasetStatus_ConnectsAheadAfterUnreachableNode) {
+
+  connect_to_first_metadata_server();
+
+  // TEST SCENARIO:
+  //   iteration 1 (instance-1): query_primary_member FAILS
+  //   iteration 2 (instance-2): CAN'T CONNECT -> instance-3 and instance-4 get connected at once
+  //   iteration 3 (instance-3): query_primary_member OK, query_status OK
+
+  unsigned session = 0;
+
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_primary_member), _)).Times(1)
+    .WillOnce(Invoke(query_primary_member_fail(session)));
+
+  EXPECT_CALL(session_factory.get(++session), flag_fail(_, 3320)).Times(1);
+
+  // connected to, even though instance-3 is enough
+  enable_connection(++session, 3330);
+  enable_connection(session + 1, 3340);
+
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_primary_member), _)).Times(1)
+    .WillOnce(Invoke(query_primary_member_ok(session)));
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_status), _)).Times(1)
+    .WillOnce(Invoke(query_status_ok(session)));
+
+  ManagedReplicaSet replicaset = typical_replicaset;
+  replicaset.members.push_back(ManagedInstance{"replicaset-1", "instance-4", "HA", ServerMode::Unavailable, 0, 0, "", "localhost", 3340, 33400, 0});
+  metadata.update_replicaset_status("replicaset-1", replicaset);
+
+  EXPECT_EQ(4u, replicaset.members.size());
+  EXPECT_EQ(ServerMode::ReadWrite, replicaset.members.at(0).mode);
+  EXPECT_EQ(ServerMode::ReadOnly, replicaset.members.at(1).mode);
+  EXPECT_EQ(ServerMode::ReadOnly, replicaset.members.at(2).mode);
+  EXPECT_EQ(ServerMode::Unavailable, replicaset.members.at(3).mode);  // not in query_status
+
+  EXPECT_EQ(4, session_factory.create_cnt());          // +3 from new connections to localhost:3320, :3330 and :3340
+}
+
+TEST_F(MetadataTest, UpdateReplicasetStatus_DeadlinePassed) {
+
+  connect_to_first_metadata_server();
+
+  // no server is tried anymore
+  EXPECT_CALL(session_factory.get(0), query(_, _)).Times(0);
+
+  ManagedReplicaSet replicaset = typical_replicaset;
+  metadata.update_replicaset_status("replicaset-1", replicaset,
+                                    std::chrono::steady_clock::now() - std::chrono::seconds(1));
+  EXPECT_TRUE(replicaset.members.empty());
+
+  EXPECT_EQ(1, session_factory.create_cnt());          // caused by connect_to_first_metadata_server()
+}
+
+TEST_F(MetadataTest, UpdateReplicasetStatus_ReusesConnections) {
+
+  connect_to_first_metadata_server();
+
+  // TEST SCENARIO (2 refreshes):
+  //   iteration 1 (instance-1): query_primary_member FAILS
+  //   iteration 2 (instance-2): query_primary_member OK, query_status OK
+  // the connection to instance-2 is only established by the 1st refresh
+
+  unsigned session = 0;
+
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_primary_member), _)).Times(2)
+    .WillRepeatedly(Invoke(query_primary_member_fail(session)));
+
+  enable_connection(++session, 3320);
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_primary_member), _)).Times(2)
+    .WillRepeatedly(Invoke(query_primary_member_ok(session)));
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_status), _)).Times(2)
+    .WillRepeatedly(Invoke(query_status_ok(session)));
+
+  for (int i = 0; i < 2; ++i) {
+    ManagedReplicaSet replicaset = typical_replicaset;
+    metadata.update_replicaset_status("replicaset-1", replicaset);
+    EXPECT_EQ(3u, replicaset.members.size());
+  }
+
+  EXPECT_EQ(2, session_factory.create_cnt());          // +1 from new connection to localhost:3320, reused afterwards
+}
+
+TEST_F(MetadataTest, UpdateReplicasetStatus_BackoffAfterFailedConnect) {
+
+  connect_to_first_metadata_server();
+
+  // TEST SCENARIO (2 refreshes):
+  //   1st refresh: instance-1 query_primary_member FAILS, instance-2 CAN'T CONNECT,
+  //                instance-3 query_primary_member OK, query_status OK
+  //   2nd refresh: instance-1 query_primary_member FAILS, instance-3 (pooled)
+  //                OK, instance-2 is in backoff and would only be tried last
+
+  EXPECT_CALL(session_factory.get(0), query(StartsWith(query_primary_member), _)).Times(2)
+    .WillRepeatedly(Invoke(query_primary_member_fail(0)));
+
+  EXPECT_CALL(session_factory.get(1), flag_fail(_, 3320)).Times(1);
+
+  enable_connection(2, 3330);
+  EXPECT_CALL(session_factory.get(2), query(StartsWith(query_primary_member), _)).Times(2)
+    .WillRepeatedly(Invoke(query_primary_member_ok(2)));
+  EXPECT_CALL(session_factory.get(2), query(StartsWith(query_status), _)).Times(2)
+    .WillRepeatedly(Invoke(query_status_ok(2)));
+
+  for (int i = 0; i < 2; ++i) {
+    ManagedReplicaSet replicaset = typical_replicaset;
+    metadata.update_replicaset_status("replicaset-1", replicaset);
+    EXPECT_EQ(3u, replicaset.members.size());
+  }
+
+  EXPECT_EQ(3, session_factory.create_cnt());          // +2 from new connections to localhost:3320 and :3330
+}
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1032,9 +1164,9 @@ TEST_F(MetadataTest, UpdateReplicasetStatus_PrimaryMember_FailQueryOnNode1) {
 
   // query_status reported back from instance-2
   EXPECT_EQ(3u, replicaset.members.size());
-  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100}, replicaset.members.at(0)));
-  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3320, 33200}, replicaset.members.at(1)));
-  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300}, replicaset.members.at(2)));
+  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100, 0}, replicaset.members.at(0)));
+  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3320, 33200, 0}, replicaset.members.at(1)));
+  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300, 0}, replicaset.members.at(2)));
 }
 
 TEST_F(MetadataTest, UpdateReplicasetStatus_PrimaryMember_FailQueryOnAllNodes) {
@@ -1128,9 +1260,9 @@ TEST_F(MetadataTest, UpdateReplicasetStatus_Status_FailQueryOnNode1) {
 
   // query_status reported back from instance-1
   EXPECT_EQ(3u, replicaset.members.size());
-  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100}, replicaset.members.at(0)));
-  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3320, 33200}, replicaset.members.at(1)));
-  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300}, replicaset.members.at(2)));
+  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100, 0}, replicaset.members.at(0)));
+  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3320, 33200, 0}, replicaset.members.at(1)));
+  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300, 0}, replicaset.members.at(2)));
 }
 
 TEST_F(MetadataTest, UpdateReplicasetStatus_Status_FailQueryOnAllNodes) {
@@ -1222,12 +1354,110 @@ TEST_F(MetadataTest, UpdateReplicasetStatus_SimpleSunnyDayScenario) {
 
   // query_status reported back from instance-1
   EXPECT_EQ(3u, replicaset.members.size());
-  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100}, replicaset.members.at(0)));
-  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3320, 33200}, replicaset.members.at(1)));
-  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300}, replicaset.members.at(2)));
+  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100, 0}, replicaset.members.at(0)));
+  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-2", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3320, 33200, 0}, replicaset.members.at(1)));
+  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-3", "", ServerMode::ReadOnly,  0, 0, "", "localhost", 3330, 33300, 0}, replicaset.members.at(2)));
 }
 
 
+TEST_F(MetadataTest, UpdateReplicasetStatus_ApplyBacklog) {
+  connect_to_first_metadata_server();
+
+  unsigned session = 0;
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_primary_member), _)).Times(3)
+    .WillRepeatedly(Invoke(query_primary_member_ok(session)));
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_status), _)).Times(3)
+    .WillRepeatedly(Invoke(query_status_ok(session)));
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_backlog), _)).Times(3)
+    .WillOnce(Invoke([this, session](const std::string&, const MySQLSession::RowProcessor& processor) {
+      session_factory.get(session).query_impl(processor, {
+        {"instance-1", "0"},
+        {"instance-2", "1500"},
+        {"instance-3", nullptr},  // no stats reported yet
+      });
+    }))
+    .WillOnce(Invoke([this, session](const std::string&, const MySQLSession::RowProcessor& processor) {
+      session_factory.get(session).query_impl(processor, {}, false);
+    }))
+    .WillOnce(Invoke([](const std::string&, const MySQLSession::RowProcessor&) {
+      // before MySQL 8.0
+      throw MySQLSession::Error("Unknown column 'count_transactions_remote_in_applier_queue'", 1054);
+    }));
+
+  ManagedReplicaSet replicaset = typical_replicaset;
+  metadata.update_replicaset_status("replicaset-1", replicaset);
+  ASSERT_EQ(3u, replicaset.members.size());
+  EXPECT_EQ(0u, replicaset.members.at(0).apply_backlog);
+  EXPECT_EQ(1500u, replicaset.members.at(1).apply_backlog);
+  EXPECT_EQ(0u, replicaset.members.at(2).apply_backlog);
+
+  // the query fails: the backlog is unknown for this refresh
+  replicaset = typical_replicaset;
+  metadata.update_replicaset_status("replicaset-1", replicaset);
+  EXPECT_EQ(3u, replicaset.members.size());
+  EXPECT_EQ(0u, replicaset.members.at(1).apply_backlog);
+
+  // the server doesn't report it: it isn't asked for anymore
+  replicaset = typical_replicaset;
+  metadata.update_replicaset_status("replicaset-1", replicaset);
+  EXPECT_EQ(3u, replicaset.members.size());
+  EXPECT_EQ(0u, replicaset.members.at(1).apply_backlog);
+
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_primary_member), _)).Times(1)
+    .WillOnce(Invoke(query_primary_member_ok(session)));
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_status), _)).Times(1)
+    .WillOnce(Invoke(query_status_ok(session)));
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_backlog), _)).Times(0);
+  replicaset = typical_replicaset;
+  metadata.update_replicaset_status("replicaset-1", replicaset);
+  EXPECT_EQ(3u, replicaset.members.size());
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// test ClusterMetadata::wait_for_gtids()
+//
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_F(MetadataTest, WaitForGtids_ConnectionReused) {
+  connect_to_first_metadata_server();
+
+  const ManagedInstance instance{"replicaset-1", "instance-2", "", ServerMode::ReadOnly, 0, 0, "", "127.0.0.1", 3320, 33200, 0};
+  const std::string gtids = "3E11FA47-71CA-11E1-9E33-C80AA9429562:23";
+  const std::string query_wait = "SELECT WAIT_FOR_EXECUTED_GTID_SET('" + gtids + "', 0.500)";
+
+  // 1st call connects, 2nd call reuses the connection
+  unsigned session = 1;
+  enable_connection(session, 3320);
+  EXPECT_CALL(session_factory.get(session), query(query_wait, _)).Times(3)
+    .WillOnce(Invoke([this, session](const std::string&, const MySQLSession::RowProcessor& processor) {
+      session_factory.get(session).query_impl(processor, {{"1"}});  // timed out
+    }))
+    .WillOnce(Invoke([this, session](const std::string&, const MySQLSession::RowProcessor& processor) {
+      session_factory.get(session).query_impl(processor, {{"0"}});
+    }))
+    .WillOnce(Invoke([this, session](const std::string&, const MySQLSession::RowProcessor& processor) {
+      session_factory.get(session).query_impl(processor, {}, false);
+    }));
+
+  EXPECT_FALSE(metadata.wait_for_gtids(instance, gtids, std::chrono::milliseconds(500)));
+  EXPECT_TRUE(metadata.wait_for_gtids(instance, gtids, std::chrono::milliseconds(500)));
+  EXPECT_EQ(2, session_factory.create_cnt());
+
+  // the query fails: the connection isn't used again
+  EXPECT_FALSE(metadata.wait_for_gtids(instance, gtids, std::chrono::milliseconds(500)));
+
+  session = 2;
+  enable_connection(session, 3320);
+  EXPECT_CALL(session_factory.get(session), query(query_wait, _)).Times(1)
+    .WillOnce(Invoke([this, session](const std::string&, const MySQLSession::RowProcessor& processor) {
+      session_factory.get(session).query_impl(processor, {{"0"}});
+    }));
+  EXPECT_TRUE(metadata.wait_for_gtids(instance, gtids, std::chrono::milliseconds(500)));
+  EXPECT_EQ(3, session_factory.create_cnt());
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -1264,9 +1494,9 @@ TEST_F(MetadataTest, FetchInstances_1Replicaset_ok) {
 
   EXPECT_EQ(1u, rs.size());
   EXPECT_EQ(3u, rs.at("replicaset-1").members.size());
-  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100}, rs.at("replicaset-1").members.at(0)));
-  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-2", "", ServerMode::ReadOnly, 0, 0, "", "localhost", 3320, 33200}, rs.at("replicaset-1").members.at(1)));
-  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-3", "", ServerMode::ReadOnly, 0, 0, "", "localhost", 3330, 33300}, rs.at("replicaset-1").members.at(2)));
+  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100, 0}, rs.at("replicaset-1").members.at(0)));
+  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-2", "", ServerMode::ReadOnly, 0, 0, "", "localhost", 3320, 33200, 0}, rs.at("replicaset-1").members.at(1)));
+  EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-3", "", ServerMode::ReadOnly, 0, 0, "", "localhost", 3330, 33300, 0}, rs.at("replicaset-1").members.at(2)));
 }
 
 TEST_F(MetadataTest, FetchInstances_1Replicaset_fail) {
@@ -1297,3 +1527,147 @@ TEST_F(MetadataTest, FetchInstances_1Replicaset_fail) {
   EXPECT_EQ(1u, rs.size());
   EXPECT_EQ(0u, rs.at("replicaset-1").members.size());
 }
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// test ClusterMetadata::topology_changed()
+//
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_F(MetadataTest, TopologyChanged_SignatureCompared) {
+
+  connect_to_first_metadata_server();
+
+  // all requests go to existing connection to instance-1 (shared with metadata server)
+  unsigned session = 0;
+
+  auto resultset_metadata = [this](const std::string&, const MySQLSession::RowProcessor& processor) {
+    session_factory.get(0).query_impl(processor, {
+      {"replicaset-1", "instance-1", "HA", NULL, NULL, "blabla", "localhost:3310", NULL},
+      {"replicaset-1", "instance-2", "HA", NULL, NULL, "blabla", "localhost:3320", NULL},
+      {"replicaset-1", "instance-3", "HA", NULL, NULL, "blabla", "localhost:3330", NULL},
+    });
+  };
+  auto signature = [this](const char *view_id) {
+    return [this, view_id](const std::string&, const MySQLSession::RowProcessor& processor) {
+      session_factory.get(0).query_impl(processor, {
+        {"3/123456", view_id, "instance-1:ONLINE,instance-2:ONLINE,instance-3:ONLINE", "instance-1", "1"},
+      });
+    };
+  };
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_metadata), _)).Times(2)
+    .WillRepeatedly(Invoke(resultset_metadata));
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_primary_member), _)).Times(2)
+    .WillRepeatedly(Invoke(query_primary_member_ok(session)));
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_status), _)).Times(2)
+    .WillRepeatedly(Invoke(query_status_ok(session)));
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_signature), _)).Times(3)
+    .WillOnce(Invoke(signature("1:1")))
+    .WillOnce(Invoke(signature("1:1")))
+    .WillOnce(Invoke(signature("1:2")));
+
+  // nothing known about the topology yet, the signature isn't queried
+  EXPECT_TRUE(metadata.topology_changed("replicaset-1"));
+  metadata.fetch_instances("replicaset-1");
+
+  // instance-1 turned out to be an online member; its signature is taken
+  // before the next fetch
+  EXPECT_TRUE(metadata.topology_changed("replicaset-1"));
+  metadata.fetch_instances("replicaset-1");
+
+  // the connection is kept for the next check
+  EXPECT_TRUE(metadata.connect({}));
+  EXPECT_EQ(1, session_factory.create_cnt());
+
+  // same signature: no need to fetch
+  EXPECT_FALSE(metadata.topology_changed("replicaset-1"));
+
+  // new GR view
+  EXPECT_TRUE(metadata.topology_changed("replicaset-1"));
+}
+
+TEST_F(MetadataTest, TopologyChanged_BacklogMagnitude) {
+
+  connect_to_first_metadata_server();
+
+  unsigned session = 0;
+
+  auto resultset_metadata = [this](const std::string&, const MySQLSession::RowProcessor& processor) {
+    session_factory.get(0).query_impl(processor, {
+      {"replicaset-1", "instance-1", "HA", NULL, NULL, "blabla", "localhost:3310", NULL},
+      {"replicaset-1", "instance-2", "HA", NULL, NULL, "blabla", "localhost:3320", NULL},
+      {"replicaset-1", "instance-3", "HA", NULL, NULL, "blabla", "localhost:3330", NULL},
+    });
+  };
+  auto signature = [this](const std::string&, const MySQLSession::RowProcessor& processor) {
+    session_factory.get(0).query_impl(processor, {
+      {"3/123456", "1:1", "instance-1:ONLINE,instance-2:ONLINE,instance-3:ONLINE", "instance-1", "1"},
+    });
+  };
+  auto backlog = [this](const char *instance_2) {
+    return [this, instance_2](const std::string&, const MySQLSession::RowProcessor& processor) {
+      session_factory.get(0).query_impl(processor, {
+        {"instance-1", "0"},
+        {"instance-2", instance_2},
+        {"instance-3", "0"},
+      });
+    };
+  };
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_metadata), _)).Times(2)
+    .WillRepeatedly(Invoke(resultset_metadata));
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_primary_member), _)).Times(2)
+    .WillRepeatedly(Invoke(query_primary_member_ok(session)));
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_status), _)).Times(2)
+    .WillRepeatedly(Invoke(query_status_ok(session)));
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_signature), _)).Times(3)
+    .WillRepeatedly(Invoke(signature));
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_backlog), _)).Times(5)
+    .WillOnce(Invoke(backlog("10")))    // 1st fetch
+    .WillOnce(Invoke(backlog("10")))    // 1st signature
+    .WillOnce(Invoke(backlog("10")))    // 2nd fetch
+    .WillOnce(Invoke(backlog("40")))    // 2nd signature
+    .WillOnce(Invoke(backlog("100")));  // 3rd signature
+
+  EXPECT_TRUE(metadata.topology_changed("replicaset-1"));
+  metadata.fetch_instances("replicaset-1");
+  EXPECT_TRUE(metadata.topology_changed("replicaset-1"));
+  ClusterMetadata::ReplicaSetsByName rs = metadata.fetch_instances("replicaset-1");
+  EXPECT_EQ(10u, rs.at("replicaset-1").members.at(1).apply_backlog);
+
+  // small backlogs don't need a fetch, even if they quadrupled
+  EXPECT_FALSE(metadata.topology_changed("replicaset-1"));
+
+  // the backlog grew by an order of magnitude
+  EXPECT_TRUE(metadata.topology_changed("replicaset-1"));
+}
+
+TEST_F(MetadataTest, TopologyChanged_NoQuorum) {
+
+  connect_to_first_metadata_server();
+
+  unsigned session = 0;
+
+  auto resultset_metadata = [this](const std::string&, const MySQLSession::RowProcessor& processor) {
+    session_factory.get(0).query_impl(processor, {
+      {"replicaset-1", "instance-1", "HA", NULL, NULL, "blabla", "localhost:3310", NULL},
+      {"replicaset-1", "instance-2", "HA", NULL, NULL, "blabla", "localhost:3320", NULL},
+      {"replicaset-1", "instance-3", "HA", NULL, NULL, "blabla", "localhost:3330", NULL},
+    });
+  };
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_metadata), _)).Times(1)
+    .WillOnce(Invoke(resultset_metadata));
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_primary_member), _)).Times(1)
+    .WillOnce(Invoke(query_primary_member_fail(session)));
+  EXPECT_CALL(session_factory.get(++session), flag_fail(_, 3320)).Times(1);
+  EXPECT_CALL(session_factory.get(++session), flag_fail(_, 3330)).Times(1);
+  EXPECT_CALL(session_factory.get(0), query(StartsWith(query_signature), _)).Times(0);
+
+  ClusterMetadata::ReplicaSetsByName rs = metadata.fetch_instances("replicaset-1");
+  EXPECT_EQ(0u, rs.at("replicaset-1").members.size());
+
+  // the metadata server isn't known to be an online member, so its view
+  // of the group doesn't tell anything
+  EXPECT_TRUE(metadata.topology_changed("replicaset-1"));
+}
@@ -22,6 +22,7 @@
 #include "gtest/gtest_prod.h" // must be the first header
 #include "cluster_metadata.h"
 #include "dim.h"
+#include "filesystem.h"
 #include "metadata_cache.h"
 #include "metadata_factory.h"
 #include "mock_metadata.h"
@@ -31,6 +32,10 @@
 
 #include "mysqlrouter/datatypes.h"
 
+#include <algorithm>
+#include <set>
+#include <vector>
+
 using metadata_cache::ManagedInstance;
 
 class MetadataCacheTest : public ::testing::Test {
@@ -102,14 +107,16 @@ class MetadataCacheTest2 : public ::testing::Test {
     });
   }
 
-  // make queries on PFS.replication_group_members return all members ONLINE
-  void expect_sql_members() {
+  // make queries on PFS.replication_group_members return all members ONLINE,
+  // the ones on PFS.replication_group_member_stats the given backlog of the
+  // 2nd member
+  void expect_sql_members(const char *primary = "uuid-server1", const char *backlog2 = "0") {
     MySQLSessionReplayer &m = *session;
 
     m.expect_query("show status like 'group_replication_primary_member'");
     m.then_return(2, {
       // Variable_name, Value
-      {m.string_or_null("group_replication_primary_member"), m.string_or_null("uuid-server1")}
+      {m.string_or_null("group_replication_primary_member"), m.string_or_null(primary)}
     });
 
     m.expect_query("SELECT member_id, member_host, member_port, member_state, @@group_replication_single_primary_mode FROM performance_schema.replication_group_members WHERE channel_name = 'group_replication_applier'");
@@ -119,6 +126,14 @@ class MetadataCacheTest2 : public ::testing::Test {
       {m.string_or_null("uuid-server2"), m.string_or_null("somehost"), m.string_or_null("3001"), m.string_or_null("ONLINE"), m.string_or_null("1")},
       {m.string_or_null("uuid-server3"), m.string_or_null("somehost"), m.string_or_null("3002"), m.string_or_null("ONLINE"), m.string_or_null("1")}
     });
+
+    m.expect_query("SELECT member_id, count_transactions_remote_in_applier_queue FROM performance_schema.replication_group_member_stats WHERE channel_name = 'group_replication_applier'");
+    m.then_return(2, {
+      // member_id, count_transactions_remote_in_applier_queue
+      {m.string_or_null("uuid-server1"), m.string_or_null("0")},
+      {m.string_or_null("uuid-server2"), m.string_or_null(backlog2)},
+      {m.string_or_null("uuid-server3"), m.string_or_null("0")}
+    });
   }
 
   std::shared_ptr<MySQLSessionReplayer> session;
@@ -171,6 +186,105 @@ TEST_F(MetadataCacheTest2, basic_test) {
   expect_cluster_routable(mc);  // repeated queries should not change anything
 }
 
+TEST_F(MetadataCacheTest2, lookup_result_outlives_refresh) {
+
+  MySQLSessionReplayer& m = *session;
+
+  expect_sql_metadata();
+  expect_sql_members();
+  MetadataCache mc(metadata_servers, cmeta, 10, mysqlrouter::SSLOptions(), "cluster-1");
+
+  metadata_cache::LookupResult result = mc.lookup("cluster-1");
+  const uint64_t generation = result.generation();
+  ASSERT_EQ(3U, result.instance_vector.size());
+
+  // refresh without changes: the snapshot is kept
+  expect_sql_metadata();
+  expect_sql_members();
+  mc.refresh();
+  EXPECT_EQ(generation, mc.lookup("cluster-1").generation());
+
+  // refresh: all metadata servers are down, an empty snapshot gets published
+  m.disconnect();
+  m.expect_connect("127.0.0.1", 3000, "admin", "admin", "").then_error("some fake bad connection message", 66);
+  m.expect_connect("127.0.0.1", 3001, "admin", "admin", "").then_error("some fake bad connection message", 66);
+  m.expect_connect("127.0.0.1", 3002, "admin", "admin", "").then_error("some fake bad connection message", 66);
+  mc.refresh();
+  expect_cluster_not_routable(mc);
+  EXPECT_LT(generation, mc.topology()->generation);
+
+  // the old result still refers to the old snapshot
+  ASSERT_EQ(3U, result.instance_vector.size());
+  EXPECT_EQ("uuid-server1", result.instance_vector[0].mysql_server_uuid);
+  EXPECT_EQ(generation, result.generation());
+}
+
+class RecordingListener : public metadata_cache::TopologyListener {
+ public:
+  void topology_changed(const std::shared_ptr<const metadata_cache::Topology> &topology,
+                        const std::vector<metadata_cache::TopologyChange> &changes) override {
+    generations.push_back(topology->generation);
+    this->changes.push_back(changes);
+  }
+
+  std::vector<uint64_t> generations;
+  std::vector<std::vector<metadata_cache::TopologyChange>> changes;
+};
+
+TEST_F(MetadataCacheTest2, listeners_get_changes) {
+  using Type = metadata_cache::TopologyChange::Type;
+
+  MySQLSessionReplayer& m = *session;
+
+  expect_sql_metadata();
+  expect_sql_members();
+  MetadataCache mc(metadata_servers, cmeta, 10, mysqlrouter::SSLOptions(), "cluster-1");
+
+  RecordingListener listener;
+  mc.add_listener(&listener);
+
+  // refresh without changes: no notification
+  expect_sql_metadata();
+  expect_sql_members();
+  mc.refresh();
+  EXPECT_TRUE(listener.changes.empty());
+
+  // refresh: server2 became the primary
+  expect_sql_metadata();
+  expect_sql_members("uuid-server2");
+  mc.refresh();
+  ASSERT_EQ(1U, listener.changes.size());
+  EXPECT_EQ(mc.topology()->generation, listener.generations.back());
+  ASSERT_EQ(2U, listener.changes[0].size());
+  EXPECT_EQ(Type::ModeChanged, listener.changes[0][0].type);
+  EXPECT_EQ("uuid-server1", listener.changes[0][0].instance.mysql_server_uuid);
+  EXPECT_EQ(metadata_cache::ServerMode::ReadOnly, listener.changes[0][0].instance.mode);
+  EXPECT_EQ(metadata_cache::ServerMode::ReadWrite, listener.changes[0][0].previous_mode);
+  EXPECT_EQ(Type::ModeChanged, listener.changes[0][1].type);
+  EXPECT_EQ("uuid-server2", listener.changes[0][1].instance.mysql_server_uuid);
+  EXPECT_EQ(metadata_cache::ServerMode::ReadWrite, listener.changes[0][1].instance.mode);
+
+  // refresh: all metadata servers are down, all instances are removed
+  m.disconnect();
+  m.expect_connect("127.0.0.1", 3000, "admin", "admin", "").then_error("some fake bad connection message", 66);
+  m.expect_connect("127.0.0.1", 3001, "admin", "admin", "").then_error("some fake bad connection message", 66);
+  m.expect_connect("127.0.0.1", 3002, "admin", "admin", "").then_error("some fake bad connection message", 66);
+  mc.refresh();
+  ASSERT_EQ(2U, listener.changes.size());
+  ASSERT_EQ(3U, listener.changes[1].size());
+  for (const auto &change : listener.changes[1]) {
+    EXPECT_EQ(Type::InstanceRemoved, change.type);
+  }
+
+  // no notifications after removing the listener
+  mc.remove_listener(&listener);
+  expect_sql_metadata();
+  expect_sql_members();
+  mc.refresh();
+  EXPECT_EQ(2U, listener.changes.size());
+  expect_cluster_routable(mc);
+}
+
 TEST_F(MetadataCacheTest2, metadata_server_connection_failures) {
 
   // Here we test MC behaviour when metadata servers go down and back up again. ATM (2017.01.10, might be changed later)
@@ -184,21 +298,24 @@ TEST_F(MetadataCacheTest2, metadata_server_connection_failures) {
   MetadataCache mc(metadata_servers, cmeta, 10, mysqlrouter::SSLOptions(), "cluster-1");
   expect_cluster_routable(mc);
 
-  // refresh: fail connecting to first metadata server
+  // refresh: connection to metadata server gets lost, fail reconnecting to first metadata server
+  m.disconnect();
   m.expect_connect("127.0.0.1", 3000, "admin", "admin", "").then_error("some fake bad connection message", 66);
   expect_sql_metadata();
   expect_sql_members();
   mc.refresh();
   expect_cluster_routable(mc);
 
-  // refresh: fail connecting to all 3 metadata servers
-  m.expect_connect("127.0.0.1", 3000, "admin", "admin", "").then_error("some fake bad connection message", 66);
+  // refresh: connection gets lost, fail connecting to all 3 metadata servers
+  // (the first one failed recently, so it's tried last)
+  m.disconnect();
   m.expect_connect("127.0.0.1", 3001, "admin", "admin", "").then_error("some fake bad connection message", 66);
   m.expect_connect("127.0.0.1", 3002, "admin", "admin", "").then_error("some fake bad connection message", 66);
+  m.expect_connect("127.0.0.1", 3000, "admin", "admin", "").then_error("some fake bad connection message", 66);
   mc.refresh();
   expect_cluster_not_routable(mc); // lookup should return nothing (all route paths should have been cleared)
 
-  // refresh: fail connecting to first 2 metadata servers
+  // refresh: fail connecting to first 2 metadata servers (all of them failed recently, so the order is kept)
   m.expect_connect("127.0.0.1", 3000, "admin", "admin", "").then_error("some fake bad connection message", 66);
   m.expect_connect("127.0.0.1", 3001, "admin", "admin", "").then_error("some fake bad connection message", 66);
   expect_sql_metadata();
@@ -207,3 +324,170 @@ TEST_F(MetadataCacheTest2, metadata_server_connection_failures) {
   expect_cluster_routable(mc); // lookup should see the cluster again
 }
 
+
+TEST_F(MetadataCacheTest2, stale_topology_during_outage) {
+
+  MySQLSessionReplayer& m = *session;
+
+  expect_sql_metadata();
+  expect_sql_members();
+  MetadataCache mc(metadata_servers, cmeta, 10, mysqlrouter::SSLOptions(), "cluster-1",
+                   nullptr, "", std::chrono::seconds(3600));
+  expect_cluster_routable(mc);
+  EXPECT_FALSE(mc.lookup("cluster-1").stale());
+
+  // refresh: all metadata servers are down, the topology is kept but stale
+  m.disconnect();
+  m.expect_connect("127.0.0.1", 3000, "admin", "admin", "").then_error("some fake bad connection message", 66);
+  m.expect_connect("127.0.0.1", 3001, "admin", "admin", "").then_error("some fake bad connection message", 66);
+  m.expect_connect("127.0.0.1", 3002, "admin", "admin", "").then_error("some fake bad connection message", 66);
+  mc.refresh();
+  expect_cluster_routable(mc);
+  EXPECT_TRUE(mc.lookup("cluster-1").stale());
+
+  // refresh: the metadata servers are back, the topology is current again
+  expect_sql_metadata();
+  expect_sql_members();
+  mc.refresh();
+  expect_cluster_routable(mc);
+  EXPECT_FALSE(mc.lookup("cluster-1").stale());
+}
+
+TEST_F(MetadataCacheTest2, warm_start_from_topology_file) {
+
+  const std::string tmp_dir = mysql_harness::get_tmp_dir("topology");
+  const std::string topology_file = mysql_harness::Path(tmp_dir).join("cluster-1_topology.json").str();
+
+  // the first instance saves the topology
+  {
+    expect_sql_metadata();
+    expect_sql_members();
+    MetadataCache mc(metadata_servers, cmeta, 10, mysqlrouter::SSLOptions(), "cluster-1",
+                     nullptr, topology_file, std::chrono::seconds(3600));
+    expect_cluster_routable(mc);
+  }
+
+  // the second one routes with the saved topology without asking the
+  // metadata servers
+  MetadataCache mc(metadata_servers, cmeta, 10, mysqlrouter::SSLOptions(), "cluster-1",
+                   nullptr, topology_file, std::chrono::seconds(3600));
+  expect_cluster_routable(mc);
+  EXPECT_TRUE(mc.lookup("cluster-1").stale());
+
+  expect_sql_metadata();
+  expect_sql_members();
+  mc.refresh();
+  expect_cluster_routable(mc);
+  EXPECT_FALSE(mc.lookup("cluster-1").stale());
+
+  // without max staleness, the saved topology isn't used
+  expect_sql_metadata();
+  expect_sql_members();
+  MetadataCache mc2(metadata_servers, cmeta, 10, mysqlrouter::SSLOptions(), "cluster-1",
+                    nullptr, topology_file, std::chrono::seconds(0));
+  EXPECT_FALSE(mc2.lookup("cluster-1").stale());
+
+  mysql_harness::delete_dir_recursive(tmp_dir);
+}
+
+TEST_F(MetadataCacheTest2, apply_backlog_changes_get_published) {
+
+  expect_sql_metadata();
+  expect_sql_members();
+  MetadataCache mc(metadata_servers, cmeta, 10, mysqlrouter::SSLOptions(), "cluster-1");
+  const uint64_t generation = mc.lookup("cluster-1").generation();
+
+  // the 2nd member falls behind
+  expect_sql_metadata();
+  expect_sql_members("uuid-server1", "5000");
+  mc.refresh();
+  metadata_cache::LookupResult result = mc.lookup("cluster-1");
+  EXPECT_LT(generation, result.generation());
+  ASSERT_EQ(3U, result.instance_vector.size());
+  EXPECT_EQ(0U, result.instance_vector[0].apply_backlog);
+  EXPECT_EQ(5000U, result.instance_vector[1].apply_backlog);
+  EXPECT_EQ(0U, result.instance_vector[2].apply_backlog);
+}
+
+TEST_F(MetadataCacheTest2, apply_backlog_changes_are_not_saved) {
+
+  const std::string tmp_dir = mysql_harness::get_tmp_dir("topology");
+  const std::string topology_file = mysql_harness::Path(tmp_dir).join("cluster-1_topology.json").str();
+  auto saved = [&topology_file] { return mysql_harness::Path(topology_file).exists(); };
+
+  expect_sql_metadata();
+  expect_sql_members();
+  MetadataCache mc(metadata_servers, cmeta, 10, mysqlrouter::SSLOptions(), "cluster-1",
+                   nullptr, topology_file, std::chrono::seconds(3600));
+  ASSERT_TRUE(saved());
+  mysql_harness::delete_file(topology_file);
+  const uint64_t generation = mc.lookup("cluster-1").generation();
+
+  // the topology is the same: nothing saved, but the new backlog is published
+  expect_sql_metadata();
+  expect_sql_members("uuid-server1", "5000");
+  mc.refresh();
+  EXPECT_FALSE(saved());
+  EXPECT_EQ(generation + 1, mc.lookup("cluster-1").generation());
+
+  // same backlog again: no new snapshot
+  expect_sql_metadata();
+  expect_sql_members("uuid-server1", "5000");
+  mc.refresh();
+  EXPECT_EQ(generation + 1, mc.lookup("cluster-1").generation());
+
+  // a real change is saved
+  expect_sql_metadata();
+  expect_sql_members("uuid-server2", "5000");
+  mc.refresh();
+  EXPECT_TRUE(saved());
+
+  mysql_harness::delete_dir_recursive(tmp_dir);
+}
+
+TEST_F(MetadataCacheTest2, refresh_wait_jitter_and_budget) {
+
+  RefreshSchedule schedule;
+  schedule.jitter = 20;
+  expect_sql_metadata();
+  expect_sql_members();
+  MetadataCache mc(metadata_servers, cmeta, 10, mysqlrouter::SSLOptions(), "cluster-1",
+                   nullptr, "", std::chrono::seconds(0), schedule);
+
+  std::set<std::chrono::milliseconds::rep> waits;
+  for (int i = 0; i < 100; ++i) {
+    const std::chrono::milliseconds wait = mc.next_refresh_wait();
+    EXPECT_LE(8000, wait.count());
+    EXPECT_GE(12000, wait.count());
+    waits.insert(wait.count());
+  }
+  EXPECT_LT(1U, waits.size());
+
+  // the budget of the fleet stretches the TTL
+  schedule.min_interval = std::chrono::seconds(30);
+  expect_sql_metadata();
+  expect_sql_members();
+  MetadataCache mc2(metadata_servers, cmeta, 10, mysqlrouter::SSLOptions(), "cluster-1",
+                    nullptr, "", std::chrono::seconds(0), schedule);
+  EXPECT_EQ(std::chrono::milliseconds(30000), mc2.next_refresh_wait());
+}
+
+TEST(RefreshPhaseOffsetTest, spreads_routers) {
+  const std::chrono::milliseconds period = std::chrono::seconds(300);
+
+  std::vector<std::chrono::milliseconds::rep> offsets;
+  for (uint32_t router_id = 1; router_id <= 200; ++router_id) {
+    const std::chrono::milliseconds offset = refresh_phase_offset(router_id, period);
+    EXPECT_LE(0, offset.count());
+    EXPECT_GT(period.count(), offset.count());
+    offsets.push_back(offset.count());
+  }
+
+  // no two routers refresh at about the same time
+  std::sort(offsets.begin(), offsets.end());
+  for (size_t i = 1; i < offsets.size(); ++i) {
+    EXPECT_LT(300, offsets[i] - offsets[i - 1]);
+  }
+
+  EXPECT_EQ(std::chrono::milliseconds(0), refresh_phase_offset(1, std::chrono::milliseconds(0)));
+}
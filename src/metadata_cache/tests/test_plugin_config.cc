@@ -274,4 +274,18 @@ INSTANTIATE_TEST_CASE_P(SomethingUseful, MetadataCachePluginConfigBadTest,
         "option ttl in [metadata_cache] needs value between 0 and 4294967295 inclusive, was 'garbage'",
       }
     },
+    // jitter of more than half the ttl
+    {
+      {
+        std::map<std::string, std::string>({
+          { "user", "foo" }, // required
+          { "ttl_jitter", "60" },
+        }),
+      },
+
+      {
+        typeid(std::invalid_argument),
+        "option ttl_jitter in [metadata_cache] needs value between 0 and 50 inclusive, was '60'",
+      }
+    },
   })));
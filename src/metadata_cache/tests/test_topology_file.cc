@@ -0,0 +1,144 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * Test saving and loading the topology file.
+ */
+
+#include "topology_file.h"
+#include "filesystem.h"
+
+#include "gmock/gmock.h"
+
+#include <fstream>
+
+using metadata_cache::ManagedInstance;
+using metadata_cache::ManagedReplicaSet;
+using metadata_cache::ServerMode;
+
+class TopologyFileTest : public ::testing::Test {
+ public:
+  virtual void SetUp() override {
+    tmp_dir = mysql_harness::get_tmp_dir("topology");
+    path = mysql_harness::Path(tmp_dir).join("cluster-1_topology.json").str();
+  }
+
+  virtual void TearDown() override {
+    mysql_harness::delete_dir_recursive(tmp_dir);
+  }
+
+  static ManagedInstance make_instance(const std::string &uuid, ServerMode mode,
+                                       unsigned int port) {
+    ManagedInstance mi;
+    mi.replicaset_name = "default";
+    mi.mysql_server_uuid = uuid;
+    mi.role = "HA";
+    mi.mode = mode;
+    mi.weight = 1.5f;
+    mi.version_token = 0;
+    mi.location = "";
+    mi.host = "127.0.0.1";
+    mi.port = port;
+    mi.xport = port * 10;
+    return mi;
+  }
+
+  static MetaData::ReplicaSetsByName make_topology() {
+    ManagedReplicaSet rs;
+    rs.name = "default";
+    rs.single_primary_mode = true;
+    rs.members.push_back(make_instance("uuid-server1", ServerMode::ReadWrite, 3000));
+    rs.members.push_back(make_instance("uuid-server2", ServerMode::ReadOnly, 3001));
+    rs.members.push_back(make_instance("uuid-server3", ServerMode::Unavailable, 3002));
+
+    MetaData::ReplicaSetsByName replicasets;
+    replicasets["default"] = rs;
+    return replicasets;
+  }
+
+  std::string tmp_dir;
+  std::string path;
+};
+
+TEST_F(TopologyFileTest, save_and_load) {
+  TopologyFile file(path);
+  const auto confirmed_at = TopologyFile::clock_type::time_point(std::chrono::seconds(1500000000));
+  file.save("cluster-1", make_topology(), confirmed_at);
+
+  MetaData::ReplicaSetsByName replicasets;
+  TopologyFile::clock_type::time_point loaded_confirmed_at;
+  ASSERT_TRUE(file.load("cluster-1", replicasets, loaded_confirmed_at));
+  EXPECT_EQ(confirmed_at, loaded_confirmed_at);
+
+  ASSERT_EQ(1U, replicasets.size());
+  const ManagedReplicaSet &rs = replicasets["default"];
+  EXPECT_EQ("default", rs.name);
+  EXPECT_TRUE(rs.single_primary_mode);
+  ASSERT_EQ(3U, rs.members.size());
+  EXPECT_EQ(make_instance("uuid-server1", ServerMode::ReadWrite, 3000), rs.members[0]);
+  EXPECT_EQ(make_instance("uuid-server2", ServerMode::ReadOnly, 3001), rs.members[1]);
+  EXPECT_EQ(make_instance("uuid-server3", ServerMode::Unavailable, 3002), rs.members[2]);
+
+  // saving again replaces the file
+  file.save("cluster-1", MetaData::ReplicaSetsByName(), confirmed_at);
+  ASSERT_TRUE(file.load("cluster-1", replicasets, loaded_confirmed_at));
+  EXPECT_TRUE(replicasets.empty());
+}
+
+TEST_F(TopologyFileTest, no_file) {
+  TopologyFile file(path);
+
+  MetaData::ReplicaSetsByName replicasets;
+  TopologyFile::clock_type::time_point confirmed_at;
+  EXPECT_FALSE(file.load("cluster-1", replicasets, confirmed_at));
+}
+
+TEST_F(TopologyFileTest, other_cluster) {
+  TopologyFile file(path);
+  file.save("cluster-2", make_topology(), TopologyFile::clock_type::now());
+
+  MetaData::ReplicaSetsByName replicasets;
+  TopologyFile::clock_type::time_point confirmed_at;
+  EXPECT_FALSE(file.load("cluster-1", replicasets, confirmed_at));
+  EXPECT_TRUE(replicasets.empty());
+}
+
+TEST_F(TopologyFileTest, invalid_file) {
+  TopologyFile file(path);
+
+  MetaData::ReplicaSetsByName replicasets;
+  TopologyFile::clock_type::time_point confirmed_at;
+
+  {
+    std::ofstream f(path);
+    f << "{\"version\": 1, \"cluster\": \"cluster-1\", \"confirmed_at\"";
+  }
+  EXPECT_THROW(file.load("cluster-1", replicasets, confirmed_at), std::runtime_error);
+
+  {
+    std::ofstream f(path);
+    f << "{\"version\": 1, \"cluster\": \"cluster-1\", \"confirmed_at\": 0, \"replicasets\": {}}";
+  }
+  EXPECT_THROW(file.load("cluster-1", replicasets, confirmed_at), std::runtime_error);
+}
+
+TEST_F(TopologyFileTest, save_fails) {
+  TopologyFile file(mysql_harness::Path(tmp_dir).join("no-such-dir").join("topology.json").str());
+
+  EXPECT_THROW(file.save("cluster-1", make_topology(), TopologyFile::clock_type::now()),
+               std::runtime_error);
+}
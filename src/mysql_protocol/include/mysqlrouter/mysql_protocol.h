@@ -37,8 +37,12 @@
 
 #include "mysql_protocol/constants.h" // comes first
 #include "mysql_protocol/base_packet.h"
+#include "mysql_protocol/packet_view.h"
 #include "mysql_protocol/error_packet.h"
 #include "mysql_protocol/handshake_packet.h"
+#include "mysql_protocol/ok_packet.h"
+#include "mysql_protocol/command_packets.h"
+#include "mysql_protocol/resultset_packets.h"
 
 namespace mysql_protocol {
 
@@ -22,6 +22,7 @@
 #include <climits>
 #include <cstdint>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -258,6 +259,27 @@ class MYSQL_PROTOCOL_API Packet : public std::vector<uint8_t> {
    */
   void add(const std::string &value);
 
+  /** @brief Adds a length encoded integer to the packet
+   *
+   * @param value Integral to add to the packet
+   */
+  void add_lenenc_uint(uint64_t value);
+
+  /** @brief Adds a length encoded string to the packet
+   *
+   * @param value String to add to the packet
+   */
+  void add_lenenc_string(const std::string &value);
+
+  /** @brief Gets the number of bytes an integer takes length encoded
+   *
+   * @param value Integral to encode
+   * @return size_t
+   */
+  static size_t get_lenenc_uint_size(uint64_t value) noexcept {
+    return value < 0xfb ? 1 : value <= 0xffff ? 3 : value <= 0xffffff ? 4 : 9;
+  }
+
   /** @brief Gets the packet sequence ID
    *
    * @return uint8_t
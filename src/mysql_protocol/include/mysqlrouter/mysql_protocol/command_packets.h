@@ -0,0 +1,278 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef MYSQLROUTER_MYSQL_PROTOCOL_COMMAND_PACKETS_INCLUDED
+#define MYSQLROUTER_MYSQL_PROTOCOL_COMMAND_PACKETS_INCLUDED
+
+#include "base_packet.h"
+
+#include <utility>
+
+namespace mysql_protocol {
+
+/** @class CommandPacket
+ * @brief Base class of the packets sent by the client after authentication
+ *
+ * The first byte of the payload tells which command it is.
+ */
+class MYSQL_PROTOCOL_API CommandPacket : public Packet {
+ public:
+  /** @brief Gets the command of the packet */
+  Command get_command() const noexcept {
+    return command_;
+  }
+
+  /** @brief Returns whether the payload is the given command
+   *
+   * @param packet the packet to look at
+   * @param command the command to check for
+   */
+  static bool is_command(const PacketView &packet, Command command) noexcept {
+    return packet.size() > kHeaderSize && packet[kHeaderSize] == static_cast<uint8_t>(command);
+  }
+
+ protected:
+  CommandPacket(uint8_t sequence_id, Command command, uint32_t capabilities)
+      : Packet(sequence_id, capabilities), command_(command) { }
+
+  /** @throws packet_error if buffer does not contain the given command */
+  CommandPacket(const std::vector<uint8_t> &buffer, Command command, uint32_t capabilities);
+
+  /** @brief Starts a new packet with the command byte */
+  void reset_command(size_t payload_size);
+
+  Command command_;
+};
+
+/** @class QueryPacket
+ * @brief Creates or parses a COM_QUERY packet
+ */
+class MYSQL_PROTOCOL_API QueryPacket final : public CommandPacket {
+ public:
+  /** @brief Constructor
+   *
+   * @param sequence_id MySQL Packet number
+   * @param query SQL statement
+   */
+  QueryPacket(uint8_t sequence_id, const std::string &query);
+
+  /** @overload
+   *
+   * @param buffer bytes of the packet
+   * @throws packet_error if buffer does not contain a COM_QUERY packet
+   */
+  explicit QueryPacket(const std::vector<uint8_t> &buffer);
+
+  const std::string &get_query() const noexcept {
+    return query_;
+  }
+
+ private:
+  std::string query_;
+};
+
+/** @class InitDbPacket
+ * @brief Creates or parses a COM_INIT_DB packet
+ */
+class MYSQL_PROTOCOL_API InitDbPacket final : public CommandPacket {
+ public:
+  /** @brief Constructor
+   *
+   * @param sequence_id MySQL Packet number
+   * @param schema name of the new default schema
+   */
+  InitDbPacket(uint8_t sequence_id, const std::string &schema);
+
+  /** @overload
+   *
+   * @param buffer bytes of the packet
+   * @throws packet_error if buffer does not contain a COM_INIT_DB packet
+   */
+  explicit InitDbPacket(const std::vector<uint8_t> &buffer);
+
+  const std::string &get_schema() const noexcept {
+    return schema_;
+  }
+
+ private:
+  std::string schema_;
+};
+
+/** @class StmtPreparePacket
+ * @brief Creates or parses a COM_STMT_PREPARE packet
+ */
+class MYSQL_PROTOCOL_API StmtPreparePacket final : public CommandPacket {
+ public:
+  /** @brief Constructor
+   *
+   * @param sequence_id MySQL Packet number
+   * @param query SQL statement to prepare
+   */
+  StmtPreparePacket(uint8_t sequence_id, const std::string &query);
+
+  /** @overload
+   *
+   * @param buffer bytes of the packet
+   * @throws packet_error if buffer does not contain a COM_STMT_PREPARE packet
+   */
+  explicit StmtPreparePacket(const std::vector<uint8_t> &buffer);
+
+  const std::string &get_query() const noexcept {
+    return query_;
+  }
+
+ private:
+  std::string query_;
+};
+
+/** @brief Parameter of a prepared statement */
+struct MYSQL_PROTOCOL_API StmtParam {
+  ColumnType type;
+  bool is_unsigned;
+  bool is_null;
+  /** @brief bytes of the value in the binary protocol, without length prefix */
+  std::string value;
+};
+
+/** @class StmtExecutePacket
+ * @brief Creates or parses a COM_STMT_EXECUTE packet
+ */
+class MYSQL_PROTOCOL_API StmtExecutePacket final : public CommandPacket {
+ public:
+  /** @brief Constructor
+   *
+   * @param sequence_id MySQL Packet number
+   * @param statement_id id the server returned for COM_STMT_PREPARE
+   * @param flags cursor flags (CURSOR_TYPE_*)
+   * @param params values of the parameters
+   * @param new_params_bound whether the types of the parameters are sent
+   */
+  StmtExecutePacket(uint8_t sequence_id, uint32_t statement_id, uint8_t flags,
+                    const std::vector<StmtParam> &params, bool new_params_bound = true);
+
+  /** @overload
+   *
+   * The number of parameters is not part of the packet, but known from
+   * the response to COM_STMT_PREPARE. If the types are not sent, the types
+   * of the previous execution of the statement are used.
+   *
+   * @param buffer bytes of the packet
+   * @param param_count number of parameters of the statement
+   * @param bound_types types of the parameters sent by a previous execution
+   * @throws packet_error if buffer does not contain a COM_STMT_EXECUTE packet
+   */
+  StmtExecutePacket(const std::vector<uint8_t> &buffer, uint16_t param_count,
+                    const std::vector<ColumnType> &bound_types = {});
+
+  uint32_t get_statement_id() const noexcept {
+    return statement_id_;
+  }
+
+  uint8_t get_flags() const noexcept {
+    return flags_;
+  }
+
+  bool get_new_params_bound() const noexcept {
+    return new_params_bound_;
+  }
+
+  const std::vector<StmtParam> &get_params() const noexcept {
+    return params_;
+  }
+
+ private:
+  void prepare_packet();
+
+  void parse_payload(uint16_t param_count, const std::vector<ColumnType> &bound_types);
+
+  uint32_t statement_id_;
+  uint8_t flags_;
+  bool new_params_bound_;
+  std::vector<StmtParam> params_;
+};
+
+/** @class ChangeUserPacket
+ * @brief Creates or parses a COM_CHANGE_USER packet
+ */
+class MYSQL_PROTOCOL_API ChangeUserPacket final : public CommandPacket {
+ public:
+  using Attributes = std::vector<std::pair<std::string, std::string>>;
+
+  /** @brief Constructor
+   *
+   * @param sequence_id MySQL Packet number
+   * @param username MySQL username
+   * @param auth_response authentication data for the authentication plugin
+   * @param schema default schema (can be empty)
+   * @param char_set MySQL character set code
+   * @param auth_plugin name of the authentication plugin
+   * @param attributes connection attributes
+   * @param capabilities Client capability flags
+   */
+  ChangeUserPacket(uint8_t sequence_id, const std::string &username,
+                   const std::string &auth_response, const std::string &schema,
+                   uint16_t char_set, const std::string &auth_plugin,
+                   const Attributes &attributes, uint32_t capabilities);
+
+  /** @overload
+   *
+   * @param buffer bytes of the packet
+   * @param capabilities Client capability flags
+   * @throws packet_error if buffer does not contain a COM_CHANGE_USER packet
+   */
+  ChangeUserPacket(const std::vector<uint8_t> &buffer, uint32_t capabilities);
+
+  const std::string &get_username() const noexcept {
+    return username_;
+  }
+
+  const std::string &get_auth_response() const noexcept {
+    return auth_response_;
+  }
+
+  const std::string &get_schema() const noexcept {
+    return schema_;
+  }
+
+  uint16_t get_char_set() const noexcept {
+    return char_set_;
+  }
+
+  const std::string &get_auth_plugin() const noexcept {
+    return auth_plugin_;
+  }
+
+  const Attributes &get_attributes() const noexcept {
+    return attributes_;
+  }
+
+ private:
+  void prepare_packet();
+
+  void parse_payload();
+
+  std::string username_;
+  std::string auth_response_;
+  std::string schema_;
+  uint16_t char_set_;
+  std::string auth_plugin_;
+  Attributes attributes_;
+};
+
+} // namespace mysql_protocol
+
+#endif // MYSQLROUTER_MYSQL_PROTOCOL_COMMAND_PACKETS_INCLUDED
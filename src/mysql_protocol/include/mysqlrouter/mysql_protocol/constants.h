@@ -27,6 +27,13 @@ namespace mysql_protocol {
 // - See also MySQL Server source include/mysql_com.h
 // - using uint32_t because transmitted as 4 byte long integer
 
+/** @brief CLIENT_COMPRESS
+ *
+ * Server: Supports compression.
+ * Client: Switches to compression after the handshake.
+ */
+const uint32_t kClientCompress = 0x00000020;
+
 /** @brief CLIENT_PROTOCOL_41
  *
  * Server: Supports the 4.1 protocol.
@@ -41,6 +48,110 @@ const uint32_t kClientProtocol41 = 0x00000200;
  */
 const uint32_t kClientSSL = 0x00000800;
 
+/** @brief CLIENT_SECURE_CONNECTION
+ *
+ * Server: Supports the 4.1 authentication.
+ * Client: Sends the auth response prefixed by its length.
+ */
+const uint32_t kClientSecureConnection = 0x00008000;
+
+/** @brief CLIENT_PLUGIN_AUTH
+ *
+ * Server: Supports authentication plugins.
+ * Client: Sends the name of the authentication plugin.
+ */
+const uint32_t kClientPluginAuth = 0x00080000;
+
+/** @brief CLIENT_CONNECT_ATTRS
+ *
+ * Server: Permits connection attributes.
+ * Client: Sends connection attributes.
+ */
+const uint32_t kClientConnectAttrs = 0x00100000;
+
+/** @brief CLIENT_SESSION_TRACK
+ *
+ * Server: Can send session state changes in OK packets.
+ * Client: Expects session state changes in OK packets.
+ */
+const uint32_t kClientSessionTrack = 0x00800000;
+
+/** @brief CLIENT_DEPRECATE_EOF
+ *
+ * Server: Can send OK instead of EOF packets.
+ * Client: Expects OK instead of EOF packets.
+ */
+const uint32_t kClientDeprecateEOF = 0x01000000;
+
+// Server status flags are prefixed with `SERVER_`.
+// - See MySQL Server source include/mysql_com.h
+
+/** @brief SERVER_STATUS_IN_TRANS: a transaction is active */
+const uint16_t kServerStatusInTrans = 0x0001;
+
+/** @brief SERVER_STATUS_AUTOCOMMIT: autocommit mode is set */
+const uint16_t kServerStatusAutocommit = 0x0002;
+
+/** @brief SERVER_MORE_RESULTS_EXISTS: more resultsets follow */
+const uint16_t kServerMoreResultsExist = 0x0008;
+
+/** @brief SERVER_SESSION_STATE_CHANGED: the OK packet has session state changes */
+const uint16_t kServerSessionStateChanged = 0x4000;
+
+/** @brief Commands sent by the client (first byte of the payload) */
+enum class Command : uint8_t {
+  kQuit = 0x01,
+  kInitDb = 0x02,
+  kQuery = 0x03,
+  kPing = 0x0e,
+  kChangeUser = 0x11,
+  kStmtPrepare = 0x16,
+  kStmtExecute = 0x17,
+  kStmtClose = 0x19,
+  kResetConnection = 0x1f,
+};
+
+/** @brief Types of session state changes (SESSION_TRACK_*) */
+enum class SessionTrackType : uint8_t {
+  kSystemVariables = 0x00,
+  kSchema = 0x01,
+  kStateChange = 0x02,
+  kGtids = 0x03,
+  kTransactionCharacteristics = 0x04,
+  kTransactionState = 0x05,
+};
+
+/** @brief Column types (MYSQL_TYPE_*) */
+enum class ColumnType : uint8_t {
+  kDecimal = 0x00,
+  kTiny = 0x01,
+  kShort = 0x02,
+  kLong = 0x03,
+  kFloat = 0x04,
+  kDouble = 0x05,
+  kNull = 0x06,
+  kTimestamp = 0x07,
+  kLongLong = 0x08,
+  kInt24 = 0x09,
+  kDate = 0x0a,
+  kTime = 0x0b,
+  kDatetime = 0x0c,
+  kYear = 0x0d,
+  kVarchar = 0x0f,
+  kBit = 0x10,
+  kJson = 0xf5,
+  kNewDecimal = 0xf6,
+  kEnum = 0xf7,
+  kSet = 0xf8,
+  kTinyBlob = 0xf9,
+  kMediumBlob = 0xfa,
+  kLongBlob = 0xfb,
+  kBlob = 0xfc,
+  kVarString = 0xfd,
+  kString = 0xfe,
+  kGeometry = 0xff,
+};
+
 } // mysql_protocol
 
 #endif // MYSQLROUTER_MYSQL_PROTOCOL_CONSTANTS_INCLUDED
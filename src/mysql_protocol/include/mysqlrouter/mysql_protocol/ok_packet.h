@@ -0,0 +1,190 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef MYSQLROUTER_MYSQL_PROTOCOL_OK_PACKET_INCLUDED
+#define MYSQLROUTER_MYSQL_PROTOCOL_OK_PACKET_INCLUDED
+
+#include "base_packet.h"
+
+namespace mysql_protocol {
+
+/** @brief Session state change sent along with an OK packet
+ *
+ * The data is kept as sent by the server; its format depends on the type.
+ */
+struct MYSQL_PROTOCOL_API SessionStateChange {
+  SessionTrackType type;
+  std::string data;
+
+  /** @brief Creates a change of the executed GTIDs */
+  static SessionStateChange gtids(const std::string &gtids);
+
+  /** @brief Creates a change of the default schema */
+  static SessionStateChange schema(const std::string &schema);
+
+  /** @brief Creates a change of a system variable */
+  static SessionStateChange system_variable(const std::string &name, const std::string &value);
+};
+
+/** @class OkPacket
+ * @brief Creates or parses a MySQL OK packet
+ *
+ * When CLIENT_SESSION_TRACK is set, the packet can carry session state
+ * changes, such as the GTIDs of the committed transaction.
+ *
+ * With CLIENT_DEPRECATE_EOF, the OK packet ending a resultset starts with
+ * 0xfe instead of 0x00; both are accepted when parsing.
+ */
+class MYSQL_PROTOCOL_API OkPacket final : public Packet {
+ public:
+  /** @brief Constructor
+   *
+   * @param sequence_id MySQL Packet number
+   * @param affected_rows Number of rows changed by the statement
+   * @param last_insert_id Last value of an auto increment column
+   * @param status_flags Server status flags (SERVER_*)
+   * @param warnings Number of warnings
+   * @param info Human readable status information
+   * @param session_changes Session state changes (only sent with CLIENT_SESSION_TRACK)
+   * @param capabilities Server/Client capability flags (default 0)
+   */
+  OkPacket(uint8_t sequence_id, uint64_t affected_rows, uint64_t last_insert_id,
+           uint16_t status_flags, uint16_t warnings, const std::string &info = "",
+           const std::vector<SessionStateChange> &session_changes = {},
+           uint32_t capabilities = 0);
+
+  /** @overload
+   *
+   * @param buffer bytes of the OK packet
+   * @param capabilities Server/Client capability flags
+   * @throws packet_error if buffer does not contain a valid OK packet
+   */
+  OkPacket(const std::vector<uint8_t> &buffer, uint32_t capabilities);
+
+  /** @brief Returns whether the payload is an OK packet
+   *
+   * @param packet the packet to look at
+   */
+  static bool is_ok_packet(const PacketView &packet) noexcept {
+    return packet.size() > kHeaderSize && packet[kHeaderSize] == 0x00;
+  }
+
+  uint64_t get_affected_rows() const noexcept {
+    return affected_rows_;
+  }
+
+  uint64_t get_last_insert_id() const noexcept {
+    return last_insert_id_;
+  }
+
+  uint16_t get_status_flags() const noexcept {
+    return status_flags_;
+  }
+
+  uint16_t get_warnings() const noexcept {
+    return warnings_;
+  }
+
+  const std::string &get_info() const noexcept {
+    return info_;
+  }
+
+  const std::vector<SessionStateChange> &get_session_changes() const noexcept {
+    return session_changes_;
+  }
+
+  /** @brief Gets the GTIDs tracked by the server
+   *
+   * @return GTID set of the last transaction; empty if none was sent
+   */
+  std::string get_tracked_gtids() const;
+
+  /** @brief Gets the default schema tracked by the server
+   *
+   * @return the new default schema; empty if it didn't change
+   */
+  std::string get_tracked_schema() const;
+
+ private:
+  void prepare_packet();
+
+  void parse_payload();
+
+  uint64_t affected_rows_;
+  uint64_t last_insert_id_;
+  uint16_t status_flags_;
+  uint16_t warnings_;
+  std::string info_;
+  std::vector<SessionStateChange> session_changes_;
+};
+
+/** @class EofPacket
+ * @brief Creates or parses a MySQL EOF packet
+ *
+ * Ends the column definitions and rows of a resultset, unless
+ * CLIENT_DEPRECATE_EOF is set.
+ */
+class MYSQL_PROTOCOL_API EofPacket final : public Packet {
+ public:
+  /** @brief Constructor
+   *
+   * @param sequence_id MySQL Packet number
+   * @param warnings Number of warnings
+   * @param status_flags Server status flags (SERVER_*)
+   * @param capabilities Server/Client capability flags (default 0)
+   */
+  EofPacket(uint8_t sequence_id, uint16_t warnings, uint16_t status_flags,
+            uint32_t capabilities = 0);
+
+  /** @overload
+   *
+   * @param buffer bytes of the EOF packet
+   * @param capabilities Server/Client capability flags
+   * @throws packet_error if buffer does not contain a valid EOF packet
+   */
+  EofPacket(const std::vector<uint8_t> &buffer, uint32_t capabilities);
+
+  /** @brief Returns whether the payload is an EOF packet
+   *
+   * Rows can start with 0xfe too, but EOF packets are shorter than 9 bytes.
+   *
+   * @param packet the packet to look at
+   */
+  static bool is_eof_packet(const PacketView &packet) noexcept {
+    return packet.size() > kHeaderSize && packet[kHeaderSize] == 0xfe && packet.size() < kHeaderSize + 9;
+  }
+
+  uint16_t get_warnings() const noexcept {
+    return warnings_;
+  }
+
+  uint16_t get_status_flags() const noexcept {
+    return status_flags_;
+  }
+
+ private:
+  void prepare_packet();
+
+  void parse_payload();
+
+  uint16_t warnings_;
+  uint16_t status_flags_;
+};
+
+} // namespace mysql_protocol
+
+#endif // MYSQLROUTER_MYSQL_PROTOCOL_OK_PACKET_INCLUDED
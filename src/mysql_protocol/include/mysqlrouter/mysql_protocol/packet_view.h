@@ -0,0 +1,135 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef MYSQLROUTER_MYSQL_PROTOCOL_PACKET_VIEW_INCLUDED
+#define MYSQLROUTER_MYSQL_PROTOCOL_PACKET_VIEW_INCLUDED
+
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace mysql_protocol {
+
+/** @class PacketView
+ * @brief Read-only view on a MySQL packet stored elsewhere
+ *
+ * Offers the same accessors as Packet, but parses the bytes in place
+ * instead of copying them into a Packet first. The bytes must outlive
+ * the view.
+ *
+ * Like Packet, the payload size and sequence ID are read from the
+ * packet header when there are at least 4 bytes.
+ */
+class MYSQL_PROTOCOL_API PacketView {
+ public:
+  /** @brief Constructor
+   *
+   * @param data first byte of the packet (its header)
+   * @param size number of bytes available
+   * @param allow_partial Whether to allow buffers which have incomplete payload
+   * @throws packet_error if the payload is incomplete and allow_partial is false
+   */
+  PacketView(const uint8_t *data, size_t size, bool allow_partial = false);
+
+  /** @overload */
+  explicit PacketView(const std::vector<uint8_t> &buffer, bool allow_partial = false)
+      : PacketView(buffer.data(), buffer.size(), allow_partial) { }
+
+  /** @brief Gets an integral from the packet
+   *
+   * @see Packet::get_int()
+   *
+   * @param position Position where to start reading
+   * @param length size of the integer to parse
+   * @return integer type
+   */
+  template<typename Type, typename = std::enable_if<std::is_integral<Type>::value>>
+  Type get_int(size_t position, size_t length = sizeof(Type)) const {
+    assert((length >= 1 && length <= 4) || length == 8);
+    assert(position + length <= size_);
+
+    if (length == 1) {
+      return static_cast<Type>(data_[position]);
+    }
+
+    uint64_t result = 0;
+    const uint8_t *it = data_ + position + length;
+    while (length-- > 0) {
+      result <<= 8;
+      result |= *--it;
+    }
+
+    return static_cast<Type>(result);
+  }
+
+  /** @brief Gets a length encoded integer from the packet
+   *
+   * @param position Position where to start reading
+   * @return uint64_t
+   */
+  uint64_t get_lenenc_uint(size_t position) const;
+
+  /** @brief Gets a string from the packet
+   *
+   * @see Packet::get_string()
+   *
+   * @param position Position from which to start reading
+   * @param length Length of the string to read (default: until the end)
+   * @return std::string
+   */
+  std::string get_string(unsigned long position,
+                         unsigned long length = UINT_MAX) const;
+
+  /** @brief Gets the packet sequence ID */
+  uint8_t get_sequence_id() const noexcept {
+    return sequence_id_;
+  }
+
+  /** @brief Gets the payload size read from the packet header */
+  uint32_t get_payload_size() const noexcept {
+    return payload_size_;
+  }
+
+  /** @brief Gets the first byte of the packet */
+  const uint8_t *data() const noexcept {
+    return data_;
+  }
+
+  /** @brief Gets the number of bytes in view */
+  size_t size() const noexcept {
+    return size_;
+  }
+
+  uint8_t operator[](size_t position) const {
+    assert(position < size_);
+    return data_[position];
+  }
+
+ private:
+  const uint8_t *data_;
+  size_t size_;
+  uint8_t sequence_id_;
+  uint32_t payload_size_;
+};
+
+} // namespace mysql_protocol
+
+#endif // MYSQLROUTER_MYSQL_PROTOCOL_PACKET_VIEW_INCLUDED
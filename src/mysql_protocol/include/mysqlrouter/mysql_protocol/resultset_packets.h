@@ -0,0 +1,168 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef MYSQLROUTER_MYSQL_PROTOCOL_RESULTSET_PACKETS_INCLUDED
+#define MYSQLROUTER_MYSQL_PROTOCOL_RESULTSET_PACKETS_INCLUDED
+
+#include "base_packet.h"
+
+namespace mysql_protocol {
+
+/** @class ColumnCountPacket
+ * @brief Creates or parses the packet starting a resultset
+ */
+class MYSQL_PROTOCOL_API ColumnCountPacket final : public Packet {
+ public:
+  /** @brief Constructor
+   *
+   * @param sequence_id MySQL Packet number
+   * @param column_count number of columns of the resultset
+   */
+  ColumnCountPacket(uint8_t sequence_id, uint64_t column_count);
+
+  /** @overload
+   *
+   * @param buffer bytes of the packet
+   * @throws packet_error if buffer does not contain a column count
+   */
+  explicit ColumnCountPacket(const std::vector<uint8_t> &buffer);
+
+  uint64_t get_column_count() const noexcept {
+    return column_count_;
+  }
+
+ private:
+  uint64_t column_count_;
+};
+
+/** @brief Description of a column of a resultset (protocol 4.1) */
+struct MYSQL_PROTOCOL_API ColumnDefinition {
+  std::string catalog;
+  std::string schema;
+  std::string table;
+  std::string org_table;
+  std::string name;
+  std::string org_name;
+  uint16_t char_set;
+  uint32_t column_length;
+  ColumnType type;
+  uint16_t flags;
+  uint8_t decimals;
+};
+
+/** @class ColumnDefinitionPacket
+ * @brief Creates or parses a column definition of a resultset
+ */
+class MYSQL_PROTOCOL_API ColumnDefinitionPacket final : public Packet {
+ public:
+  /** @brief Constructor
+   *
+   * @param sequence_id MySQL Packet number
+   * @param column description of the column
+   */
+  ColumnDefinitionPacket(uint8_t sequence_id, const ColumnDefinition &column);
+
+  /** @overload
+   *
+   * @param buffer bytes of the packet
+   * @throws packet_error if buffer does not contain a column definition
+   */
+  explicit ColumnDefinitionPacket(const std::vector<uint8_t> &buffer);
+
+  const ColumnDefinition &get_column() const noexcept {
+    return column_;
+  }
+
+ private:
+  void prepare_packet();
+
+  void parse_payload();
+
+  ColumnDefinition column_;
+};
+
+/** @brief Value of a column in a resultset row */
+struct MYSQL_PROTOCOL_API ResultsetField {
+  bool is_null;
+  /** @brief text representation or bytes in the binary protocol */
+  std::string value;
+};
+
+/** @class TextResultsetRow
+ * @brief Creates or parses a row of a resultset sent for COM_QUERY
+ */
+class MYSQL_PROTOCOL_API TextResultsetRow final : public Packet {
+ public:
+  /** @brief Constructor
+   *
+   * @param sequence_id MySQL Packet number
+   * @param fields values of the columns
+   */
+  TextResultsetRow(uint8_t sequence_id, const std::vector<ResultsetField> &fields);
+
+  /** @overload
+   *
+   * @param buffer bytes of the packet
+   * @param column_count number of columns of the resultset
+   * @throws packet_error if buffer does not contain a row with that many columns
+   */
+  TextResultsetRow(const std::vector<uint8_t> &buffer, size_t column_count);
+
+  const std::vector<ResultsetField> &get_fields() const noexcept {
+    return fields_;
+  }
+
+ private:
+  std::vector<ResultsetField> fields_;
+};
+
+/** @class BinaryResultsetRow
+ * @brief Creates or parses a row of a resultset sent for COM_STMT_EXECUTE
+ */
+class MYSQL_PROTOCOL_API BinaryResultsetRow final : public Packet {
+ public:
+  /** @brief Constructor
+   *
+   * @param sequence_id MySQL Packet number
+   * @param types types of the columns
+   * @param fields values of the columns, in the binary protocol
+   */
+  BinaryResultsetRow(uint8_t sequence_id, const std::vector<ColumnType> &types,
+                     const std::vector<ResultsetField> &fields);
+
+  /** @overload
+   *
+   * @param buffer bytes of the packet
+   * @param types types of the columns, from the column definitions
+   * @throws packet_error if buffer does not contain a row with those columns
+   */
+  BinaryResultsetRow(const std::vector<uint8_t> &buffer, const std::vector<ColumnType> &types);
+
+  const std::vector<ResultsetField> &get_fields() const noexcept {
+    return fields_;
+  }
+
+ private:
+  // the first 2 bits of the NULL bitmap of rows are not used
+  static const size_t kNullBitmapOffset{2};
+
+  std::vector<ResultsetField> fields_;
+};
+
+} // namespace mysql_protocol
+
+#endif // MYSQLROUTER_MYSQL_PROTOCOL_RESULTSET_PACKETS_INCLUDED
@@ -59,40 +59,11 @@ void Packet::update_packet_size() {
 
 uint64_t Packet::get_lenenc_uint(size_t position) const {
   assert(size() >= 1);
-  assert(position < size());
-  assert((*this)[position] != 0xff); // 0xff is undefined in length encoded integers
-  assert((*this)[position] != 0xfb); // 0xfb represents NULL and not used in length encoded integers
-
-  if ((*this)[position] < 0xfb) {
-    return (*this)[position];
-  }
-
-  size_t length = 2;
-  switch ((*this)[position]) {
-    case 0xfc:
-      length = 2;
-      break;
-    case 0xfd:
-      length = 3;
-      break;
-    case 0xfe:
-      length = 8;
-  }
-  assert(size() >= length + 1);
-  assert(position + length < size());
-  return get_int<uint64_t>(position + 1, length);
+  return PacketView(data(), size(), true).get_lenenc_uint(position);
 }
 
 std::string Packet::get_string(unsigned long position, unsigned long length) const {
-
-  if (static_cast<size_t>(position) > size()) {
-    return "";
-  }
-
-  auto start = begin() + static_cast<vector_t::difference_type>(position);
-  auto finish = (length == UINT_MAX) ? size() : position + length;
-  auto it = std::find(start, begin() + static_cast<vector_t::difference_type>(finish), 0);
-  return std::string(start, it);
+  return PacketView(data(), size(), true).get_string(position, length);
 }
 
 Packet::vector_t Packet::get_lenenc_bytes(size_t position) const {
@@ -126,4 +97,24 @@ void Packet::add(const std::string &value) {
   insert(end(), value.begin(), value.end());
 }
 
+void Packet::add_lenenc_uint(uint64_t value) {
+  if (value < 0xfb) {
+    add_int<uint8_t>(static_cast<uint8_t>(value));
+  } else if (value <= 0xffff) {
+    add_int<uint8_t>(0xfc);
+    add_int<uint16_t>(static_cast<uint16_t>(value));
+  } else if (value <= 0xffffff) {
+    add_int<uint8_t>(0xfd);
+    add_int<uint32_t>(static_cast<uint32_t>(value), 3);
+  } else {
+    add_int<uint8_t>(0xfe);
+    add_int<uint64_t>(value);
+  }
+}
+
+void Packet::add_lenenc_string(const std::string &value) {
+  add_lenenc_uint(value.size());
+  add(value);
+}
+
 } // namespace mysql_protocol
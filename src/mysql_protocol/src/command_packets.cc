@@ -0,0 +1,266 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "mysqlrouter/mysql_protocol.h"
+#include "payload_codec.h"
+
+#include <string>
+#include <vector>
+
+namespace mysql_protocol {
+
+CommandPacket::CommandPacket(const std::vector<uint8_t> &buffer, Command command, uint32_t capabilities)
+    : Packet(buffer, capabilities), command_(command) {
+  if (!is_command(payload_view(*this), command)) {
+    throw packet_error("Not a command packet of type " + std::to_string(static_cast<int>(command)));
+  }
+}
+
+void CommandPacket::reset_command(size_t payload_size) {
+  reserve(kHeaderSize + 1 + payload_size);
+  reset();
+  add_int<uint8_t>(static_cast<uint8_t>(command_));
+}
+
+QueryPacket::QueryPacket(uint8_t sequence_id, const std::string &query)
+    : CommandPacket(sequence_id, Command::kQuery, 0), query_(query) {
+  reset_command(query_.size());
+  add(query_);
+  update_packet_size();
+}
+
+QueryPacket::QueryPacket(const std::vector<uint8_t> &buffer)
+    : CommandPacket(buffer, Command::kQuery, 0) {
+  query_ = PayloadReader(payload_view(*this), kHeaderSize + 1).read_eof_string();
+}
+
+InitDbPacket::InitDbPacket(uint8_t sequence_id, const std::string &schema)
+    : CommandPacket(sequence_id, Command::kInitDb, 0), schema_(schema) {
+  reset_command(schema_.size());
+  add(schema_);
+  update_packet_size();
+}
+
+InitDbPacket::InitDbPacket(const std::vector<uint8_t> &buffer)
+    : CommandPacket(buffer, Command::kInitDb, 0) {
+  schema_ = PayloadReader(payload_view(*this), kHeaderSize + 1).read_eof_string();
+}
+
+StmtPreparePacket::StmtPreparePacket(uint8_t sequence_id, const std::string &query)
+    : CommandPacket(sequence_id, Command::kStmtPrepare, 0), query_(query) {
+  reset_command(query_.size());
+  add(query_);
+  update_packet_size();
+}
+
+StmtPreparePacket::StmtPreparePacket(const std::vector<uint8_t> &buffer)
+    : CommandPacket(buffer, Command::kStmtPrepare, 0) {
+  query_ = PayloadReader(payload_view(*this), kHeaderSize + 1).read_eof_string();
+}
+
+StmtExecutePacket::StmtExecutePacket(uint8_t sequence_id, uint32_t statement_id, uint8_t flags,
+                                     const std::vector<StmtParam> &params, bool new_params_bound)
+    : CommandPacket(sequence_id, Command::kStmtExecute, 0),
+      statement_id_(statement_id), flags_(flags),
+      new_params_bound_(new_params_bound), params_(params) {
+  prepare_packet();
+}
+
+StmtExecutePacket::StmtExecutePacket(const std::vector<uint8_t> &buffer, uint16_t param_count,
+                                     const std::vector<ColumnType> &bound_types)
+    : CommandPacket(buffer, Command::kStmtExecute, 0),
+      statement_id_(0), flags_(0), new_params_bound_(false) {
+  parse_payload(param_count, bound_types);
+}
+
+void StmtExecutePacket::prepare_packet() {
+  const size_t null_bitmap_size = (params_.size() + 7) / 8;
+
+  size_t values_size = 0;
+  for (const auto &param: params_) {
+    values_size += 9 + param.value.size();
+  }
+  reset_command(4 + 1 + 4 + null_bitmap_size + 1 + params_.size() * 2 + values_size);
+
+  add_int<uint32_t>(statement_id_);
+  add_int<uint8_t>(flags_);
+  add_int<uint32_t>(1);  // iteration count, always 1
+
+  if (params_.empty()) {
+    update_packet_size();
+    return;
+  }
+
+  const size_t null_bitmap_pos = size();
+  insert(end(), null_bitmap_size, 0x0);
+  for (size_t i = 0; i < params_.size(); ++i) {
+    if (params_[i].is_null) {
+      (*this)[null_bitmap_pos + i / 8] |= static_cast<uint8_t>(1 << (i % 8));
+    }
+  }
+
+  add_int<uint8_t>(new_params_bound_ ? 1 : 0);
+  if (new_params_bound_) {
+    for (const auto &param: params_) {
+      add_int<uint8_t>(static_cast<uint8_t>(param.type));
+      add_int<uint8_t>(param.is_unsigned ? 0x80 : 0x00);
+    }
+  }
+
+  for (const auto &param: params_) {
+    if (!param.is_null) {
+      add_binary_value(*this, param.type, param.value);
+    }
+  }
+
+  update_packet_size();
+}
+
+void StmtExecutePacket::parse_payload(uint16_t param_count, const std::vector<ColumnType> &bound_types) {
+  PayloadReader reader(payload_view(*this), kHeaderSize + 1);
+  statement_id_ = reader.read_int<uint32_t>();
+  flags_ = reader.read_int<uint8_t>();
+  reader.skip(4);  // iteration count
+
+  if (param_count == 0) {
+    return;
+  }
+
+  const size_t null_bitmap_pos = reader.position();
+  reader.skip((static_cast<size_t>(param_count) + 7) / 8);
+  new_params_bound_ = reader.read_int<uint8_t>() == 1;
+
+  params_.resize(param_count);
+  for (size_t i = 0; i < param_count; ++i) {
+    StmtParam &param = params_[i];
+    param.is_null = ((*this)[null_bitmap_pos + i / 8] & (1 << (i % 8))) != 0;
+    if (new_params_bound_) {
+      param.type = static_cast<ColumnType>(reader.read_int<uint8_t>());
+      param.is_unsigned = (reader.read_int<uint8_t>() & 0x80) != 0;
+    } else if (bound_types.size() == param_count) {
+      param.type = bound_types[i];
+      param.is_unsigned = false;
+    } else {
+      throw packet_error("Types of the statement parameters are unknown");
+    }
+  }
+
+  for (auto &param: params_) {
+    if (!param.is_null) {
+      param.value = reader.read_binary_value(param.type);
+    }
+  }
+}
+
+ChangeUserPacket::ChangeUserPacket(uint8_t sequence_id, const std::string &username,
+                                   const std::string &auth_response, const std::string &schema,
+                                   uint16_t char_set, const std::string &auth_plugin,
+                                   const Attributes &attributes, uint32_t capabilities)
+    : CommandPacket(sequence_id, Command::kChangeUser, capabilities),
+      username_(username), auth_response_(auth_response), schema_(schema),
+      char_set_(char_set), auth_plugin_(auth_plugin), attributes_(attributes) {
+  prepare_packet();
+}
+
+ChangeUserPacket::ChangeUserPacket(const std::vector<uint8_t> &buffer, uint32_t capabilities)
+    : CommandPacket(buffer, Command::kChangeUser, capabilities), char_set_(0) {
+  parse_payload();
+}
+
+void ChangeUserPacket::prepare_packet() {
+  size_t attributes_size = 0;
+  for (const auto &attr: attributes_) {
+    attributes_size += get_lenenc_uint_size(attr.first.size()) + attr.first.size() +
+                       get_lenenc_uint_size(attr.second.size()) + attr.second.size();
+  }
+  reset_command(username_.size() + 1 + 1 + auth_response_.size() + 1 + schema_.size() + 1 + 2 +
+                auth_plugin_.size() + 1 + 9 + attributes_size);
+
+  add(username_);
+  push_back(0x0);
+
+  if (capability_flags_ & kClientSecureConnection) {
+    assert(auth_response_.size() < 256);
+    add_int<uint8_t>(static_cast<uint8_t>(auth_response_.size()));
+    add(auth_response_);
+  } else {
+    add(auth_response_);
+    push_back(0x0);
+  }
+
+  add(schema_);
+  push_back(0x0);
+
+  add_int<uint16_t>(char_set_);
+
+  if (capability_flags_ & kClientPluginAuth) {
+    add(auth_plugin_);
+    push_back(0x0);
+  }
+
+  if (capability_flags_ & kClientConnectAttrs) {
+    add_lenenc_uint(attributes_size);
+    for (const auto &attr: attributes_) {
+      add_lenenc_string(attr.first);
+      add_lenenc_string(attr.second);
+    }
+  }
+
+  update_packet_size();
+}
+
+void ChangeUserPacket::parse_payload() {
+  PayloadReader reader(payload_view(*this), kHeaderSize + 1);
+  username_ = reader.read_nul_string();
+
+  if (capability_flags_ & kClientSecureConnection) {
+    auth_response_ = reader.read_string(reader.read_int<uint8_t>());
+  } else {
+    auth_response_ = reader.read_nul_string();
+  }
+
+  schema_ = reader.read_nul_string();
+
+  // everything after the schema is optional
+  if (reader.at_end()) {
+    return;
+  }
+  char_set_ = reader.read_int<uint16_t>();
+
+  if ((capability_flags_ & kClientPluginAuth) && !reader.at_end()) {
+    auth_plugin_ = reader.read_nul_string();
+  }
+
+  if ((capability_flags_ & kClientConnectAttrs) && !reader.at_end()) {
+    const uint64_t attributes_size = reader.read_lenenc_uint();
+    if (attributes_size > reader.remaining()) {
+      throw packet_error("Connection attributes exceed packet");
+    }
+
+    const size_t attributes_end = reader.position() + static_cast<size_t>(attributes_size);
+    while (reader.position() < attributes_end) {
+      std::string key = reader.read_lenenc_string();
+      std::string value = reader.read_lenenc_string();
+      attributes_.emplace_back(std::move(key), std::move(value));
+    }
+    if (reader.position() != attributes_end) {
+      throw packet_error("Invalid connection attributes");
+    }
+  }
+}
+
+} // namespace mysql_protocol
@@ -0,0 +1,206 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "mysqlrouter/mysql_protocol.h"
+#include "payload_codec.h"
+
+#include <string>
+#include <vector>
+
+namespace mysql_protocol {
+
+namespace {
+
+std::string lenenc_string(const std::string &value) {
+  Packet packet;
+  packet.add_lenenc_string(value);
+  return std::string(packet.begin(), packet.end());
+}
+
+} // namespace
+
+SessionStateChange SessionStateChange::gtids(const std::string &gtids) {
+  // first byte is the encoding specification; 0 is the only one defined
+  return SessionStateChange{SessionTrackType::kGtids, std::string(1, '\0') + lenenc_string(gtids)};
+}
+
+SessionStateChange SessionStateChange::schema(const std::string &schema) {
+  return SessionStateChange{SessionTrackType::kSchema, lenenc_string(schema)};
+}
+
+SessionStateChange SessionStateChange::system_variable(const std::string &name, const std::string &value) {
+  return SessionStateChange{SessionTrackType::kSystemVariables, lenenc_string(name) + lenenc_string(value)};
+}
+
+OkPacket::OkPacket(uint8_t sequence_id, uint64_t affected_rows, uint64_t last_insert_id,
+                   uint16_t status_flags, uint16_t warnings, const std::string &info,
+                   const std::vector<SessionStateChange> &session_changes,
+                   uint32_t capabilities)
+    : Packet(sequence_id, capabilities),
+      affected_rows_(affected_rows), last_insert_id_(last_insert_id),
+      status_flags_(status_flags), warnings_(warnings),
+      info_(info), session_changes_(session_changes) {
+  if (!session_changes_.empty()) {
+    status_flags_ = static_cast<uint16_t>(status_flags_ | kServerSessionStateChanged);
+  }
+  prepare_packet();
+}
+
+OkPacket::OkPacket(const std::vector<uint8_t> &buffer, uint32_t capabilities)
+    : Packet(buffer, capabilities),
+      affected_rows_(0), last_insert_id_(0), status_flags_(0), warnings_(0) {
+  parse_payload();
+}
+
+void OkPacket::prepare_packet() {
+  const bool session_track = (capability_flags_ & kClientSessionTrack) != 0;
+
+  size_t session_changes_size = 0;
+  for (const auto &change: session_changes_) {
+    session_changes_size += 1 + get_lenenc_uint_size(change.data.size()) + change.data.size();
+  }
+
+  reserve(kHeaderSize + 1 + 9 + 9 + 4 + 9 + info_.size() + 9 + session_changes_size);
+  reset();
+
+  add_int<uint8_t>(0x00);
+  add_lenenc_uint(affected_rows_);
+  add_lenenc_uint(last_insert_id_);
+
+  if (capability_flags_ & kClientProtocol41) {
+    add_int<uint16_t>(status_flags_);
+    add_int<uint16_t>(warnings_);
+  }
+
+  if (session_track) {
+    add_lenenc_string(info_);
+    if (status_flags_ & kServerSessionStateChanged) {
+      add_lenenc_uint(session_changes_size);
+      for (const auto &change: session_changes_) {
+        add_int<uint8_t>(static_cast<uint8_t>(change.type));
+        add_lenenc_string(change.data);
+      }
+    }
+  } else {
+    add(info_);
+  }
+
+  update_packet_size();
+}
+
+void OkPacket::parse_payload() {
+  PacketView packet = payload_view(*this);
+  if (!(is_ok_packet(packet) || (size() > kHeaderSize && (*this)[kHeaderSize] == 0xfe))) {
+    throw packet_error("OK packet marker not found");
+  }
+
+  PayloadReader reader(packet, kHeaderSize + 1);
+  affected_rows_ = reader.read_lenenc_uint();
+  last_insert_id_ = reader.read_lenenc_uint();
+
+  if (capability_flags_ & kClientProtocol41) {
+    status_flags_ = reader.read_int<uint16_t>();
+    warnings_ = reader.read_int<uint16_t>();
+  }
+
+  if (!(capability_flags_ & kClientSessionTrack)) {
+    info_ = reader.read_eof_string();
+    return;
+  }
+
+  if (reader.at_end()) {
+    return;
+  }
+  info_ = reader.read_lenenc_string();
+
+  if (status_flags_ & kServerSessionStateChanged) {
+    const uint64_t changes_size = reader.read_lenenc_uint();
+    if (changes_size > reader.remaining()) {
+      throw packet_error("Session state changes exceed packet");
+    }
+
+    const size_t changes_end = reader.position() + static_cast<size_t>(changes_size);
+    while (reader.position() < changes_end) {
+      const auto type = static_cast<SessionTrackType>(reader.read_int<uint8_t>());
+      session_changes_.push_back(SessionStateChange{type, reader.read_lenenc_string()});
+    }
+    if (reader.position() != changes_end) {
+      throw packet_error("Invalid session state changes");
+    }
+  }
+}
+
+std::string OkPacket::get_tracked_gtids() const {
+  for (const auto &change: session_changes_) {
+    if (change.type == SessionTrackType::kGtids) {
+      PacketView data(reinterpret_cast<const uint8_t*>(change.data.data()), change.data.size(), true);
+      PayloadReader reader(data, 0);
+      reader.skip(1);  // encoding specification
+      return reader.read_lenenc_string();
+    }
+  }
+  return "";
+}
+
+std::string OkPacket::get_tracked_schema() const {
+  for (const auto &change: session_changes_) {
+    if (change.type == SessionTrackType::kSchema) {
+      PacketView data(reinterpret_cast<const uint8_t*>(change.data.data()), change.data.size(), true);
+      return PayloadReader(data, 0).read_lenenc_string();
+    }
+  }
+  return "";
+}
+
+EofPacket::EofPacket(uint8_t sequence_id, uint16_t warnings, uint16_t status_flags,
+                     uint32_t capabilities)
+    : Packet(sequence_id, capabilities), warnings_(warnings), status_flags_(status_flags) {
+  prepare_packet();
+}
+
+EofPacket::EofPacket(const std::vector<uint8_t> &buffer, uint32_t capabilities)
+    : Packet(buffer, capabilities), warnings_(0), status_flags_(0) {
+  parse_payload();
+}
+
+void EofPacket::prepare_packet() {
+  reserve(kHeaderSize + 5);
+  reset();
+
+  add_int<uint8_t>(0xfe);
+  if (capability_flags_ & kClientProtocol41) {
+    add_int<uint16_t>(warnings_);
+    add_int<uint16_t>(status_flags_);
+  }
+
+  update_packet_size();
+}
+
+void EofPacket::parse_payload() {
+  PacketView packet = payload_view(*this);
+  if (!is_eof_packet(packet)) {
+    throw packet_error("EOF packet marker not found");
+  }
+
+  if (capability_flags_ & kClientProtocol41) {
+    PayloadReader reader(packet, kHeaderSize + 1);
+    warnings_ = reader.read_int<uint16_t>();
+    status_flags_ = reader.read_int<uint16_t>();
+  }
+}
+
+} // namespace mysql_protocol
@@ -0,0 +1,75 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "mysqlrouter/mysql_protocol.h"
+
+#include <algorithm>
+
+namespace mysql_protocol {
+
+PacketView::PacketView(const uint8_t *data, size_t size, bool allow_partial)
+    : data_(data), size_(size), sequence_id_(0), payload_size_(0) {
+  if (size_ < Packet::kHeaderSize) {
+    // do nothing when there are not enough bytes
+    return;
+  }
+
+  payload_size_ = get_int<uint32_t>(0, 3);
+
+  if (!allow_partial && size_ < payload_size_ + Packet::kHeaderSize) {
+    throw packet_error("Incorrect payload size (was " +
+                       std::to_string(size_) + "; should be at least " + std::to_string(payload_size_) + ")");
+  }
+
+  sequence_id_ = data_[3];
+}
+
+uint64_t PacketView::get_lenenc_uint(size_t position) const {
+  assert(position < size_);
+  assert(data_[position] != 0xff); // 0xff is undefined in length encoded integers
+  assert(data_[position] != 0xfb); // 0xfb represents NULL and not used in length encoded integers
+
+  if (data_[position] < 0xfb) {
+    return data_[position];
+  }
+
+  size_t length = 2;
+  switch (data_[position]) {
+    case 0xfc:
+      length = 2;
+      break;
+    case 0xfd:
+      length = 3;
+      break;
+    case 0xfe:
+      length = 8;
+  }
+  assert(position + length < size_);
+  return get_int<uint64_t>(position + 1, length);
+}
+
+std::string PacketView::get_string(unsigned long position, unsigned long length) const {
+  if (static_cast<size_t>(position) > size_) {
+    return "";
+  }
+
+  const uint8_t *start = data_ + position;
+  const uint8_t *finish = data_ + ((length == UINT_MAX) ? size_ : std::min<size_t>(size_, position + length));
+  return std::string(start, std::find(start, finish, 0));
+}
+
+} // namespace mysql_protocol
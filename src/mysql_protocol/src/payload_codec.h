@@ -0,0 +1,214 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef MYSQL_PROTOCOL_PAYLOAD_CODEC_INCLUDED
+#define MYSQL_PROTOCOL_PAYLOAD_CODEC_INCLUDED
+
+#include "mysqlrouter/mysql_protocol.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace mysql_protocol {
+
+/** @brief Returns a view on the packet ending with its payload
+ *
+ * The buffer a packet was created from can contain more than one packet.
+ *
+ * @throws packet_error if the packet has no header
+ */
+inline PacketView payload_view(const Packet &packet) {
+  if (packet.size() < Packet::kHeaderSize) {
+    throw packet_error("Packet too short (was " + std::to_string(packet.size()) + ")");
+  }
+  return PacketView(packet.data(), Packet::kHeaderSize + packet.get_payload_size());
+}
+
+/** @class PayloadReader
+ * @brief Reads the fields of a packet one after the other
+ *
+ * Reads in place from a PacketView, starting after the packet header.
+ * Unlike the accessors of Packet, running past the end of the packet
+ * throws packet_error instead of asserting, as the packets come from the
+ * network.
+ */
+class PayloadReader {
+ public:
+  explicit PayloadReader(const PacketView &packet, size_t position = Packet::kHeaderSize)
+      : packet_(packet), position_(position) { }
+
+  size_t position() const noexcept {
+    return position_;
+  }
+
+  bool at_end() const noexcept {
+    return position_ >= packet_.size();
+  }
+
+  size_t remaining() const noexcept {
+    return at_end() ? 0 : packet_.size() - position_;
+  }
+
+  uint8_t peek() const {
+    need(1);
+    return packet_[position_];
+  }
+
+  void skip(size_t length) {
+    need(length);
+    position_ += length;
+  }
+
+  template<typename Type>
+  Type read_int(size_t length = sizeof(Type)) {
+    need(length);
+    Type result = packet_.get_int<Type>(position_, length);
+    position_ += length;
+    return result;
+  }
+
+  uint64_t read_lenenc_uint() {
+    const uint8_t first = read_int<uint8_t>();
+    switch (first) {
+      case 0xfb:  // NULL, only valid in place of a value in a text row
+      case 0xff:
+        throw packet_error("Invalid length encoded integer");
+      case 0xfc:
+        return read_int<uint16_t>();
+      case 0xfd:
+        return read_int<uint32_t>(3);
+      case 0xfe:
+        return read_int<uint64_t>();
+      default:
+        return first;
+    }
+  }
+
+  std::string read_string(size_t length) {
+    need(length);
+    const char *start = reinterpret_cast<const char*>(packet_.data()) + position_;
+    position_ += length;
+    return std::string(start, length);
+  }
+
+  std::string read_lenenc_string() {
+    const uint64_t length = read_lenenc_uint();
+    if (length > remaining()) {
+      throw packet_error("Length encoded string exceeds packet (length " + std::to_string(length) + ")");
+    }
+    return read_string(static_cast<size_t>(length));
+  }
+
+  std::string read_nul_string() {
+    size_t end = position_;
+    while (end < packet_.size() && packet_[end] != 0) {
+      ++end;
+    }
+    if (end == packet_.size()) {
+      throw packet_error("String not terminated");
+    }
+    std::string result = read_string(end - position_);
+    ++position_;
+    return result;
+  }
+
+  std::string read_eof_string() {
+    return read_string(remaining());
+  }
+
+  /** @brief Reads a value in the binary protocol
+   *
+   * Used by COM_STMT_EXECUTE parameters and binary resultset rows.
+   *
+   * @return the bytes of the value, without length prefix
+   */
+  std::string read_binary_value(ColumnType type) {
+    switch (type) {
+      case ColumnType::kNull:
+        return "";
+      case ColumnType::kTiny:
+        return read_string(1);
+      case ColumnType::kShort:
+      case ColumnType::kYear:
+        return read_string(2);
+      case ColumnType::kLong:
+      case ColumnType::kInt24:
+      case ColumnType::kFloat:
+        return read_string(4);
+      case ColumnType::kLongLong:
+      case ColumnType::kDouble:
+        return read_string(8);
+      case ColumnType::kDate:
+      case ColumnType::kDatetime:
+      case ColumnType::kTimestamp:
+      case ColumnType::kTime:
+        return read_string(read_int<uint8_t>());
+      default:
+        return read_lenenc_string();
+    }
+  }
+
+ private:
+  void need(size_t length) const {
+    if (position_ + length > packet_.size()) {
+      throw packet_error("Packet too short (need " + std::to_string(position_ + length) +
+                         " bytes, got " + std::to_string(packet_.size()) + ")");
+    }
+  }
+
+  PacketView packet_;
+  size_t position_;
+};
+
+/** @brief Adds a value in the binary protocol to the packet
+ *
+ * @param packet packet to add the value to
+ * @param type type of the value
+ * @param value bytes of the value, as returned by PayloadReader::read_binary_value()
+ */
+inline void add_binary_value(Packet &packet, ColumnType type, const std::string &value) {
+  switch (type) {
+    case ColumnType::kNull:
+      break;
+    case ColumnType::kTiny:
+    case ColumnType::kShort:
+    case ColumnType::kYear:
+    case ColumnType::kLong:
+    case ColumnType::kInt24:
+    case ColumnType::kFloat:
+    case ColumnType::kLongLong:
+    case ColumnType::kDouble:
+      packet.add(value);
+      break;
+    case ColumnType::kDate:
+    case ColumnType::kDatetime:
+    case ColumnType::kTimestamp:
+    case ColumnType::kTime:
+      assert(value.size() < 256);
+      packet.add_int<uint8_t>(static_cast<uint8_t>(value.size()));
+      packet.add(value);
+      break;
+    default:
+      packet.add_lenenc_string(value);
+  }
+}
+
+} // namespace mysql_protocol
+
+#endif // MYSQL_PROTOCOL_PAYLOAD_CODEC_INCLUDED
@@ -0,0 +1,195 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "mysqlrouter/mysql_protocol.h"
+#include "payload_codec.h"
+
+#include <string>
+#include <vector>
+
+namespace mysql_protocol {
+
+ColumnCountPacket::ColumnCountPacket(uint8_t sequence_id, uint64_t column_count)
+    : Packet(sequence_id), column_count_(column_count) {
+  reserve(kHeaderSize + get_lenenc_uint_size(column_count_));
+  reset();
+  add_lenenc_uint(column_count_);
+  update_packet_size();
+}
+
+ColumnCountPacket::ColumnCountPacket(const std::vector<uint8_t> &buffer)
+    : Packet(buffer), column_count_(0) {
+  PayloadReader reader(payload_view(*this));
+  column_count_ = reader.read_lenenc_uint();
+  if (column_count_ == 0 || !reader.at_end()) {
+    throw packet_error("Not a column count packet");
+  }
+}
+
+ColumnDefinitionPacket::ColumnDefinitionPacket(uint8_t sequence_id, const ColumnDefinition &column)
+    : Packet(sequence_id), column_(column) {
+  prepare_packet();
+}
+
+ColumnDefinitionPacket::ColumnDefinitionPacket(const std::vector<uint8_t> &buffer)
+    : Packet(buffer), column_() {
+  parse_payload();
+}
+
+void ColumnDefinitionPacket::prepare_packet() {
+  const std::string *strings[] = {
+    &column_.catalog, &column_.schema, &column_.table,
+    &column_.org_table, &column_.name, &column_.org_name,
+  };
+
+  size_t strings_size = 0;
+  for (const std::string *str: strings) {
+    strings_size += get_lenenc_uint_size(str->size()) + str->size();
+  }
+  reserve(kHeaderSize + strings_size + 13);
+  reset();
+
+  for (const std::string *str: strings) {
+    add_lenenc_string(*str);
+  }
+
+  add_lenenc_uint(0x0c);  // length of the fixed length fields
+  add_int<uint16_t>(column_.char_set);
+  add_int<uint32_t>(column_.column_length);
+  add_int<uint8_t>(static_cast<uint8_t>(column_.type));
+  add_int<uint16_t>(column_.flags);
+  add_int<uint8_t>(column_.decimals);
+  add_int<uint16_t>(0);  // filler
+
+  update_packet_size();
+}
+
+void ColumnDefinitionPacket::parse_payload() {
+  PayloadReader reader(payload_view(*this));
+
+  column_.catalog = reader.read_lenenc_string();
+  column_.schema = reader.read_lenenc_string();
+  column_.table = reader.read_lenenc_string();
+  column_.org_table = reader.read_lenenc_string();
+  column_.name = reader.read_lenenc_string();
+  column_.org_name = reader.read_lenenc_string();
+
+  if (reader.read_lenenc_uint() != 0x0c) {
+    throw packet_error("Invalid length of column definition fields");
+  }
+  column_.char_set = reader.read_int<uint16_t>();
+  column_.column_length = reader.read_int<uint32_t>();
+  column_.type = static_cast<ColumnType>(reader.read_int<uint8_t>());
+  column_.flags = reader.read_int<uint16_t>();
+  column_.decimals = reader.read_int<uint8_t>();
+  reader.skip(2);
+}
+
+TextResultsetRow::TextResultsetRow(uint8_t sequence_id, const std::vector<ResultsetField> &fields)
+    : Packet(sequence_id), fields_(fields) {
+  size_t fields_size = 0;
+  for (const auto &field: fields_) {
+    fields_size += get_lenenc_uint_size(field.value.size()) + field.value.size();
+  }
+  reserve(kHeaderSize + fields_size);
+  reset();
+
+  for (const auto &field: fields_) {
+    if (field.is_null) {
+      add_int<uint8_t>(0xfb);
+    } else {
+      add_lenenc_string(field.value);
+    }
+  }
+
+  update_packet_size();
+}
+
+TextResultsetRow::TextResultsetRow(const std::vector<uint8_t> &buffer, size_t column_count)
+    : Packet(buffer) {
+  PayloadReader reader(payload_view(*this));
+
+  fields_.resize(column_count);
+  for (auto &field: fields_) {
+    field.is_null = reader.peek() == 0xfb;
+    if (field.is_null) {
+      reader.skip(1);
+    } else {
+      field.value = reader.read_lenenc_string();
+    }
+  }
+
+  if (!reader.at_end()) {
+    throw packet_error("Row has more than " + std::to_string(column_count) + " columns");
+  }
+}
+
+BinaryResultsetRow::BinaryResultsetRow(uint8_t sequence_id, const std::vector<ColumnType> &types,
+                                       const std::vector<ResultsetField> &fields)
+    : Packet(sequence_id), fields_(fields) {
+  assert(types.size() == fields_.size());
+  const size_t null_bitmap_size = (fields_.size() + 7 + kNullBitmapOffset) / 8;
+
+  size_t values_size = 0;
+  for (const auto &field: fields_) {
+    values_size += 9 + field.value.size();
+  }
+  reserve(kHeaderSize + 1 + null_bitmap_size + values_size);
+  reset();
+
+  add_int<uint8_t>(0x00);
+
+  const size_t null_bitmap_pos = size();
+  insert(end(), null_bitmap_size, 0x0);
+  for (size_t i = 0; i < fields_.size(); ++i) {
+    if (fields_[i].is_null) {
+      const size_t bit = i + kNullBitmapOffset;
+      (*this)[null_bitmap_pos + bit / 8] |= static_cast<uint8_t>(1 << (bit % 8));
+    } else {
+      add_binary_value(*this, types[i], fields_[i].value);
+    }
+  }
+
+  update_packet_size();
+}
+
+BinaryResultsetRow::BinaryResultsetRow(const std::vector<uint8_t> &buffer,
+                                       const std::vector<ColumnType> &types)
+    : Packet(buffer) {
+  PayloadReader reader(payload_view(*this));
+  if (reader.read_int<uint8_t>() != 0x00) {
+    throw packet_error("Binary row marker not found");
+  }
+
+  const size_t null_bitmap_pos = reader.position();
+  reader.skip((types.size() + 7 + kNullBitmapOffset) / 8);
+
+  fields_.resize(types.size());
+  for (size_t i = 0; i < types.size(); ++i) {
+    const size_t bit = i + kNullBitmapOffset;
+    fields_[i].is_null = ((*this)[null_bitmap_pos + bit / 8] & (1 << (bit % 8))) != 0;
+    if (!fields_[i].is_null) {
+      fields_[i].value = reader.read_binary_value(types[i]);
+    }
+  }
+
+  if (!reader.at_end()) {
+    throw packet_error("Row has more than " + std::to_string(types.size()) + " columns");
+  }
+}
+
+} // namespace mysql_protocol
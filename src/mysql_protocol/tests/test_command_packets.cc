@@ -0,0 +1,140 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gmock/gmock.h>
+
+#include <string>
+#include <vector>
+
+#include "mysqlrouter/mysql_protocol.h"
+
+using ::testing::ContainerEq;
+using mysql_protocol::ChangeUserPacket;
+using mysql_protocol::ColumnType;
+using mysql_protocol::Command;
+using mysql_protocol::CommandPacket;
+using mysql_protocol::InitDbPacket;
+using mysql_protocol::Packet;
+using mysql_protocol::PacketView;
+using mysql_protocol::QueryPacket;
+using mysql_protocol::StmtExecutePacket;
+using mysql_protocol::StmtParam;
+using mysql_protocol::StmtPreparePacket;
+using mysql_protocol::packet_error;
+
+TEST(MySQLProtocolCommandTest, Query) {
+  const Packet::vector_t expected = {
+    0x09, 0x00, 0x00, 0x00, 0x03, 'S', 'E', 'L', 'E', 'C', 'T', ' ', '1',
+  };
+
+  QueryPacket query(0, "SELECT 1");
+  EXPECT_THAT(query, ContainerEq(expected));
+  EXPECT_EQ(Command::kQuery, query.get_command());
+  EXPECT_TRUE(CommandPacket::is_command(PacketView(expected), Command::kQuery));
+  EXPECT_FALSE(CommandPacket::is_command(PacketView(expected), Command::kInitDb));
+
+  EXPECT_EQ("SELECT 1", QueryPacket(expected).get_query());
+  EXPECT_THROW(QueryPacket(InitDbPacket(0, "test")), packet_error);
+}
+
+TEST(MySQLProtocolCommandTest, InitDbAndPrepare) {
+  EXPECT_EQ("test", InitDbPacket(InitDbPacket(0, "test")).get_schema());
+  EXPECT_EQ("SELECT ?", StmtPreparePacket(StmtPreparePacket(0, "SELECT ?")).get_query());
+}
+
+TEST(MySQLProtocolCommandTest, StmtExecute) {
+  const std::vector<StmtParam> params = {
+    {ColumnType::kLongLong, true, false, std::string("\x2a\0\0\0\0\0\0\0", 8)},
+    {ColumnType::kVarString, false, true, ""},
+    {ColumnType::kVarString, false, false, "hello"},
+    {ColumnType::kDatetime, false, false, std::string("\xe2\x07\x01\x02", 4)},
+  };
+
+  StmtExecutePacket execute(0, 7, 0, params);
+  const Packet::vector_t expected_start = {
+    0x17,                           // COM_STMT_EXECUTE
+    0x07, 0x00, 0x00, 0x00,         // statement id
+    0x00,                           // flags
+    0x01, 0x00, 0x00, 0x00,         // iteration count
+    0x02,                           // NULL bitmap
+    0x01,                           // new params bound
+    0x08, 0x80, 0xfd, 0x00, 0xfd, 0x00, 0x0c, 0x00,
+  };
+  ASSERT_GT(execute.size(), 4 + expected_start.size());
+  EXPECT_EQ(expected_start, Packet::vector_t(execute.begin() + 4, execute.begin() + 4 + expected_start.size()));
+
+  StmtExecutePacket parsed(execute, static_cast<uint16_t>(params.size()));
+  EXPECT_EQ(7U, parsed.get_statement_id());
+  EXPECT_TRUE(parsed.get_new_params_bound());
+  ASSERT_EQ(params.size(), parsed.get_params().size());
+  for (size_t i = 0; i < params.size(); ++i) {
+    EXPECT_EQ(params[i].type, parsed.get_params()[i].type);
+    EXPECT_EQ(params[i].is_unsigned, parsed.get_params()[i].is_unsigned);
+    EXPECT_EQ(params[i].is_null, parsed.get_params()[i].is_null);
+    EXPECT_EQ(params[i].value, parsed.get_params()[i].value);
+  }
+}
+
+TEST(MySQLProtocolCommandTest, StmtExecuteWithoutTypes) {
+  const std::vector<StmtParam> params = {
+    {ColumnType::kTiny, false, false, "\x05"},
+  };
+  StmtExecutePacket execute(0, 1, 0, params, false);
+
+  EXPECT_THROW(StmtExecutePacket(execute, 1), packet_error);
+
+  StmtExecutePacket parsed(execute, 1, {ColumnType::kTiny});
+  EXPECT_FALSE(parsed.get_new_params_bound());
+  ASSERT_EQ(1U, parsed.get_params().size());
+  EXPECT_EQ("\x05", parsed.get_params()[0].value);
+
+  // the parameters are missing
+  EXPECT_THROW(StmtExecutePacket(StmtExecutePacket(0, 1, 0, {}), 1), packet_error);
+}
+
+TEST(MySQLProtocolCommandTest, ChangeUser) {
+  const uint32_t capabilities = mysql_protocol::kClientProtocol41 | mysql_protocol::kClientSecureConnection |
+                                mysql_protocol::kClientPluginAuth | mysql_protocol::kClientConnectAttrs;
+  const std::string auth_response(20, '\x71');
+
+  ChangeUserPacket change_user(0, "root", auth_response, "test", 33, "mysql_native_password",
+                               {{"_client_name", "libmysql"}, {"program_name", "mysql"}}, capabilities);
+
+  ChangeUserPacket parsed(change_user, capabilities);
+  EXPECT_EQ("root", parsed.get_username());
+  EXPECT_EQ(auth_response, parsed.get_auth_response());
+  EXPECT_EQ("test", parsed.get_schema());
+  EXPECT_EQ(33U, parsed.get_char_set());
+  EXPECT_EQ("mysql_native_password", parsed.get_auth_plugin());
+  ASSERT_EQ(2U, parsed.get_attributes().size());
+  EXPECT_EQ("program_name", parsed.get_attributes()[1].first);
+  EXPECT_EQ("mysql", parsed.get_attributes()[1].second);
+
+  // old clients end the packet after the schema
+  const Packet::vector_t old_client = {
+    0x0d, 0x00, 0x00, 0x00, 0x11, 'r', 'o', 'o', 't', 0x00, 'x', 0x00, 't', 'e', 's', 't', 0x00,
+  };
+  ChangeUserPacket parsed_old(old_client, 0);
+  EXPECT_EQ("root", parsed_old.get_username());
+  EXPECT_EQ("x", parsed_old.get_auth_response());
+  EXPECT_EQ("test", parsed_old.get_schema());
+  EXPECT_EQ(0U, parsed_old.get_char_set());
+
+  // the schema is not terminated
+  EXPECT_THROW(ChangeUserPacket(Packet::vector_t(old_client.begin(), old_client.end() - 1), 0),
+               packet_error);
+}
@@ -0,0 +1,130 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gmock/gmock.h>
+
+#include <string>
+#include <vector>
+
+#include "mysqlrouter/mysql_protocol.h"
+
+using ::testing::ContainerEq;
+using mysql_protocol::EofPacket;
+using mysql_protocol::OkPacket;
+using mysql_protocol::Packet;
+using mysql_protocol::SessionStateChange;
+using mysql_protocol::SessionTrackType;
+using mysql_protocol::packet_error;
+
+namespace {
+const uint32_t kCapabilities = mysql_protocol::kClientProtocol41 | mysql_protocol::kClientSessionTrack;
+const std::string kGtid = "3e11fa47-71ca-11e1-9e33-c80aa9429562:23";
+}
+
+TEST(MySQLProtocolOkPacketTest, Constructor) {
+  const Packet::vector_t expected = {
+    0x07, 0x00, 0x00, 0x02, 0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00,
+  };
+
+  OkPacket ok(2, 1, 0, mysql_protocol::kServerStatusAutocommit, 0, "", {}, mysql_protocol::kClientProtocol41);
+  EXPECT_THAT(ok, ContainerEq(expected));
+
+  OkPacket parsed(expected, mysql_protocol::kClientProtocol41);
+  EXPECT_EQ(2, parsed.get_sequence_id());
+  EXPECT_EQ(1U, parsed.get_affected_rows());
+  EXPECT_EQ(0U, parsed.get_last_insert_id());
+  EXPECT_EQ(mysql_protocol::kServerStatusAutocommit, parsed.get_status_flags());
+  EXPECT_EQ(0U, parsed.get_warnings());
+  EXPECT_EQ("", parsed.get_info());
+  EXPECT_TRUE(parsed.get_session_changes().empty());
+}
+
+TEST(MySQLProtocolOkPacketTest, LargeValuesAndInfo) {
+  OkPacket ok(1, 70000, 1ULL << 40, 0, 3, "Rows matched: 1", {}, mysql_protocol::kClientProtocol41);
+
+  OkPacket parsed(ok, mysql_protocol::kClientProtocol41);
+  EXPECT_EQ(70000U, parsed.get_affected_rows());
+  EXPECT_EQ(1ULL << 40, parsed.get_last_insert_id());
+  EXPECT_EQ(3U, parsed.get_warnings());
+  EXPECT_EQ("Rows matched: 1", parsed.get_info());
+}
+
+TEST(MySQLProtocolOkPacketTest, SessionTrackGtids) {
+  // as sent by the server with session_track_gtids=OWN_GTID
+  Packet::vector_t expected = {
+    0x00, 0x00, 0x00, 0x01,             // header, size updated below
+    0x00, 0x00, 0x00,                   // OK, affected rows, last insert id
+    0x02, 0x40, 0x00, 0x00,             // status flags, warnings
+    0x00,                               // info
+    0x2b,                               // length of the session state changes
+    0x03, 0x29, 0x00, 0x27,             // type, length, encoding, length of GTID
+  };
+  expected.insert(expected.end(), kGtid.begin(), kGtid.end());
+  expected[0] = static_cast<uint8_t>(expected.size() - 4);
+
+  OkPacket ok(1, 0, 0, mysql_protocol::kServerStatusAutocommit, 0, "",
+              {SessionStateChange::gtids(kGtid)}, kCapabilities);
+  EXPECT_THAT(ok, ContainerEq(expected));
+
+  OkPacket parsed(expected, kCapabilities);
+  EXPECT_EQ(mysql_protocol::kServerStatusAutocommit | mysql_protocol::kServerSessionStateChanged,
+            parsed.get_status_flags());
+  ASSERT_EQ(1U, parsed.get_session_changes().size());
+  EXPECT_EQ(SessionTrackType::kGtids, parsed.get_session_changes()[0].type);
+  EXPECT_EQ(kGtid, parsed.get_tracked_gtids());
+  EXPECT_EQ("", parsed.get_tracked_schema());
+}
+
+TEST(MySQLProtocolOkPacketTest, SessionTrackMultipleChanges) {
+  OkPacket ok(1, 0, 0, 0, 0, "info", {
+                SessionStateChange::schema("test"),
+                SessionStateChange::system_variable("autocommit", "OFF"),
+                SessionStateChange::gtids(kGtid),
+              }, kCapabilities);
+
+  OkPacket parsed(ok, kCapabilities);
+  EXPECT_EQ("info", parsed.get_info());
+  ASSERT_EQ(3U, parsed.get_session_changes().size());
+  EXPECT_EQ(SessionTrackType::kSystemVariables, parsed.get_session_changes()[1].type);
+  EXPECT_EQ("test", parsed.get_tracked_schema());
+  EXPECT_EQ(kGtid, parsed.get_tracked_gtids());
+}
+
+TEST(MySQLProtocolOkPacketTest, Invalid) {
+  // no OK marker
+  EXPECT_THROW(OkPacket({0x01, 0x00, 0x00, 0x01, 0xff}, kCapabilities), packet_error);
+
+  // truncated status flags
+  EXPECT_THROW(OkPacket({0x04, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02}, kCapabilities), packet_error);
+
+  // session state changes longer than the packet
+  EXPECT_THROW(OkPacket({0x09, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x20},
+                        kCapabilities), packet_error);
+}
+
+TEST(MySQLProtocolEofPacketTest, Constructor) {
+  const Packet::vector_t expected = {0x05, 0x00, 0x00, 0x05, 0xfe, 0x01, 0x00, 0x22, 0x00};
+
+  EofPacket eof(5, 1, 0x22, mysql_protocol::kClientProtocol41);
+  EXPECT_THAT(eof, ContainerEq(expected));
+
+  EofPacket parsed(expected, mysql_protocol::kClientProtocol41);
+  EXPECT_EQ(1U, parsed.get_warnings());
+  EXPECT_EQ(0x22U, parsed.get_status_flags());
+
+  EXPECT_THROW(EofPacket(OkPacket(1, 0, 0, 0, 0), 0), packet_error);
+}
@@ -0,0 +1,108 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gmock/gmock.h>
+
+#include <string>
+#include <vector>
+
+#include "mysqlrouter/mysql_protocol.h"
+
+using mysql_protocol::Packet;
+using mysql_protocol::PacketView;
+using mysql_protocol::packet_error;
+
+TEST(MySQLProtocolPacketViewTest, ParsesHeader) {
+  const std::vector<uint8_t> buffer{0x04, 0x0, 0x0, 0x03, 't', 'e', 's', 't'};
+  PacketView view(buffer);
+
+  EXPECT_EQ(buffer.data(), view.data());
+  EXPECT_EQ(buffer.size(), view.size());
+  EXPECT_EQ(4U, view.get_payload_size());
+  EXPECT_EQ(3, view.get_sequence_id());
+  EXPECT_EQ(std::string("test"), view.get_string(4));
+}
+
+TEST(MySQLProtocolPacketViewTest, PartialPayload) {
+  const std::vector<uint8_t> buffer{0x08, 0x0, 0x0, 0x01, 't', 'e', 's', 't'};
+
+  EXPECT_THROW(PacketView(buffer.data(), buffer.size()), packet_error);
+
+  PacketView view(buffer.data(), buffer.size(), true);
+  EXPECT_EQ(8U, view.get_payload_size());
+  EXPECT_EQ(1, view.get_sequence_id());
+
+  // a view on a part of the buffer
+  PacketView header(buffer.data(), 4, true);
+  EXPECT_EQ(4U, header.size());
+  EXPECT_EQ(std::string(""), header.get_string(4));
+}
+
+TEST(MySQLProtocolPacketViewTest, GetInt) {
+  const std::vector<uint8_t> buffer{0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08};
+  PacketView view(buffer, true);
+
+  EXPECT_EQ(0x01U, view.get_int<uint8_t>(0));
+  EXPECT_EQ(0x0302U, view.get_int<uint16_t>(1));
+  EXPECT_EQ(0x050403U, view.get_int<uint32_t>(2, 3));
+  EXPECT_EQ(0x08070605U, view.get_int<uint32_t>(4));
+  EXPECT_EQ(0x0807060504030201ULL, view.get_int<uint64_t>(0));
+}
+
+TEST(MySQLProtocolPacketViewTest, GetLenencUint) {
+  const std::vector<std::pair<std::vector<uint8_t>, uint64_t>> cases{
+    {{0xfa}, 250U},
+    {{0xfc, 0xfb, 0x00}, 251U},
+    {{0xfd, 0x00, 0x00, 0x01}, 65536U},
+    {{0xfe, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00}, 16777216U},
+  };
+
+  for (auto &c: cases) {
+    EXPECT_EQ(c.second, PacketView(c.first, true).get_lenenc_uint(0));
+  }
+}
+
+TEST(MySQLProtocolPacketViewTest, GetString) {
+  const std::vector<uint8_t> buffer{'h', 'a', 'm', 0x0, 's', 'p', 'a', 'm'};
+  PacketView view(buffer, true);
+
+  EXPECT_EQ(std::string("ham"), view.get_string(0));
+  EXPECT_EQ(std::string("spam"), view.get_string(4));
+  EXPECT_EQ(std::string("ha"), view.get_string(0, 2));
+  EXPECT_EQ(std::string("sp"), view.get_string(4, 2));
+  EXPECT_EQ(std::string("spam"), view.get_string(4, 100));
+  EXPECT_EQ(std::string(""), view.get_string(30));
+}
+
+// the view gives the same results as a Packet copied from the same bytes
+TEST(MySQLProtocolPacketViewTest, SameAsPacket) {
+  const Packet::vector_t buffer = mysql_protocol::ErrorPacket(2, 1045, "Access denied", "28000",
+                                                               mysql_protocol::kClientProtocol41);
+  Packet packet(buffer);
+  PacketView view(buffer);
+
+  EXPECT_EQ(packet.get_payload_size(), view.get_payload_size());
+  EXPECT_EQ(packet.get_sequence_id(), view.get_sequence_id());
+  EXPECT_EQ(packet.get_int<uint16_t>(5), view.get_int<uint16_t>(5));
+  EXPECT_EQ(packet.get_string(8, 5), view.get_string(8, 5));
+  EXPECT_EQ(packet.get_string(13), view.get_string(13));
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
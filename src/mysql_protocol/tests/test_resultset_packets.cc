@@ -0,0 +1,116 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gmock/gmock.h>
+
+#include <string>
+#include <vector>
+
+#include "mysqlrouter/mysql_protocol.h"
+
+using ::testing::ContainerEq;
+using mysql_protocol::BinaryResultsetRow;
+using mysql_protocol::ColumnCountPacket;
+using mysql_protocol::ColumnDefinition;
+using mysql_protocol::ColumnDefinitionPacket;
+using mysql_protocol::ColumnType;
+using mysql_protocol::Packet;
+using mysql_protocol::ResultsetField;
+using mysql_protocol::TextResultsetRow;
+using mysql_protocol::packet_error;
+
+TEST(MySQLProtocolResultsetTest, ColumnCount) {
+  const Packet::vector_t expected = {0x01, 0x00, 0x00, 0x01, 0x02};
+
+  EXPECT_THAT(ColumnCountPacket(1, 2), ContainerEq(expected));
+  EXPECT_EQ(2U, ColumnCountPacket(expected).get_column_count());
+  EXPECT_EQ(300U, ColumnCountPacket(ColumnCountPacket(1, 300)).get_column_count());
+
+  // an OK packet is not a column count
+  EXPECT_THROW(ColumnCountPacket(Packet::vector_t{0x07, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00}),
+               packet_error);
+}
+
+TEST(MySQLProtocolResultsetTest, ColumnDefinition) {
+  // SELECT @@version_comment LIMIT 1
+  const Packet::vector_t expected = {
+    0x27, 0x00, 0x00, 0x02, 0x03, 'd', 'e', 'f', 0x00, 0x00, 0x00,
+    0x11, '@', '@', 'v', 'e', 'r', 's', 'i', 'o', 'n', '_', 'c', 'o', 'm', 'm', 'e', 'n', 't',
+    0x00, 0x0c, 0x08, 0x00, 0x1c, 0x00, 0x00, 0x00, 0xfd, 0x00, 0x00, 0x1f, 0x00, 0x00,
+  };
+
+  ColumnDefinitionPacket parsed(expected);
+  const ColumnDefinition &column = parsed.get_column();
+  EXPECT_EQ("def", column.catalog);
+  EXPECT_EQ("", column.schema);
+  EXPECT_EQ("@@version_comment", column.name);
+  EXPECT_EQ("", column.org_name);
+  EXPECT_EQ(8U, column.char_set);
+  EXPECT_EQ(28U, column.column_length);
+  EXPECT_EQ(ColumnType::kVarString, column.type);
+  EXPECT_EQ(0U, column.flags);
+  EXPECT_EQ(31U, column.decimals);
+
+  EXPECT_THAT(ColumnDefinitionPacket(2, column), ContainerEq(expected));
+
+  // truncated
+  EXPECT_THROW(ColumnDefinitionPacket(Packet::vector_t{0x04, 0x00, 0x00, 0x02, 0x03, 'd', 'e', 'f'}),
+               packet_error);
+}
+
+TEST(MySQLProtocolResultsetTest, TextRow) {
+  const Packet::vector_t expected = {
+    0x08, 0x00, 0x00, 0x04, 0x01, '1', 0xfb, 0x04, 't', 'e', 's', 't',
+  };
+  const std::vector<ResultsetField> fields = {{false, "1"}, {true, ""}, {false, "test"}};
+
+  EXPECT_THAT(TextResultsetRow(4, fields), ContainerEq(expected));
+
+  TextResultsetRow parsed(expected, 3);
+  ASSERT_EQ(3U, parsed.get_fields().size());
+  EXPECT_EQ("1", parsed.get_fields()[0].value);
+  EXPECT_TRUE(parsed.get_fields()[1].is_null);
+  EXPECT_EQ("test", parsed.get_fields()[2].value);
+
+  EXPECT_THROW(TextResultsetRow(expected, 2), packet_error);
+  EXPECT_THROW(TextResultsetRow(expected, 4), packet_error);
+}
+
+TEST(MySQLProtocolResultsetTest, BinaryRow) {
+  const std::vector<ColumnType> types = {ColumnType::kLong, ColumnType::kVarString, ColumnType::kNull,
+                                         ColumnType::kDouble};
+  const std::vector<ResultsetField> fields = {
+    {false, std::string("\x01\0\0\0", 4)},
+    {false, "abc"},
+    {true, ""},
+    {false, std::string(8, '\x11')},
+  };
+
+  BinaryResultsetRow row(3, types, fields);
+  const Packet::vector_t expected_start = {0x00, 0x10, 0x01, 0x00, 0x00, 0x00, 0x03, 'a', 'b', 'c'};
+  EXPECT_EQ(expected_start, Packet::vector_t(row.begin() + 4, row.begin() + 4 + expected_start.size()));
+
+  BinaryResultsetRow parsed(row, types);
+  ASSERT_EQ(fields.size(), parsed.get_fields().size());
+  for (size_t i = 0; i < fields.size(); ++i) {
+    EXPECT_EQ(fields[i].is_null, parsed.get_fields()[i].is_null);
+    EXPECT_EQ(fields[i].value, parsed.get_fields()[i].value);
+  }
+
+  // the double is missing
+  EXPECT_THROW(BinaryResultsetRow(Packet::vector_t(row.begin(), row.end() - 1), types), packet_error);
+}
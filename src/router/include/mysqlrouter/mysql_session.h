@@ -129,6 +129,7 @@ class MySQLSession {
   virtual std::string quote(const std::string &s, char qchar = '\'') noexcept;
 
   virtual bool is_connected() noexcept { return connection_ && connected_; }
+  virtual bool ping() noexcept; // round trip to check if the connection is still alive
   const std::string& get_address() noexcept { return connection_address_; }
 
   virtual const char *last_error();
@@ -721,6 +721,11 @@ std::string MySQLSession::quote(const std::string &s, char qchar) noexcept {
   return r;
 }
 
+bool MySQLSession::ping() noexcept {
+  // fails if the server closed the connection (no auto-reconnect is enabled)
+  return is_connected() && mysql_ping(connection_) == 0;
+}
+
 const char *MySQLSession::last_error() {
   return connection_ ? mysql_error(connection_) : nullptr;
 }
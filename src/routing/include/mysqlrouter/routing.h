@@ -22,6 +22,7 @@
 #include "mysqlrouter/plugin_config.h"
 
 #include <chrono>
+#include <cstdint>
 #include <map>
 #include <string>
 
@@ -96,6 +97,47 @@ extern const unsigned int kDefaultNetBufferLength;
  */
 extern const std::chrono::seconds kDefaultClientConnectTimeout;
 
+/** @brief Time given to active connections to finish when stopping
+ *
+ * When the routing service is stopped, it stops accepting new connections
+ * and gives active connections this many seconds to finish before they get
+ * closed. The default of 0 closes them right away.
+ */
+extern const std::chrono::seconds kDefaultDrainTimeout;
+
+/** @brief Maximum number of client connections of all routes together
+ *
+ * Shared by all routing sections of the process. The default of 0 means
+ * that only the `max_connections` of each route applies.
+ */
+extern const unsigned int kDefaultMaxTotalConnections;
+
+/** @brief File descriptors kept free for other purposes than connections
+ *
+ * Listening sockets, log files, metadata cache sessions, ...
+ */
+extern const uint64_t kReservedFileDescriptors;
+
+/** @brief Number of TLS sessions cached per route for resumption
+ *
+ * Only used if the route terminates client TLS (`client_ssl_cert`).
+ */
+extern const unsigned int kDefaultClientSslSessionCacheSize;
+
+/** @brief Servers in the router's own location needed to keep other locations out
+ *
+ * Only used if `location` is set. If fewer servers of the router's location
+ * are available, servers of the other locations get connections as well.
+ */
+extern const unsigned int kDefaultLocationMinServers;
+
+/** @brief How long a secondary may take to catch up with a client's writes
+ *
+ * The default of 0 disables read-your-writes: reads are routed without
+ * looking at the writes of the client.
+ */
+extern const std::chrono::milliseconds kDefaultReadYourWritesTimeout;
+
 #ifdef _WIN32
   const SOCKET kInvalidSocket = INVALID_SOCKET;// windows defines INVALID_SOCKET already
 #else
@@ -131,6 +173,18 @@ std::string get_access_mode_name(AccessMode access_mode) noexcept;
  */
 void set_socket_blocking(int sock, bool blocking);
 
+/**
+ * Makes sure the process may open at least the given number of files
+ *
+ * Raises the soft limit of open file descriptors (RLIMIT_NOFILE) up to the
+ * hard limit if it is lower than wanted. On Windows there is no such limit
+ * for sockets and nothing is done.
+ *
+ * @param wanted number of file descriptors needed
+ * @return the limit in effect afterwards (which may be lower than wanted)
+ */
+uint64_t ensure_open_files_limit(uint64_t wanted);
+
 /** @class SocketOperationsBase
  * @brief Base class to allow multiple SocketOperations implementations
  *        (at least one "real" and one mock for testing purposes)
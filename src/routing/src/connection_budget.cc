@@ -0,0 +1,39 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "connection_budget.h"
+
+namespace routing {
+
+ConnectionBudget& ConnectionBudget::instance() {
+  static ConnectionBudget instance_;
+  return instance_;
+}
+
+bool ConnectionBudget::acquire() noexcept {
+  uint32_t used = used_.load();
+  do {
+    const uint32_t limit = limit_.load();
+    if (limit > 0 && used >= limit) {
+      return false;
+    }
+  } while (!used_.compare_exchange_weak(used, used + 1));
+
+  return true;
+}
+
+} // namespace routing
@@ -0,0 +1,79 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_CONNECTION_BUDGET_INCLUDED
+#define ROUTING_CONNECTION_BUDGET_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+
+namespace routing {
+
+/** @class ConnectionBudget
+ * @brief Limit of client connections shared by all routing sections
+ *
+ * `max_connections` limits the connections of a single route. The budget
+ * limits the sum over all routes of the process (`max_total_connections`),
+ * so that many routes can be configured generously without the process
+ * running out of file descriptors or memory.
+ *
+ * A limit of 0 means unlimited.
+ */
+class ConnectionBudget {
+ public:
+  ConnectionBudget() : limit_(0), used_(0) {}
+
+  ConnectionBudget(const ConnectionBudget&) = delete;
+  ConnectionBudget& operator=(const ConnectionBudget&) = delete;
+
+  /** @brief Returns the budget shared by the whole process */
+  static ConnectionBudget& instance();
+
+  /** @brief Sets the maximum number of connections (0 = unlimited) */
+  void set_limit(uint32_t limit) noexcept {
+    limit_.store(limit);
+  }
+
+  /** @brief Returns the maximum number of connections (0 = unlimited) */
+  uint32_t get_limit() const noexcept {
+    return limit_.load();
+  }
+
+  /** @brief Reserves a connection
+   *
+   * @return false if the limit is reached; release() must not be called then
+   */
+  bool acquire() noexcept;
+
+  /** @brief Gives back a connection reserved with acquire() */
+  void release() noexcept {
+    used_.fetch_sub(1);
+  }
+
+  /** @brief Returns the number of reserved connections */
+  uint32_t get_used() const noexcept {
+    return used_.load();
+  }
+
+ private:
+  std::atomic<uint32_t> limit_;
+  std::atomic<uint32_t> used_;
+};
+
+} // namespace routing
+
+#endif // ROUTING_CONNECTION_BUDGET_INCLUDED
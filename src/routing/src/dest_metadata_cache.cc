@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <iterator>
 #ifndef _WIN32
 #  include <netdb.h>
 #  include <netinet/tcp.h>
@@ -39,7 +40,6 @@ using std::chrono::duration_cast;
 using std::chrono::system_clock;
 using std::chrono::seconds;
 
-using metadata_cache::lookup_replicaset;
 using metadata_cache::ManagedInstance;
 
 // if client wants a primary and there's none, we can wait up to this amount of
@@ -50,13 +50,20 @@ static const int kPrimaryFailoverTimeout = 10;
 
 DestMetadataCacheGroup::DestMetadataCacheGroup(const std::string &metadata_cache, const std::string &replicaset,
   const std::string &mode, const mysqlrouter::URIQuery &query,
-  const Protocol::Type protocol) :
-    RouteDestination(protocol),
+  const Protocol::Type protocol, const std::string &location,
+  unsigned int location_min_servers, metadata_cache::MetadataCacheAPIBase *cache_api,
+  routing::SocketOperationsBase *sock_ops) :
+    RouteDestination(protocol, sock_ops),
     cache_name_(metadata_cache),
     ha_replicaset_(replicaset),
     uri_query_(query),
+    cache_api_(cache_api),
     allow_primary_reads_(false),
-    current_pos_(0) {
+    max_replication_lag_(0),
+    location_(location),
+    location_min_servers_(location_min_servers),
+    spillover_pos_(0),
+    subscribed_(false) {
   if (mode == "read-only")
     routing_mode_ = ReadOnly;
   else if (mode == "read-write")
@@ -66,30 +73,188 @@ DestMetadataCacheGroup::DestMetadataCacheGroup(const std::string &metadata_cache
   init();
 }
 
-std::vector<mysqlrouter::TCPAddress> DestMetadataCacheGroup::get_available(std::vector<std::string> *server_ids) {
-  auto managed_servers = lookup_replicaset(ha_replicaset_).instance_vector;
-  std::vector<mysqlrouter::TCPAddress> available;
-  for (auto &it: managed_servers) {
+DestMetadataCacheGroup::~DestMetadataCacheGroup() {
+  if (subscribed_) {
+    cache_api_->remove_topology_listener(this);
+  }
+}
+
+std::shared_ptr<const DestMetadataCacheGroup::Candidates> DestMetadataCacheGroup::get_candidates() {
+  auto topology = cache_api_->get_topology();
+  if (!subscribed_.exchange(true)) {
+    cache_api_->add_topology_listener(this);
+  }
+
+  auto candidates = std::atomic_load(&candidates_);
+  if (candidates && candidates->generation == topology->generation) {
+    return candidates;
+  }
+
+  // topology_changed() wasn't called yet (e.g. first use); concurrent
+  // callers may rebuild the list as well, they all come to the same result
+  candidates = build_candidates(*topology);
+  std::atomic_store(&candidates_, candidates);
+  return candidates;
+}
+
+std::shared_ptr<const DestMetadataCacheGroup::Candidates> DestMetadataCacheGroup::build_candidates(
+    const metadata_cache::Topology &topology) const {
+  auto candidates = std::make_shared<Candidates>();
+  candidates->generation = topology.generation;
+
+  auto replicaset = topology.replicasets.find(ha_replicaset_);
+  if (replicaset == topology.replicasets.end()) {
+    log_warning("Replicaset '%s' not available", ha_replicaset_.c_str());
+    return candidates;
+  }
+
+  // secondaries lagging too far behind, only used if there's nothing else
+  std::vector<Candidate> lagging;
+  // servers of other locations than the router's
+  std::vector<Candidate> remote;
+
+  for (auto &it: replicaset->second.members) {
     if (!(it.role == "HA")) {
       continue;
     }
     auto port = (protocol_ == Protocol::Type::kXProtocol) ? static_cast<uint16_t>(it.xport) : static_cast<uint16_t>(it.port);
-    if (routing_mode_ == RoutingMode::ReadOnly && it.mode == metadata_cache::ServerMode::ReadOnly) {
-      // Secondary read-only
-      available.push_back(mysqlrouter::TCPAddress(it.host, port));
-      if (server_ids)
-        server_ids->push_back(it.mysql_server_uuid);
-    } else if ((routing_mode_ == RoutingMode::ReadWrite &&
-                it.mode == metadata_cache::ServerMode::ReadWrite) ||
-               allow_primary_reads_) {
-      // Primary and secondary read-write/write-only
-      available.push_back(mysqlrouter::TCPAddress(it.host, port));
-      if (server_ids)
-        server_ids->push_back(it.mysql_server_uuid);
+    if (it.mode == metadata_cache::ServerMode::ReadWrite) {
+      candidates->primaries.push_back(Candidate{mysqlrouter::TCPAddress(it.host, port), it.mysql_server_uuid});
+    }
+    if (routes_to(it.mode)) {
+      Candidate candidate{mysqlrouter::TCPAddress(it.host, port), it.mysql_server_uuid};
+      if (max_replication_lag_ > 0 && it.apply_backlog > max_replication_lag_) {
+        log_module_debug(LOG_MODULE_ROUTING, "Server %s:%u of replicaset '%s' is %llu transactions behind",
+                         it.host.c_str(), it.port, ha_replicaset_.c_str(),
+                         static_cast<unsigned long long>(it.apply_backlog));
+        lagging.push_back(std::move(candidate));
+      } else if (!location_.empty() && it.location != location_) {
+        remote.push_back(std::move(candidate));
+      } else {
+        candidates->servers.push_back(std::move(candidate));
+      }
     }
   }
 
-  return available;
+  if (candidates->servers.size() < location_min_servers_ && !remote.empty()) {
+#ifndef _WIN32
+    log_module_debug(LOG_MODULE_ROUTING, "%zu server(s) of replicaset '%s' available in location '%s', "
+                     "using other locations as well",
+                     candidates->servers.size(), ha_replicaset_.c_str(), location_.c_str());
+#else
+    log_module_debug(LOG_MODULE_ROUTING, "%Iu server(s) of replicaset '%s' available in location '%s', "
+                     "using other locations as well",
+                     candidates->servers.size(), ha_replicaset_.c_str(), location_.c_str());
+#endif
+    std::move(remote.begin(), remote.end(), std::back_inserter(candidates->servers));
+  } else {
+    candidates->spillover = std::move(remote);
+  }
+
+  if (candidates->servers.empty() && !lagging.empty()) {
+    log_warning("All servers of replicaset '%s' are more than %u transactions behind, using them anyway",
+                ha_replicaset_.c_str(), max_replication_lag_);
+    candidates->servers = std::move(lagging);
+  }
+
+  return candidates;
+}
+
+bool DestMetadataCacheGroup::routes_to(metadata_cache::ServerMode mode) const {
+  return (routing_mode_ == RoutingMode::ReadOnly && mode == metadata_cache::ServerMode::ReadOnly) ||
+         // Primary and secondary read-write/write-only
+         (routing_mode_ == RoutingMode::ReadWrite && mode == metadata_cache::ServerMode::ReadWrite) ||
+         allow_primary_reads_;
+}
+
+void DestMetadataCacheGroup::topology_changed(const std::shared_ptr<const metadata_cache::Topology> &topology,
+                                              const std::vector<metadata_cache::TopologyChange> &changes) {
+  using metadata_cache::TopologyChange;
+
+  // servers the open connections of the route mustn't stay on
+  std::vector<mysqlrouter::TCPAddress> dropped;
+  for (const auto &change : changes) {
+    if (change.instance.replicaset_name != ha_replicaset_) {
+      continue;
+    }
+    const auto &mi = change.instance;
+    auto port = (protocol_ == Protocol::Type::kXProtocol) ? static_cast<uint16_t>(mi.xport) : static_cast<uint16_t>(mi.port);
+    switch (change.type) {
+      case TopologyChange::Type::InstanceAdded:
+        log_module_debug(LOG_MODULE_ROUTING, "Server %s:%u added to replicaset '%s'",
+                         mi.host.c_str(), mi.port, ha_replicaset_.c_str());
+        break;
+      case TopologyChange::Type::InstanceRemoved:
+        log_module_debug(LOG_MODULE_ROUTING, "Server %s:%u removed from replicaset '%s'",
+                         mi.host.c_str(), mi.port, ha_replicaset_.c_str());
+        dropped.push_back(mysqlrouter::TCPAddress(mi.host, port));
+        break;
+      case TopologyChange::Type::ModeChanged:
+        log_module_debug(LOG_MODULE_ROUTING, "Server %s:%u of replicaset '%s' changed mode",
+                         mi.host.c_str(), mi.port, ha_replicaset_.c_str());
+        if (!routes_to(mi.mode)) {
+          dropped.push_back(mysqlrouter::TCPAddress(mi.host, port));
+        }
+        break;
+    }
+  }
+
+  // connections get the new list right away, without rebuilding it themselves
+  std::atomic_store(&candidates_, build_candidates(*topology));
+
+  if (dropped.empty()) {
+    return;
+  }
+
+  // the connection threads notice the shutdown and close both sockets
+  unsigned count = 0;
+  {
+    std::lock_guard<std::mutex> lock(connections_mtx_);
+    for (auto &it : connections_) {
+      if (!it.second.dropped &&
+          std::find(dropped.begin(), dropped.end(), it.second.address) != dropped.end()) {
+        it.second.dropped = true;
+        socket_operations_->shutdown(it.first);
+        ++count;
+      }
+    }
+  }
+  if (count > 0) {
+    log_info("Closing %u connection(s) to servers which left the destinations of '%s'",
+             count, ha_replicaset_.c_str());
+  }
+}
+
+int DestMetadataCacheGroup::get_mysql_socket(const mysqlrouter::TCPAddress &addr,
+                                             std::chrono::milliseconds connect_timeout, bool log_errors) {
+  int fd = RouteDestination::get_mysql_socket(addr, connect_timeout, log_errors);
+  if (fd >= 0) {
+    std::lock_guard<std::mutex> lock(connections_mtx_);
+    connections_[fd] = Connection{addr, false};
+  }
+  return fd;
+}
+
+bool DestMetadataCacheGroup::release_server_socket(int fd) noexcept {
+  std::lock_guard<std::mutex> lock(connections_mtx_);
+  auto it = connections_.find(fd);
+  if (it == connections_.end()) {
+    return false;
+  }
+  bool dropped = it->second.dropped;
+  connections_.erase(it);
+  return dropped;
+}
+
+void DestMetadataCacheGroup::prepare() noexcept {
+  try {
+    destinations_.clear();
+    for (const auto &candidate : get_candidates()->servers) {
+      destinations_.push_back(candidate.address);
+    }
+  } catch (const std::runtime_error &re) {
+    log_error("Failed getting managed servers from the Metadata server: %s", re.what());
+  }
 }
 
 void DestMetadataCacheGroup::init() {
@@ -106,13 +271,57 @@ void DestMetadataCacheGroup::init() {
       log_warning("allow_primary_reads only works with read-only mode");
     }
   }
+
+  query_part = uri_query_.find("max_replication_lag");
+  if (query_part != uri_query_.end()) {
+    if (routing_mode_ == RoutingMode::ReadOnly) {
+      const std::string &value = query_part->second;
+      max_replication_lag_ = mysqlrouter::strtoui_checked(value.c_str());
+      if (max_replication_lag_ == 0 && value != "0") {
+        throw std::runtime_error("Invalid max_replication_lag value '" + value + "'");
+      }
+    } else {
+      log_warning("max_replication_lag only works with read-only mode");
+    }
+  }
+}
+
+int DestMetadataCacheGroup::get_primary_socket(std::chrono::milliseconds connect_timeout, int *error) noexcept {
+  try {
+    auto candidates = get_candidates();
+    const auto &primaries = candidates->primaries;
+    if (primaries.empty()) {
+      log_warning("No available RW servers found for '%s'", ha_replicaset_.c_str());
+      return -1;
+    }
+
+    const auto &primary = primaries[current_pos_++ % primaries.size()];
+    int fd = get_mysql_socket(primary.address, connect_timeout);
+    if (fd >= 0) {
+      return fd;
+    }
+    cache_api_->mark_instance_reachability(primary.server_id, metadata_cache::InstanceStatus::Unreachable);
+  } catch (const std::runtime_error &re) {
+    log_error("Failed getting managed servers from the Metadata server: %s", re.what());
+  }
+
+  *error = errno;
+  return -1;
 }
 
 int DestMetadataCacheGroup::get_server_socket(std::chrono::milliseconds connect_timeout, int *error) noexcept {
+  bool server_behind;
+  return get_server_socket(connect_timeout, error, "", std::chrono::milliseconds::zero(), &server_behind);
+}
+
+int DestMetadataCacheGroup::get_server_socket(std::chrono::milliseconds connect_timeout, int *error,
+                                              const std::string &gtids, std::chrono::milliseconds wait_timeout,
+                                              bool *server_behind) noexcept {
+  *server_behind = false;
   while (true) {
     try {
-      std::vector<std::string> server_ids;
-      auto available = get_available(&server_ids);
+      auto candidates = get_candidates();
+      const auto &available = candidates->servers;
       if (available.empty()) {
         log_warning("No available %s servers found for '%s'",
             routing_mode_ == RoutingMode::ReadWrite ? "RW" : "RO",
@@ -120,29 +329,40 @@ int DestMetadataCacheGroup::get_server_socket(std::chrono::milliseconds connect_
         return -1;
       }
 
-      size_t next_up = 0;
-      {
-        std::lock_guard<std::mutex> lock(mutex_update_);
-        // round-robin between available nodes
-        next_up = current_pos_;
-        if (next_up >= available.size()) {
-          next_up = 0;
-          current_pos_ = 0;
-        }
-        ++current_pos_;
-        if (current_pos_ >= available.size()) {
-          current_pos_ = 0;
-        }
+      // round-robin between available nodes
+      const size_t next_up = current_pos_++ % available.size();
+
+      // the server has to catch up with the client's writes first; asked
+      // over a connection of the Metadata Cache, before the client connects
+      if (!gtids.empty() &&
+          !cache_api_->wait_for_gtids(available[next_up].server_id, gtids, wait_timeout)) {
+        *server_behind = true;
+        return get_primary_socket(connect_timeout, error);
       }
 
-      int fd = get_mysql_socket(available.at(next_up), connect_timeout);
+      int fd = get_mysql_socket(available[next_up].address, connect_timeout);
       if (fd < 0) {
         // Signal that we can't connect to the instance
-        metadata_cache::mark_instance_reachability(server_ids.at(next_up),
+        cache_api_->mark_instance_reachability(available[next_up].server_id,
             metadata_cache::InstanceStatus::Unreachable);
+        // the server of our location is down or too busy to accept
+        // connections in time, give one of another location a chance
+        const auto &spillover = candidates->spillover;
+        if (!spillover.empty()) {
+          const auto &other = spillover[spillover_pos_++ % spillover.size()];
+          log_info("Connecting to %s failed, trying %s of another location for '%s'",
+                   available[next_up].address.str().c_str(), other.address.str().c_str(),
+                   ha_replicaset_.c_str());
+          fd = get_mysql_socket(other.address, connect_timeout);
+          if (fd >= 0) {
+            return fd;
+          }
+          cache_api_->mark_instance_reachability(other.server_id,
+              metadata_cache::InstanceStatus::Unreachable);
+        }
         // if we're looking for a primary member, wait for there to be at least one
         if (routing_mode_ == RoutingMode::ReadWrite &&
-            metadata_cache::wait_primary_failover(ha_replicaset_,
+            cache_api_->wait_primary_failover(ha_replicaset_,
                 kPrimaryFailoverTimeout)) {
           log_info("Retrying connection for '%s' after possible failover",
                    ha_replicaset_.c_str());
@@ -22,24 +22,47 @@
 #include "mysql_routing.h"
 #include "mysqlrouter/uri.h"
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <thread>
 
 #include "mysqlrouter/datatypes.h"
+#include "mysqlrouter/metadata_cache.h"
 #include "logger.h"
 
-class DestMetadataCacheGroup final : public RouteDestination {
+class DestMetadataCacheGroup final : public RouteDestination,
+                                     public metadata_cache::TopologyListener {
 public:
    enum RoutingMode {
      ReadWrite,
      ReadOnly
    };
 
-   /** @brief Constructor */
+   /** @brief Constructor
+    *
+    * @param location servers with this location (see `ManagedInstance::location`)
+    *        are preferred; empty if all servers are equal
+    * @param location_min_servers servers of `location` needed to keep the
+    *        servers of other locations out of the rotation
+    * @param cache_api Metadata Cache to use (replaced by a mock in tests)
+    * @param sock_ops socket operations (replaced by a mock in tests)
+    */
    DestMetadataCacheGroup(const std::string &metadata_cache,
                           const std::string &replicaset,
                           const std::string &mode,
                           const mysqlrouter::URIQuery &query,
-                          const Protocol::Type protocol);
+                          const Protocol::Type protocol,
+                          const std::string &location = "",
+                          unsigned int location_min_servers = 1,
+                          metadata_cache::MetadataCacheAPIBase *cache_api =
+                            metadata_cache::MetadataCacheAPI::instance(),
+                          routing::SocketOperationsBase *sock_ops =
+                            routing::SocketOperations::instance());
+
+  /** @brief Destructor; stops listening for topology changes */
+  ~DestMetadataCacheGroup() override;
 
   /** @brief Copy constructor */
   DestMetadataCacheGroup(const DestMetadataCacheGroup &other) = delete;
@@ -55,6 +78,33 @@ public:
 
   int get_server_socket(std::chrono::milliseconds connect_timeout, int *error) noexcept override;
 
+  /** @brief Connects to a server which applied the given GTIDs
+   *
+   * Like get_server_socket(), but the chosen server is first asked through
+   * the Metadata Cache to apply `gtids` within `wait_timeout`. If it
+   * doesn't, the primary is connected to instead.
+   *
+   * @param connect_timeout timeout of the connection attempt
+   * @param error set to the errno if no server could be connected to
+   * @param gtids GTID set of the client's writes
+   * @param wait_timeout how long the server may take to apply them
+   * @param server_behind set to whether the chosen server didn't apply them
+   * @return socket descriptor; -1 on error
+   */
+  int get_server_socket(std::chrono::milliseconds connect_timeout, int *error,
+                        const std::string &gtids, std::chrono::milliseconds wait_timeout,
+                        bool *server_behind) noexcept;
+
+  /** @brief Connects to the primary of the replicaset, whatever the routing mode
+   *
+   * Used for reads of clients whose writes didn't reach the secondaries yet.
+   *
+   * @param connect_timeout timeout of the connection attempt
+   * @param error set to the errno if no primary could be connected to
+   * @return socket descriptor; -1 on error
+   */
+  int get_primary_socket(std::chrono::milliseconds connect_timeout, int *error) noexcept;
+
   void add(const std::string &, uint16_t) override { }
 
 
@@ -76,9 +126,7 @@ public:
    * Prepares the list of destination by fetching data from the
    * Metadata Cache.
    */
-  void prepare() noexcept {
-    destinations_ = get_available(nullptr);
-  }
+  void prepare() noexcept;
 
   /** @brief empty implementation
    *
@@ -87,6 +135,37 @@ public:
    */
   void start() override {}
 
+  /** @brief Rebuilds the candidates as soon as the topology changed
+   *
+   * Called by the Metadata Cache's refresh thread. Connections to servers
+   * which were removed from the replicaset, or whose new mode isn't routed
+   * to anymore (e.g. the demoted primary of a read-write route), are shut
+   * down; their connection threads close them.
+   *
+   * Connections which are being established while the topology changes
+   * may still reach such a server.
+   */
+  void topology_changed(const std::shared_ptr<const metadata_cache::Topology> &topology,
+                        const std::vector<metadata_cache::TopologyChange> &changes) override;
+
+  /** @brief Forgets a server connection before it gets closed
+   *
+   * Has to be called for every socket returned by get_server_socket() or
+   * get_primary_socket(), before closing it.
+   *
+   * @param fd socket descriptor of the server connection
+   * @return whether the connection was shut down by topology_changed()
+   */
+  bool release_server_socket(int fd) noexcept;
+
+protected:
+  /** @brief Connects to a server, remembering which one
+   *
+   * The connection is tracked until release_server_socket() is called.
+   */
+  int get_mysql_socket(const mysqlrouter::TCPAddress &addr, std::chrono::milliseconds connect_timeout,
+                       bool log_errors = true) override;
+
 private:
   /** @brief The Metadata Cache to use
    *
@@ -128,6 +207,9 @@ private:
    */
   const mysqlrouter::URIQuery uri_query_;
 
+  /** @brief Metadata Cache API, "real" or mock */
+  metadata_cache::MetadataCacheAPIBase *cache_api_;
+
   /** @brief Initializes
    *
    * This method initialized the object. It goes of the URI query information
@@ -135,18 +217,100 @@ private:
    */
   void init();
 
+  /** @brief Server a connection can be routed to */
+  struct Candidate {
+    /** @brief Address (classic or X protocol port, depending on the route) */
+    mysqlrouter::TCPAddress address;
+    /** @brief mysql_server_uuid, to report the server as unreachable */
+    std::string server_id;
+  };
+
+  /** @brief Candidates computed from a topology snapshot */
+  struct Candidates {
+    /** @brief Generation of the snapshot they were computed from */
+    uint64_t generation;
+    /** @brief Servers matching the routing mode, in metadata order */
+    std::vector<Candidate> servers;
+    /** @brief Servers of other locations, tried if connecting to one of
+     *         `servers` failed; empty if they are part of `servers` already
+     */
+    std::vector<Candidate> spillover;
+    /** @brief Read-write members, whatever the routing mode */
+    std::vector<Candidate> primaries;
+  };
+
   /** @brief Gets available destinations from Metadata Cache
    *
-   * This method gets the destinations using Metadata Cache information. It uses
-   * the `metadata_cache::lookup_replicaset()` function to get a list of current managed
-   * servers.
+   * Returns the servers of the replicaset matching the routing mode and the
+   * protocol of this route. The list is only rebuilt when the Metadata Cache
+   * published a new topology snapshot, see `metadata_cache::get_topology()`.
    *
+   * @throws std::runtime_error if the Metadata Cache is not initialized
    */
-  std::vector<mysqlrouter::TCPAddress> get_available(std::vector<std::string> *server_ids);
+  std::shared_ptr<const Candidates> get_candidates();
+
+  /** @brief Computes the candidates from a topology snapshot */
+  std::shared_ptr<const Candidates> build_candidates(const metadata_cache::Topology &topology) const;
+
+  /** @brief Whether servers in the given mode are routed to */
+  bool routes_to(metadata_cache::ServerMode mode) const;
 
   /** @brief Whether we allow a read operations going to the primary (master) */
   bool allow_primary_reads_;
-  size_t current_pos_;
+
+  /** @brief Apply backlog (in transactions) above which a secondary only
+   *         gets new connections if no other server is available; 0 if
+   *         replication lag is not taken into account
+   *
+   * Set with `max_replication_lag` in the URI query. Needs MySQL 8.0 on
+   * the members, older servers don't report the backlog.
+   */
+  unsigned int max_replication_lag_;
+
+  /** @brief Location of the router; servers of this location are preferred
+   *
+   * Compared with the location of the hosts in the metadata. Empty if the
+   * location of the servers doesn't matter.
+   */
+  const std::string location_;
+
+  /** @brief Servers of `location_` needed to keep other locations out
+   *
+   * If fewer are available, the servers of the other locations are added
+   * to the round-robin as well.
+   */
+  const unsigned int location_min_servers_;
+
+  /** @brief Position of the next server of another location to try */
+  std::atomic<size_t> spillover_pos_;
+
+  /** @brief Last result of get_candidates()
+   *
+   * Shared by all connection threads; accessed through std::atomic_load()
+   * and std::atomic_store().
+   */
+  std::shared_ptr<const Candidates> candidates_;
+
+  /** @brief Whether we registered as topology listener
+   *
+   * Done on first use, as the Metadata Cache may get initialized after
+   * the route.
+   */
+  std::atomic<bool> subscribed_;
+
+  /** @brief Server connection in use by a connection thread */
+  struct Connection {
+    /** @brief Server the connection goes to */
+    mysqlrouter::TCPAddress address;
+    /** @brief Whether topology_changed() shut the connection down */
+    bool dropped;
+  };
+
+  /** @brief Open server connections, by socket descriptor */
+  std::map<int, Connection> connections_;
+
+  /** @brief Protects `connections_` */
+  std::mutex connections_mtx_;
 };
 
 
@@ -50,7 +50,12 @@ static const int kTimeoutQuarantineConditional = 2;
 
 RouteDestination::~RouteDestination() {
 
-  stopping_ = true;
+  {
+    // wake up the quarantine manager instead of letting it finish its nap
+    std::lock_guard<std::mutex> lock(mutex_quarantine_manager_);
+    stopping_ = true;
+  }
+  condvar_quarantine_.notify_all();
   if (quarantine_thread_.joinable()) {
     quarantine_thread_.join();
   }
@@ -216,12 +221,13 @@ void RouteDestination::quarantine_manager_thread() noexcept {
   std::unique_lock<std::mutex> lock(mutex_quarantine_manager_);
   while (!stopping_) {
     condvar_quarantine_.wait_for(lock, std::chrono::seconds(kTimeoutQuarantineConditional),
-                                 [this] { return !quarantined_.empty(); });
+                                 [this] { return stopping_ || !quarantined_.empty(); });
 
     if (!stopping_) {
       cleanup_quarantine();
       // Temporize
-      std::this_thread::sleep_for(std::chrono::seconds(kQuarantineCleanupInterval));
+      condvar_quarantine_.wait_for(lock, std::chrono::seconds(kQuarantineCleanupInterval),
+                                   [this] { return stopping_.load(); });
     }
   }
 }
@@ -0,0 +1,101 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "forwarding_queue.h"
+#include "mysqlrouter/routing.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+
+namespace routing {
+
+ForwardingQueue::ForwardingQueue(RoutingProtocolBuffer storage)
+    : storage_(std::move(storage)), head_(0), size_(0), peak_size_(0) {}
+
+bool ForwardingQueue::would_block(int err) noexcept {
+#ifdef _WIN32
+  return err == WSAEWOULDBLOCK;
+#else
+  return err == EAGAIN || err == EWOULDBLOCK;
+#endif
+}
+
+ssize_t ForwardingQueue::fill(int fd, SocketOperationsBase *socket_operations) {
+  assert(!full());
+  ssize_t total = 0;
+
+  // at most 2 reads: up to the end of the buffer, then from its start
+  while (!full()) {
+    const size_t tail = (head_ + size_) % storage_.size();
+    const size_t contiguous = (tail >= head_) ? storage_.size() - tail : head_ - tail;
+
+    const ssize_t res = socket_operations->read(fd, &storage_[tail], contiguous);
+    if (res <= 0) {
+      if (total > 0 && (res == 0 || would_block(socket_operations->get_errno()))) {
+        // report the data now; EOF or the error shows up with the next read
+        break;
+      }
+      if (res == 0) {
+        // the caller assumes that errno == 0 on plain connection closes.
+        socket_operations->set_errno(0);
+      }
+      return res;
+    }
+
+    size_ += static_cast<size_t>(res);
+    total += res;
+    if (static_cast<size_t>(res) < contiguous) {
+      break;
+    }
+  }
+  peak_size_ = std::max(peak_size_, size_);
+
+  return total;
+}
+
+ssize_t ForwardingQueue::flush(int fd, SocketOperationsBase *socket_operations) {
+  ssize_t total = 0;
+
+  while (!empty()) {
+    const size_t contiguous = std::min(size_, storage_.size() - head_);
+
+    const ssize_t res = socket_operations->write(fd, &storage_[head_], contiguous);
+    if (res < 0) {
+      if (total > 0 && would_block(socket_operations->get_errno())) {
+        break;
+      }
+      return res;
+    }
+
+    head_ = (head_ + static_cast<size_t>(res)) % storage_.size();
+    size_ -= static_cast<size_t>(res);
+    total += res;
+    if (static_cast<size_t>(res) < contiguous) {
+      break;
+    }
+  }
+
+  if (empty()) {
+    // start over at the beginning to keep the next reads contiguous
+    head_ = 0;
+  }
+
+  return total;
+}
+
+} // namespace routing
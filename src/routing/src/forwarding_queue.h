@@ -0,0 +1,86 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_FORWARDING_QUEUE_INCLUDED
+#define ROUTING_FORWARDING_QUEUE_INCLUDED
+
+#include "protocol/base_protocol.h"
+
+#include <cstddef>
+
+namespace routing {
+
+/** @class ForwardingQueue
+ * @brief Bounded queue of bytes forwarded from one socket to another
+ *
+ * Ring buffer used on non-blocking sockets: fill() reads from the sender as
+ * much as fits, flush() writes to the receiver as much as it accepts. When
+ * the queue is full the sender must not be polled for POLLIN anymore, which
+ * makes a slow receiver throttle the sender (backpressure) instead of
+ * blocking the whole connection.
+ *
+ * Not thread-safe.
+ */
+class ForwardingQueue {
+ public:
+  /** @brief Constructor
+   *
+   * @param storage buffer to use; its size is the capacity of the queue
+   */
+  explicit ForwardingQueue(RoutingProtocolBuffer storage);
+
+  /** @brief Reads from the sender into the free space of the queue
+   *
+   * Must not be called while the queue is full.
+   *
+   * @param fd socket to read from
+   * @param socket_operations object handling the operations on network sockets
+   * @return bytes read, 0 if the sender closed the connection, -1 on error
+   *         (which includes "would block" if nothing could be read)
+   */
+  ssize_t fill(int fd, SocketOperationsBase *socket_operations);
+
+  /** @brief Writes queued data to the receiver
+   *
+   * @param fd socket to write to
+   * @param socket_operations object handling the operations on network sockets
+   * @return bytes written, -1 on error (which includes "would block" if
+   *         nothing could be written)
+   */
+  ssize_t flush(int fd, SocketOperationsBase *socket_operations);
+
+  /** @brief Returns whether errno of a failed fill()/flush() means "try later" */
+  static bool would_block(int err) noexcept;
+
+  size_t size() const noexcept { return size_; }
+  size_t capacity() const noexcept { return storage_.size(); }
+  bool empty() const noexcept { return size_ == 0; }
+  bool full() const noexcept { return size_ == storage_.size(); }
+
+  /** @brief Returns the highest number of bytes queued so far */
+  size_t peak_size() const noexcept { return peak_size_; }
+
+ private:
+  RoutingProtocolBuffer storage_;
+  size_t head_;  // position of the first queued byte
+  size_t size_;
+  size_t peak_size_;
+};
+
+} // namespace routing
+
+#endif // ROUTING_FORWARDING_QUEUE_INCLUDED
@@ -19,8 +19,10 @@
 #endif
 
 #include "common.h"
+#include "connection_budget.h"
 #include "dest_first_available.h"
 #include "dest_metadata_cache.h"
+#include "forwarding_queue.h"
 #include "logger.h"
 #include "mysql_routing.h"
 #include "mysqlrouter/metadata_cache.h"
@@ -29,6 +31,8 @@
 #include "mysqlrouter/utils.h"
 #include "plugin_config.h"
 #include "protocol/protocol.h"
+#include "read_your_writes.h"
+#include "timer_wheel.h"
 
 #include <algorithm>
 #include <array>
@@ -44,6 +48,7 @@
 #ifndef _WIN32
 #  include <netinet/in.h>
 #  include <fcntl.h>
+#  include <pthread.h>
 #  include <sys/un.h>
 #  include <sys/select.h>
 #  include <sys/socket.h>
@@ -76,7 +81,28 @@ using mysqlrouter::is_valid_socket_name;
 static int kListenQueueSize = 1024;
 
 static const char *kDefaultReplicaSetName = "default";
-static const std::chrono::milliseconds kAcceptorStopPollInterval_ms { 1000 };
+
+// how long the acceptor pauses when running out of file descriptors
+static const std::chrono::milliseconds kAcceptFileLimitBackoff(100);
+
+// minimum time between two "reached max connections" warnings (ms); under
+// overload they would be logged for every connection attempt
+static const unsigned kConnectionLimitLogInterval = 10000;
+
+// stack size the client threads get (virtual memory, reserved up front)
+static size_t get_default_thread_stack_size() {
+#ifndef _WIN32
+  size_t size = 0;
+  pthread_attr_t attr;
+  if (pthread_attr_init(&attr) == 0) {
+    pthread_attr_getstacksize(&attr, &size);
+    pthread_attr_destroy(&attr);
+  }
+  return size;
+#else
+  return 1024 * 1024;  // default of the linker
+#endif
+}
 
 MySQLRouting::MySQLRouting(routing::AccessMode mode, uint16_t port,
                            const Protocol::Type protocol,
@@ -100,11 +126,16 @@ MySQLRouting::MySQLRouting(routing::AccessMode mode, uint16_t port,
       bind_named_socket_(named_socket),
       service_tcp_(routing::kInvalidSocket),
       service_named_socket_(routing::kInvalidSocket),
+      metadata_destination_(nullptr),
       stopping_(false),
       info_active_routes_(0),
       info_handled_routes_(0),
+      drain_timeout_(0),
+      client_threads_(0),
       socket_operations_(socket_operations),
-      protocol_(Protocol::create(protocol, socket_operations)) {
+      protocol_(Protocol::create(protocol, socket_operations)),
+      location_min_servers_(routing::kDefaultLocationMinServers),
+      read_your_writes_timeout_(routing::kDefaultReadYourWritesTimeout) {
 
   assert(socket_operations_ != nullptr);
 
@@ -165,7 +196,8 @@ const std::vector<std::array<uint8_t, 16>> MySQLRouting::get_blocked_client_host
 }
 
 /*static*/
-std::string MySQLRouting::make_thread_name(const std::string& config_name, const std::string& prefix) {
+std::string MySQLRouting::make_thread_name(const std::string& config_name, const std::string& prefix,
+                                           const std::string& placement) {
 
   const char* p = config_name.c_str();
 
@@ -196,15 +228,63 @@ std::string MySQLRouting::make_thread_name(const std::string& config_name, const
     key = key.substr(key.find(kPrefix) + sizeof(kPrefix) - 1);  // -1 for string terminator
   }
 
-  // now put everything together
+  // now put everything together; the placement is kept, the key gets
+  // trimmed to make room for it
   std::string thread_name = prefix + ":" + key;
-  thread_name.resize(15); // max for pthread_setname_np()
+  const size_t max_len = 15 - std::min<size_t>(placement.size(), 15);  // max for pthread_setname_np()
+  if (thread_name.size() > max_len) {
+    thread_name.resize(max_len);
+  }
+  thread_name += placement.substr(0, 15);
 
   return thread_name;
 }
 
+std::string MySQLRouting::get_placement(const mysql_harness::CpuSet &cpus) {
+  if (cpus.empty()) {
+    return "";
+  }
+  if (cpus.size() == 1) {
+    return "@c" + std::to_string(cpus.front());
+  }
+  const int node = mysql_harness::get_numa_node_of_cpus(cpus);
+  if (node >= 0) {
+    return "@n" + std::to_string(node);
+  }
+  return "@p";
+}
+
+void MySQLRouting::set_cpu_affinity(const mysql_harness::CpuSet &acceptor_cpus,
+                                    const mysql_harness::CpuSet &connection_cpus) {
+  acceptor_cpus_ = acceptor_cpus;
+  connection_cpus_ = connection_cpus;
+  acceptor_placement_ = get_placement(acceptor_cpus_);
+  connection_placement_ = get_placement(connection_cpus_);
+}
+
+void MySQLRouting::pin_thread(const mysql_harness::CpuSet &cpus, const char *what) {
+  if (cpus.empty() || mysql_harness::set_thread_affinity(cpus)) {
+    return;
+  }
+
+  // connection threads would log this for every connection otherwise
+  static std::atomic<bool> logged_this_before(false);
+  if (!logged_this_before.exchange(true)) {
+    log_warning("[%s] failed pinning %s thread to CPUs %s", name.c_str(), what,
+                mysql_harness::cpu_set_to_string(cpus).c_str());
+  }
+}
+
 void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& client_addr ) noexcept {
-  mysql_harness::rename_thread(make_thread_name(name, "RtS").c_str());  // "Rt select() thread" would be too long :(
+  // threads created by a pinned acceptor inherit its CPUs, undo that if
+  // connections are not pinned themselves. Done before any buffer gets
+  // allocated, so that they end up on the local NUMA node.
+  if (!connection_cpus_.empty()) {
+    pin_thread(connection_cpus_, "connection");
+  } else if (!acceptor_cpus_.empty()) {
+    pin_thread(process_cpus_, "connection");
+  }
+  mysql_harness::rename_thread(make_thread_name(name, "RtS", connection_placement_).c_str());  // "Rt select() thread" would be too long :(
 
   int error = 0;
   size_t bytes_down = 0;
@@ -214,7 +294,39 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
   RoutingProtocolBuffer buffer(net_buffer_length_);
   bool handshake_done = false;
 
-  int server = destination_->get_server_socket(destination_connect_timeout_, &error);
+  // read-your-writes: the read-write route records the GTIDs of the
+  // client's writes, the read-only route picks a server which applied them
+  std::string client_host;
+  routing::GtidRegistry::Pending pending_writes;
+  if (read_your_writes_timeout_.count() > 0 && protocol_->get_type() == Protocol::Type::kClassicProtocol) {
+    if (mode_ == routing::AccessMode::kReadWrite) {
+      client_host = get_addr_str(client_addr);
+    } else if (mode_ == routing::AccessMode::kReadOnly && metadata_destination_) {
+      client_host = get_addr_str(client_addr);
+      pending_writes = routing::GtidRegistry::instance().get(client_host);
+    }
+  }
+
+  int server;
+  if (pending_writes.replicas_behind) {
+    // a secondary didn't catch up with the last writes of the client
+    log_module_debug(LOG_MODULE_ROUTING, "[%s] fd=%d reading from the primary until %s caught up",
+                     name.c_str(), client, client_host.c_str());
+    server = metadata_destination_->get_primary_socket(destination_connect_timeout_, &error);
+  } else if (!pending_writes.gtids.empty()) {
+    bool secondary_behind;
+    server = metadata_destination_->get_server_socket(destination_connect_timeout_, &error,
+                                                      pending_writes.gtids, read_your_writes_timeout_,
+                                                      &secondary_behind);
+    if (secondary_behind) {
+      // the next connections of the host go to the primary right away
+      routing::GtidRegistry::instance().mark_replicas_behind(client_host, pending_writes.gtids);
+      log_info("[%s] fd=%d secondary didn't catch up with the writes of %s in time, reading from the primary",
+               name.c_str(), client, client_host.c_str());
+    }
+  } else {
+    server = destination_->get_server_socket(destination_connect_timeout_, &error);
+  }
 
   if ((server == routing::kInvalidSocket) ||
       (client == routing::kInvalidSocket)) {
@@ -234,29 +346,33 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
       socket_operations_->close(client);
     }
     if (server != routing::kInvalidSocket) {
+      if (metadata_destination_) metadata_destination_->release_server_socket(server);
       socket_operations_->close(server);
     }
     return;
   }
 
-  std::pair<std::string, int> c_ip = get_peer_name(client);
-  std::pair<std::string, int> s_ip = get_peer_name(server);
-
-  if (c_ip.second == 0) {
-    // Unix socket/Windows Named pipe
-    log_debug("[%s] fd=%d connected %s -> %s:%d as fd=%d",
-        name.c_str(),
-        client,
-        bind_named_socket_.c_str(),
-        s_ip.first.c_str(), s_ip.second,
-        server);
-  } else {
-    log_debug("[%s] fd=%d connected %s:%d -> %s:%d as fd=%d",
-        name.c_str(),
-        client,
-        c_ip.first.c_str(), c_ip.second,
-        s_ip.first.c_str(), s_ip.second,
-        server);
+  // the peer names take 2 syscalls, only get them if they get logged
+  if (log_level_is_enabled(LOG_MODULE_ROUTING, LOG_LEVEL_DEBUG)) {
+    std::pair<std::string, int> c_ip = get_peer_name(client);
+    std::pair<std::string, int> s_ip = get_peer_name(server);
+
+    if (c_ip.second == 0) {
+      // Unix socket/Windows Named pipe
+      log_module_debug(LOG_MODULE_ROUTING, "[%s] fd=%d connected %s -> %s:%d as fd=%d",
+          name.c_str(),
+          client,
+          bind_named_socket_.c_str(),
+          s_ip.first.c_str(), s_ip.second,
+          server);
+    } else {
+      log_module_debug(LOG_MODULE_ROUTING, "[%s] fd=%d connected %s:%d -> %s:%d as fd=%d",
+          name.c_str(),
+          client,
+          c_ip.first.c_str(), c_ip.second,
+          s_ip.first.c_str(), s_ip.second,
+          server);
+    }
   }
 
   ++info_active_routes_;
@@ -264,21 +380,57 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
 
   int pktnr = 0;
 
+  // the client has to finish the handshake within client_connect_timeout_.
+  // The deadline is kept by the shared timer wheel which shuts down the
+  // client socket to wake us up; this way poll() can block until there is
+  // traffic on one of the sockets instead of waking up periodically.
+  auto &timer_wheel = mysql_harness::TimerWheel::instance();
+  std::atomic<bool> client_auth_timed_out{false};
+  mysql_harness::TimerWheel::TimerId handshake_timer =
+      timer_wheel.add(client_connect_timeout_, [this, client, &client_auth_timed_out] {
+        client_auth_timed_out = true;
+        socket_operations_->shutdown(client);
+      });
+
   bool connection_is_ok = true;
-  while (connection_is_ok) {
+  std::unique_ptr<ProtocolConnectionState> protocol_state = protocol_->create_connection_state();
+  std::unique_ptr<routing::TlsConnection> tls;
+  if (tls_context_) {
+    switch (protocol_->terminate_tls(client, server, *tls_context_, tls, &pktnr, protocol_state.get(),
+                                     client_connect_timeout_, stop_connections_.native_handle())) {
+      case 1:
+        // TLS is established and the client authenticated
+        handshake_done = true;
+        log_module_debug(LOG_MODULE_ROUTING, "[%s] fd=%d %s%s%s", name.c_str(), client, tls->get_description().c_str(),
+                  tls->is_resumed() ? ", resumed" : "", tls->is_kernel_tls() ? ", kTLS" : "");
+        break;
+      case 0:
+        // client doesn't use TLS
+        break;
+      default:
+        connection_is_ok = false;
+        extra_msg = (tls && !tls->get_error().empty()) ? tls->get_error() : string("TLS termination failed");
+        break;
+    }
+  }
+
+  while (connection_is_ok && !handshake_done) {
     const size_t kClientEventIndex = 0;
     const size_t kServerEventIndex = 1;
+    const size_t kStopEventIndex = 2;
 
     struct pollfd fds[] = {
       { routing::kInvalidSocket, POLLIN, 0 },
       { routing::kInvalidSocket, POLLIN, 0 },
+      { routing::kInvalidSocket, POLLIN, 0 },
     };
 
     fds[kClientEventIndex].fd = client;
     fds[kServerEventIndex].fd = server;
+    fds[kStopEventIndex].fd = stop_connections_.native_handle();
 
-    const std::chrono::milliseconds poll_timeout_ms = handshake_done ? std::chrono::milliseconds(1000) : client_connect_timeout_;
-    int res = socket_operations_->poll(fds, sizeof(fds) / sizeof(fds[0]), poll_timeout_ms);
+    // no timeout: wait for traffic, a closed socket, the handshake timer or stop()
+    int res = socket_operations_->poll(fds, sizeof(fds) / sizeof(fds[0]), std::chrono::milliseconds(-1));
 
     if (res < 0) {
       const int last_errno = socket_operations_->get_errno();
@@ -296,15 +448,12 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
 
       continue;
     } else if (res == 0) {
-      // timeout
-      if (!handshake_done) {
-        connection_is_ok = false;
-        extra_msg = string("client auth timed out");
+      continue;
+    }
 
-        break;
-      } else {
-        continue;
-      }
+    if (fds[kStopEventIndex].revents != 0) {
+      extra_msg = string("router is shutting down");
+      break;
     }
 
     // something happened on the socket: either we have data or the socket was closed.
@@ -321,7 +470,7 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
     // Note: In classic protocol Server _always_ talks first
     if (protocol_->copy_packets(server, client, server_is_readable,
                                 buffer, &pktnr,
-                                handshake_done, &bytes_read, true) == -1) {
+                                handshake_done, &bytes_read, true, protocol_state.get()) == -1) {
       const int last_errno = socket_operations_->get_errno();
       if (last_errno > 0) {
         // if read() against closed socket, errno will be 0. Don't log that.
@@ -336,7 +485,7 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
     // Handle traffic from Client to Server
     if (protocol_->copy_packets(client, server, client_is_readable,
                                 buffer, &pktnr,
-                                handshake_done, &bytes_read, false) == -1) {
+                                handshake_done, &bytes_read, false, protocol_state.get()) == -1) {
       const int last_errno = socket_operations_->get_errno();
       if (last_errno > 0) {
         extra_msg = string("Copy client->server failed: " + to_string(get_message_error(last_errno)));
@@ -349,18 +498,52 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
       bytes_down += bytes_read;
     }
 
+    if (handshake_done && handshake_timer != mysql_harness::TimerWheel::kInvalidTimerId) {
+      timer_wheel.cancel(handshake_timer);
+      handshake_timer = mysql_harness::TimerWheel::kInvalidTimerId;
+    }
+
+    // the protocol doesn't need to look at the traffic anymore
+    if (handshake_done) {
+      break;
+    }
   } // while (true)
 
-  if (!handshake_done) {
+  // make sure the timer doesn't touch the socket after we closed it
+  if (handshake_timer != mysql_harness::TimerWheel::kInvalidTimerId) {
+    timer_wheel.cancel(handshake_timer);
+  }
+
+  if (connection_is_ok && handshake_done) {
+    forward_traffic(client, server, buffer, bytes_up, bytes_down, extra_msg, tls.get(), protocol_state.get(),
+                    mode_ == routing::AccessMode::kReadWrite ? client_host : string());
+  }
+  if (client_auth_timed_out) {
+    extra_msg = string("client auth timed out");
+  }
+
+  // the server left the destinations of the route while connected to it
+  const bool server_dropped = metadata_destination_ && metadata_destination_->release_server_socket(server);
+  if (server_dropped) {
+    extra_msg = string("server is not a destination anymore");
+  }
+
+  // a connection closed by stop() or a topology change isn't the client's fault
+  if (!handshake_done && !stop_connections_.is_cancelled() && !server_dropped) {
+    // the peer may be gone already, getpeername() wouldn't work anymore
+    const std::string client_ip = get_addr_str(client_addr);
     log_info("[%s] fd=%d Pre-auth socket failure %s: %s",
         name.c_str(),
         client,
-        c_ip.first.c_str(), extra_msg.c_str());
+        client_ip.c_str(), extra_msg.c_str());
      auto ip_array = in_addr_to_array(client_addr);
-     block_client_host(ip_array, c_ip.first.c_str(), server);
+     block_client_host(ip_array, client_ip, server);
   }
 
   // Either client or server terminated
+  if (tls) {
+    tls->shutdown();
+  }
   socket_operations_->shutdown(client);
   socket_operations_->shutdown(server);
   socket_operations_->close(client);
@@ -368,16 +551,206 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
 
   --info_active_routes_;
 #ifndef _WIN32
-  log_debug("[%s] fd=%d connection closed (up: %zub; down: %zub) %s",
+  log_module_debug(LOG_MODULE_ROUTING, "[%s] fd=%d connection closed (up: %zub; down: %zub) %s",
       name.c_str(),
       client, bytes_up, bytes_down, extra_msg.c_str());
 #else
-  log_debug("[%s] fd=%d connection closed (up: %Iub; down: %Iub) %s",
+  log_module_debug(LOG_MODULE_ROUTING, "[%s] fd=%d connection closed (up: %Iub; down: %Iub) %s",
       name.c_str(),
       client, bytes_up, bytes_down, extra_msg.c_str());
 #endif
 }
 
+void MySQLRouting::forward_traffic(int client, int server, RoutingProtocolBuffer &buffer,
+                                   size_t &bytes_up, size_t &bytes_down, std::string &extra_msg,
+                                   routing::TlsConnection *tls, ProtocolConnectionState *protocol_state,
+                                   const std::string &client_host) {
+  struct Direction {
+    Direction(int from_fd, int to_fd, RoutingProtocolBuffer storage, const char *description):
+        from(from_fd), to(to_fd), queue(std::move(storage)), closed(false), bytes(0), what(description) {}
+
+    const int from;
+    const int to;
+    routing::ForwardingQueue queue;
+    bool closed;  // sender closed the connection
+    size_t bytes;
+    const char *what;
+  };
+
+  const size_t queue_size = buffer.size();
+  Direction to_server(client, server, std::move(buffer), "client->server");
+  Direction to_client(server, client, RoutingProtocolBuffer(queue_size), "server->client");
+
+  std::list<QueueStats>::iterator stats;
+  {
+    std::lock_guard<std::mutex> lock(queue_stats_mtx_);
+    stats = queue_stats_.emplace(queue_stats_.end(), client);
+  }
+
+  routing::set_socket_blocking(client, false);
+  routing::set_socket_blocking(server, false);
+
+  // encrypts and decrypts what goes through the client socket
+  routing::TlsSocketOperations tls_operations(socket_operations_, tls);
+  SocketOperationsBase *ops = tls ? &tls_operations : socket_operations_;
+
+  // records the GTIDs the server reports for the client's writes
+  std::unique_ptr<SocketOperationsBase> gtid_tracking;
+  if (!client_host.empty()) {
+    gtid_tracking = protocol_->track_gtids(ops, client, server, client_host, protocol_state);
+    if (gtid_tracking) {
+      ops = gtid_tracking.get();
+    }
+  }
+
+  // writes what is queued, returns false on error
+  auto flush = [this, ops, &extra_msg](Direction &dir) -> bool {
+    if (dir.queue.empty()) {
+      return true;
+    }
+    const ssize_t res = dir.queue.flush(dir.to, ops);
+    if (res < 0) {
+      const int last_errno = socket_operations_->get_errno();
+      if (!routing::ForwardingQueue::would_block(last_errno)) {
+        extra_msg = string("Copy ") + dir.what + " failed: " + get_message_error(last_errno);
+        return false;
+      }
+    } else {
+      dir.bytes += static_cast<size_t>(res);
+    }
+    return true;
+  };
+
+  // reads what fits into the queue and tries to pass it on right away,
+  // returns false on error
+  auto fill = [this, ops, &extra_msg, &flush](Direction &dir) -> bool {
+    const ssize_t res = dir.queue.fill(dir.from, ops);
+    if (res == 0) {
+      dir.closed = true;
+    } else if (res < 0) {
+      const int last_errno = socket_operations_->get_errno();
+      if (!routing::ForwardingQueue::would_block(last_errno)) {
+        extra_msg = string("Copy ") + dir.what + " failed: " + get_message_error(last_errno);
+        return false;
+      }
+    }
+    return flush(dir);
+  };
+
+  const size_t kClientEventIndex = 0;
+  const size_t kServerEventIndex = 1;
+  const size_t kStopEventIndex = 2;
+
+  while (true) {
+    // once one side closed the connection, only what is queued for the
+    // other side still gets delivered
+    if ((to_server.closed && to_server.queue.empty()) ||
+        (to_client.closed && to_client.queue.empty())) {
+      break;
+    }
+    const bool reading = !to_server.closed && !to_client.closed;
+
+    // don't read from a sender whose queue is full: backpressure
+    auto events = [reading](const Direction &in, const Direction &out) -> short {
+      short ev = 0;
+      if (reading && !in.queue.full()) ev |= POLLIN;
+      if (!out.queue.empty()) ev |= POLLOUT;
+      return ev;
+    };
+
+    struct pollfd fds[] = {
+      { client, events(to_server, to_client), 0 },
+      { server, events(to_client, to_server), 0 },
+      { stop_connections_.native_handle(), POLLIN, 0 },
+    };
+
+    // records the TLS session already read from the socket don't make it
+    // readable again: don't block in poll() while they wait to be queued
+    const bool tls_pending = tls && (fds[kClientEventIndex].events & POLLIN) && tls->pending() > 0;
+
+    int res = socket_operations_->poll(fds, sizeof(fds) / sizeof(fds[0]),
+                                       std::chrono::milliseconds(tls_pending ? 0 : -1));
+    if (res < 0) {
+      const int last_errno = socket_operations_->get_errno();
+      if (last_errno == EINTR || last_errno == EAGAIN) {
+        continue;
+      }
+      extra_msg = string("poll() failed: " + to_string(get_message_error(last_errno)));
+      break;
+    }
+    if (tls_pending) {
+      fds[kClientEventIndex].revents |= POLLIN;
+    }
+
+    if (fds[kStopEventIndex].revents != 0) {
+      extra_msg = string("router is shutting down");
+      break;
+    }
+
+    bool connection_is_ok = true;
+    for (size_t ndx: { kClientEventIndex, kServerEventIndex }) {
+      Direction &in = (ndx == kClientEventIndex) ? to_server : to_client;
+      Direction &out = (ndx == kClientEventIndex) ? to_client : to_server;
+      const short revents = fds[ndx].revents;
+
+      if (revents == 0) {
+        continue;
+      }
+      if ((revents & POLLOUT) && !flush(out)) {
+        connection_is_ok = false;
+        break;
+      }
+      if (fds[ndx].events & POLLIN) {
+        // closed sockets are signalled as POLLIN (Linux) or POLLHUP (Windows)
+        if ((revents & (POLLIN|POLLHUP|POLLERR)) && !fill(in)) {
+          connection_is_ok = false;
+          break;
+        }
+      } else if ((revents & (POLLHUP|POLLERR|POLLNVAL)) && !(revents & POLLOUT)) {
+        // not reading from it, so the hangup would be reported again and again
+        extra_msg = string("Copy ") + in.what + " failed: connection closed";
+        connection_is_ok = false;
+        break;
+      }
+    }
+
+    stats->to_server.store(to_server.queue.size(), std::memory_order_relaxed);
+    stats->to_client.store(to_client.queue.size(), std::memory_order_relaxed);
+    stats->peak_to_server.store(to_server.queue.peak_size(), std::memory_order_relaxed);
+    stats->peak_to_client.store(to_client.queue.peak_size(), std::memory_order_relaxed);
+
+    if (!connection_is_ok) {
+      break;
+    }
+  }
+
+  log_module_debug(LOG_MODULE_ROUTING, "[%s] fd=%d peak queue depth (up: %lub; down: %lub)", name.c_str(), client,
+            static_cast<unsigned long>(to_client.queue.peak_size()),
+            static_cast<unsigned long>(to_server.queue.peak_size()));
+  {
+    std::lock_guard<std::mutex> lock(queue_stats_mtx_);
+    queue_stats_.erase(stats);
+  }
+
+  bytes_up += to_client.bytes;
+  bytes_down += to_server.bytes;
+}
+
+std::vector<MySQLRouting::QueueDepth> MySQLRouting::get_queue_depths() const {
+  std::vector<QueueDepth> depths;
+
+  std::lock_guard<std::mutex> lock(queue_stats_mtx_);
+  depths.reserve(queue_stats_.size());
+  for (const QueueStats &stats: queue_stats_) {
+    depths.push_back({ stats.client,
+                       stats.to_server.load(std::memory_order_relaxed),
+                       stats.to_client.load(std::memory_order_relaxed),
+                       stats.peak_to_server.load(std::memory_order_relaxed),
+                       stats.peak_to_client.load(std::memory_order_relaxed) });
+  }
+  return depths;
+}
+
 void MySQLRouting::start() {
 
   mysql_harness::rename_thread(make_thread_name(name, "RtM").c_str());  // "Rt main" would be too long :(
@@ -406,11 +779,30 @@ void MySQLRouting::start() {
   }
 #endif
   if (bind_address_.port > 0 || bind_named_socket_.is_set()) {
+    if (!acceptor_cpus_.empty() || !connection_cpus_.empty()) {
+      process_cpus_ = mysql_harness::get_thread_affinity();
+      log_info("[%s] acceptor CPUs: %s%s, connection CPUs: %s%s", name.c_str(),
+               acceptor_cpus_.empty() ? "any" : mysql_harness::cpu_set_to_string(acceptor_cpus_).c_str(),
+               acceptor_placement_.c_str(),
+               connection_cpus_.empty() ? "any" : mysql_harness::cpu_set_to_string(connection_cpus_).c_str(),
+               connection_placement_.c_str());
+    }
+
+    const size_t stack_size = get_default_thread_stack_size();
+    // one queue of net_buffer_length per direction
+    const uint64_t per_connection = 2 * static_cast<uint64_t>(net_buffer_length_) + stack_size;
+    log_info("[%s] each connection uses 2 file descriptors, 2 x %u bytes network buffers and %lu KiB thread stack;"
+             " %lu MiB at max_connections=%d", name.c_str(), net_buffer_length_,
+             static_cast<unsigned long>(stack_size / 1024),
+             static_cast<unsigned long>(per_connection * static_cast<uint64_t>(max_connections_) / (1024 * 1024)),
+             max_connections_);
+
     //XXX this thread seems unnecessary, since we block on it right after anyway
     thread_acceptor_ = std::thread(&MySQLRouting::start_acceptor, this);
     if (thread_acceptor_.joinable()) {
       thread_acceptor_.join();
     }
+    wait_client_threads();
 #ifndef _WIN32
     if (bind_named_socket_.is_set() && unlink(bind_named_socket_.str().c_str()) == -1) {
       if (errno != ENOENT)
@@ -462,7 +854,9 @@ static int unix_getpeercred(int sock, pid_t &peer_pid, uid_t &peer_uid) {
 #endif
 
 void MySQLRouting::start_acceptor() {
-  mysql_harness::rename_thread(make_thread_name(name, "RtA").c_str());  // "Rt Acceptor" would be too long :(
+  // before destination_->start(), so that the quarantine thread runs on the same CPUs
+  pin_thread(acceptor_cpus_, "acceptor");
+  mysql_harness::rename_thread(make_thread_name(name, "RtA", acceptor_placement_).c_str());  // "Rt Acceptor" would be too long :(
 
   destination_->start();
 
@@ -475,18 +869,22 @@ void MySQLRouting::start_acceptor() {
 
   const int kAcceptUnixSocketNdx = 0;
   const int kAcceptTcpNdx = 1;
+  const int kStopNdx = 2;
   struct pollfd fds[] = {
     { routing::kInvalidSocket, POLLIN, 0 },
     { routing::kInvalidSocket, POLLIN, 0 },
+    { routing::kInvalidSocket, POLLIN, 0 },
   };
 
   fds[kAcceptTcpNdx].fd = service_tcp_;
   fds[kAcceptUnixSocketNdx].fd = service_named_socket_;
+  fds[kStopNdx].fd = stop_accepting_.native_handle();
 
   while (!stopping()) {
-    // wait for the accept() sockets to become readable (POLLIN)
+    // wait for the accept() sockets to become readable (POLLIN) or stop()
+    // to be called
 
-    int ready_fdnum = socket_operations_->poll(fds, sizeof(fds) / sizeof(fds[0]), kAcceptorStopPollInterval_ms);
+    int ready_fdnum = socket_operations_->poll(fds, sizeof(fds) / sizeof(fds[0]), std::chrono::milliseconds(-1));
     // < 0 - failure
     // == 0 - timeout
     // > 0  - number of pollfd's with a .revent
@@ -503,7 +901,11 @@ void MySQLRouting::start_acceptor() {
       }
     }
 
-    for (size_t ndx = 0; ndx < sizeof(fds) / sizeof(fds[0]) && ready_fdnum > 0; ndx++) {
+    if (ready_fdnum > 0 && fds[kStopNdx].revents != 0) {
+      break;
+    }
+
+    for (size_t ndx = 0; ndx < kStopNdx && ready_fdnum > 0; ndx++) {
       // walk through all fields and check which fired
 
       if ((fds[ndx].revents & POLLIN) == 0) {
@@ -518,14 +920,22 @@ void MySQLRouting::start_acceptor() {
 
 
       if ((sock_client = accept(fds[ndx].fd, (struct sockaddr *) &client_addr, &sin_size)) < 0) {
-        log_error("[%s] Failed accepting connection: %s", name.c_str(), get_message_error(socket_operations_->get_errno()).c_str());
+        const int last_errno = socket_operations_->get_errno();
+        log_error("[%s] Failed accepting connection: %s", name.c_str(), get_message_error(last_errno).c_str());
+#ifndef _WIN32
+        if (last_errno == EMFILE || last_errno == ENFILE) {
+          // the listening socket stays readable; don't spin until a
+          // connection got closed
+          stop_accepting_.wait_for(kAcceptFileLimitBackoff);
+        }
+#endif
         continue;
       }
 
       bool is_tcp = (ndx == kAcceptTcpNdx);
 
       if (is_tcp) {
-        log_debug("[%s] fd=%d connection accepted at %s", name.c_str(), sock_client, bind_address_.str().c_str());
+        log_module_debug(LOG_MODULE_ROUTING, "[%s] fd=%d connection accepted at %s", name.c_str(), sock_client, bind_address_.str().c_str());
       } else {
 #if !defined(_WIN32)
         pid_t peer_pid;
@@ -537,13 +947,13 @@ void MySQLRouting::start_acceptor() {
         // if we can't get the PID, we'll just show a simpler errormsg
 
         if (0 == unix_getpeercred(sock_client, peer_pid, peer_uid)) {
-          log_debug("[%s] fd=%d connection accepted at %s from (pid=%d, uid=%d)",
+          log_module_debug(LOG_MODULE_ROUTING, "[%s] fd=%d connection accepted at %s from (pid=%d, uid=%d)",
               name.c_str(), sock_client, bind_named_socket_.str().c_str(),
               peer_pid, peer_uid);
         } else
           // fall through
 #endif
-        log_debug("[%s] fd=%d connection accepted at %s",
+        log_module_debug(LOG_MODULE_ROUTING, "[%s] fd=%d connection accepted at %s",
             name.c_str(), sock_client, bind_named_socket_.str().c_str());
       }
 
@@ -559,8 +969,19 @@ void MySQLRouting::start_acceptor() {
       if (info_active_routes_.load(std::memory_order_relaxed) >= max_connections_) {
         protocol_->send_error(sock_client, 1040, "Too many connections", "HY000", name);
         socket_operations_->close(sock_client); // no shutdown() before close()
-        log_warning("[%s] reached max active connections (%d max=%d)", name.c_str(),
-                   info_active_routes_.load(), max_connections_);
+        log_module_warning_limited(LOG_MODULE_ROUTING, kConnectionLimitLogInterval,
+                                   "[%s] reached max active connections (%d max=%d)", name.c_str(),
+                                   info_active_routes_.load(), max_connections_);
+        continue;
+      }
+
+      routing::ConnectionBudget &budget = routing::ConnectionBudget::instance();
+      if (!budget.acquire()) {
+        protocol_->send_error(sock_client, 1040, "Too many connections", "HY000", name);
+        socket_operations_->close(sock_client); // no shutdown() before close()
+        log_module_warning_limited(LOG_MODULE_ROUTING, kConnectionLimitLogInterval,
+                                   "[%s] reached max total connections of all routes (max_total_connections=%u)",
+                                   name.c_str(), budget.get_limit());
         continue;
       }
 
@@ -600,9 +1021,27 @@ void MySQLRouting::start_acceptor() {
                       get_peer_name(sock_client).first.c_str());
         };
 
+        // counted before the thread exists, so that stop() can't miss it
+        auto client_thread_done = [this] {
+          routing::ConnectionBudget::instance().release();
+          // notified under the lock: once wait_client_threads() sees no
+          // threads left, this object may be gone
+          std::lock_guard<std::mutex> lock(client_threads_mtx_);
+          --client_threads_;
+          client_threads_cond_.notify_all();
+        };
+        {
+          std::lock_guard<std::mutex> lock(client_threads_mtx_);
+          ++client_threads_;
+        }
+
         try {
-          std::thread(&MySQLRouting::routing_select_thread, this, sock_client, client_addr).detach();
+          std::thread([this, sock_client, client_addr, client_thread_done] {
+            routing_select_thread(sock_client, client_addr);
+            client_thread_done();
+          }).detach();
         } catch (const std::system_error& e) {
+          client_thread_done();
           thread_spawn_failure_handler(&e);
           continue;
         } catch (...) {
@@ -610,6 +1049,7 @@ void MySQLRouting::start_acceptor() {
           // depending on the library implementation, std::thread constructor may also throw other
           // exceptions, such as bad_alloc or system_error with different a condition.
           // Thus we have this catch(...) here to take care of the rest of them in a generic way.
+          client_thread_done();
           thread_spawn_failure_handler(nullptr);
           continue;
         }
@@ -619,8 +1059,30 @@ void MySQLRouting::start_acceptor() {
   log_info("[%s] stopped", name.c_str());
 }
 
-void MySQLRouting::stop() {
+void MySQLRouting::stop(std::chrono::milliseconds drain_timeout) {
+  {
+    std::lock_guard<std::mutex> lock(client_threads_mtx_);
+    drain_timeout_ = drain_timeout;
+  }
   stopping_.store(true);
+  stop_accepting_.cancel();
+}
+
+void MySQLRouting::wait_client_threads() {
+  std::unique_lock<std::mutex> lock(client_threads_mtx_);
+
+  if (client_threads_ > 0 && drain_timeout_.count() > 0) {
+    log_info("[%s] waiting up to %lld ms for %lu connection(s) to finish", name.c_str(),
+             static_cast<long long>(drain_timeout_.count()), static_cast<unsigned long>(client_threads_));
+    client_threads_cond_.wait_for(lock, drain_timeout_, [this] { return client_threads_ == 0; });
+  }
+
+  if (client_threads_ > 0) {
+    log_info("[%s] closing %lu connection(s)", name.c_str(), static_cast<unsigned long>(client_threads_));
+  }
+  // wake up the remaining connections and let them close their sockets
+  stop_connections_.cancel();
+  client_threads_cond_.wait(lock, [this] { return client_threads_ == 0; });
 }
 
 static int get_socket_errno() {
@@ -787,9 +1249,11 @@ void MySQLRouting::set_destinations_from_uri(const URI &uri) {
     if (uri.query.find("role") == uri.query.end())
       throw runtime_error("Missing 'role' in routing destination specification");
 
-    destination_.reset(new DestMetadataCacheGroup(uri.host, replicaset_name,
-                                                  get_access_mode_name(mode_),
-                                                  uri.query, protocol_->get_type()));
+    metadata_destination_ = new DestMetadataCacheGroup(uri.host, replicaset_name,
+                                                       get_access_mode_name(mode_),
+                                                       uri.query, protocol_->get_type(),
+                                                       location_, location_min_servers_);
+    destination_.reset(metadata_destination_);
   } else {
     throw runtime_error(string_format("Invalid URI scheme; expecting: 'metadata-cache' is: '%s'",
                                       uri.scheme.c_str()));
@@ -803,8 +1267,10 @@ void MySQLRouting::set_destinations_from_csv(const string &csv) {
 
 
   if (AccessMode::kReadOnly == mode_) {
+    metadata_destination_ = nullptr;
     destination_.reset(new RouteDestination(protocol_->get_type(), socket_operations_));
   } else if (AccessMode::kReadWrite == mode_) {
+    metadata_destination_ = nullptr;
     destination_.reset(new DestFirstAvailable(protocol_->get_type(), socket_operations_));
   } else {
     throw std::runtime_error("Unknown mode");
@@ -847,7 +1313,7 @@ std::chrono::milliseconds MySQLRouting::set_destination_connect_timeout(std::chr
 }
 
 int MySQLRouting::set_max_connections(int maximum) {
-  if (maximum <= 0 || maximum > UINT16_MAX) {
+  if (maximum <= 0) {
     auto err = string_format("[%s] tried to set max_connections using invalid value, was '%d'", name.c_str(),
                              maximum);
     throw std::invalid_argument(err);
@@ -27,20 +27,27 @@
  */
 
 #include "protocol/base_protocol.h"
+#include "cancellation_event.h"
+#include "cpu_affinity.h"
 #include "config.h"
 #include "destination.h"
 #include "filesystem.h"
 #include "mysqlrouter/datatypes.h"
 #include "mysqlrouter/mysql_protocol.h"
 #include "plugin_config.h"
+#include "tls_termination.h"
 #include "utils.h"
 #include "mysqlrouter/routing.h"
 
 #include <array>
 #include <atomic>
+#include <condition_variable>
 #include <iostream>
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 #ifndef _WIN32
 #  include <arpa/inet.h>
@@ -74,6 +81,8 @@
 using std::string;
 using mysqlrouter::URI;
 
+class DestMetadataCacheGroup;
+
 /** @class MySQLRoutering
  *  @brief Manage Connections from clients to MySQL servers
  *
@@ -149,8 +158,13 @@ public:
 
   /** @brief Asks the service to stop
    *
+   * Stops accepting new connections right away. Active client connections
+   * are given up to `drain_timeout` to finish on their own before they get
+   * closed; start() returns once all of them are gone.
+   *
+   * @param drain_timeout how long to wait for active connections to finish
    */
-  void stop();
+  void stop(std::chrono::milliseconds drain_timeout = std::chrono::milliseconds(0));
 
   /** @brief Returns whether the service is stopping
    *
@@ -176,6 +190,67 @@ public:
 
   void set_destinations_from_uri(const mysqlrouter::URI &uri);
 
+  /** @brief Pins the threads of the routing to CPUs
+   *
+   * The quarantine thread runs on the CPUs of the acceptor. Network buffers
+   * of a connection are allocated by its thread, so the OS places them on
+   * the NUMA node the thread is pinned to. The placement is shown in the
+   * thread names, e.g. "RtS:x_ro@n1" for a thread pinned to NUMA node 1.
+   *
+   * Must be called before start().
+   *
+   * @param acceptor_cpus CPUs for the acceptor thread (empty: not pinned)
+   * @param connection_cpus CPUs for the connection threads (empty: not pinned)
+   */
+  void set_cpu_affinity(const mysql_harness::CpuSet &acceptor_cpus,
+                        const mysql_harness::CpuSet &connection_cpus);
+
+  /** @brief Terminates TLS of the client connections at the router
+   *
+   * Clients asking for SSL do the TLS handshake with the router, which
+   * forwards their traffic unencrypted to the servers. Clients not asking
+   * for SSL are routed as before.
+   *
+   * Must be called before start().
+   *
+   * @param tls_context certificate, key and session cache of the route
+   */
+  void set_tls_context(std::unique_ptr<routing::TlsServerContext> tls_context) {
+    tls_context_ = std::move(tls_context);
+  }
+
+  /** @brief Sets the location whose servers metadata-cache destinations prefer
+   *
+   * Servers of other locations only get connections if fewer than
+   * `min_servers` servers of the location are available, or if connecting
+   * to the chosen server of the location failed.
+   *
+   * Must be called before set_destinations_from_uri().
+   *
+   * @param location location of the router (empty: all servers are equal)
+   * @param min_servers servers of the location needed to keep the others out
+   */
+  void set_location(const std::string &location, unsigned int min_servers) {
+    location_ = location;
+    location_min_servers_ = min_servers;
+  }
+
+  /** @brief Lets reads of a client see its own writes
+   *
+   * Classic protocol only. A read-write route records the GTID of the last
+   * transaction each client host committed. Before connecting a client, a
+   * read-only metadata-cache route asks the chosen secondary to wait up to
+   * `timeout` until it applied that GTID; if it doesn't, the client and its
+   * following connections go to the primary.
+   *
+   * Must be called before start().
+   *
+   * @param timeout how long a secondary may take to catch up (0: disabled)
+   */
+  void set_read_your_writes_timeout(std::chrono::milliseconds timeout) {
+    read_your_writes_timeout_ = timeout;
+  }
+
   /** @brief Descriptive name of the connection routing */
   const std::string name;
 
@@ -200,8 +275,7 @@ public:
 
   /** @brief Sets maximum active connections
    *
-   * Sets maximum of active connections. Maximum must be between 1 and
-   * 65535.
+   * Sets maximum of active connections. Maximum must be at least 1.
    *
    * Throws std::invalid_argument when an invalid value was provided.
    *
@@ -243,6 +317,28 @@ public:
     return max_connections_;
   }
 
+  /** @brief Bytes waiting to be written to a slow receiver of a connection */
+  struct QueueDepth {
+    /** @brief socket descriptor of the client connection */
+    int client;
+    /** @brief bytes queued from client to server */
+    size_t to_server;
+    /** @brief bytes queued from server to client */
+    size_t to_client;
+    /** @brief highest number of bytes queued from client to server */
+    size_t peak_to_server;
+    /** @brief highest number of bytes queued from server to client */
+    size_t peak_to_client;
+  };
+
+  /** @brief Returns the queue depths of all established connections
+   *
+   * Each connection buffers at most net_buffer_length bytes per direction;
+   * a full queue means the receiver is slower than the sender and reading
+   * from the sender is paused.
+   */
+  std::vector<QueueDepth> get_queue_depths() const;
+
 private:
   /** @brief Sets up the TCP service
    *
@@ -282,15 +378,68 @@ private:
    */
   void routing_select_thread(int client, const sockaddr_storage &client_addr) noexcept;
 
+  struct QueueStats {
+    explicit QueueStats(int client_fd): client(client_fd), to_server(0), to_client(0),
+        peak_to_server(0), peak_to_client(0) {}
+
+    const int client;
+    std::atomic<size_t> to_server;
+    std::atomic<size_t> to_client;
+    std::atomic<size_t> peak_to_server;
+    std::atomic<size_t> peak_to_client;
+  };
+
+  /** @brief Forwards traffic between client and server after the handshake
+   *
+   * Uses non-blocking sockets and one bounded queue per direction: while a
+   * queue is full, its sender isn't read from anymore until the receiver
+   * caught up. Returns when either side closed the connection (after
+   * flushing what the other side still has to receive), on error or when
+   * the routing is stopped.
+   *
+   * @param client socket descriptor of the client connection
+   * @param server socket descriptor of the server connection
+   * @param buffer buffer of the handshake, reused for one of the queues
+   * @param bytes_up bytes sent from server to client are added to it
+   * @param bytes_down bytes sent from client to server are added to it
+   * @param extra_msg set to the reason the connection ended, if any
+   * @param tls TLS session of the client (nullptr: plaintext)
+   * @param protocol_state what the protocol keeps for the connection
+   * @param client_host host of the client, if GTIDs of its writes are tracked
+   */
+  void forward_traffic(int client, int server, RoutingProtocolBuffer &buffer,
+                       size_t &bytes_up, size_t &bytes_down, std::string &extra_msg,
+                       routing::TlsConnection *tls, ProtocolConnectionState *protocol_state,
+                       const std::string &client_host);
+
   void start_acceptor();
 
+  /** @brief Waits for the client connection threads to finish
+   *
+   * Gives the connections up to the drain timeout passed to stop() to
+   * finish, then wakes up the remaining ones to close their sockets.
+   */
+  void wait_client_threads();
+
   /** @brief return a short string suitable to be used as a thread name
    * @param config_name configuration name (e.g: "routing", "routing:test_default_x_ro", etc)
    * @param prefix thread name prefix (e.g. "RtS")
+   * @param placement CPU placement appended to the name (e.g. "@n1"), see get_placement()
    *
    * @return a short string (example: "RtS:x_ro")
    */
-  static std::string make_thread_name(const std::string& config_name, const std::string& prefix);
+  static std::string make_thread_name(const std::string& config_name, const std::string& prefix,
+                                      const std::string& placement = "");
+
+  /** @brief return a short description of where threads pinned to the CPUs run
+   *
+   * "@c<cpu>" for a single CPU, "@n<node>" for CPUs of a single NUMA node,
+   * "@p" for CPUs spread over several nodes, empty if not pinned.
+   */
+  static std::string get_placement(const mysql_harness::CpuSet &cpus);
+
+  /** @brief pins the calling thread, logs a warning if that fails */
+  void pin_thread(const mysql_harness::CpuSet &cpus, const char *what);
 
   /** @brief Mode to use when getting next destination */
   routing::AccessMode mode_;
@@ -325,12 +474,17 @@ private:
   int service_named_socket_;
   /** @brief Destination object to use when getting next connection */
   std::unique_ptr<RouteDestination> destination_;
+  /** @brief destination_ if it is a metadata-cache one, nullptr otherwise */
+  DestMetadataCacheGroup *metadata_destination_;
   /** @brief Whether we were asked to stop */
   std::atomic<bool> stopping_;
   /** @brief Number of active routes */
-  std::atomic<uint16_t> info_active_routes_;
+  std::atomic<int> info_active_routes_;
   /** @brief Number of handled routes */
   std::atomic<uint64_t> info_handled_routes_;
+  /** @brief Queue depths of the established connections */
+  mutable std::mutex queue_stats_mtx_;
+  std::list<QueueStats> queue_stats_;
 
   /** @brief Connection error counters for IPv4 or IPv6 hosts */
   mutable std::mutex mutex_conn_errors_;
@@ -338,14 +492,43 @@ private:
 
   /** @brief TCP (and UNIX socket) service thread */
   std::thread thread_acceptor_;
+
+  /** @brief Wakes up the acceptor when stop() is called */
+  mysql_harness::CancellationEvent stop_accepting_;
+  /** @brief Wakes up the client connection threads after the drain timeout */
+  mysql_harness::CancellationEvent stop_connections_;
+  /** @brief How long stop() lets active connections finish on their own */
+  std::chrono::milliseconds drain_timeout_;
+
+  /** @brief Number of running client connection threads */
+  size_t client_threads_;
+  std::mutex client_threads_mtx_;
+  std::condition_variable client_threads_cond_;
+  /** @brief CPUs the acceptor thread is pinned to (empty: not pinned) */
+  mysql_harness::CpuSet acceptor_cpus_;
+  /** @brief CPUs the connection threads are pinned to (empty: not pinned) */
+  mysql_harness::CpuSet connection_cpus_;
+  /** @brief CPUs the process may run on, for unpinned threads created by a pinned one */
+  mysql_harness::CpuSet process_cpus_;
+  std::string acceptor_placement_;
+  std::string connection_placement_;
   /** @brief object handling the operations on network sockets */
   routing::SocketOperationsBase* socket_operations_;
   /** @brief object to handle protocol specific stuff */
   std::unique_ptr<BaseProtocol> protocol_;
+  /** @brief TLS context if client TLS is terminated at the router */
+  std::unique_ptr<routing::TlsServerContext> tls_context_;
+  /** @brief Location preferred by metadata-cache destinations (empty: none) */
+  std::string location_;
+  /** @brief Servers of `location_` needed to keep other locations out */
+  unsigned int location_min_servers_;
+  /** @brief How long secondaries may take to catch up with a client's writes (0: disabled) */
+  std::chrono::milliseconds read_your_writes_timeout_;
 
 #ifdef FRIEND_TEST
   FRIEND_TEST(RoutingTests, bug_24841281);
   FRIEND_TEST(RoutingTests, make_thread_name);
+  FRIEND_TEST(RoutingTests, get_placement);
   FRIEND_TEST(ClassicProtocolRoutingTest, NoValidDestinations);
 #ifndef _WIN32
   FRIEND_TEST(TestSetupNamedSocketService, unix_socket_permissions_failure);
@@ -17,6 +17,7 @@
 
 #include "plugin_config.h"
 #include "mysql_routing.h"
+#include "tls_termination.h"
 #include "mysqlrouter/routing.h"
 #include "mysqlrouter/metadata_cache.h"
 
@@ -47,15 +48,54 @@ RoutingPluginConfig::RoutingPluginConfig(const mysql_harness::ConfigSection *sec
       named_socket(get_option_named_socket(section, "socket")),
       connect_timeout(get_uint_option<uint16_t>(section, "connect_timeout", 1)),
       mode(get_option_mode(section, "mode")),
-      max_connections(get_uint_option<uint16_t>(section, "max_connections", 1)),
+      max_connections(get_uint_option<uint32_t>(section, "max_connections", 1, INT32_MAX)),
       max_connect_errors(get_uint_option<uint32_t>(section, "max_connect_errors", 1, UINT32_MAX)),
       client_connect_timeout(get_uint_option<uint32_t>(section, "client_connect_timeout", 2, 31536000)),
-      net_buffer_length(get_uint_option<uint32_t>(section, "net_buffer_length", 1024, 1048576)) {
+      net_buffer_length(get_uint_option<uint32_t>(section, "net_buffer_length", 1024, 1048576)),
+      drain_timeout(get_uint_option<uint32_t>(section, "drain_timeout", 0, 3600)),
+      max_total_connections(get_uint_option<uint32_t>(section, "max_total_connections", 0, INT32_MAX)),
+      acceptor_cpus(get_option_cpu_set(section, "acceptor_cpus")),
+      connection_cpus(get_option_cpu_set(section, "connection_cpus")),
+      client_ssl_cert(get_option_string(section, "client_ssl_cert")),
+      client_ssl_key(get_option_string(section, "client_ssl_key")),
+      client_ssl_cipher(get_option_string(section, "client_ssl_cipher")),
+      client_ssl_session_cache_size(get_uint_option<uint32_t>(section, "client_ssl_session_cache_size",
+                                                              0, INT32_MAX)),
+      location(get_option_string(section, "location")),
+      location_min_servers(get_uint_option<uint32_t>(section, "location_min_servers", 1, UINT16_MAX)),
+      read_your_writes_timeout(get_uint_option<uint32_t>(section, "read_your_writes_timeout", 0, 3600000)),
+      read_your_writes_scope(get_option_string(section, "read_your_writes_scope")) {
 
   // either bind_address or socket needs to be set, or both
   if (!bind_address.port && !named_socket.is_set()) {
     throw invalid_argument("either bind_address or socket option needs to be supplied, or both");
   }
+
+  if (client_ssl_cert.empty() != client_ssl_key.empty()) {
+    throw invalid_argument(get_log_prefix(client_ssl_cert.empty() ? "client_ssl_cert" : "client_ssl_key") +
+                           " is required when " +
+                           (client_ssl_cert.empty() ? "client_ssl_key" : "client_ssl_cert") + " is set");
+  }
+  // the read-only route picks the server before the client authenticated,
+  // so clients can only be told apart by their host
+  if (!read_your_writes_scope.empty() && read_your_writes_scope != "host") {
+    throw invalid_argument(get_log_prefix("read_your_writes_scope") + " needs value 'host', was '" +
+                           read_your_writes_scope + "'");
+  }
+  if (read_your_writes_timeout > 0 && read_your_writes_scope.empty()) {
+    throw invalid_argument(get_log_prefix("read_your_writes_scope") +
+                           " is required when read_your_writes_timeout is set: set it to 'host' to make"
+                           " the reads of a client wait for the writes of all clients of its host");
+  }
+  if (!client_ssl_cert.empty()) {
+    if (protocol != Protocol::Type::kClassicProtocol) {
+      throw invalid_argument(get_log_prefix("client_ssl_cert") + " is only supported with protocol=classic");
+    }
+    if (!routing::TlsServerContext::is_supported()) {
+      throw invalid_argument(get_log_prefix("client_ssl_cert") +
+                             " is not supported: router was built without OpenSSL 1.1.0 or later");
+    }
+  }
 }
 
 
@@ -68,6 +108,11 @@ string RoutingPluginConfig::get_default(const string &option) {
       {"max_connect_errors", to_string(routing::kDefaultMaxConnectErrors)},
       {"client_connect_timeout", to_string(std::chrono::duration_cast<std::chrono::seconds>(routing::kDefaultClientConnectTimeout).count())},
       {"net_buffer_length", to_string(routing::kDefaultNetBufferLength)},
+      {"drain_timeout", to_string(routing::kDefaultDrainTimeout.count())},
+      {"max_total_connections", to_string(routing::kDefaultMaxTotalConnections)},
+      {"client_ssl_session_cache_size", to_string(routing::kDefaultClientSslSessionCacheSize)},
+      {"location_min_servers", to_string(routing::kDefaultLocationMinServers)},
+      {"read_your_writes_timeout", to_string(routing::kDefaultReadYourWritesTimeout.count())},
   };
 
   auto it = defaults.find(option);
@@ -199,3 +244,13 @@ string RoutingPluginConfig::get_option_destinations(const mysql_harness::ConfigS
 
   return value;
 }
+
+mysql_harness::CpuSet RoutingPluginConfig::get_option_cpu_set(const mysql_harness::ConfigSection *section,
+                                                              const std::string &option) {
+  const std::string value = get_option_string(section, option);
+  try {
+    return mysql_harness::parse_cpu_set(value);
+  } catch (const invalid_argument &exc) {
+    throw invalid_argument(get_log_prefix(option) + ": " + exc.what());
+  }
+}
@@ -18,6 +18,7 @@
 #ifndef PLUGIN_CONFIG_ROUTING_INCLUDED
 #define PLUGIN_CONFIG_ROUTING_INCLUDED
 
+#include "cpu_affinity.h"
 #include "mysql/harness/filesystem.h"
 #include "mysql/harness/plugin.h"
 
@@ -78,6 +79,30 @@ public:
   const unsigned int client_connect_timeout;
   /** @brief Size of buffer to receive packets */
   const unsigned int net_buffer_length;
+  /** @brief `drain_timeout` option read from configuration section */
+  const unsigned int drain_timeout;
+  /** @brief `max_total_connections` option, usually set in [DEFAULT] */
+  const unsigned int max_total_connections;
+  /** @brief `acceptor_cpus` option read from configuration section */
+  const mysql_harness::CpuSet acceptor_cpus;
+  /** @brief `connection_cpus` option read from configuration section */
+  const mysql_harness::CpuSet connection_cpus;
+  /** @brief `client_ssl_cert` option; if set, client TLS is terminated at the router */
+  const std::string client_ssl_cert;
+  /** @brief `client_ssl_key` option read from configuration section */
+  const std::string client_ssl_key;
+  /** @brief `client_ssl_cipher` option read from configuration section */
+  const std::string client_ssl_cipher;
+  /** @brief `client_ssl_session_cache_size` option read from configuration section */
+  const unsigned int client_ssl_session_cache_size;
+  /** @brief `location` option, usually set in [DEFAULT]; metadata-cache routes prefer servers of this location */
+  const std::string location;
+  /** @brief `location_min_servers` option read from configuration section */
+  const unsigned int location_min_servers;
+  /** @brief `read_your_writes_timeout` option (in milliseconds), usually set in [DEFAULT] */
+  const unsigned int read_your_writes_timeout;
+  /** @brief `read_your_writes_scope` option; "host", the only supported value, is required with `read_your_writes_timeout` */
+  const std::string read_your_writes_scope;
 
 protected:
 
@@ -86,6 +111,7 @@ private:
   std::string get_option_destinations(const mysql_harness::ConfigSection *section, const std::string &option,
                                       const Protocol::Type &protocol_type);
   Protocol::Type get_protocol(const mysql_harness::ConfigSection *section, const std::string &option);
+  mysql_harness::CpuSet get_option_cpu_set(const mysql_harness::ConfigSection *section, const std::string &option);
 };
 
 #endif // PLUGIN_CONFIG_ROUTING_INCLUDED
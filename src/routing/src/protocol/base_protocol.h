@@ -18,7 +18,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #ifndef ROUTING_BASEPROTOCOL_INCLUDED
 #define ROUTING_BASEPROTOCOL_INCLUDED
 
+#include <chrono>
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 #include "mysqlrouter/mysql_protocol.h"
@@ -34,10 +36,23 @@ using RoutingProtocolBuffer = mysql_protocol::Packet::vector_t;
 
 namespace routing {
   class SocketOperationsBase;
+  class TlsConnection;
+  class TlsServerContext;
 }
 
 using routing::SocketOperationsBase;
 
+/** @brief State a protocol keeps per routed connection
+ *
+ * Created by BaseProtocol::create_connection_state() for every connection
+ * and passed to the calls handling that connection, so that one protocol
+ * object can serve all connections of a route.
+ */
+class ProtocolConnectionState {
+public:
+  virtual ~ProtocolConnectionState() {}
+};
+
 class BaseProtocol {
 public:
 
@@ -76,13 +91,22 @@ public:
    * @param report_bytes_read Pointer to storage to report bytes read
    * @param from_server true if the message sender is the server, false
    *                    if it is a client
+   * @param state what create_connection_state() returned for the connection
    *
    * @return 0 on success; -1 on error
    */
   virtual int copy_packets(int sender, int receiver, bool sender_is_readable,
                            RoutingProtocolBuffer &buffer, int *curr_pktnr,
                            bool &handshake_done, size_t *report_bytes_read,
-                           bool from_server) = 0;
+                           bool from_server, ProtocolConnectionState *state) = 0;
+
+  /** @brief Creates the state of a new connection
+   *
+   * @return state to pass to copy_packets(); nullptr if the protocol keeps none
+   */
+  virtual std::unique_ptr<ProtocolConnectionState> create_connection_state() {
+    return nullptr;
+  }
 
   /** @brief Sends error message to the provided receiver.
    *
@@ -102,6 +126,56 @@ public:
                           const std::string &sql_state,
                           const std::string &log_prefix) = 0;
 
+  /** @brief Terminates the TLS session of the client at the router
+   *
+   * Called right after the connection to the server was established,
+   * before any packet was exchanged. Offers TLS to the client in place of
+   * the server; if the client asks for it, does the TLS handshake and
+   * relays the authentication between the decrypted client connection and
+   * the plaintext server connection.
+   *
+   * Protocols not supporting it return -1.
+   *
+   * @param client Descriptor of the client
+   * @param server Descriptor of the server
+   * @param tls_context TLS context of the route
+   * @param tls set to the TLS session of the client, if one was started
+   * @param curr_pktnr Pointer to storage for sequence id of packet
+   * @param state what create_connection_state() returned for the connection
+   * @param timeout how long the authentication exchange may take at most
+   * @param stop_event descriptor which becomes readable when the route
+   *        stops; -1 if there is none
+   *
+   * @return 1 if TLS was established and authentication is done; 0 if the
+   *         client doesn't use TLS and the handshake continues as usual;
+   *         -1 on error, timeout or stop
+   */
+  virtual int terminate_tls(int /*client*/, int /*server*/, routing::TlsServerContext &/*tls_context*/,
+                            std::unique_ptr<routing::TlsConnection> &/*tls*/, int * /*curr_pktnr*/,
+                            ProtocolConnectionState * /*state*/, std::chrono::milliseconds /*timeout*/,
+                            int /*stop_event*/) {
+    return -1;
+  }
+
+  /** @brief Wraps the socket operations of an authenticated connection to
+   *         record the GTIDs of the client's writes
+   *
+   * @param socket_operations socket operations to wrap
+   * @param client Descriptor of the client
+   * @param server Descriptor of the server
+   * @param client_host host the client connected from
+   * @param state what create_connection_state() returned for the connection
+   *
+   * @return socket operations to use for the connection; nullptr if the
+   *         protocol doesn't support it
+   */
+  virtual std::unique_ptr<SocketOperationsBase> track_gtids(SocketOperationsBase * /*socket_operations*/,
+                                                            int /*client*/, int /*server*/,
+                                                            const std::string &/*client_host*/,
+                                                            ProtocolConnectionState * /*state*/) {
+    return nullptr;
+  }
+
   /** @brief Gets protocol type. */
   virtual Type get_type() = 0;
 protected:
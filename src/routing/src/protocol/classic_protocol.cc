@@ -21,16 +21,87 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "logger.h"
 #include "mysqlrouter/mysql_protocol.h"
 #include "mysqlrouter/routing.h"
+#include "../read_your_writes.h"
+#include "../tls_termination.h"
 #include "../utils.h"
 
+#include <algorithm>
 #include <cstring>
+#include <stdexcept>
 
 using mysql_harness::get_strerror;
 
+namespace {
+
+const size_t kHeaderSize = mysql_protocol::Packet::kHeaderSize;
+
+// reads exactly nbyte bytes; on connection close errno is set to 0
+bool read_all(SocketOperationsBase *socket_operations, int fd, uint8_t *buffer, size_t nbyte) {
+  while (nbyte > 0) {
+    const ssize_t res = socket_operations->read(fd, buffer, nbyte);
+    if (res <= 0) {
+      if (res == 0) {
+        socket_operations->set_errno(0);
+      }
+      return false;
+    }
+    buffer += res;
+    nbyte -= static_cast<size_t>(res);
+  }
+  return true;
+}
+
+// reads one complete packet, header included
+bool read_packet(SocketOperationsBase *socket_operations, int fd, RoutingProtocolBuffer &packet) {
+  packet.resize(kHeaderSize);
+  if (!read_all(socket_operations, fd, &packet[0], kHeaderSize)) {
+    return false;
+  }
+
+  const size_t payload_size = static_cast<size_t>(packet[0]) |
+                              static_cast<size_t>(packet[1]) << 8 |
+                              static_cast<size_t>(packet[2]) << 16;
+  packet.resize(kHeaderSize + payload_size);
+  return payload_size == 0 || read_all(socket_operations, fd, &packet[kHeaderSize], payload_size);
+}
+
+bool write_packet(SocketOperationsBase *socket_operations, int fd, RoutingProtocolBuffer &packet) {
+  return socket_operations->write_all(fd, &packet[0], packet.size()) >= 0;
+}
+
+// capabilities of a handshake response (packet 1 of the client)
+uint32_t get_client_capabilities(const RoutingProtocolBuffer &packet) {
+  if (packet.size() < kHeaderSize + 4) {
+    return 0;
+  }
+  return mysql_protocol::PacketView(packet.data(), packet.size(), true).get_int<uint32_t>(4);
+}
+
+void set_client_capabilities(ProtocolConnectionState *state, uint32_t capabilities) {
+  if (state) {
+    static_cast<ClassicConnectionState*>(state)->client_capabilities = capabilities;
+  }
+}
+
+// commands can't be injected into compressed connections
+bool is_compressed(ProtocolConnectionState *state) {
+  return !state || (static_cast<ClassicConnectionState*>(state)->client_capabilities &
+                    mysql_protocol::kClientCompress) != 0;
+}
+
+// TLS passed through to the server: the traffic can't be looked at
+bool is_tls_passed_through(ProtocolConnectionState *state) {
+  auto classic_state = static_cast<ClassicConnectionState*>(state);
+  return !classic_state || ((classic_state->client_capabilities & mysql_protocol::kClientSSL) != 0 &&
+                            !classic_state->tls_terminated);
+}
+
+} // namespace
+
 bool ClassicProtocol::on_block_client_host(int server, const std::string &log_prefix) {
   auto fake_response = mysql_protocol::HandshakeResponsePacket(1, {}, "ROUTER", "", "fake_router_login");
   if (socket_operations_->write_all(server, fake_response.data(), fake_response.size()) < 0) {
-    log_debug("[%s] fd=%d write error: %s",
+    log_module_debug(LOG_MODULE_PROTOCOL, "[%s] fd=%d write error: %s",
         log_prefix.c_str(),
         server,
         get_message_error(socket_operations_->get_errno()).c_str());
@@ -42,7 +113,7 @@ bool ClassicProtocol::on_block_client_host(int server, const std::string &log_pr
 int ClassicProtocol::copy_packets(int sender, int receiver, bool sender_is_readable,
                                   RoutingProtocolBuffer &buffer, int *curr_pktnr,
                                   bool &handshake_done, size_t *report_bytes_read,
-                                  bool /*from_server*/) {
+                                  bool /*from_server*/, ProtocolConnectionState *state) {
   assert(curr_pktnr);
   assert(report_bytes_read);
   ssize_t res = 0;
@@ -60,7 +131,7 @@ int ClassicProtocol::copy_packets(int sender, int receiver, bool sender_is_reada
       if (res == -1) {
         const int last_errno = socket_operations_->get_errno();
 
-        log_debug("fd=%d read failed: (%d %s)",
+        log_module_debug(LOG_MODULE_PROTOCOL, "fd=%d read failed: (%d %s)",
             sender,
             last_errno, get_message_error(last_errno).c_str());
       } else {
@@ -82,7 +153,7 @@ int ClassicProtocol::copy_packets(int sender, int receiver, bool sender_is_reada
       }
       pktnr = buffer[3];
       if (*curr_pktnr > 0 && pktnr != *curr_pktnr + 1) {
-        log_debug("Received incorrect packet number; aborting (was %d)", pktnr);
+        log_module_debug(LOG_MODULE_PROTOCOL, "Received incorrect packet number; aborting (was %d)", pktnr);
         return -1;
       }
 
@@ -90,13 +161,16 @@ int ClassicProtocol::copy_packets(int sender, int receiver, bool sender_is_reada
         // We got error from MySQL Server while handshaking
         // We do not consider this a failed handshake
 
-        // copy part of the buffer containing serialized error
-        RoutingProtocolBuffer buffer_err(buffer.begin(), buffer.begin() +
-                                         static_cast<RoutingProtocolBuffer::iterator::difference_type>(bytes_read));
+        try {
+          // make sure the error packet is complete before passing it on
+          mysql_protocol::PacketView server_error(buffer.data(), bytes_read);
+        } catch (const mysql_protocol::packet_error &exc) {
+          log_module_debug(LOG_MODULE_PROTOCOL, "%s", exc.what());
+          return -1;
+        }
 
-        auto server_error = mysql_protocol::ErrorPacket(buffer_err);
-        if (socket_operations_->write_all(receiver, server_error.data(), server_error.size()) < 0) {
-          log_debug("fd=%d write error: %s",
+        if (socket_operations_->write_all(receiver, &buffer[0], bytes_read) < 0) {
+          log_module_debug(LOG_MODULE_PROTOCOL, "fd=%d write error: %s",
               receiver, get_message_error(socket_operations_->get_errno()).c_str());
         }
         // receiver socket closed by caller
@@ -108,14 +182,15 @@ int ClassicProtocol::copy_packets(int sender, int receiver, bool sender_is_reada
       // We are dealing with the handshake response from client
       if (pktnr == 1) {
         // if client is switching to SSL, we are not continuing any checks
-        uint32_t capabilities = 0;
-        try {
-          auto pkt = mysql_protocol::Packet(buffer);
-          capabilities = pkt.get_int<uint32_t>(4);
-        } catch (const mysql_protocol::packet_error &exc) {
-          log_debug(exc.what());
+        // only the capabilities are needed, the rest of the packet
+        // doesn't have to be there yet
+        mysql_protocol::PacketView pkt(buffer.data(), bytes_read, true);
+        if (pkt.size() < mysql_protocol::Packet::kHeaderSize + 4) {
+          log_module_debug(LOG_MODULE_PROTOCOL, "Handshake response too short (was %lu)", static_cast<long unsigned>(pkt.size()));
           return -1;
         }
+        const uint32_t capabilities = pkt.get_int<uint32_t>(4);
+        set_client_capabilities(state, capabilities);
         if (capabilities & mysql_protocol::kClientSSL) {
           pktnr = 2;  // Setting to 2, we tell the caller that handshaking is done
         }
@@ -125,7 +200,7 @@ int ClassicProtocol::copy_packets(int sender, int receiver, bool sender_is_reada
     if (socket_operations_->write_all(receiver, &buffer[0], bytes_read) < 0) {
       const int last_errno = socket_operations_->get_errno();
 
-      log_debug("fd=%d write error: %s",
+      log_module_debug(LOG_MODULE_PROTOCOL, "fd=%d write error: %s",
           receiver,
           get_message_error(last_errno).c_str());
       return -1;
@@ -138,6 +213,171 @@ int ClassicProtocol::copy_packets(int sender, int receiver, bool sender_is_reada
   return 0;
 }
 
+int ClassicProtocol::terminate_tls(int client, int server, routing::TlsServerContext &tls_context,
+                                   std::unique_ptr<routing::TlsConnection> &tls, int *curr_pktnr,
+                                   ProtocolConnectionState *state, std::chrono::milliseconds timeout,
+                                   int stop_event) {
+  assert(curr_pktnr);
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  RoutingProtocolBuffer packet;
+
+  // the server sends its greeting right away, don't wait for it forever
+  struct pollfd greeting_fds[] = {
+    { server, POLLIN, 0 },
+    { stop_event, POLLIN, 0 },
+  };
+  if (socket_operations_->poll(greeting_fds, 2, timeout) <= 0 || greeting_fds[1].revents != 0) {
+    log_module_debug(LOG_MODULE_PROTOCOL, "fd=%d no server greeting", server);
+    return -1;
+  }
+
+  // the server greeting offers SSL, whether the server supports it or not
+  if (!read_packet(socket_operations_, server, packet)) {
+    log_module_debug(LOG_MODULE_PROTOCOL, "fd=%d reading server greeting failed: %s", server,
+              get_message_error(socket_operations_->get_errno()).c_str());
+    return -1;
+  }
+  if (packet.size() > kHeaderSize && packet[kHeaderSize] == 0xff) {
+    // server refused the connection; pass the error on and we are done
+    write_packet(socket_operations_, client, packet);
+    *curr_pktnr = 2;
+    return 0;
+  }
+
+  // protocol version, server version, connection id, auth-plugin-data-part-1, filler
+  auto version_end = std::find(packet.begin() + static_cast<long>(kHeaderSize) + 1, packet.end(), 0);
+  const size_t capabilities_pos = static_cast<size_t>(version_end - packet.begin()) + 1 + 4 + 8 + 1;
+  if (capabilities_pos + 2 > packet.size()) {
+    log_module_debug(LOG_MODULE_PROTOCOL, "fd=%d server greeting is too short", server);
+    return -1;
+  }
+  packet[capabilities_pos + 1] |= static_cast<uint8_t>(mysql_protocol::kClientSSL >> 8);
+
+  if (!write_packet(socket_operations_, client, packet) ||
+      !read_packet(socket_operations_, client, packet)) {
+    log_module_debug(LOG_MODULE_PROTOCOL, "fd=%d handshake with client failed: %s", client,
+              get_message_error(socket_operations_->get_errno()).c_str());
+    return -1;
+  }
+
+  const bool ssl_request = packet.size() >= kHeaderSize + 4 &&
+                           (packet[kHeaderSize + 1] & (mysql_protocol::kClientSSL >> 8)) != 0;
+  if (!ssl_request) {
+    // plaintext client: the usual handshake checks take over
+    set_client_capabilities(state, get_client_capabilities(packet));
+    if (!write_packet(socket_operations_, server, packet)) {
+      return -1;
+    }
+    *curr_pktnr = packet[3];
+    return 0;
+  }
+
+  try {
+    tls.reset(new routing::TlsConnection(tls_context, client, socket_operations_));
+  } catch (const std::runtime_error &exc) {
+    log_module_debug(LOG_MODULE_PROTOCOL, "fd=%d %s", client, exc.what());
+    return -1;
+  }
+  if (!tls->accept()) {
+    log_module_debug(LOG_MODULE_PROTOCOL, "fd=%d %s", client, tls->get_error().c_str());
+    return -1;
+  }
+  if (state) {
+    static_cast<ClassicConnectionState*>(state)->tls_terminated = true;
+  }
+
+  routing::TlsSocketOperations tls_operations(socket_operations_, tls.get());
+
+  // the server never saw the SSL request: the handshake response becomes
+  // packet 1 and the client must not ask the server for SSL
+  if (!read_packet(&tls_operations, client, packet) || packet.size() < kHeaderSize + 4) {
+    log_module_debug(LOG_MODULE_PROTOCOL, "fd=%d reading handshake response failed", client);
+    return -1;
+  }
+  set_client_capabilities(state, get_client_capabilities(packet));
+  packet[kHeaderSize + 1] &= static_cast<uint8_t>(~(mysql_protocol::kClientSSL >> 8));
+  --packet[3];
+  if (!write_packet(socket_operations_, server, packet)) {
+    return -1;
+  }
+
+  // relay the authentication exchange until the server sends OK or Error
+  while (true) {
+    struct pollfd fds[] = {
+      { client, POLLIN, 0 },
+      { server, POLLIN, 0 },
+      { stop_event, POLLIN, 0 },
+    };
+
+    const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (remaining.count() <= 0) {
+      log_module_debug(LOG_MODULE_PROTOCOL, "fd=%d authentication timed out", client);
+      return -1;
+    }
+
+    // decrypted data waiting in the TLS session doesn't make the socket readable
+    const bool client_pending = tls->pending() > 0;
+    if (!client_pending) {
+      const int res = socket_operations_->poll(fds, 3, remaining);
+      if (res < 0) {
+        if (socket_operations_->get_errno() == EINTR) {
+          continue;
+        }
+        return -1;
+      }
+      if (res == 0) {
+        continue;  // the deadline is checked above
+      }
+    }
+
+    if (fds[2].revents != 0) {
+      return -1;  // the route stops
+    }
+
+    if (fds[1].revents != 0) {
+      if (!read_packet(socket_operations_, server, packet)) {
+        return -1;
+      }
+      ++packet[3];
+      if (!write_packet(&tls_operations, client, packet)) {
+        return -1;
+      }
+
+      const uint8_t type = (packet.size() > kHeaderSize) ? packet[kHeaderSize] : 0xff;
+      if (type == 0x00 || type == 0xff) {
+        *curr_pktnr = 2;
+        return 1;
+      }
+    }
+
+    if (client_pending || fds[0].revents != 0) {
+      if (!read_packet(&tls_operations, client, packet)) {
+        return -1;
+      }
+      --packet[3];
+      if (!write_packet(socket_operations_, server, packet)) {
+        return -1;
+      }
+    }
+  }
+}
+
+std::unique_ptr<ProtocolConnectionState> ClassicProtocol::create_connection_state() {
+  return std::unique_ptr<ProtocolConnectionState>(new ClassicConnectionState());
+}
+
+std::unique_ptr<SocketOperationsBase> ClassicProtocol::track_gtids(SocketOperationsBase *socket_operations,
+                                                                   int client, int server,
+                                                                   const std::string &client_host,
+                                                                   ProtocolConnectionState *state) {
+  if (is_compressed(state) || is_tls_passed_through(state)) {
+    return nullptr;
+  }
+  return std::unique_ptr<SocketOperationsBase>(new routing::GtidTrackingSocketOperations(
+      socket_operations, client, server, client_host, routing::GtidRegistry::instance()));
+}
+
 bool ClassicProtocol::send_error(int destination,
                                  unsigned short code,
                                  const std::string &message,
@@ -146,7 +386,7 @@ bool ClassicProtocol::send_error(int destination,
   auto server_error = mysql_protocol::ErrorPacket(0, code, message, sql_state);
 
   if (socket_operations_->write_all(destination, server_error.data(), server_error.size()) < 0) {
-    log_debug("[%s] fd=%d write error: %s", log_prefix.c_str(),
+    log_module_debug(LOG_MODULE_PROTOCOL, "[%s] fd=%d write error: %s", log_prefix.c_str(),
         destination,
         get_message_error(socket_operations_->get_errno()).c_str());
 
@@ -22,6 +22,16 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include <string>
 
+/** @brief What the classic protocol keeps per routed connection */
+class ClassicConnectionState : public ProtocolConnectionState {
+public:
+  /** @brief Capabilities of the client's handshake response; 0 until it was seen */
+  uint32_t client_capabilities = 0;
+  /** @brief Whether the router terminated the client's TLS; if the client
+   *         asked for TLS otherwise, it is passed through to the server */
+  bool tls_terminated = false;
+};
+
 class ClassicProtocol: public BaseProtocol {
 public:
   ClassicProtocol(SocketOperationsBase *socket_operations): BaseProtocol(socket_operations) {}
@@ -60,13 +70,14 @@ public:
    * @param report_bytes_read Pointer to storage to report bytes read
    * @param from_server true if the message sender is the server, false
    *                    if it is a client
+   * @param state what create_connection_state() returned for the connection
    *
    * @return 0 on success; -1 on error
    */
   virtual int copy_packets(int sender, int receiver, bool sender_is_readable,
                            RoutingProtocolBuffer &buffer, int *curr_pktnr,
                            bool &handshake_done, size_t *report_bytes_read,
-                           bool from_server) override;
+                           bool from_server, ProtocolConnectionState *state) override;
 
   /** @brief Sends error message to the provided receiver.
    *
@@ -86,6 +97,55 @@ public:
                           const std::string &sql_state,
                           const std::string &log_prefix) override;
 
+  /** @brief Terminates the TLS session of the client at the router
+   *
+   * The greeting of the server gets the SSL capability added. If the client
+   * sends an SSL request, the TLS handshake is done with the client and its
+   * handshake response is passed on to the server without the SSL
+   * capability and with the sequence ids shifted by one; so are all further
+   * packets until the server sends OK or Error.
+   *
+   * The server sees a plaintext connection: authentication methods which
+   * need a secure transport to the server (e.g. the full authentication of
+   * caching_sha2_password) and servers with require_secure_transport fail.
+   *
+   * @param client Descriptor of the client
+   * @param server Descriptor of the server
+   * @param tls_context TLS context of the route
+   * @param tls set to the TLS session of the client, if one was started
+   * @param curr_pktnr Pointer to storage for sequence id of packet
+   * @param state what create_connection_state() returned for the connection
+   * @param timeout how long the authentication exchange may take at most
+   * @param stop_event descriptor which becomes readable when the route
+   *        stops; -1 if there is none
+   *
+   * @return 1 if TLS was established and authentication is done; 0 if the
+   *         client doesn't use TLS and the handshake continues as usual;
+   *         -1 on error, timeout or stop
+   */
+  virtual int terminate_tls(int client, int server, routing::TlsServerContext &tls_context,
+                            std::unique_ptr<routing::TlsConnection> &tls, int *curr_pktnr,
+                            ProtocolConnectionState *state, std::chrono::milliseconds timeout,
+                            int stop_event) override;
+
+  /** @brief Creates the state of a new connection */
+  virtual std::unique_ptr<ProtocolConnectionState> create_connection_state() override;
+
+  /** @brief Wraps the socket operations to record the GTIDs of the client's writes
+   *
+   * The GTIDs are taken from the OK packets of the server, which only
+   * carries them with `session_track_gtids=OWN_GTID` and if the client
+   * supports session tracking. Not possible if the client uses compression,
+   * or TLS which the router passes through instead of terminating it.
+   *
+   * @return a routing::GtidTrackingSocketOperations; nullptr if the GTIDs
+   *         can't be tracked on this connection
+   */
+  virtual std::unique_ptr<SocketOperationsBase> track_gtids(SocketOperationsBase *socket_operations,
+                                                            int client, int server,
+                                                            const std::string &client_host,
+                                                            ProtocolConnectionState *state) override;
+
   /** @brief Gets protocol type. */
   virtual Type get_type() override {
     return Type::kClassicProtocol;
@@ -0,0 +1,112 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "x_message_framer.h"
+
+#include <algorithm>
+
+XMessageFramer::XMessageFramer(size_t max_collect_size)
+    : max_collect_size_(max_collect_size), state_(State::kHeader), event_(Event::kNone),
+      header_(), header_size_(0), type_(0), payload_size_(0), remaining_(0),
+      collect_(false), payload_(nullptr) {}
+
+bool XMessageFramer::collect_payload() {
+  if (event_ != Event::kHeader || payload_size_ > max_collect_size_) {
+    return false;
+  }
+  collect_ = true;
+  return true;
+}
+
+size_t XMessageFramer::consume(const uint8_t *data, size_t size) {
+  event_ = Event::kNone;
+  size_t consumed = 0;
+
+  while (true) {
+    switch (state_) {
+      case State::kInvalid:
+        event_ = Event::kInvalid;
+        return consumed;
+
+      case State::kHeader: {
+        const size_t n = std::min(kHeaderSize - header_size_, size - consumed);
+        std::copy(data + consumed, data + consumed + n, header_.begin() + static_cast<long>(header_size_));
+        header_size_ += n;
+        consumed += n;
+        if (header_size_ < kHeaderSize) {
+          return consumed;
+        }
+
+        const uint32_t length = static_cast<uint32_t>(header_[0]) |
+                                static_cast<uint32_t>(header_[1]) << 8 |
+                                static_cast<uint32_t>(header_[2]) << 16 |
+                                static_cast<uint32_t>(header_[3]) << 24;
+        header_size_ = 0;
+        if (length == 0) {
+          // the length includes the type, it can't be 0
+          state_ = State::kInvalid;
+          event_ = Event::kInvalid;
+          return consumed;
+        }
+
+        type_ = header_[4];
+        payload_size_ = length - 1;
+        remaining_ = payload_size_;
+        collect_ = false;
+        collected_.clear();
+        payload_ = nullptr;
+        state_ = State::kPayload;
+        event_ = Event::kHeader;
+        return consumed;
+      }
+
+      case State::kPayload: {
+        const size_t n = std::min(remaining_, size - consumed);
+
+        if (!collect_) {
+          consumed += n;
+          remaining_ -= n;
+          if (remaining_ > 0) {
+            return consumed;
+          }
+          state_ = State::kHeader;
+          continue;
+        }
+
+        if (remaining_ == payload_size_ && n == remaining_) {
+          // arrived in one piece, no need to copy it
+          payload_ = data + consumed;
+        } else {
+          if (collected_.empty()) {
+            collected_.reserve(payload_size_);
+          }
+          collected_.insert(collected_.end(), data + consumed, data + consumed + n);
+          payload_ = collected_.data();
+        }
+        consumed += n;
+        remaining_ -= n;
+        if (remaining_ > 0) {
+          return consumed;
+        }
+
+        state_ = State::kHeader;
+        event_ = Event::kMessage;
+        return consumed;
+      }
+    }
+  }
+}
@@ -0,0 +1,129 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_X_MESSAGE_FRAMER_INCLUDED
+#define ROUTING_X_MESSAGE_FRAMER_INCLUDED
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** @class XMessageFramer
+ * @brief Splits a stream of X protocol messages into messages
+ *
+ * Bytes are fed as they arrive from the socket, split at arbitrary
+ * positions; the framer keeps where it is between the calls, so it never
+ * has to read more itself and works with non-blocking sockets.
+ *
+ * Each message starts with a header: 4 bytes little-endian length
+ * (counting the type byte and the payload) followed by the type byte.
+ * The framer reports every header; payloads are skipped unless the caller
+ * asks for them with collect_payload(). A collected payload which arrived
+ * in one piece is returned in place, only payloads split over several
+ * reads are copied.
+ *
+ * Example:
+ *
+ * @code
+ * while (offset < size) {
+ *   offset += framer.consume(data + offset, size - offset);
+ *   if (framer.get_event() == XMessageFramer::Event::kHeader) ...
+ * }
+ * @endcode
+ */
+class XMessageFramer {
+ public:
+  /** @brief size of length and type of a message */
+  static constexpr size_t kHeaderSize = 5;
+
+  /** @brief What the last call to consume() ended with */
+  enum class Event {
+    /** all bytes were consumed, more are needed */
+    kNone,
+    /** header of a message is complete, see get_type() and get_payload_size() */
+    kHeader,
+    /** collected payload is complete, see get_payload() */
+    kMessage,
+    /** header with an invalid length; the stream can't be parsed further */
+    kInvalid,
+  };
+
+  /** @brief Constructor
+   *
+   * @param max_collect_size payloads larger than this are never collected
+   */
+  explicit XMessageFramer(size_t max_collect_size);
+
+  /** @brief Consumes bytes until the next event or until all are consumed
+   *
+   * Has to be called again with the remaining bytes as long as it returns
+   * an event other than kNone; with size 0 if the event was the last one
+   * of the bytes (e.g. an empty payload after its header).
+   *
+   * @param data received bytes
+   * @param size number of bytes in data
+   *
+   * @return number of bytes consumed
+   */
+  size_t consume(const uint8_t *data, size_t size);
+
+  /** @brief Returns what the last call of consume() ended with */
+  Event get_event() const noexcept { return event_; }
+
+  /** @brief Returns type of the current message */
+  uint8_t get_type() const noexcept { return type_; }
+
+  /** @brief Returns size of the payload of the current message */
+  uint32_t get_payload_size() const noexcept { return payload_size_; }
+
+  /** @brief Requests the payload of the current message
+   *
+   * Only valid right after a kHeader event. Once the payload is complete,
+   * consume() reports kMessage.
+   *
+   * @return false if the payload is bigger than max_collect_size
+   */
+  bool collect_payload();
+
+  /** @brief Returns the collected payload
+   *
+   * Only valid after a kMessage event and until the next consume(); points
+   * into the data passed to consume() if the payload came in one piece.
+   */
+  const uint8_t *get_payload() const noexcept { return payload_; }
+
+ private:
+  enum class State { kHeader, kPayload, kInvalid };
+
+  const size_t max_collect_size_;
+
+  State state_;
+  Event event_;
+
+  std::array<uint8_t, kHeaderSize> header_;
+  size_t header_size_;
+
+  uint8_t type_;
+  uint32_t payload_size_;
+  size_t remaining_;  // of the payload not consumed yet
+  bool collect_;
+  std::vector<uint8_t> collected_;
+  const uint8_t *payload_;
+};
+
+#endif // ROUTING_X_MESSAGE_FRAMER_INCLUDED
@@ -26,11 +26,113 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include <algorithm>
 #include <cassert>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 using ProtobufMessage = google::protobuf::Message;
 
 constexpr size_t kMessageHeaderSize = 5;
 
+// messages the router sends are small error messages; bigger ones fall back
+// to a heap buffer
+constexpr size_t kSendBufferSize = 512;
+
+namespace {
+
+// the messages the router parses or sends while handshaking, kept for reuse.
+//
+// Clear() keeps the memory the previous contents used, so once a set has
+// been used a couple of times, parsing and building messages doesn't
+// allocate anymore.
+struct XMessages {
+  Mysqlx::Session::AuthenticateStart authenticate_start;
+  Mysqlx::Connection::CapabilitiesGet capabilities_get;
+  Mysqlx::Connection::CapabilitiesSet capabilities_set;
+  Mysqlx::Connection::Close close;
+  Mysqlx::Error error;
+};
+
+// sets of messages not used by any connection at the moment.
+//
+// Each connection has its own thread, so the sets have to be shared between
+// threads to be reused at all; they are only held for parsing or
+// serializing a single message.
+class XMessagesPool {
+public:
+  // messages which were bigger than this are not kept, to not hold on to
+  // the memory of rare big ones
+  static constexpr uint32_t kMaxPooledMessageSize = 16 * 1024;
+
+  // sets kept at most; more only exist while more connections than that
+  // are handshaking at the same time
+  static constexpr size_t kMaxPooledSets = 64;
+
+  static XMessagesPool &instance() {
+    static XMessagesPool pool;
+    return pool;
+  }
+
+  std::unique_ptr<XMessages> acquire() {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      if (!free_.empty()) {
+        std::unique_ptr<XMessages> messages = std::move(free_.back());
+        free_.pop_back();
+        return messages;
+      }
+    }
+    return std::unique_ptr<XMessages>(new XMessages());
+  }
+
+  void release(std::unique_ptr<XMessages> messages) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (free_.size() < kMaxPooledSets) {
+      free_.push_back(std::move(messages));
+    }
+  }
+
+private:
+  XMessagesPool() {
+    free_.reserve(kMaxPooledSets);
+  }
+
+  std::mutex mtx_;
+  std::vector<std::unique_ptr<XMessages>> free_;
+};
+
+constexpr uint32_t XMessagesPool::kMaxPooledMessageSize;
+constexpr size_t XMessagesPool::kMaxPooledSets;
+
+// borrows a set of messages from the pool for the lifetime of the object
+class PooledXMessages {
+public:
+  PooledXMessages(): messages_(XMessagesPool::instance().acquire()) {}
+
+  ~PooledXMessages() {
+    if (messages_) {
+      XMessagesPool::instance().release(std::move(messages_));
+    }
+  }
+
+  PooledXMessages(const PooledXMessages&) = delete;
+  PooledXMessages& operator=(const PooledXMessages&) = delete;
+
+  XMessages *operator->() {
+    return messages_.get();
+  }
+
+  // the set is deleted instead of returned to the pool
+  void discard() {
+    messages_.reset();
+  }
+
+private:
+  std::unique_ptr<XMessages> messages_;
+};
+
+} // namespace
+
 static bool send_message(const std::string &log_prefix,
                          int destination,
                          const int8_t type,
@@ -38,20 +140,26 @@ static bool send_message(const std::string &log_prefix,
                          SocketOperationsBase *socket_operations) {
   using google::protobuf::io::CodedOutputStream;
 
-  const size_t msg_size = msg.ByteSize();
-  RoutingProtocolBuffer buffer(kMessageHeaderSize + msg_size);
+  const size_t msg_size = static_cast<size_t>(msg.ByteSize());
+  const size_t buffer_size = kMessageHeaderSize + msg_size;
+
+  uint8_t stack_buffer[kSendBufferSize];
+  RoutingProtocolBuffer heap_buffer;
+  uint8_t *buffer = stack_buffer;
+  if (buffer_size > sizeof(stack_buffer)) {
+    heap_buffer.resize(buffer_size);
+    buffer = heap_buffer.data();
+  }
 
   // first 4 bytes is the message size (plus type byte, without size bytes)
-  CodedOutputStream::WriteLittleEndian32ToArray(static_cast<uint32_t>(msg_size + 1), &buffer[0]);
+  CodedOutputStream::WriteLittleEndian32ToArray(static_cast<uint32_t>(msg_size + 1), buffer);
   // fifth byte is the message type
   buffer[kMessageHeaderSize-1] = static_cast<uint8_t>(type);
 
-  if ((msg.ByteSize() > 0) && (!msg.SerializeToArray(&buffer[kMessageHeaderSize], msg.ByteSize()))) {
-    log_error("[%s] error while serializing error message: %s", log_prefix.c_str());
-    return false;
-  }
+  // ByteSize() cached the sizes already
+  msg.SerializeWithCachedSizesToArray(buffer + kMessageHeaderSize);
 
-  if (socket_operations->write_all(destination, &buffer[0], buffer.size()) < 0) {
+  if (socket_operations->write_all(destination, buffer, buffer_size) < 0) {
     const int last_errno = socket_operations->get_errno();
 
     log_error("[%s] fd=%d write error: %s", log_prefix.c_str(),
@@ -64,125 +172,73 @@ static bool send_message(const std::string &log_prefix,
 }
 
 static bool message_valid(const void* message_buffer, const int8_t message_type, const uint32_t message_size) {
-  std::unique_ptr<google::protobuf::Message> msg;
-
   assert(message_type == Mysqlx::ClientMessages::SESS_AUTHENTICATE_START
          || message_type == Mysqlx::ClientMessages::CON_CAPABILITIES_GET
          || message_type == Mysqlx::ClientMessages::CON_CAPABILITIES_SET
          || message_type == Mysqlx::ClientMessages::CON_CLOSE);
 
+  PooledXMessages messages;
+  google::protobuf::Message *msg;
+
   switch (message_type) {
   case Mysqlx::ClientMessages::SESS_AUTHENTICATE_START:
-    msg.reset(new Mysqlx::Session::AuthenticateStart());
+    msg = &messages->authenticate_start;
     break;
   case Mysqlx::ClientMessages::CON_CAPABILITIES_GET:
-    msg.reset(new Mysqlx::Connection::CapabilitiesGet());
+    msg = &messages->capabilities_get;
     break;
   case Mysqlx::ClientMessages::CON_CAPABILITIES_SET:
-    msg.reset(new Mysqlx::Connection::CapabilitiesSet());
+    msg = &messages->capabilities_set;
     break;
   default: /* Mysqlx::ClientMessages::CON_CLOSE */
-    msg.reset(new Mysqlx::Connection::Close());
+    msg = &messages->close;
   }
 
-  assert(msg.get() != nullptr);
-
   // sanity check deserializing the message
-  if (!msg->ParseFromArray(message_buffer, static_cast<int>(message_size))) {
-    return false;
-  }
+  const bool valid = msg->ParseFromArray(message_buffer, static_cast<int>(message_size));
 
-  return true;
-}
-
-static bool get_next_message(int sender,
-                             RoutingProtocolBuffer &buffer,
-                             size_t   &buffer_contents_size,
-                             size_t   &message_offset,
-                             int8_t   &message_type,
-                             uint32_t &message_size,
-                             SocketOperationsBase *socket_operations,
-                             bool &error) {
-  using google::protobuf::io::CodedInputStream;
-  error = false;
-  ssize_t read_res = 0;
-
-  assert(buffer_contents_size >= message_offset);
-  size_t bytes_left = buffer_contents_size - message_offset;
-
-  // no more messages to process
-  if (bytes_left == 0) {
-    return false;
+  if (message_size > XMessagesPool::kMaxPooledMessageSize) {
+    messages.discard();
+  } else {
+    msg->Clear();
   }
 
-  // we need at least 4 bytes to know the message size
-  while (bytes_left < 4) {
-    read_res = socket_operations->read(sender, &buffer[message_offset + bytes_left], 4 - bytes_left);
-    if (read_res < 0) {
-      const int last_errno = socket_operations->get_errno();
-      log_error("fd=%d failed reading size of the message: (%d %s %ld)",
-          sender,
-          last_errno, get_message_error(last_errno).c_str(), static_cast<long>(read_res));
-      error = true;
-      return false;
-    } else if (read_res == 0) {
-      // connection got closed on us
-
-      error = true;
-      return false;
-    }
-
-    buffer_contents_size += read_res;
-    bytes_left += read_res;
-  }
+  return valid;
+}
 
-  // we got the message size, we can decode it
-  CodedInputStream::ReadLittleEndian32FromArray(&buffer[message_offset], &message_size);
-
-  // If not the whole message is in the buffer we need to read the remaining part to be able to decode it.
-  // First let's check if the message will fit the buffer.
-  // Currently we decode the messages ONLY in the handshake phase when we expect relatively small messages:
-  // (AuthOk, AutCont, Notice, Error, CapabilitiesGet...)
-  // In case the message does not fit the buffer, we just return an error. This way we defend against the possibility
-  // of the client sending huge messages while authenticating.
-  size_t size_needed = message_offset + 4 + message_size;
-  if (buffer.size() < size_needed) {
-    log_error("X protocol message too big to fit the buffer: (%u, %lu, %lu)", message_size,
-              static_cast<long unsigned>(buffer.size()), static_cast<long unsigned>(message_offset)); // 32bit Linux requires casts
-    error = true;
-    return false;
-  }
-  // next read the remaining part of the message if needed
-  while (message_size + 4 > bytes_left) {
-    read_res = socket_operations->read(sender, &buffer[message_offset+bytes_left], message_size + 4 - bytes_left);
-    if (read_res < 0) {
-      const int last_errno = socket_operations->get_errno();
-
-      log_error("fd=%d failed reading part of X protocol message: (%d %s %ld)",
-          sender,
-          last_errno, get_message_error(last_errno).c_str(), static_cast<long>(read_res));
-
-      error = true;
-      return false;
-    } else if (read_res == 0) {
-      // connection got closed on us.
-      error = true;
-      return false;
-    }
+namespace {
+
+// where the handshake inspection of each direction of a connection is;
+// messages can be split over any number of reads
+class XConnectionState : public ProtocolConnectionState {
+public:
+  XConnectionState():
+      from_client(XProtocol::kMaxHandshakeMessageSize),
+      from_server(XProtocol::kMaxHandshakeMessageSize) {}
+
+  XMessageFramer from_client;
+  XMessageFramer from_server;
+};
+
+bool is_allowed_first_client_message(uint8_t message_type) {
+  return message_type == Mysqlx::ClientMessages::SESS_AUTHENTICATE_START
+      || message_type == Mysqlx::ClientMessages::CON_CAPABILITIES_GET
+      || message_type == Mysqlx::ClientMessages::CON_CAPABILITIES_SET
+      || message_type == Mysqlx::ClientMessages::CON_CLOSE;
+}
 
-    buffer_contents_size += read_res;
-    bytes_left += read_res;
-  }
+} // namespace
 
-  message_type = buffer[message_offset + kMessageHeaderSize - 1];
+constexpr size_t XProtocol::kMaxHandshakeMessageSize;
 
-  return true;
+std::unique_ptr<ProtocolConnectionState> XProtocol::create_connection_state() {
+  return std::unique_ptr<ProtocolConnectionState>(new XConnectionState());
 }
 
 int XProtocol::copy_packets(int sender, int receiver, bool sender_is_readable,
                             RoutingProtocolBuffer &buffer, int * /*curr_pktnr*/,
                             bool &handshake_done, size_t *report_bytes_read,
-                            bool from_server) {
+                            bool from_server, ProtocolConnectionState *state) {
   assert(report_bytes_read != nullptr);
 
   ssize_t res = 0;
@@ -209,55 +265,61 @@ int XProtocol::copy_packets(int sender, int receiver, bool sender_is_readable,
       // AuthenticateStart or CapabilitesGet as a first message
       // that should be enough to prevent the MySQL Server from considering
       // the connection as an error even if it is terminated after that.
-      int8_t message_type;
-      size_t message_offset = 0;
-      uint32_t message_size = 0;
-      // the buffer can contain partial message or more than one message
-      // the loop is to make sure that all messages are inspected
-      // and that the whole message that is being processed is in the buffer
-      bool msg_read_error = false;
-      while (get_next_message(sender, buffer, bytes_read, message_offset, message_type,
-                              message_size, socket_operations_, msg_read_error)
-             && !msg_read_error) {
-
-
-        if (!from_server) {
-          // the first message from the client. We need to check if it's correct.
-          if (message_type == Mysqlx::ClientMessages::SESS_AUTHENTICATE_START
-                  || message_type == Mysqlx::ClientMessages::CON_CAPABILITIES_GET
-                  || message_type == Mysqlx::ClientMessages::CON_CAPABILITIES_SET
-                  || message_type == Mysqlx::ClientMessages::CON_CLOSE) {
-            // validate the message
-            if (!message_valid(&buffer[message_offset+kMessageHeaderSize], message_type, message_size-1)) {
-              log_warning("Invalid message content: type(%hhu), size(%u)", message_type, message_size-1);
-              return -1;
-            }
+      //
+      // the buffer can contain partial messages or more than one message;
+      // the framer remembers where the last read ended, so we never have to
+      // wait for the rest of a message here.
+      assert(state != nullptr);
+      XConnectionState &connection_state = *static_cast<XConnectionState*>(state);
+      XMessageFramer &framer = from_server ? connection_state.from_server : connection_state.from_client;
+
+      size_t offset = 0;
+      while (!handshake_done) {
+        offset += framer.consume(buffer.data() + offset, bytes_read - offset);
+
+        const XMessageFramer::Event event = framer.get_event();
+        if (event == XMessageFramer::Event::kNone) {
+          break;
+        } else if (event == XMessageFramer::Event::kInvalid) {
+          log_warning("Received invalid X protocol message header while handshaking");
+          return -1;
+        }
+
+        const uint8_t message_type = framer.get_type();
+        if (from_server) {
+          if (message_type == Mysqlx::ServerMessages::ERROR) {
+            // if the server sends an error we don't consider it a failed handshake.
+            // this is to have parity with how we behave in case of classic protocol
+            // where error from the server (even ACCESS DENIED) does not increment
+            // error connection counter
             handshake_done = true;
-            break;
           }
-          else {
+          continue;
+        }
+
+        // the first message from the client. We need to check if it's correct.
+        if (event == XMessageFramer::Event::kHeader) {
+          if (!is_allowed_first_client_message(message_type)) {
             // any other message at this point is not allowed by the x protocol and would make
             // MySQL Server consider this connection an error which we need to prevent
             log_warning("Received incorrect message type from the client while handshaking (was %hhu)",
                         message_type);
             return -1;
           }
+          if (!framer.collect_payload()) {
+            log_error("X protocol message too big while handshaking: (%u, max %lu)", framer.get_payload_size(),
+                      static_cast<long unsigned>(kMaxHandshakeMessageSize)); // 32bit Linux requires casts
+            return -1;
+          }
+          continue;
         }
 
-        if (from_server && message_type == Mysqlx::ServerMessages::ERROR) {
-          // if the server sends an error we don't consider it a failed handshake.
-          // this is to have parity with how we behave in case of classic protocol
-          // where error from the server (even ACCESS DENIED) does not increment
-          // error connection counter
-          handshake_done = true;
-          break;
+        // validate the message
+        if (!message_valid(framer.get_payload(), static_cast<int8_t>(message_type), framer.get_payload_size())) {
+          log_warning("Invalid message content: type(%hhu), size(%u)", message_type, framer.get_payload_size());
+          return -1;
         }
-
-        message_offset += (message_size + 4);
-      }
-
-      if (msg_read_error) {
-        return -1;
+        handshake_done = true;
       }
     }
 
@@ -279,12 +341,16 @@ bool XProtocol::send_error(int destination,
                            const std::string &message,
                            const std::string &sql_state,
                            const std::string &log_prefix) {
-  Mysqlx::Error error;
+  PooledXMessages messages;
+  Mysqlx::Error &error = messages->error;
   error.set_code(code);
   error.set_sql_state(sql_state);
   error.set_msg(message);
 
-  return send_message(log_prefix, destination, Mysqlx::ServerMessages::ERROR, error, socket_operations_);
+  const bool res = send_message(log_prefix, destination, Mysqlx::ServerMessages::ERROR, error, socket_operations_);
+  error.Clear();
+
+  return res;
 }
 
 
@@ -296,8 +362,8 @@ bool XProtocol::on_block_client_host(int server, const std::string &log_prefix)
 
   // at the moment we send CapabilitiesGet message to the server assuming this will prevent the
   // MySQL Server from considering the connection as an error and incrementing the counter.
-  Mysqlx::Connection::CapabilitiesGet capabilities_get;
+  PooledXMessages messages;
 
   return send_message(log_prefix, server, Mysqlx::ClientMessages::CON_CAPABILITIES_GET,
-                      capabilities_get, socket_operations_);
+                      messages->capabilities_get, socket_operations_);
 }
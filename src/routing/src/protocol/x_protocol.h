@@ -18,11 +18,19 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define ROUTING_XPROTOCOL_INCLUDED
 
 #include "base_protocol.h"
+#include "x_message_framer.h"
 
 #include <memory>
 
 class XProtocol: public BaseProtocol {
 public:
+  /** @brief Handshake messages bigger than this are refused
+   *
+   * Only the messages the router has to look into are limited; this
+   * protects against clients sending huge messages before authenticating.
+   */
+  static constexpr size_t kMaxHandshakeMessageSize = 1024 * 1024;
+
   XProtocol(SocketOperationsBase *socket_operations): BaseProtocol(socket_operations) {}
 
   /** @brief Function that gets called when the client is being blocked
@@ -52,13 +60,17 @@ public:
    * @param report_bytes_read Pointer to storage to report bytes read
    * @param from_server true if the message sender is the server, false
    *                    if it is a client
+   * @param state what create_connection_state() returned for the connection
    *
    * @return 0 on success; -1 on error
    */
   virtual int copy_packets(int sender, int receiver, bool sender_is_readable,
                            RoutingProtocolBuffer &buffer, int *curr_pktnr,
                            bool &handshake_done, size_t *report_bytes_read,
-                           bool from_server) override;
+                           bool from_server, ProtocolConnectionState *state) override;
+
+  /** @brief Creates the message framers of a new connection */
+  virtual std::unique_ptr<ProtocolConnectionState> create_connection_state() override;
 
   /** @brief Sends error message to the provided receiver.
    *
@@ -0,0 +1,214 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "read_your_writes.h"
+
+#include "logger.h"
+#include "mysqlrouter/mysql_protocol.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace routing {
+
+namespace {
+
+const size_t kHeaderSize = mysql_protocol::Packet::kHeaderSize;
+
+// OK packets are small, anything bigger is not worth buffering
+const size_t kMaxOkPacketSize = 64 * 1024;
+
+} // namespace
+
+bool is_valid_gtid_set(const std::string &gtids) noexcept {
+  if (gtids.empty()) {
+    return false;
+  }
+  // UUIDs, tags, intervals and the separators; the server puts line
+  // breaks after the commas
+  return std::all_of(gtids.begin(), gtids.end(), [](char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == ':' || c == '-' ||
+           c == ',' || c == '_' || c == '\n' || c == ' ';
+  });
+}
+
+GtidRegistry& GtidRegistry::instance() {
+  static GtidRegistry instance_;
+  return instance_;
+}
+
+void GtidRegistry::expire(clock_type::time_point now) {
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    if (now - it->second.recorded_at >= max_age_) {
+      it = entries_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void GtidRegistry::record(const std::string &client_host, const std::string &gtids) {
+  const auto now = clock_type::now();
+
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto it = entries_.find(client_host);
+  if (it == entries_.end()) {
+    if (entries_.size() >= max_entries_) {
+      expire(now);
+      if (entries_.size() >= max_entries_) {
+        // the reads of this host aren't made to wait then
+        log_module_debug(LOG_MODULE_ROUTING, "Too many client hosts to track GTIDs, not tracking '%s'",
+                         client_host.c_str());
+        return;
+      }
+    }
+    it = entries_.emplace(client_host, Entry()).first;
+  }
+  it->second.gtids = gtids;
+  it->second.recorded_at = now;
+  it->second.replicas_behind = false;
+}
+
+GtidRegistry::Pending GtidRegistry::get(const std::string &client_host) {
+  Pending pending;
+
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto it = entries_.find(client_host);
+  if (it == entries_.end()) {
+    return pending;
+  }
+  if (clock_type::now() - it->second.recorded_at >= max_age_) {
+    entries_.erase(it);
+    return pending;
+  }
+  pending.gtids = it->second.gtids;
+  pending.replicas_behind = it->second.replicas_behind;
+  return pending;
+}
+
+void GtidRegistry::mark_replicas_behind(const std::string &client_host, const std::string &gtids) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto it = entries_.find(client_host);
+  if (it != entries_.end() && it->second.gtids == gtids) {
+    it->second.replicas_behind = true;
+  }
+}
+
+size_t GtidRegistry::size() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return entries_.size();
+}
+
+ssize_t GtidTrackingSocketOperations::read(int fd, void *buffer, size_t nbyte) {
+  const ssize_t res = socket_operations_->read(fd, buffer, nbyte);
+  if (res > 0) {
+    if (fd == client_) {
+      on_client_data(static_cast<const uint8_t*>(buffer), static_cast<size_t>(res));
+    } else if (fd == server_) {
+      on_server_data(static_cast<const uint8_t*>(buffer), static_cast<size_t>(res));
+    }
+  }
+  return res;
+}
+
+void GtidTrackingSocketOperations::on_client_data(const uint8_t *data, size_t size) {
+  while (size > 0) {
+    if (client_payload_left_ == 0) {
+      // header of the next packet
+      const size_t n = std::min(size, kHeaderSize - client_header_size_);
+      std::memcpy(client_header_ + client_header_size_, data, n);
+      client_header_size_ += n;
+      data += n;
+      size -= n;
+      if (client_header_size_ < kHeaderSize) {
+        return;
+      }
+      client_header_size_ = 0;
+      client_payload_left_ = static_cast<size_t>(client_header_[0]) |
+                             static_cast<size_t>(client_header_[1]) << 8 |
+                             static_cast<size_t>(client_header_[2]) << 16;
+      // a new command starts with sequence id 0
+      client_command_next_ = client_header_[3] == 0 && client_payload_left_ > 0;
+      continue;
+    }
+
+    if (client_command_next_) {
+      client_command_next_ = false;
+      const auto command = static_cast<mysql_protocol::Command>(data[0]);
+      // the responses to other commands don't carry the GTIDs of writes
+      watch_response_ = command == mysql_protocol::Command::kQuery ||
+                        command == mysql_protocol::Command::kStmtExecute;
+      response_.clear();
+    }
+
+    const size_t n = std::min(size, client_payload_left_);
+    client_payload_left_ -= n;
+    data += n;
+    size -= n;
+  }
+}
+
+void GtidTrackingSocketOperations::on_server_data(const uint8_t *data, size_t size) {
+  if (!watch_response_) {
+    return;
+  }
+
+  if (response_.size() < kHeaderSize + 1) {
+    const size_t n = std::min(size, kHeaderSize + 1 - response_.size());
+    response_.insert(response_.end(), data, data + n);
+    data += n;
+    size -= n;
+    if (response_.size() < kHeaderSize + 1) {
+      return;
+    }
+  }
+
+  const size_t packet_size = kHeaderSize + (static_cast<size_t>(response_[0]) |
+                                            static_cast<size_t>(response_[1]) << 8 |
+                                            static_cast<size_t>(response_[2]) << 16);
+  // resultsets, errors, ... only OK packets report GTIDs
+  if (response_[kHeaderSize] != 0x00 || packet_size > kMaxOkPacketSize) {
+    watch_response_ = false;
+    response_.clear();
+    return;
+  }
+
+  const size_t n = std::min(size, packet_size - response_.size());
+  response_.insert(response_.end(), data, data + n);
+  if (response_.size() < packet_size) {
+    return;
+  }
+  watch_response_ = false;
+
+  std::string gtids;
+  try {
+    // the server only sends session state changes if the client asked for them
+    mysql_protocol::OkPacket ok(response_, mysql_protocol::kClientProtocol41 |
+                                           mysql_protocol::kClientSessionTrack);
+    gtids = ok.get_tracked_gtids();
+  } catch (const mysql_protocol::packet_error &exc) {
+    log_module_debug(LOG_MODULE_ROUTING, "fd=%d ignoring OK packet: %s", server_, exc.what());
+  }
+  response_.clear();
+
+  if (is_valid_gtid_set(gtids)) {
+    registry_.record(client_host_, gtids);
+  }
+}
+
+} // namespace routing
@@ -0,0 +1,211 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_READ_YOUR_WRITES_INCLUDED
+#define ROUTING_READ_YOUR_WRITES_INCLUDED
+
+#include "mysqlrouter/routing.h"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace routing {
+
+/** @brief Returns whether a string looks like a GTID set
+ *
+ * Only what the server returns for session tracking passes, so that the
+ * set can be put into an SQL string literal as is.
+ */
+bool is_valid_gtid_set(const std::string &gtids) noexcept;
+
+/** @class GtidRegistry
+ * @brief GTIDs of the last writes of the clients, by client host
+ *
+ * The read-write routes record the GTID the server reported for the last
+ * transaction a client committed (`session_track_gtids=OWN_GTID`). The
+ * read-only routes look it up when the same host connects, so that the
+ * secondary can be made to wait until it applied that transaction.
+ *
+ * Connections of a client to different routes can't be matched, and the
+ * read-only route picks the server before the client authenticated, so
+ * clients are told apart by their host only: reads of a host wait for the
+ * writes of all connections from that host. Hence the scope has to be
+ * chosen explicitly with `read_your_writes_scope=host`.
+ *
+ * Only the last GTID of a host is kept. Waiting for it covers the earlier
+ * writes of the host as long as the secondaries apply the transactions in
+ * the order the primary committed them. Group Replication members do, their
+ * multi-threaded applier requires `slave_preserve_commit_order=ON`; if the
+ * order isn't preserved, a read may miss an earlier write of another
+ * connection of the host.
+ *
+ * Entries are dropped after `max_age`; by then all secondaries are expected
+ * to have caught up.
+ */
+class GtidRegistry {
+ public:
+  using clock_type = std::chrono::steady_clock;
+
+  /** @brief What a read-only connection has to wait for */
+  struct Pending {
+    /** @brief GTID set of the last write; empty if there is nothing to wait for */
+    std::string gtids;
+    /** @brief Whether a secondary already failed to apply it in time */
+    bool replicas_behind = false;
+  };
+
+  /** @brief Constructor
+   *
+   * @param max_age how long the GTID of a write is remembered
+   * @param max_entries number of client hosts remembered at most
+   */
+  explicit GtidRegistry(std::chrono::milliseconds max_age = std::chrono::seconds(60),
+                        size_t max_entries = 100000)
+      : max_age_(max_age), max_entries_(max_entries) {}
+
+  GtidRegistry(const GtidRegistry&) = delete;
+  GtidRegistry& operator=(const GtidRegistry&) = delete;
+
+  /** @brief Returns the registry shared by all routes of the process */
+  static GtidRegistry& instance();
+
+  /** @brief Records the GTID set of the last write of a client host
+   *
+   * Replaces the GTIDs recorded before for the host instead of merging
+   * them, see the commit order assumption above.
+   */
+  void record(const std::string &client_host, const std::string &gtids);
+
+  /** @brief Returns what a new read-only connection of a client host has to wait for */
+  Pending get(const std::string &client_host);
+
+  /** @brief Remembers that a secondary didn't apply the writes in time
+   *
+   * Further read-only connections of the host go to the primary until it
+   * writes again or the entry expires. Ignored if the host wrote again in
+   * the meantime.
+   */
+  void mark_replicas_behind(const std::string &client_host, const std::string &gtids);
+
+  /** @brief Returns the number of client hosts remembered */
+  size_t size();
+
+ private:
+  struct Entry {
+    std::string gtids;
+    clock_type::time_point recorded_at;
+    bool replicas_behind;
+  };
+
+  // drops expired entries; caller holds mtx_
+  void expire(clock_type::time_point now);
+
+  const std::chrono::milliseconds max_age_;
+  const size_t max_entries_;
+  std::mutex mtx_;
+  std::unordered_map<std::string, Entry> entries_;
+};
+
+/** @class GtidTrackingSocketOperations
+ * @brief Socket operations which record the GTIDs the server reports to the client
+ *
+ * Wraps the socket operations of an established classic protocol
+ * connection. Follows the client's packets to find the start of each
+ * query; if the server answers it with an OK packet carrying tracked
+ * GTIDs, they get recorded in the registry for the client's host.
+ *
+ * Only the first packet of a response is looked at, GTIDs of further
+ * results of multi-statements are missed. Everything else is passed on to
+ * the wrapped socket operations.
+ */
+class GtidTrackingSocketOperations : public SocketOperationsBase {
+ public:
+  GtidTrackingSocketOperations(SocketOperationsBase *socket_operations, int client, int server,
+                               const std::string &client_host, GtidRegistry &registry)
+      : socket_operations_(socket_operations), client_(client), server_(server),
+        client_host_(client_host), registry_(registry) {}
+
+  int get_mysql_socket(mysqlrouter::TCPAddress addr, std::chrono::milliseconds connect_timeout_ms,
+                       bool log = true) noexcept override {
+    return socket_operations_->get_mysql_socket(addr, connect_timeout_ms, log);
+  }
+
+  ssize_t write(int fd, void *buffer, size_t nbyte) override {
+    return socket_operations_->write(fd, buffer, nbyte);
+  }
+
+  ssize_t read(int fd, void *buffer, size_t nbyte) override;
+
+  void close(int fd) override { socket_operations_->close(fd); }
+  void shutdown(int fd) override { socket_operations_->shutdown(fd); }
+  void freeaddrinfo(addrinfo *ai) override { socket_operations_->freeaddrinfo(ai); }
+
+  int getaddrinfo(const char *node, const char *service, const addrinfo *hints, addrinfo **res) override {
+    return socket_operations_->getaddrinfo(node, service, hints, res);
+  }
+
+  int bind(int fd, const struct sockaddr *addr, socklen_t len) override {
+    return socket_operations_->bind(fd, addr, len);
+  }
+
+  int socket(int domain, int type, int protocol) override {
+    return socket_operations_->socket(domain, type, protocol);
+  }
+
+  int setsockopt(int fd, int level, int optname, const void *optval, socklen_t optlen) override {
+    return socket_operations_->setsockopt(fd, level, optname, optval, optlen);
+  }
+
+  int listen(int fd, int n) override { return socket_operations_->listen(fd, n); }
+  int get_errno() override { return socket_operations_->get_errno(); }
+  void set_errno(int e) override { socket_operations_->set_errno(e); }
+
+  int poll(struct pollfd *fds, nfds_t nfds, std::chrono::milliseconds timeout) override {
+    return socket_operations_->poll(fds, nfds, timeout);
+  }
+
+ private:
+  void on_client_data(const uint8_t *data, size_t size);
+  void on_server_data(const uint8_t *data, size_t size);
+
+  SocketOperationsBase *socket_operations_;
+  const int client_;
+  const int server_;
+  const std::string client_host_;
+  GtidRegistry &registry_;
+
+  // header of the client packet being read
+  uint8_t client_header_[4];
+  size_t client_header_size_ = 0;
+  // payload bytes of the current client packet still to come
+  size_t client_payload_left_ = 0;
+  // whether the next payload byte is a command
+  bool client_command_next_ = false;
+
+  // whether the next server data starts the response to a query
+  bool watch_response_ = false;
+  // first packet of the response, as far as it was read
+  std::vector<uint8_t> response_;
+};
+
+} // namespace routing
+
+#endif // ROUTING_READ_YOUR_WRITES_INCLUDED
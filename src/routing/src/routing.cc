@@ -34,6 +34,7 @@
 # include <netinet/tcp.h>
 # include <sys/socket.h>
 # include <poll.h>
+# include <sys/resource.h>
 #else
 # define WIN32_LEAN_AND_MEAN
 # include <windows.h>
@@ -54,6 +55,12 @@ const std::string kDefaultBindAddress = "127.0.0.1";
 const unsigned int kDefaultNetBufferLength = 16384;  // Default defined in latest MySQL Server
 const unsigned long long kDefaultMaxConnectErrors = 100;  // Similar to MySQL Server
 const std::chrono::seconds kDefaultClientConnectTimeout { 9 }; // Default connect_timeout MySQL Server minus 1
+const std::chrono::seconds kDefaultDrainTimeout { 0 };
+const unsigned int kDefaultMaxTotalConnections = 0; // 0 = no router-wide limit
+const uint64_t kReservedFileDescriptors = 128;
+const unsigned int kDefaultClientSslSessionCacheSize = 1024;
+const unsigned int kDefaultLocationMinServers = 1;
+const std::chrono::milliseconds kDefaultReadYourWritesTimeout { 0 };
 
 // unused constant
 // const int kMaxConnectTimeout = INT_MAX / 1000;
@@ -104,6 +111,32 @@ void set_socket_blocking(int sock, bool blocking) {
 #endif
 }
 
+uint64_t ensure_open_files_limit(uint64_t wanted) {
+#ifndef _WIN32
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == -1) {
+    return 0;
+  }
+  if (limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < wanted) {
+    rlim_t raised = static_cast<rlim_t>(wanted);
+    if (limit.rlim_max != RLIM_INFINITY && raised > limit.rlim_max) {
+      raised = limit.rlim_max;
+    }
+    if (raised > limit.rlim_cur) {
+      struct rlimit new_limit = limit;
+      new_limit.rlim_cur = raised;
+      if (setrlimit(RLIMIT_NOFILE, &new_limit) == 0) {
+        limit = new_limit;
+      }
+    }
+  }
+  return limit.rlim_cur == RLIM_INFINITY ? UINT64_MAX : static_cast<uint64_t>(limit.rlim_cur);
+#else
+  (void)wanted;
+  return UINT64_MAX;
+#endif
+}
+
 SocketOperations* SocketOperations::instance() {
   static SocketOperations instance_;
   return &instance_;
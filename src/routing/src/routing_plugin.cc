@@ -15,8 +15,10 @@
   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
+#include "connection_budget.h"
 #include "plugin_config.h"
 #include "mysql_routing.h"
+#include "tls_termination.h"
 #include "utils.h"
 
 #include "logger.h"
@@ -24,7 +26,9 @@
 
 #include <atomic>
 #include <iostream>
+#include <map>
 #include <mutex>
+#include <set>
 #include <vector>
 
 using mysql_harness::AppInfo;
@@ -41,6 +45,13 @@ const char *kRoutingRequires[1] = {
     "logger",
 };
 
+// running routing services by section name, so that stop() can reach them
+static std::mutex g_routings_mutex;
+static std::map<std::string, MySQLRouting*> g_routings;
+static std::map<std::string, std::chrono::milliseconds> g_drain_timeouts;
+// routing services stop() was called for before they got registered
+static std::set<std::string> g_stopped_routings;
+
 static void validate_socket_info(const std::string& err_prefix,
                                  const mysql_harness::ConfigSection* section,
                                  const RoutingPluginConfig& config) {
@@ -99,11 +110,34 @@ void validate_socket_info_test_proxy(const std::string& err_prefix, const mysql_
   validate_socket_info(err_prefix, section, config);
 }
 
+// each routed connection needs a socket to the client and one to the server
+static void ensure_open_files(uint64_t sum_max_connections, unsigned int max_total_connections) {
+  uint64_t connections = sum_max_connections;
+  if (max_total_connections > 0 && max_total_connections < connections) {
+    connections = max_total_connections;
+  }
+  const uint64_t wanted = 2 * connections + routing::kReservedFileDescriptors;
+
+  const uint64_t limit = routing::ensure_open_files_limit(wanted);
+  if (limit < wanted) {
+    log_warning("open files limit is %llu, but up to %llu connections need %llu file descriptors;"
+                " raise the hard limit (ulimit -Hn) or lower max_connections/max_total_connections",
+                static_cast<unsigned long long>(limit), static_cast<unsigned long long>(connections),
+                static_cast<unsigned long long>(wanted));
+  } else {
+    log_debug("open files limit is %llu (%llu needed)", static_cast<unsigned long long>(limit),
+              static_cast<unsigned long long>(wanted));
+  }
+}
+
 static int init(const mysql_harness::AppInfo *info) {
   if (info->config != nullptr) {
     bool have_metadata_cache = false;
     bool need_metadata_cache = false;
     std::vector<TCPAddress> bind_addresses;
+    bool have_routing = false;
+    unsigned int max_total_connections = routing::kDefaultMaxTotalConnections;
+    uint64_t sum_max_connections = 0;
     for (const mysql_harness::ConfigSection* &section: info->config->sections()) {
       if (section->name == kSectionName) {
         string err_prefix = mysqlrouter::string_format("in [%s%s%s]: ", section->name.c_str(),
@@ -113,6 +147,15 @@ static int init(const mysql_harness::AppInfo *info) {
         RoutingPluginConfig config(section);                // throws std::invalid_argument
         validate_socket_info(err_prefix, section, config);  // throws std::invalid_argument
 
+        // the budget is shared by all routes, so they have to agree on it
+        if (have_routing && config.max_total_connections != max_total_connections) {
+          throw std::invalid_argument(err_prefix + "max_total_connections has to be the same for all routing "
+                                      "sections (set it in [DEFAULT])");
+        }
+        have_routing = true;
+        max_total_connections = config.max_total_connections;
+        sum_max_connections += static_cast<uint64_t>(config.max_connections);
+
         // ensure that TCP port is unique
         if (config.bind_address.port) {
 
@@ -155,6 +198,11 @@ static int init(const mysql_harness::AppInfo *info) {
       throw std::invalid_argument("Routing needs Metadata Cache, but no none "
                                   "was found in configuration.");
     }
+
+    if (have_routing) {
+      routing::ConnectionBudget::instance().set_limit(max_total_connections);
+      ensure_open_files(sum_max_connections, max_total_connections);
+    }
   }
   g_app_info = info;
   return 0;
@@ -176,19 +224,51 @@ static void start(const ConfigSection *section) {
     //
     std::chrono::milliseconds destination_connect_timeout(config.connect_timeout * 1000);
     std::chrono::milliseconds client_connect_timeout(config.client_connect_timeout * 1000);
+    std::chrono::milliseconds drain_timeout(config.drain_timeout * 1000);
 
     MySQLRouting r(config.mode,                config.bind_address.port,
                    config.protocol,
                    config.bind_address.addr,   config.named_socket,
                    name,                       config.max_connections,
                    destination_connect_timeout, config.max_connect_errors,
-                   client_connect_timeout);
+                   client_connect_timeout,     config.net_buffer_length);
+    r.set_cpu_affinity(config.acceptor_cpus, config.connection_cpus);
+    r.set_location(config.location, config.location_min_servers);
+    r.set_read_your_writes_timeout(std::chrono::milliseconds(config.read_your_writes_timeout));
+    if (!config.client_ssl_cert.empty()) {
+      // throws std::runtime_error if the certificate or key can't be used
+      r.set_tls_context(std::unique_ptr<routing::TlsServerContext>(new routing::TlsServerContext(
+          config.client_ssl_cert, config.client_ssl_key, config.client_ssl_cipher,
+          config.client_ssl_session_cache_size, name)));
+    }
+    if (config.read_your_writes_timeout > 0 && config.mode == routing::AccessMode::kReadWrite &&
+        config.protocol == Protocol::Type::kClassicProtocol && config.client_ssl_cert.empty()) {
+      // TLS is passed through to the server, the OK packets can't be read
+      log_warning("[%s] read_your_writes_timeout ignores the writes of clients using TLS: set "
+                  "client_ssl_cert and client_ssl_key to terminate TLS at the router", name.c_str());
+    }
     try {
       // don't allow rootless URIs as we did already in the get_option_destinations()
       r.set_destinations_from_uri(URI(config.destinations, false));
     } catch (URIError) {
       r.set_destinations_from_csv(config.destinations);
     }
+
+    {
+      std::lock_guard<std::mutex> lock(g_routings_mutex);
+      if (g_stopped_routings.count(name)) {
+        // the router got stopped while the route was being set up
+        return;
+      }
+      g_routings[name] = &r;
+      g_drain_timeouts[name] = drain_timeout;
+    }
+    std::shared_ptr<void> exit_guard(nullptr, [&name](void*) {
+      std::lock_guard<std::mutex> lock(g_routings_mutex);
+      g_routings.erase(name);
+      g_drain_timeouts.erase(name);
+    });
+
     r.start();
   } catch (const std::invalid_argument &exc) {
     log_error(exc.what());
@@ -198,6 +278,22 @@ static void start(const ConfigSection *section) {
   }
 }
 
+static void stop(const ConfigSection *section) {
+  string name = section->name;
+  if (!section->key.empty()) {
+    name += ":" + section->key;
+  }
+
+  std::lock_guard<std::mutex> lock(g_routings_mutex);
+  auto it = g_routings.find(name);
+  if (it != g_routings.end()) {
+    it->second->stop(g_drain_timeouts[name]);
+  } else {
+    // start() didn't register the route yet, or it ended already
+    g_stopped_routings.insert(name);
+  }
+}
+
 extern "C" {
   mysql_harness::Plugin ROUTING_API harness_plugin_routing = {
       mysql_harness::PLUGIN_ABI_VERSION,
@@ -209,6 +305,6 @@ extern "C" {
       init,       // init
       nullptr,    // deinit
       start,      // start
-      nullptr     // stop
+      stop        // stop
   };
 }
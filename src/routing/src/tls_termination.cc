@@ -0,0 +1,280 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "tls_termination.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <stdexcept>
+
+#if defined(HAVE_OPENSSL) && !defined(HAVE_YASSL)
+#  include <openssl/err.h>
+#  include <openssl/ssl.h>
+#  if OPENSSL_VERSION_NUMBER >= 0x10100000L
+#    define ROUTING_HAVE_TLS_TERMINATION
+#  endif
+#endif
+
+namespace routing {
+
+#ifdef ROUTING_HAVE_TLS_TERMINATION
+
+namespace {
+
+// collects and clears the OpenSSL error queue of the thread
+std::string get_ssl_errors(const std::string &prefix) {
+  std::string result = prefix;
+  unsigned long err;
+  while ((err = ERR_get_error()) != 0) {
+    char buf[256];
+    ERR_error_string_n(err, buf, sizeof(buf));
+    result += (result == prefix) ? ": " : "; ";
+    result += buf;
+  }
+  return result;
+}
+
+} // namespace
+
+struct TlsServerContext::Impl {
+  SSL_CTX *ctx = nullptr;
+
+  ~Impl() {
+    if (ctx) SSL_CTX_free(ctx);
+  }
+};
+
+struct TlsConnection::Impl {
+  SSL *ssl = nullptr;
+
+  ~Impl() {
+    if (ssl) SSL_free(ssl);
+  }
+};
+
+TlsServerContext::TlsServerContext(const std::string &cert_file, const std::string &key_file,
+                                   const std::string &cipher_list, size_t session_cache_size,
+                                   const std::string &session_id_context)
+    : impl_(new Impl), handshakes_(0), resumed_(0) {
+  ERR_clear_error();
+
+  SSL_CTX *ctx = impl_->ctx = SSL_CTX_new(TLS_server_method());
+  if (ctx == nullptr) {
+    throw std::runtime_error(get_ssl_errors("creating TLS context failed"));
+  }
+
+  SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+  SSL_CTX_set_options(ctx, SSL_OP_CIPHER_SERVER_PREFERENCE);
+#ifdef SSL_OP_NO_RENEGOTIATION
+  SSL_CTX_set_options(ctx, SSL_OP_NO_RENEGOTIATION);
+#endif
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+  // most clients just close the socket, that's not an error
+  SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+#ifdef SSL_OP_ENABLE_KTLS
+  // OpenSSL falls back to userspace encryption if the kernel can't do it
+  SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+  // the forwarding queue may retry writes from a different position
+  SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+  if (SSL_CTX_use_certificate_chain_file(ctx, cert_file.c_str()) != 1) {
+    throw std::runtime_error(get_ssl_errors("loading certificate '" + cert_file + "' failed"));
+  }
+  if (SSL_CTX_use_PrivateKey_file(ctx, key_file.c_str(), SSL_FILETYPE_PEM) != 1) {
+    throw std::runtime_error(get_ssl_errors("loading private key '" + key_file + "' failed"));
+  }
+  if (SSL_CTX_check_private_key(ctx) != 1) {
+    throw std::runtime_error(get_ssl_errors("private key '" + key_file + "' doesn't match the certificate"));
+  }
+  if (!cipher_list.empty() && SSL_CTX_set_cipher_list(ctx, cipher_list.c_str()) != 1) {
+    throw std::runtime_error(get_ssl_errors("invalid cipher list '" + cipher_list + "'"));
+  }
+
+  if (session_cache_size > 0) {
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, static_cast<long>(std::min<size_t>(session_cache_size, LONG_MAX)));
+
+    // sessions of one route must not be resumed on another one
+    const size_t sid_ctx_len = std::min<size_t>(session_id_context.size(), SSL_MAX_SID_CTX_LENGTH);
+    SSL_CTX_set_session_id_context(ctx, reinterpret_cast<const unsigned char*>(session_id_context.data()),
+                                   static_cast<unsigned int>(sid_ctx_len));
+  } else {
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+  }
+}
+
+TlsServerContext::~TlsServerContext() = default;
+
+bool TlsServerContext::is_supported() noexcept {
+  return true;
+}
+
+TlsConnection::TlsConnection(TlsServerContext &context, int fd, SocketOperationsBase *socket_operations)
+    : impl_(new Impl), context_(context), fd_(fd), socket_operations_(socket_operations) {
+  ERR_clear_error();
+  impl_->ssl = SSL_new(context.impl_->ctx);
+  if (impl_->ssl == nullptr || SSL_set_fd(impl_->ssl, fd) != 1) {
+    throw std::runtime_error(get_ssl_errors("creating TLS session failed"));
+  }
+}
+
+TlsConnection::~TlsConnection() = default;
+
+bool TlsConnection::accept() {
+  ERR_clear_error();
+  const int res = SSL_accept(impl_->ssl);
+  if (res != 1) {
+    const int ssl_error = SSL_get_error(impl_->ssl, res);
+    if (ssl_error == SSL_ERROR_SYSCALL && ERR_peek_error() == 0) {
+      error_ = (res == 0) ? "TLS handshake failed: connection closed"
+                          : "TLS handshake failed: " + get_message_error(socket_operations_->get_errno());
+    } else {
+      error_ = get_ssl_errors("TLS handshake failed");
+    }
+    return false;
+  }
+
+  ++context_.handshakes_;
+  if (is_resumed()) {
+    ++context_.resumed_;
+  }
+  return true;
+}
+
+bool TlsConnection::set_errno_from(int ssl_error) {
+  switch (ssl_error) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+#ifdef _WIN32
+      socket_operations_->set_errno(WSAEWOULDBLOCK);
+#else
+      socket_operations_->set_errno(EAGAIN);
+#endif
+      return true;
+    case SSL_ERROR_SYSCALL:
+      // errno was set by the failed socket call
+      if (ERR_peek_error() == 0) {
+        return false;
+      }
+      // fallthrough
+    default:
+      error_ = get_ssl_errors("TLS error");
+#ifdef _WIN32
+      socket_operations_->set_errno(WSAECONNABORTED);
+#else
+      socket_operations_->set_errno(EPROTO);
+#endif
+      return false;
+  }
+}
+
+ssize_t TlsConnection::read(void *buffer, size_t nbyte) {
+  ERR_clear_error();
+  const int res = SSL_read(impl_->ssl, buffer, static_cast<int>(std::min<size_t>(nbyte, INT_MAX)));
+  if (res > 0) {
+    return res;
+  }
+
+  const int ssl_error = SSL_get_error(impl_->ssl, res);
+  if (ssl_error == SSL_ERROR_ZERO_RETURN) {
+    // the caller assumes that errno == 0 on plain connection closes.
+    socket_operations_->set_errno(0);
+    return 0;
+  }
+  set_errno_from(ssl_error);
+  return -1;
+}
+
+ssize_t TlsConnection::write(const void *buffer, size_t nbyte) {
+  ERR_clear_error();
+  const int res = SSL_write(impl_->ssl, buffer, static_cast<int>(std::min<size_t>(nbyte, INT_MAX)));
+  if (res > 0) {
+    return res;
+  }
+
+  set_errno_from(SSL_get_error(impl_->ssl, res));
+  return -1;
+}
+
+size_t TlsConnection::pending() const {
+  return static_cast<size_t>(SSL_pending(impl_->ssl));
+}
+
+void TlsConnection::shutdown() {
+  ERR_clear_error();
+  SSL_shutdown(impl_->ssl);
+  ERR_clear_error();
+}
+
+bool TlsConnection::is_resumed() const {
+  return SSL_session_reused(impl_->ssl) == 1;
+}
+
+bool TlsConnection::is_kernel_tls() const {
+#ifdef BIO_get_ktls_send
+  return BIO_get_ktls_send(SSL_get_wbio(impl_->ssl)) != 0;
+#else
+  return false;
+#endif
+}
+
+std::string TlsConnection::get_description() const {
+  return std::string(SSL_get_version(impl_->ssl)) + " " + SSL_get_cipher_name(impl_->ssl);
+}
+
+#else  // !ROUTING_HAVE_TLS_TERMINATION
+
+struct TlsServerContext::Impl {};
+struct TlsConnection::Impl {};
+
+TlsServerContext::TlsServerContext(const std::string &, const std::string &, const std::string &,
+                                   size_t, const std::string &)
+    : handshakes_(0), resumed_(0) {
+  throw std::runtime_error("TLS termination requires MySQL Router to be built with OpenSSL 1.1.0 or later");
+}
+
+TlsServerContext::~TlsServerContext() = default;
+
+bool TlsServerContext::is_supported() noexcept {
+  return false;
+}
+
+TlsConnection::TlsConnection(TlsServerContext &context, int fd, SocketOperationsBase *socket_operations)
+    : context_(context), fd_(fd), socket_operations_(socket_operations) {
+  throw std::runtime_error("TLS termination is not supported");
+}
+
+TlsConnection::~TlsConnection() = default;
+
+bool TlsConnection::accept() { return false; }
+bool TlsConnection::set_errno_from(int) { return false; }
+ssize_t TlsConnection::read(void *, size_t) { return -1; }
+ssize_t TlsConnection::write(const void *, size_t) { return -1; }
+size_t TlsConnection::pending() const { return 0; }
+void TlsConnection::shutdown() {}
+bool TlsConnection::is_resumed() const { return false; }
+bool TlsConnection::is_kernel_tls() const { return false; }
+std::string TlsConnection::get_description() const { return ""; }
+
+#endif // ROUTING_HAVE_TLS_TERMINATION
+
+} // namespace routing
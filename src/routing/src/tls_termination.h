@@ -0,0 +1,218 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_TLS_TERMINATION_INCLUDED
+#define ROUTING_TLS_TERMINATION_INCLUDED
+
+/** @file
+ * @brief TLS termination of client connections at the router
+ *
+ * Clients talk TLS to the router, the router talks plaintext to the
+ * servers. Requires a build against OpenSSL 1.1.0 or later; with the
+ * bundled yaSSL is_supported() returns false.
+ */
+
+#include "mysqlrouter/routing.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace routing {
+
+/** @class TlsServerContext
+ * @brief Certificate, key and session cache shared by the TLS connections
+ *        of a route
+ *
+ * Sessions are cached in memory (session IDs) and session tickets are
+ * issued, so that clients reconnecting within the session timeout get an
+ * abbreviated handshake. If the kernel and OpenSSL support it, encryption
+ * is offloaded to the kernel (kTLS).
+ */
+class TlsServerContext {
+ public:
+  /** @brief Constructor
+   *
+   * @param cert_file PEM file with the certificate (chain) to present
+   * @param key_file PEM file with the private key
+   * @param cipher_list OpenSSL cipher list for TLS <= 1.2 (empty: OpenSSL default)
+   * @param session_cache_size max number of sessions cached (0: no session cache)
+   * @param session_id_context identifies the route in cached sessions
+   *
+   * @throws std::runtime_error if TLS is not supported or a file can't be loaded
+   */
+  TlsServerContext(const std::string &cert_file, const std::string &key_file,
+                   const std::string &cipher_list, size_t session_cache_size,
+                   const std::string &session_id_context);
+
+  ~TlsServerContext();
+
+  TlsServerContext(const TlsServerContext&) = delete;
+  TlsServerContext& operator=(const TlsServerContext&) = delete;
+
+  /** @brief Returns whether the router was built with TLS termination support */
+  static bool is_supported() noexcept;
+
+  /** @brief Number of handshakes that completed, resumed ones included */
+  uint64_t get_handshakes() const noexcept { return handshakes_.load(); }
+
+  /** @brief Number of handshakes that resumed a cached session or ticket */
+  uint64_t get_resumed() const noexcept { return resumed_.load(); }
+
+ private:
+  friend class TlsConnection;
+
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+
+  std::atomic<uint64_t> handshakes_;
+  std::atomic<uint64_t> resumed_;
+};
+
+/** @class TlsConnection
+ * @brief Server side of the TLS session of one client connection
+ *
+ * read() and write() work on blocking and non-blocking sockets. On a
+ * non-blocking socket they fail with the "would block" errno of the
+ * platform, like the socket functions do.
+ */
+class TlsConnection {
+ public:
+  /** @brief Constructor
+   *
+   * @param context context of the route
+   * @param fd connected client socket
+   * @param socket_operations used to report errors through errno
+   *
+   * @throws std::runtime_error if the session can't be created
+   */
+  TlsConnection(TlsServerContext &context, int fd, SocketOperationsBase *socket_operations);
+
+  ~TlsConnection();
+
+  TlsConnection(const TlsConnection&) = delete;
+  TlsConnection& operator=(const TlsConnection&) = delete;
+
+  /** @brief Does the server side of the TLS handshake (blocking)
+   *
+   * @return true on success; false on error, see get_error()
+   */
+  bool accept();
+
+  ssize_t read(void *buffer, size_t nbyte);
+
+  ssize_t write(const void *buffer, size_t nbyte);
+
+  /** @brief Returns number of decrypted bytes that can be read without
+   *         touching the socket
+   */
+  size_t pending() const;
+
+  /** @brief Sends close_notify to the client (best effort) */
+  void shutdown();
+
+  /** @brief Returns the client socket */
+  int fd() const noexcept { return fd_; }
+
+  /** @brief Returns whether the session was resumed */
+  bool is_resumed() const;
+
+  /** @brief Returns whether the kernel encrypts what is sent (kTLS) */
+  bool is_kernel_tls() const;
+
+  /** @brief Returns the negotiated protocol version and cipher */
+  std::string get_description() const;
+
+  /** @brief Returns the reason of the last failure */
+  const std::string &get_error() const noexcept { return error_; }
+
+ private:
+  // maps an SSL error to errno; returns false for errors other than
+  // "would block"
+  bool set_errno_from(int ssl_error);
+
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+
+  TlsServerContext &context_;
+  const int fd_;
+  SocketOperationsBase *socket_operations_;
+  std::string error_;
+};
+
+/** @class TlsSocketOperations
+ * @brief Socket operations which read and write the client socket through
+ *        its TLS session
+ *
+ * Everything else is passed on to the wrapped socket operations, so the
+ * forwarding code doesn't need to know whether a connection is encrypted.
+ */
+class TlsSocketOperations : public SocketOperationsBase {
+ public:
+  TlsSocketOperations(SocketOperationsBase *socket_operations, TlsConnection *tls)
+      : socket_operations_(socket_operations), tls_(tls) {}
+
+  int get_mysql_socket(mysqlrouter::TCPAddress addr, std::chrono::milliseconds connect_timeout_ms,
+                       bool log = true) noexcept override {
+    return socket_operations_->get_mysql_socket(addr, connect_timeout_ms, log);
+  }
+
+  ssize_t write(int fd, void *buffer, size_t nbyte) override {
+    return (fd == tls_->fd()) ? tls_->write(buffer, nbyte) : socket_operations_->write(fd, buffer, nbyte);
+  }
+
+  ssize_t read(int fd, void *buffer, size_t nbyte) override {
+    return (fd == tls_->fd()) ? tls_->read(buffer, nbyte) : socket_operations_->read(fd, buffer, nbyte);
+  }
+
+  void close(int fd) override { socket_operations_->close(fd); }
+  void shutdown(int fd) override { socket_operations_->shutdown(fd); }
+  void freeaddrinfo(addrinfo *ai) override { socket_operations_->freeaddrinfo(ai); }
+
+  int getaddrinfo(const char *node, const char *service, const addrinfo *hints, addrinfo **res) override {
+    return socket_operations_->getaddrinfo(node, service, hints, res);
+  }
+
+  int bind(int fd, const struct sockaddr *addr, socklen_t len) override {
+    return socket_operations_->bind(fd, addr, len);
+  }
+
+  int socket(int domain, int type, int protocol) override {
+    return socket_operations_->socket(domain, type, protocol);
+  }
+
+  int setsockopt(int fd, int level, int optname, const void *optval, socklen_t optlen) override {
+    return socket_operations_->setsockopt(fd, level, optname, optval, optlen);
+  }
+
+  int listen(int fd, int n) override { return socket_operations_->listen(fd, n); }
+  int get_errno() override { return socket_operations_->get_errno(); }
+  void set_errno(int e) override { socket_operations_->set_errno(e); }
+
+  int poll(struct pollfd *fds, nfds_t nfds, std::chrono::milliseconds timeout) override {
+    return socket_operations_->poll(fds, nfds, timeout);
+  }
+
+ private:
+  SocketOperationsBase *socket_operations_;
+  TlsConnection *tls_;
+};
+
+} // namespace routing
+
+#endif // ROUTING_TLS_TERMINATION_INCLUDED
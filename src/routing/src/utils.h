@@ -54,6 +54,17 @@ void * get_in_addr(struct sockaddr *addr);
  */
 std::pair<std::string, int > get_peer_name(int sock);
 
+/**
+ * Get IP address stored in a sockaddr_storage struct as string
+ *
+ * Unlike get_peer_name() this still works after the peer closed the
+ * connection.
+ *
+ * @param addr a sockaddr_storage struct, as filled by accept()
+ * @return IPv4 or IPv6 address, "unix socket" for Unix sockets
+ */
+std::string get_addr_str(const sockaddr_storage &addr);
+
 /**
  * Splits a string using a delimiter
  *
@@ -61,6 +61,23 @@ protected:
   }
 };
 
+// used for the log and the blocked host when the client is gone already
+TEST_F(TestBlockClients, ClientAddrString) {
+  sockaddr_storage addr;
+  memset(&addr, 0, sizeof(addr));
+
+  sockaddr_in *addr4 = reinterpret_cast<sockaddr_in*>(&addr);
+  addr4->sin_family = AF_INET;
+  addr4->sin_addr.s_addr = htonl(0xc0a80007);  // 192.168.0.7
+  EXPECT_EQ("192.168.0.7", get_addr_str(addr));
+
+  sockaddr_in6 *addr6 = reinterpret_cast<sockaddr_in6*>(&addr);
+  memset(&addr, 0, sizeof(addr));
+  addr6->sin6_family = AF_INET6;
+  reinterpret_cast<unsigned char*>(&addr6->sin6_addr)[15] = 1;
+  EXPECT_EQ("::1", get_addr_str(addr));
+}
+
 TEST_F(TestBlockClients, BlockClientHost) {
   unsigned long long max_connect_errors = 2;
   std::chrono::seconds client_connect_timeout(2);
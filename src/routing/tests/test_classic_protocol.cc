@@ -103,7 +103,7 @@ TEST_F(ClassicProtocolTest, CopyPacketsFdNotSet)
   size_t report_bytes_read = 0xff;
 
   int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, false, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, true);
+                                         handshake_done_, &report_bytes_read, true, nullptr);
 
   ASSERT_TRUE(result==0);
   ASSERT_TRUE(report_bytes_read==0);
@@ -117,7 +117,7 @@ TEST_F(ClassicProtocolTest, CopyPacketsReadError)
   EXPECT_CALL(*mock_socket_operations_, read(sender_socket_,_,_)).WillOnce(Return(-1));
 
   int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, true);
+                                         handshake_done_, &report_bytes_read, true, nullptr);
 
   ASSERT_FALSE(handshake_done_);
   ASSERT_EQ(-1, result);
@@ -133,7 +133,7 @@ TEST_F(ClassicProtocolTest, CopyPacketsHandshakeDoneOK)
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], PACKET_SIZE)).WillOnce(Return(PACKET_SIZE));
 
   int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, true);
+                                         handshake_done_, &report_bytes_read, true, nullptr);
 
   ASSERT_TRUE(handshake_done_);
   ASSERT_EQ(0, result);
@@ -151,7 +151,7 @@ TEST_F(ClassicProtocolTest, CopyPacketsHandshakeDoneWriteError)
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], 20)).WillOnce(Return(-1));
 
   int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                       handshake_done_, &report_bytes_read, true);
+                                       handshake_done_, &report_bytes_read, true, nullptr);
 
   ASSERT_TRUE(handshake_done_);
   ASSERT_EQ(-1, result);
@@ -165,7 +165,7 @@ TEST_F(ClassicProtocolTest, CopyPacketsHandshakePacketTooSmall)
                                                                   WillOnce(Return((ssize_t)report_bytes_read));
 
   int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                       handshake_done_, &report_bytes_read, true);
+                                       handshake_done_, &report_bytes_read, true, nullptr);
 
   ASSERT_FALSE(handshake_done_);
   ASSERT_EQ(-1, result);
@@ -184,7 +184,7 @@ TEST_F(ClassicProtocolTest, CopyPacketsHandshakeInvalidPacketNumber)
                                                                   WillOnce(Return((ssize_t)report_bytes_read));
 
   int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                       handshake_done_, &report_bytes_read, true);
+                                       handshake_done_, &report_bytes_read, true, nullptr);
 
   ASSERT_FALSE(handshake_done_);
   ASSERT_EQ(-1, result);
@@ -207,7 +207,7 @@ TEST_F(ClassicProtocolTest, CopyPacketsHandshakeServerSendsError)
                                                        WillOnce(Return((ssize_t)network_buffer_offset_));
 
   int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                       handshake_done_, &report_bytes_read, true);
+                                       handshake_done_, &report_bytes_read, true, nullptr);
 
   // if the server sent error handshake is considered done
   ASSERT_EQ(2, curr_pktnr_);
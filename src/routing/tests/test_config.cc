@@ -128,6 +128,30 @@ TEST_F(TestConfig, InvalidDefaultPort) {
       "option bind_port in [routing] needs value between 1 and 65535 inclusive, was '23123124123123'");
 }
 
+TEST_F(TestConfig, ReadYourWritesWithoutScope) {
+  reset_config();
+  std::ofstream c(config_path->str(), std::fstream::app | std::fstream::out);
+  c << "[routing]\nbind_port=7001\nread_your_writes_timeout=500\n";
+  c << kDefaultRoutingConfig;
+  c.close();
+
+  MySQLRouter r(g_origin, {"-c", config_path->str()});
+  ASSERT_THROW_LIKE(r.start(), std::invalid_argument,
+      "option read_your_writes_scope in [routing] is required when read_your_writes_timeout is set");
+}
+
+TEST_F(TestConfig, InvalidReadYourWritesScope) {
+  reset_config();
+  std::ofstream c(config_path->str(), std::fstream::app | std::fstream::out);
+  c << "[routing]\nbind_port=7001\nread_your_writes_timeout=500\nread_your_writes_scope=user\n";
+  c << kDefaultRoutingConfig;
+  c.close();
+
+  MySQLRouter r(g_origin, {"-c", config_path->str()});
+  ASSERT_THROW_LIKE(r.start(), std::invalid_argument,
+      "option read_your_writes_scope in [routing] needs value 'host', was 'user'");
+}
+
 int main(int argc, char *argv[]) {
   init_windows_sockets();
   g_origin = Path(argv[0]).dirname();
@@ -0,0 +1,88 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "gtest/gtest.h"
+
+#include "connection_budget.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using routing::ConnectionBudget;
+
+TEST(ConnectionBudgetTest, unlimited) {
+  ConnectionBudget budget;
+
+  EXPECT_EQ(0u, budget.get_limit());
+  for (int i = 0; i < 100000; ++i) {
+    ASSERT_TRUE(budget.acquire());
+  }
+  EXPECT_EQ(100000u, budget.get_used());
+}
+
+TEST(ConnectionBudgetTest, limit) {
+  ConnectionBudget budget;
+  budget.set_limit(2);
+
+  EXPECT_TRUE(budget.acquire());
+  EXPECT_TRUE(budget.acquire());
+  EXPECT_FALSE(budget.acquire());
+  EXPECT_EQ(2u, budget.get_used());
+
+  budget.release();
+  EXPECT_TRUE(budget.acquire());
+  EXPECT_FALSE(budget.acquire());
+}
+
+TEST(ConnectionBudgetTest, lowered_limit) {
+  ConnectionBudget budget;
+  budget.set_limit(3);
+
+  EXPECT_TRUE(budget.acquire());
+  EXPECT_TRUE(budget.acquire());
+
+  // connections above the new limit stay, but no new ones are accepted
+  budget.set_limit(1);
+  EXPECT_FALSE(budget.acquire());
+  budget.release();
+  EXPECT_FALSE(budget.acquire());
+  budget.release();
+  EXPECT_TRUE(budget.acquire());
+}
+
+TEST(ConnectionBudgetTest, concurrent_acquire) {
+  ConnectionBudget budget;
+  const uint32_t kLimit = 1000;
+  budget.set_limit(kLimit);
+
+  std::atomic<uint32_t> acquired(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&budget, &acquired] {
+      for (uint32_t i = 0; i < kLimit; ++i) {
+        if (budget.acquire()) ++acquired;
+      }
+    });
+  }
+  for (auto &thread: threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(kLimit, acquired.load());
+  EXPECT_EQ(kLimit, budget.get_used());
+}
@@ -0,0 +1,143 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "forwarding_queue.h"
+#include "mysqlrouter/routing.h"
+
+#include "routing_mocks.h"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+using routing::ForwardingQueue;
+using ::testing::_;
+using ::testing::Invoke;
+
+class ForwardingQueueTest : public ::testing::Test {
+ protected:
+  // read() returns what is left of `incoming_`, at most `max_read_` bytes
+  // per call; write() appends to `outgoing_`, accepting at most
+  // `max_write_` bytes in total
+  void SetUp() override {
+    ON_CALL(sock_ops_, read(_, _, _)).WillByDefault(Invoke([this](int, void *buf, size_t len) -> ssize_t {
+      if (incoming_.empty()) {
+        if (eof_) return 0;
+        sock_ops_.set_errno(EAGAIN);
+        return -1;
+      }
+      const size_t n = std::min(std::min(len, incoming_.size()), max_read_);
+      std::memcpy(buf, incoming_.data(), n);
+      incoming_.erase(0, n);
+      return static_cast<ssize_t>(n);
+    }));
+    ON_CALL(sock_ops_, write(_, _, _)).WillByDefault(Invoke([this](int, void *buf, size_t len) -> ssize_t {
+      const size_t n = std::min(len, max_write_);
+      if (n == 0) {
+        sock_ops_.set_errno(EAGAIN);
+        return -1;
+      }
+      outgoing_.append(static_cast<const char*>(buf), n);
+      max_write_ -= n;
+      return static_cast<ssize_t>(n);
+    }));
+  }
+
+  ::testing::NiceMock<MockSocketOperations> sock_ops_;
+  std::string incoming_;
+  std::string outgoing_;
+  size_t max_read_ = SIZE_MAX;
+  size_t max_write_ = SIZE_MAX;
+  bool eof_ = false;
+};
+
+TEST_F(ForwardingQueueTest, fill_and_flush) {
+  ForwardingQueue queue(RoutingProtocolBuffer(8));
+  EXPECT_EQ(8u, queue.capacity());
+  EXPECT_TRUE(queue.empty());
+
+  incoming_ = "hello";
+  EXPECT_EQ(5, queue.fill(1, &sock_ops_));
+  EXPECT_EQ(5u, queue.size());
+
+  EXPECT_EQ(5, queue.flush(2, &sock_ops_));
+  EXPECT_EQ("hello", outgoing_);
+  EXPECT_TRUE(queue.empty());
+  EXPECT_EQ(5u, queue.peak_size());
+}
+
+TEST_F(ForwardingQueueTest, full_queue_stops_reading) {
+  ForwardingQueue queue(RoutingProtocolBuffer(4));
+
+  incoming_ = "0123456789";
+  EXPECT_EQ(4, queue.fill(1, &sock_ops_));
+  EXPECT_TRUE(queue.full());
+  EXPECT_EQ("456789", incoming_);
+
+  // room for more after the receiver took some
+  max_write_ = 2;
+  EXPECT_EQ(2, queue.flush(2, &sock_ops_));
+  EXPECT_EQ(2, queue.fill(1, &sock_ops_));
+  EXPECT_TRUE(queue.full());
+  EXPECT_EQ("6789", incoming_);
+}
+
+TEST_F(ForwardingQueueTest, slow_receiver) {
+  ForwardingQueue queue(RoutingProtocolBuffer(8));
+
+  incoming_ = "abcdefgh";
+  EXPECT_EQ(8, queue.fill(1, &sock_ops_));
+
+  // receiver takes 3 bytes, then would block
+  max_write_ = 3;
+  EXPECT_EQ(3, queue.flush(2, &sock_ops_));
+  EXPECT_EQ(5u, queue.size());
+
+  EXPECT_EQ(-1, queue.flush(2, &sock_ops_));
+  EXPECT_TRUE(ForwardingQueue::would_block(sock_ops_.get_errno()));
+  EXPECT_EQ(5u, queue.size());
+
+  // the free space wraps around the end of the buffer
+  incoming_ = "ijk";
+  EXPECT_EQ(3, queue.fill(1, &sock_ops_));
+  EXPECT_TRUE(queue.full());
+
+  max_write_ = SIZE_MAX;
+  EXPECT_EQ(8, queue.flush(2, &sock_ops_));
+  EXPECT_EQ("abcdefghijk", outgoing_);
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST_F(ForwardingQueueTest, would_block) {
+  ForwardingQueue queue(RoutingProtocolBuffer(8));
+
+  EXPECT_EQ(-1, queue.fill(1, &sock_ops_));
+  EXPECT_TRUE(ForwardingQueue::would_block(sock_ops_.get_errno()));
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST_F(ForwardingQueueTest, eof) {
+  ForwardingQueue queue(RoutingProtocolBuffer(8));
+
+  // data before the close is reported first
+  incoming_ = "bye";
+  eof_ = true;
+  EXPECT_EQ(3, queue.fill(1, &sock_ops_));
+  EXPECT_EQ(0, queue.fill(1, &sock_ops_));
+  EXPECT_EQ(0, sock_ops_.get_errno());
+  EXPECT_EQ(3u, queue.size());
+}
@@ -0,0 +1,389 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "dest_metadata_cache.h"
+
+#include "routing_mocks.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+using metadata_cache::InstanceStatus;
+using metadata_cache::ManagedInstance;
+using metadata_cache::ServerMode;
+using metadata_cache::Topology;
+using ::testing::_;
+using ::testing::Return;
+
+namespace {
+
+const std::string kReplicaset = "default";
+
+class MockMetadataCacheAPI : public metadata_cache::MetadataCacheAPIBase {
+ public:
+  std::shared_ptr<const Topology> get_topology() override {
+    return topology_;
+  }
+  void add_topology_listener(metadata_cache::TopologyListener *) override {}
+  void remove_topology_listener(metadata_cache::TopologyListener *) noexcept override {}
+  MOCK_METHOD2(mark_instance_reachability, void(const std::string &, InstanceStatus));
+  MOCK_METHOD2(wait_primary_failover, bool(const std::string &, int));
+  MOCK_METHOD3(wait_for_gtids, bool(const std::string &, const std::string &, std::chrono::milliseconds));
+
+  std::shared_ptr<const Topology> topology_ = std::make_shared<Topology>();
+};
+
+// the host is a number: MockSocketOperations returns it as the socket
+ManagedInstance make_instance(const std::string &host, ServerMode mode,
+                              const std::string &location = "",
+                              const std::string &role = "HA") {
+  ManagedInstance instance{};
+  instance.replicaset_name = kReplicaset;
+  instance.mysql_server_uuid = "uuid-" + host;
+  instance.role = role;
+  instance.mode = mode;
+  instance.location = location;
+  instance.host = host;
+  instance.port = 3306;
+  instance.xport = 33060;
+  return instance;
+}
+
+} // namespace
+
+class MetadataCacheGroupTest : public ::testing::Test {
+ protected:
+  std::unique_ptr<DestMetadataCacheGroup> make_dest(const std::string &mode,
+      const mysqlrouter::URIQuery &query = {},
+      Protocol::Type protocol = Protocol::Type::kClassicProtocol) {
+    return std::unique_ptr<DestMetadataCacheGroup>(new DestMetadataCacheGroup(
+        "cache", kReplicaset, mode, query, protocol, "", 1, &cache_api_, &sock_ops_));
+  }
+
+  // read-only route of a router in location "dc1"
+  std::unique_ptr<DestMetadataCacheGroup> make_location_dest(unsigned int location_min_servers) {
+    return std::unique_ptr<DestMetadataCacheGroup>(new DestMetadataCacheGroup(
+        "cache", kReplicaset, "read-only", {}, Protocol::Type::kClassicProtocol,
+        "dc1", location_min_servers, &cache_api_, &sock_ops_));
+  }
+
+  // publishes a snapshot with the given members
+  void set_topology(uint64_t generation, const std::vector<ManagedInstance> &members) {
+    auto topology = std::make_shared<Topology>();
+    topology->generation = generation;
+    topology->replicasets[kReplicaset].name = kReplicaset;
+    topology->replicasets[kReplicaset].members = members;
+    cache_api_.topology_ = topology;
+  }
+
+  // addresses the route currently picks from, in round-robin order
+  static std::vector<std::string> destinations(DestMetadataCacheGroup &dest) {
+    dest.prepare();
+    std::vector<std::string> result;
+    for (const auto &address : dest) {
+      result.push_back(address.str());
+    }
+    return result;
+  }
+
+  ::testing::NiceMock<MockMetadataCacheAPI> cache_api_;
+  MockSocketOperations sock_ops_;
+};
+
+TEST_F(MetadataCacheGroupTest, read_only_uses_secondaries) {
+  set_topology(1, {make_instance("1", ServerMode::ReadWrite),
+                   make_instance("2", ServerMode::ReadOnly),
+                   make_instance("3", ServerMode::ReadOnly)});
+  auto dest = make_dest("read-only");
+
+  EXPECT_EQ(std::vector<std::string>({"2:3306", "3:3306"}), destinations(*dest));
+}
+
+TEST_F(MetadataCacheGroupTest, read_write_uses_primaries) {
+  set_topology(1, {make_instance("1", ServerMode::ReadWrite),
+                   make_instance("2", ServerMode::ReadOnly)});
+  auto dest = make_dest("read-write");
+
+  EXPECT_EQ(std::vector<std::string>({"1:3306"}), destinations(*dest));
+}
+
+TEST_F(MetadataCacheGroupTest, allow_primary_reads) {
+  set_topology(1, {make_instance("1", ServerMode::ReadWrite),
+                   make_instance("2", ServerMode::ReadOnly)});
+  auto dest = make_dest("read-only", {{"allow_primary_reads", "yes"}});
+
+  EXPECT_EQ(std::vector<std::string>({"1:3306", "2:3306"}), destinations(*dest));
+}
+
+TEST_F(MetadataCacheGroupTest, allow_primary_reads_ignored_in_read_write_mode) {
+  set_topology(1, {make_instance("1", ServerMode::ReadWrite),
+                   make_instance("2", ServerMode::ReadOnly)});
+  auto dest = make_dest("read-write", {{"allow_primary_reads", "yes"}});
+
+  EXPECT_EQ(std::vector<std::string>({"1:3306"}), destinations(*dest));
+}
+
+TEST_F(MetadataCacheGroupTest, only_ha_members) {
+  set_topology(1, {make_instance("1", ServerMode::ReadWrite),
+                   make_instance("2", ServerMode::ReadOnly, "", "arbiter"),
+                   make_instance("3", ServerMode::ReadOnly)});
+  auto dest = make_dest("read-only");
+
+  EXPECT_EQ(std::vector<std::string>({"3:3306"}), destinations(*dest));
+}
+
+TEST_F(MetadataCacheGroupTest, x_protocol_port) {
+  set_topology(1, {make_instance("1", ServerMode::ReadWrite)});
+  auto dest = make_dest("read-write", {}, Protocol::Type::kXProtocol);
+
+  EXPECT_EQ(std::vector<std::string>({"1:33060"}), destinations(*dest));
+}
+
+TEST_F(MetadataCacheGroupTest, unknown_replicaset) {
+  cache_api_.topology_ = std::make_shared<Topology>();
+  auto dest = make_dest("read-only");
+
+  EXPECT_TRUE(destinations(*dest).empty());
+}
+
+TEST_F(MetadataCacheGroupTest, rebuilt_on_new_generation) {
+  set_topology(1, {make_instance("1", ServerMode::ReadWrite),
+                   make_instance("2", ServerMode::ReadOnly)});
+  auto dest = make_dest("read-only");
+  ASSERT_EQ(std::vector<std::string>({"2:3306"}), destinations(*dest));
+
+  // same generation: the cached list is used, whatever the snapshot says
+  set_topology(1, {make_instance("1", ServerMode::ReadWrite),
+                   make_instance("3", ServerMode::ReadOnly)});
+  EXPECT_EQ(std::vector<std::string>({"2:3306"}), destinations(*dest));
+
+  // a new snapshot was published
+  set_topology(2, {make_instance("1", ServerMode::ReadWrite),
+                   make_instance("3", ServerMode::ReadOnly),
+                   make_instance("4", ServerMode::ReadOnly)});
+  EXPECT_EQ(std::vector<std::string>({"3:3306", "4:3306"}), destinations(*dest));
+
+  // failover: the former primary is a secondary now
+  set_topology(3, {make_instance("1", ServerMode::ReadOnly),
+                   make_instance("3", ServerMode::ReadWrite)});
+  EXPECT_EQ(std::vector<std::string>({"1:3306"}), destinations(*dest));
+}
+
+TEST_F(MetadataCacheGroupTest, rebuilt_by_topology_changed) {
+  set_topology(1, {make_instance("1", ServerMode::ReadWrite)});
+  auto dest = make_dest("read-write");
+  ASSERT_EQ(std::vector<std::string>({"1:3306"}), destinations(*dest));
+
+  // the listener builds the list for the snapshot it is given, connections
+  // don't rebuild it for the same generation
+  auto topology = std::make_shared<Topology>();
+  topology->generation = 2;
+  topology->replicasets[kReplicaset].members = {make_instance("2", ServerMode::ReadWrite)};
+  dest->topology_changed(topology, {});
+  set_topology(2, {make_instance("3", ServerMode::ReadWrite)});
+
+  EXPECT_EQ(std::vector<std::string>({"2:3306"}), destinations(*dest));
+}
+
+TEST_F(MetadataCacheGroupTest, connections_to_demoted_primary_shut_down) {
+  set_topology(1, {make_instance("1", ServerMode::ReadWrite),
+                   make_instance("2", ServerMode::ReadOnly)});
+  auto dest = make_dest("read-write");
+  int error;
+  ASSERT_EQ(1, dest->get_server_socket(std::chrono::seconds::zero(), &error));
+
+  auto demoted = make_instance("1", ServerMode::ReadOnly);
+  auto promoted = make_instance("2", ServerMode::ReadWrite);
+  set_topology(2, {demoted, promoted});
+  EXPECT_CALL(sock_ops_, shutdown(1)).Times(1);
+  dest->topology_changed(cache_api_.topology_,
+                         {{metadata_cache::TopologyChange::Type::ModeChanged, demoted, ServerMode::ReadWrite},
+                          {metadata_cache::TopologyChange::Type::ModeChanged, promoted, ServerMode::ReadOnly}});
+
+  // the connection thread learns why the server went away, once
+  EXPECT_TRUE(dest->release_server_socket(1));
+  EXPECT_FALSE(dest->release_server_socket(1));
+}
+
+TEST_F(MetadataCacheGroupTest, connections_to_removed_server_shut_down) {
+  auto removed = make_instance("2", ServerMode::ReadOnly);
+  set_topology(1, {make_instance("1", ServerMode::ReadWrite), removed,
+                   make_instance("3", ServerMode::ReadOnly)});
+  auto dest = make_dest("read-only");
+  int error;
+  ASSERT_EQ(2, dest->get_server_socket(std::chrono::seconds::zero(), &error));
+  ASSERT_EQ(3, dest->get_server_socket(std::chrono::seconds::zero(), &error));
+  ASSERT_EQ(1, dest->get_primary_socket(std::chrono::seconds::zero(), &error));
+
+  // connections to the servers which are still routed to stay open
+  set_topology(2, {make_instance("1", ServerMode::ReadWrite),
+                   make_instance("3", ServerMode::ReadOnly)});
+  EXPECT_CALL(sock_ops_, shutdown(2)).Times(1);
+  EXPECT_CALL(sock_ops_, shutdown(3)).Times(0);
+  EXPECT_CALL(sock_ops_, shutdown(1)).Times(0);
+  dest->topology_changed(cache_api_.topology_,
+                         {{metadata_cache::TopologyChange::Type::InstanceRemoved, removed, ServerMode::ReadOnly}});
+
+  EXPECT_TRUE(dest->release_server_socket(2));
+  EXPECT_FALSE(dest->release_server_socket(3));
+}
+
+TEST_F(MetadataCacheGroupTest, released_connections_not_shut_down) {
+  auto removed = make_instance("2", ServerMode::ReadOnly);
+  set_topology(1, {removed});
+  auto dest = make_dest("read-only");
+  int error;
+  ASSERT_EQ(2, dest->get_server_socket(std::chrono::seconds::zero(), &error));
+  EXPECT_FALSE(dest->release_server_socket(2));
+
+  // the descriptor may belong to another connection by now
+  set_topology(2, {});
+  EXPECT_CALL(sock_ops_, shutdown(_)).Times(0);
+  dest->topology_changed(cache_api_.topology_,
+                         {{metadata_cache::TopologyChange::Type::InstanceRemoved, removed, ServerMode::ReadOnly}});
+}
+
+TEST_F(MetadataCacheGroupTest, round_robin) {
+  set_topology(1, {make_instance("1", ServerMode::ReadWrite),
+                   make_instance("2", ServerMode::ReadOnly),
+                   make_instance("3", ServerMode::ReadOnly)});
+  auto dest = make_dest("read-only");
+  int error;
+
+  EXPECT_EQ(2, dest->get_server_socket(std::chrono::seconds::zero(), &error));
+  EXPECT_EQ(3, dest->get_server_socket(std::chrono::seconds::zero(), &error));
+  EXPECT_EQ(2, dest->get_server_socket(std::chrono::seconds::zero(), &error));
+  EXPECT_EQ(1, dest->get_primary_socket(std::chrono::seconds::zero(), &error));
+}
+
+TEST_F(MetadataCacheGroupTest, location_ignored_if_not_set) {
+  set_topology(1, {make_instance("1", ServerMode::ReadOnly, "dc2"),
+                   make_instance("2", ServerMode::ReadOnly, "dc1")});
+  auto dest = make_dest("read-only");
+
+  EXPECT_EQ(std::vector<std::string>({"1:3306", "2:3306"}), destinations(*dest));
+}
+
+TEST_F(MetadataCacheGroupTest, location_preferred) {
+  set_topology(1, {make_instance("1", ServerMode::ReadWrite, "dc1"),
+                   make_instance("2", ServerMode::ReadOnly, "dc2"),
+                   make_instance("3", ServerMode::ReadOnly, "dc1"),
+                   make_instance("4", ServerMode::ReadOnly),
+                   make_instance("5", ServerMode::ReadOnly, "dc1")});
+  auto dest = make_location_dest(1);
+
+  EXPECT_EQ(std::vector<std::string>({"3:3306", "5:3306"}), destinations(*dest));
+}
+
+TEST_F(MetadataCacheGroupTest, location_min_servers) {
+  set_topology(1, {make_instance("2", ServerMode::ReadOnly, "dc2"),
+                   make_instance("3", ServerMode::ReadOnly, "dc1"),
+                   make_instance("4", ServerMode::ReadOnly, "dc3")});
+
+  // enough servers of our location
+  EXPECT_EQ(std::vector<std::string>({"3:3306"}), destinations(*make_location_dest(1)));
+
+  // too few: the other locations get connections too, after ours
+  EXPECT_EQ(std::vector<std::string>({"3:3306", "2:3306", "4:3306"}),
+            destinations(*make_location_dest(2)));
+
+  // none of our location
+  set_topology(2, {make_instance("2", ServerMode::ReadOnly, "dc2")});
+  EXPECT_EQ(std::vector<std::string>({"2:3306"}), destinations(*make_location_dest(1)));
+}
+
+TEST_F(MetadataCacheGroupTest, spillover) {
+  set_topology(1, {make_instance("2", ServerMode::ReadOnly, "dc2"),
+                   make_instance("3", ServerMode::ReadOnly, "dc1"),
+                   make_instance("4", ServerMode::ReadOnly, "dc2")});
+  auto dest = make_location_dest(1);
+  int error;
+
+  EXPECT_EQ(3, dest->get_server_socket(std::chrono::seconds::zero(), &error));
+  EXPECT_EQ(1, sock_ops_.get_mysql_socket_call_cnt());
+
+  // our server doesn't answer: the servers of the other location take turns
+  EXPECT_CALL(cache_api_, mark_instance_reachability("uuid-3", InstanceStatus::Unreachable)).Times(2);
+  sock_ops_.get_mysql_socket_fail(1);
+  EXPECT_EQ(2, dest->get_server_socket(std::chrono::seconds::zero(), &error));
+  sock_ops_.get_mysql_socket_fail(1);
+  EXPECT_EQ(4, dest->get_server_socket(std::chrono::seconds::zero(), &error));
+  EXPECT_EQ(4, sock_ops_.get_mysql_socket_call_cnt());
+
+  // only one of them is tried per connection
+  EXPECT_CALL(cache_api_, mark_instance_reachability("uuid-3", InstanceStatus::Unreachable));
+  EXPECT_CALL(cache_api_, mark_instance_reachability("uuid-2", InstanceStatus::Unreachable));
+  sock_ops_.get_mysql_socket_fail(2);
+  EXPECT_EQ(-1, dest->get_server_socket(std::chrono::seconds::zero(), &error));
+  EXPECT_EQ(2, sock_ops_.get_mysql_socket_call_cnt());
+}
+
+TEST_F(MetadataCacheGroupTest, no_spillover_below_min_servers) {
+  set_topology(1, {make_instance("2", ServerMode::ReadOnly, "dc2"),
+                   make_instance("3", ServerMode::ReadOnly, "dc1")});
+  auto dest = make_location_dest(2);
+  int error;
+
+  // the other location is part of the round-robin already
+  EXPECT_CALL(cache_api_, mark_instance_reachability(_, _)).Times(1);
+  sock_ops_.get_mysql_socket_fail(1);
+  EXPECT_EQ(-1, dest->get_server_socket(std::chrono::seconds::zero(), &error));
+  EXPECT_EQ(1, sock_ops_.get_mysql_socket_call_cnt());
+  EXPECT_EQ(2, dest->get_server_socket(std::chrono::seconds::zero(), &error));
+}
+
+TEST_F(MetadataCacheGroupTest, secondary_caught_up_with_writes) {
+  const std::string gtids = "3E11FA47-71CA-11E1-9E33-C80AA9429562:23";
+  set_topology(1, {make_instance("1", ServerMode::ReadWrite),
+                   make_instance("2", ServerMode::ReadOnly)});
+  auto dest = make_dest("read-only");
+  int error;
+  bool server_behind = true;
+
+  EXPECT_CALL(cache_api_, wait_for_gtids("uuid-2", gtids, std::chrono::milliseconds(500)))
+      .WillOnce(Return(true));
+  EXPECT_EQ(2, dest->get_server_socket(std::chrono::seconds::zero(), &error, gtids,
+                                       std::chrono::milliseconds(500), &server_behind));
+  EXPECT_FALSE(server_behind);
+}
+
+TEST_F(MetadataCacheGroupTest, primary_if_secondary_behind) {
+  const std::string gtids = "3E11FA47-71CA-11E1-9E33-C80AA9429562:23";
+  set_topology(1, {make_instance("1", ServerMode::ReadWrite),
+                   make_instance("2", ServerMode::ReadOnly)});
+  auto dest = make_dest("read-only");
+  int error;
+  bool server_behind = false;
+
+  EXPECT_CALL(cache_api_, wait_for_gtids("uuid-2", gtids, _)).WillOnce(Return(false));
+  EXPECT_EQ(1, dest->get_server_socket(std::chrono::seconds::zero(), &error, gtids,
+                                       std::chrono::milliseconds(500), &server_behind));
+  EXPECT_TRUE(server_behind);
+  // the secondary is never connected to
+  EXPECT_EQ(1, sock_ops_.get_mysql_socket_call_cnt());
+}
+
+TEST_F(MetadataCacheGroupTest, no_wait_without_gtids) {
+  set_topology(1, {make_instance("2", ServerMode::ReadOnly)});
+  auto dest = make_dest("read-only");
+  int error;
+
+  EXPECT_CALL(cache_api_, wait_for_gtids(_, _, _)).Times(0);
+  EXPECT_EQ(2, dest->get_server_socket(std::chrono::seconds::zero(), &error));
+}
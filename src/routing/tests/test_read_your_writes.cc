@@ -0,0 +1,241 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "read_your_writes.h"
+#include "mysqlrouter/mysql_protocol.h"
+#include "protocol/classic_protocol.h"
+
+#include "routing_mocks.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using routing::GtidRegistry;
+using routing::GtidTrackingSocketOperations;
+using ::testing::_;
+using ::testing::AnyNumber;
+using ::testing::Invoke;
+
+namespace {
+
+const int kClientSocket = 11;
+const int kServerSocket = 12;
+const std::string kClientHost = "192.168.0.7";
+const std::string kGtid = "3E11FA47-71CA-11E1-9E33-C80AA9429562:23";
+const uint32_t kCapabilities = mysql_protocol::kClientProtocol41 | mysql_protocol::kClientSessionTrack;
+
+// what a socket delivers: read() returns the chunks one by one
+class Stream {
+ public:
+  void add(const std::vector<uint8_t> &bytes) {
+    data_.insert(data_.end(), bytes.begin(), bytes.end());
+  }
+
+  ssize_t read(void *buffer, size_t nbyte) {
+    const size_t n = std::min(nbyte, data_.size() - pos_);
+    std::memcpy(buffer, data_.data() + pos_, n);
+    pos_ += n;
+    return static_cast<ssize_t>(n);
+  }
+
+ private:
+  std::vector<uint8_t> data_;
+  size_t pos_ = 0;
+};
+
+std::vector<uint8_t> ok_with_gtid(uint8_t sequence_id, const std::string &gtid) {
+  return mysql_protocol::OkPacket(sequence_id, 1, 0, mysql_protocol::kServerStatusAutocommit, 0, "",
+                                  {mysql_protocol::SessionStateChange::gtids(gtid)}, kCapabilities);
+}
+
+std::vector<uint8_t> packet(uint8_t sequence_id, const std::vector<uint8_t> &payload) {
+  std::vector<uint8_t> result = { static_cast<uint8_t>(payload.size()), 0, 0, sequence_id };
+  result.insert(result.end(), payload.begin(), payload.end());
+  return result;
+}
+
+} // namespace
+
+TEST(ReadYourWritesTest, is_valid_gtid_set) {
+  EXPECT_TRUE(routing::is_valid_gtid_set(kGtid));
+  EXPECT_TRUE(routing::is_valid_gtid_set(kGtid + ",\n" + "4E11FA47-71CA-11E1-9E33-C80AA9429562:1-5:7"));
+
+  EXPECT_FALSE(routing::is_valid_gtid_set(""));
+  EXPECT_FALSE(routing::is_valid_gtid_set(kGtid + "'); DROP TABLE t; --"));
+  EXPECT_FALSE(routing::is_valid_gtid_set(kGtid + "\\"));
+}
+
+TEST(GtidRegistryTest, record_and_get) {
+  GtidRegistry registry;
+
+  EXPECT_TRUE(registry.get(kClientHost).gtids.empty());
+
+  registry.record(kClientHost, kGtid);
+  GtidRegistry::Pending pending = registry.get(kClientHost);
+  EXPECT_EQ(kGtid, pending.gtids);
+  EXPECT_FALSE(pending.replicas_behind);
+
+  // other hosts are not affected
+  EXPECT_TRUE(registry.get("192.168.0.8").gtids.empty());
+}
+
+TEST(GtidRegistryTest, expires) {
+  GtidRegistry registry(std::chrono::milliseconds(20));
+
+  registry.record(kClientHost, kGtid);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  EXPECT_TRUE(registry.get(kClientHost).gtids.empty());
+  EXPECT_EQ(0u, registry.size());
+}
+
+TEST(GtidRegistryTest, replicas_behind_until_next_write) {
+  GtidRegistry registry;
+
+  registry.record(kClientHost, kGtid);
+  registry.mark_replicas_behind(kClientHost, kGtid);
+  EXPECT_TRUE(registry.get(kClientHost).replicas_behind);
+
+  // marking an older write has no effect
+  const std::string next_gtid = "3E11FA47-71CA-11E1-9E33-C80AA9429562:24";
+  registry.record(kClientHost, next_gtid);
+  EXPECT_FALSE(registry.get(kClientHost).replicas_behind);
+  registry.mark_replicas_behind(kClientHost, kGtid);
+  EXPECT_FALSE(registry.get(kClientHost).replicas_behind);
+  EXPECT_EQ(next_gtid, registry.get(kClientHost).gtids);
+}
+
+TEST(GtidRegistryTest, max_entries) {
+  GtidRegistry registry(std::chrono::seconds(60), 2);
+
+  registry.record("host1", kGtid);
+  registry.record("host2", kGtid);
+  registry.record("host3", kGtid);
+  EXPECT_EQ(2u, registry.size());
+  EXPECT_TRUE(registry.get("host3").gtids.empty());
+
+  // known hosts still get updated
+  registry.record("host1", kGtid + "-24");
+  EXPECT_EQ(kGtid + "-24", registry.get("host1").gtids);
+}
+
+class GtidTrackingTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ON_CALL(ops_, read(kClientSocket, _, _)).WillByDefault(Invoke([this](int, void *buffer, size_t nbyte) {
+      return client_.read(buffer, nbyte);
+    }));
+    ON_CALL(ops_, read(kServerSocket, _, _)).WillByDefault(Invoke([this](int, void *buffer, size_t nbyte) {
+      return server_.read(buffer, nbyte);
+    }));
+    EXPECT_CALL(ops_, read(_, _, _)).Times(AnyNumber());
+  }
+
+  // forwards what the client and the server send, in chunks of chunk_size bytes
+  void forward(SocketOperationsBase &ops, int fd, size_t chunk_size) {
+    uint8_t buffer[1024];
+    while (ops.read(fd, buffer, chunk_size) > 0) {}
+  }
+
+  ::testing::NiceMock<MockSocketOperations> ops_;
+  Stream client_;
+  Stream server_;
+  GtidRegistry registry_;
+};
+
+TEST_F(GtidTrackingTest, records_gtid_of_query) {
+  GtidTrackingSocketOperations tracking(&ops_, kClientSocket, kServerSocket, kClientHost, registry_);
+
+  client_.add(mysql_protocol::QueryPacket(0, "INSERT INTO t VALUES (1)"));
+  server_.add(ok_with_gtid(1, kGtid));
+
+  forward(tracking, kClientSocket, 1024);
+  // the OK packet arrives in pieces
+  forward(tracking, kServerSocket, 3);
+
+  EXPECT_EQ(kGtid, registry_.get(kClientHost).gtids);
+}
+
+TEST_F(GtidTrackingTest, ignores_resultsets) {
+  GtidTrackingSocketOperations tracking(&ops_, kClientSocket, kServerSocket, kClientHost, registry_);
+
+  client_.add(mysql_protocol::QueryPacket(0, "SELECT 1"));
+  // column count, then a row which would look like an OK packet
+  server_.add(packet(1, { 0x01 }));
+  server_.add(ok_with_gtid(2, kGtid));
+
+  forward(tracking, kClientSocket, 1024);
+  forward(tracking, kServerSocket, 1024);
+
+  EXPECT_TRUE(registry_.get(kClientHost).gtids.empty());
+}
+
+TEST_F(GtidTrackingTest, ignores_other_commands) {
+  GtidTrackingSocketOperations tracking(&ops_, kClientSocket, kServerSocket, kClientHost, registry_);
+
+  client_.add(packet(0, { static_cast<uint8_t>(mysql_protocol::Command::kPing) }));
+  server_.add(ok_with_gtid(1, kGtid));
+
+  forward(tracking, kClientSocket, 1024);
+  forward(tracking, kServerSocket, 1024);
+
+  EXPECT_TRUE(registry_.get(kClientHost).gtids.empty());
+}
+
+TEST_F(GtidTrackingTest, follows_client_packets) {
+  GtidTrackingSocketOperations tracking(&ops_, kClientSocket, kServerSocket, kClientHost, registry_);
+
+  // a ping and a query sent in one piece, read byte by byte
+  client_.add(packet(0, { static_cast<uint8_t>(mysql_protocol::Command::kPing) }));
+  forward(tracking, kClientSocket, 1);
+  server_.add(mysql_protocol::OkPacket(1, 0, 0, 0, 0, "", {}, kCapabilities));
+  forward(tracking, kServerSocket, 1024);
+
+  client_.add(mysql_protocol::QueryPacket(0, "COMMIT"));
+  server_.add(ok_with_gtid(1, kGtid));
+  forward(tracking, kClientSocket, 1);
+  forward(tracking, kServerSocket, 1024);
+
+  EXPECT_EQ(kGtid, registry_.get(kClientHost).gtids);
+}
+
+TEST(ClassicProtocolGtidsTest, not_tracked_with_compression) {
+  ::testing::NiceMock<MockSocketOperations> ops;
+  ClassicProtocol protocol(&ops);
+  auto state = protocol.create_connection_state();
+  static_cast<ClassicConnectionState*>(state.get())->client_capabilities = mysql_protocol::kClientCompress;
+
+  EXPECT_EQ(nullptr, protocol.track_gtids(&ops, kClientSocket, kServerSocket, kClientHost, state.get()));
+}
+
+TEST(ClassicProtocolGtidsTest, not_tracked_with_tls_passed_through) {
+  ::testing::NiceMock<MockSocketOperations> ops;
+  ClassicProtocol protocol(&ops);
+  auto state = protocol.create_connection_state();
+  auto classic_state = static_cast<ClassicConnectionState*>(state.get());
+  classic_state->client_capabilities = mysql_protocol::kClientSSL;
+
+  EXPECT_EQ(nullptr, protocol.track_gtids(&ops, kClientSocket, kServerSocket, kClientHost, state.get()));
+
+  // the router decrypts the traffic itself
+  classic_state->tls_terminated = true;
+  EXPECT_NE(nullptr, protocol.track_gtids(&ops, kClientSocket, kServerSocket, kClientHost, state.get()));
+}
@@ -90,6 +90,9 @@ TEST_F(RoutingTests, Defaults) {
   ASSERT_EQ(routing::kDefaultNetBufferLength, 16384U);
   ASSERT_EQ(routing::kDefaultMaxConnectErrors, 100ULL);
   ASSERT_EQ(routing::kDefaultClientConnectTimeout, std::chrono::seconds(9));
+  ASSERT_EQ(routing::kDefaultDrainTimeout, std::chrono::seconds(0));
+  ASSERT_EQ(routing::kDefaultMaxTotalConnections, 0u);
+  ASSERT_EQ(routing::kDefaultClientSslSessionCacheSize, 1024u);
 }
 
 #ifndef _WIN32
@@ -123,7 +126,7 @@ TEST_F(RoutingTests, CopyPacketsSingleWrite) {
   ClassicProtocol cp(&socket_op);
   int res = cp.copy_packets(sender_socket, receiver_socket, true /* sender is writable */,
                             buffer, &curr_pktnr,
-                            handshake_done, &report_bytes_read, false);
+                            handshake_done, &report_bytes_read, false, nullptr);
 
   ASSERT_EQ(0, res);
   ASSERT_EQ(200u, report_bytes_read);
@@ -150,7 +153,7 @@ TEST_F(RoutingTests, CopyPacketsMultipleWrites) {
   ClassicProtocol cp(&socket_op);
   int res = cp.copy_packets(sender_socket, receiver_socket, true,
                             buffer, &curr_pktnr,
-                            handshake_done, &report_bytes_read, false);
+                            handshake_done, &report_bytes_read, false, nullptr);
 
   ASSERT_EQ(0, res);
   ASSERT_EQ(200u, report_bytes_read);
@@ -170,7 +173,7 @@ TEST_F(RoutingTests, CopyPacketsWriteError) {
   // will log "Write error: ..." as we don't mock an errno
   int res = cp.copy_packets(sender_socket, receiver_socket, true,
                             buffer, &curr_pktnr,
-                            handshake_done, &report_bytes_read, false);
+                            handshake_done, &report_bytes_read, false, nullptr);
 
   ASSERT_EQ(-1, res);
 }
@@ -543,6 +546,20 @@ TEST_F(RoutingTests, make_thread_name) {
   EXPECT_STREQ("RtS:x_ro", MySQLRouting::make_thread_name("routing:test_default_x_ro", "RtS").c_str());
   EXPECT_STREQ("RtS:ro",   MySQLRouting::make_thread_name("routing:test_default_ro",   "RtS").c_str());
   EXPECT_STREQ("RtS:",     MySQLRouting::make_thread_name("routing",                   "RtS").c_str());
+
+  // placement is kept, the key gets trimmed
+  EXPECT_STREQ("RtS:x_ro@n1",     MySQLRouting::make_thread_name("routing:test_default_x_ro", "RtS", "@n1").c_str());
+  EXPECT_STREQ("RtS:test_def@c3", MySQLRouting::make_thread_name("routing:test_def_ult_x_ro", "RtS", "@c3").c_str());
+  EXPECT_STREQ("RtS:test_d@c123", MySQLRouting::make_thread_name("routing:test_def_ult_x_ro", "RtS", "@c123").c_str());
+}
+
+TEST_F(RoutingTests, get_placement) {
+  EXPECT_EQ("", MySQLRouting::get_placement(mysql_harness::CpuSet()));
+  EXPECT_EQ("@c5", MySQLRouting::get_placement(mysql_harness::CpuSet({ 5 })));
+
+  // several CPUs are shown as their NUMA node, if known
+  const std::string placement = MySQLRouting::get_placement(mysql_harness::CpuSet({ 0, 1 }));
+  EXPECT_TRUE(placement == "@p" || placement.compare(0, 2, "@n") == 0) << placement;
 }
 
 // This test verifies fix for Bug #23857183 and checks if trying to connect to wrong port
@@ -0,0 +1,121 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "protocol/x_message_framer.h"
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+using Event = XMessageFramer::Event;
+
+namespace {
+
+std::vector<uint8_t> make_message(uint8_t type, const std::string &payload) {
+  const uint32_t length = static_cast<uint32_t>(payload.size() + 1);
+  std::vector<uint8_t> message{
+    static_cast<uint8_t>(length), static_cast<uint8_t>(length >> 8),
+    static_cast<uint8_t>(length >> 16), static_cast<uint8_t>(length >> 24),
+    type,
+  };
+  message.insert(message.end(), payload.begin(), payload.end());
+  return message;
+}
+
+} // namespace
+
+TEST(XMessageFramerTest, payload_in_place) {
+  XMessageFramer framer(1024);
+  const auto message = make_message(4, "hello");
+
+  EXPECT_EQ(5u, framer.consume(message.data(), message.size()));
+  ASSERT_EQ(Event::kHeader, framer.get_event());
+  EXPECT_EQ(4, framer.get_type());
+  EXPECT_EQ(5u, framer.get_payload_size());
+  ASSERT_TRUE(framer.collect_payload());
+
+  EXPECT_EQ(5u, framer.consume(message.data() + 5, message.size() - 5));
+  ASSERT_EQ(Event::kMessage, framer.get_event());
+  // not copied
+  EXPECT_EQ(message.data() + 5, framer.get_payload());
+
+  EXPECT_EQ(0u, framer.consume(message.data() + message.size(), 0));
+  EXPECT_EQ(Event::kNone, framer.get_event());
+}
+
+// every byte in a read of its own
+TEST(XMessageFramerTest, split_at_every_byte) {
+  XMessageFramer framer(1024);
+  const auto message = make_message(2, "payload");
+
+  std::vector<Event> events;
+  for (uint8_t byte: message) {
+    EXPECT_EQ(1u, framer.consume(&byte, 1));
+    if (framer.get_event() == Event::kHeader) {
+      EXPECT_TRUE(framer.collect_payload());
+    }
+    events.push_back(framer.get_event());
+  }
+
+  EXPECT_EQ(Event::kHeader, events[4]);
+  EXPECT_EQ(Event::kMessage, events.back());
+  EXPECT_EQ("payload", std::string(reinterpret_cast<const char*>(framer.get_payload()), framer.get_payload_size()));
+}
+
+TEST(XMessageFramerTest, skips_payloads_not_collected) {
+  XMessageFramer framer(1024);
+  auto stream = make_message(11, std::string(100, 'x'));
+  const auto second = make_message(1, "");
+  stream.insert(stream.end(), second.begin(), second.end());
+
+  size_t offset = framer.consume(stream.data(), stream.size());
+  ASSERT_EQ(Event::kHeader, framer.get_event());
+  EXPECT_EQ(11, framer.get_type());
+
+  offset += framer.consume(stream.data() + offset, stream.size() - offset);
+  ASSERT_EQ(Event::kHeader, framer.get_event());
+  EXPECT_EQ(1, framer.get_type());
+  EXPECT_EQ(0u, framer.get_payload_size());
+  EXPECT_EQ(stream.size(), offset);
+
+  // empty payload is complete without further bytes
+  ASSERT_TRUE(framer.collect_payload());
+  EXPECT_EQ(0u, framer.consume(stream.data() + offset, 0));
+  EXPECT_EQ(Event::kMessage, framer.get_event());
+}
+
+TEST(XMessageFramerTest, too_big_to_collect) {
+  XMessageFramer framer(10);
+  const auto message = make_message(4, std::string(11, 'x'));
+
+  framer.consume(message.data(), message.size());
+  ASSERT_EQ(Event::kHeader, framer.get_event());
+  EXPECT_FALSE(framer.collect_payload());
+}
+
+TEST(XMessageFramerTest, invalid_length) {
+  XMessageFramer framer(10);
+  const std::vector<uint8_t> header{ 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+  EXPECT_EQ(5u, framer.consume(header.data(), header.size()));
+  EXPECT_EQ(Event::kInvalid, framer.get_event());
+
+  // stays invalid
+  EXPECT_EQ(0u, framer.consume(header.data() + 5, 5));
+  EXPECT_EQ(Event::kInvalid, framer.get_event());
+}
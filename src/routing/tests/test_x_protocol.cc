@@ -18,7 +18,9 @@
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
 
+#include <cstring>
 #include <memory>
+#include <vector>
 #include <google/protobuf/io/coded_stream.h>
 
 #include "logger.h"
@@ -28,6 +30,7 @@
 #include "mysqlx.pb.h"
 
 using ::testing::_;
+using ::testing::Invoke;
 using ::testing::Return;
 
 
@@ -36,6 +39,7 @@ protected:
   XProtocolTest() {
     mock_socket_operations_.reset(new MockSocketOperations());
     x_protocol_.reset(new XProtocol(mock_socket_operations_.get()));
+    connection_state_ = x_protocol_->create_connection_state();
   }
 
   virtual void SetUp() {
@@ -47,6 +51,7 @@ protected:
 
   std::unique_ptr<MockSocketOperations> mock_socket_operations_;
   std::unique_ptr<BaseProtocol> x_protocol_;
+  std::unique_ptr<ProtocolConnectionState> connection_state_;
 
   void serialize_protobuf_msg_to_buffer(RoutingProtocolBuffer& buffer,
                                         size_t &buffer_offset,
@@ -61,6 +66,23 @@ protected:
     ASSERT_TRUE(res);
   }
 
+  // makes read() return the serialized messages in chunks of the given sizes
+  void expect_reads_in_chunks(const std::vector<ssize_t> &chunk_sizes) {
+    auto &expectation = EXPECT_CALL(*mock_socket_operations_, read(sender_socket_, _, _)).Times(static_cast<int>(chunk_sizes.size()));
+    size_t offset = 0;
+    for (ssize_t chunk_size: chunk_sizes) {
+      expectation.WillOnce(Invoke([this, offset, chunk_size](int, void *buf, size_t) -> ssize_t {
+        if (chunk_size > 0) {
+          std::memcpy(buf, &messages_[offset], static_cast<size_t>(chunk_size));
+        }
+        return chunk_size;
+      }));
+      if (chunk_size > 0) {
+        offset += static_cast<size_t>(chunk_size);
+      }
+    }
+  }
+
   static constexpr int sender_socket_ = 1;
   static constexpr int receiver_socket_ = 2;
 
@@ -68,6 +90,8 @@ protected:
   size_t network_buffer_offset_;
   int curr_pktnr_;
   bool handshake_done_;
+  // messages to be returned by expect_reads_in_chunks()
+  RoutingProtocolBuffer messages_;
 };
 
 static Mysqlx::Session::AuthenticateStart create_authenticate_start_msg() {
@@ -141,7 +165,8 @@ TEST_F(XProtocolTest, CopyPacketsNoData)
   size_t report_bytes_read = 0xff;
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, false, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, true);
+                                         handshake_done_, &report_bytes_read, true,
+                                         connection_state_.get());
 
   ASSERT_TRUE(result==0);
   ASSERT_TRUE(report_bytes_read==0);
@@ -155,7 +180,8 @@ TEST_F(XProtocolTest, CopyPacketsReadError)
   EXPECT_CALL(*mock_socket_operations_, read(sender_socket_,_,_)).WillOnce(Return(-1));
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, true);
+                                         handshake_done_, &report_bytes_read, true,
+                                         connection_state_.get());
 
   ASSERT_FALSE(handshake_done_);
   ASSERT_EQ(-1, result);
@@ -171,7 +197,8 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeDoneOK)
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], 20)).WillOnce(Return(MSG_SIZE));
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, true);
+                                         handshake_done_, &report_bytes_read, true,
+                                         connection_state_.get());
 
   ASSERT_TRUE(handshake_done_);
   ASSERT_EQ(0, result);
@@ -189,7 +216,8 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeDoneWriteError)
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], 20)).WillOnce(Return(-1));
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, true);
+                                         handshake_done_, &report_bytes_read, true,
+                                         connection_state_.get());
 
   ASSERT_TRUE(handshake_done_);
   ASSERT_EQ(-1, result);
@@ -210,7 +238,8 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeClientSendsIvalidData)
                                                                               WillOnce(Return(network_buffer_offset_));
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, false);
+                                         handshake_done_, &report_bytes_read, false,
+                                         connection_state_.get());
 
   ASSERT_FALSE(handshake_done_);
   ASSERT_EQ(-1, result);
@@ -229,7 +258,8 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeClientSendsWrongMessage)
                                                      WillOnce(Return(network_buffer_offset_));
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, false);
+                                         handshake_done_, &report_bytes_read, false,
+                                         connection_state_.get());
 
   ASSERT_FALSE(handshake_done_);
   ASSERT_EQ(-1, result);
@@ -249,7 +279,8 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeClientSendsAuthStart)
                                                      WillOnce(Return(network_buffer_offset_));
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, false);
+                                         handshake_done_, &report_bytes_read, false,
+                                         connection_state_.get());
 
   ASSERT_TRUE(handshake_done_);
   ASSERT_EQ(0, result);
@@ -269,7 +300,8 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeClientSendsCapabilitiesGet)
                                                      WillOnce(Return(network_buffer_offset_));
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, false);
+                                         handshake_done_, &report_bytes_read, false,
+                                         connection_state_.get());
 
   ASSERT_TRUE(handshake_done_);
   ASSERT_EQ(0, result);
@@ -289,7 +321,8 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeClientSendsConnectionClose)
                                                      WillOnce(Return(network_buffer_offset_));
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, false);
+                                         handshake_done_, &report_bytes_read, false,
+                                         connection_state_.get());
 
   ASSERT_TRUE(handshake_done_);
   ASSERT_EQ(0, result);
@@ -309,7 +342,8 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeClientSendsCapabilitiesSet)
                                                      WillOnce(Return(network_buffer_offset_));
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, false);
+                                         handshake_done_, &report_bytes_read, false,
+                                         connection_state_.get());
 
   ASSERT_TRUE(handshake_done_);
   ASSERT_EQ(0, result);
@@ -330,7 +364,8 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeClientSendsBrokenMessage)
                                                      WillOnce(Return(network_buffer_offset_));
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, false);
+                                         handshake_done_, &report_bytes_read, false,
+                                         connection_state_.get());
 
   ASSERT_FALSE(handshake_done_);
   ASSERT_EQ(-1, result);
@@ -350,7 +385,8 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeServerSendsError)
                                                      WillOnce(Return(network_buffer_offset_));
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, true);
+                                         handshake_done_, &report_bytes_read, true,
+                                         connection_state_.get());
 
   ASSERT_TRUE(handshake_done_);
   ASSERT_EQ(0, result);
@@ -370,7 +406,8 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeServerSendsOtherMessage)
                                                      WillOnce(Return(network_buffer_offset_));
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, true);
+                                         handshake_done_, &report_bytes_read, true,
+                                         connection_state_.get());
 
   ASSERT_FALSE(handshake_done_);
   ASSERT_EQ(0, result);
@@ -394,7 +431,8 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeReadTwoMessages)
                                                                   WillOnce(Return(network_buffer_offset_));
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, true);
+                                         handshake_done_, &report_bytes_read, true,
+                                         connection_state_.get());
 
   // handshake_done_ should be set after the second message
   ASSERT_TRUE(handshake_done_);
@@ -408,23 +446,32 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeReadPartialHeader)
 
   Mysqlx::Connection::CapabilitiesGet capab_msg{};
 
-  serialize_protobuf_msg_to_buffer(network_buffer_, network_buffer_offset_, capab_msg,
+  messages_.resize(network_buffer_.size());
+  serialize_protobuf_msg_to_buffer(messages_, network_buffer_offset_, capab_msg,
                                    Mysqlx::ClientMessages::CON_CAPABILITIES_GET);
 
-  EXPECT_CALL(*mock_socket_operations_, read(sender_socket_, _, _)).
-                                               Times(2).
-                                               WillOnce(Return(network_buffer_offset_-3)).
-                                               WillOnce(Return(3));
-  EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], network_buffer_offset_)).
-                                                WillOnce(Return(network_buffer_offset_));
+  // the header arrives in two reads; each is passed on as it arrives
+  const ssize_t first_chunk = static_cast<ssize_t>(network_buffer_offset_) - 3;
+  expect_reads_in_chunks({ first_chunk, 3 });
+  EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, _, static_cast<size_t>(first_chunk))).
+                                                WillOnce(Return(first_chunk));
+  EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, _, 3u)).WillOnce(Return(3));
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, false);
+                                         handshake_done_, &report_bytes_read, false,
+                                         connection_state_.get());
+  ASSERT_FALSE(handshake_done_);
+  ASSERT_EQ(0, result);
+  ASSERT_EQ(static_cast<size_t>(first_chunk), report_bytes_read);
+
+  result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
+                                     handshake_done_, &report_bytes_read, false,
+                                     connection_state_.get());
 
   // handshake_done_ should bet set
   ASSERT_TRUE(handshake_done_);
   ASSERT_EQ(0, result);
-  ASSERT_EQ(network_buffer_offset_, report_bytes_read);
+  ASSERT_EQ(3u, report_bytes_read);
 }
 
 TEST_F(XProtocolTest, CopyPacketsHandshakeReadPartialMessage)
@@ -432,23 +479,61 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeReadPartialMessage)
   size_t report_bytes_read = 0xff;
 
   auto warn_msg = create_warning_msg(100, "Warning message");
+  auto error_msg = create_error_msg(100, "Error message", "HY007");
 
-  serialize_protobuf_msg_to_buffer(network_buffer_, network_buffer_offset_, warn_msg,
+  messages_.resize(network_buffer_.size());
+  serialize_protobuf_msg_to_buffer(messages_, network_buffer_offset_, warn_msg,
                                    Mysqlx::ServerMessages::NOTICE);
+  serialize_protobuf_msg_to_buffer(messages_, network_buffer_offset_, error_msg,
+                                   Mysqlx::ServerMessages::ERROR);
 
-  EXPECT_CALL(*mock_socket_operations_, read(sender_socket_, _, _)).
-                                               Times(2).
-                                               WillOnce(Return(network_buffer_offset_-8)).
-                                               WillOnce(Return(8));
-  EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], network_buffer_offset_)).
-                                                WillOnce(Return(network_buffer_offset_));
+  // the second header starts 8 bytes before the end of the first read
+  const ssize_t first_chunk = static_cast<ssize_t>(warn_msg.ByteSize() + 5 + 2);
+  const ssize_t second_chunk = static_cast<ssize_t>(network_buffer_offset_) - first_chunk;
+  expect_reads_in_chunks({ first_chunk, second_chunk });
+  EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, _, _)).Times(2).
+                                                WillOnce(Return(first_chunk)).
+                                                WillOnce(Return(second_chunk));
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, true);
-
+                                         handshake_done_, &report_bytes_read, true,
+                                         connection_state_.get());
   ASSERT_FALSE(handshake_done_);
   ASSERT_EQ(0, result);
-  ASSERT_EQ(network_buffer_offset_, report_bytes_read);
+  ASSERT_EQ(static_cast<size_t>(first_chunk), report_bytes_read);
+
+  result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
+                                     handshake_done_, &report_bytes_read, true,
+                                     connection_state_.get());
+  ASSERT_TRUE(handshake_done_);
+  ASSERT_EQ(0, result);
+  ASSERT_EQ(static_cast<size_t>(second_chunk), report_bytes_read);
+}
+
+TEST_F(XProtocolTest, CopyPacketsHandshakeClientMessageSplitOverReads)
+{
+  size_t report_bytes_read = 0xff;
+  auto capab_msg = create_capab_set_msg();
+
+  messages_.resize(network_buffer_.size());
+  serialize_protobuf_msg_to_buffer(messages_, network_buffer_offset_, capab_msg,
+                                   Mysqlx::ClientMessages::CON_CAPABILITIES_SET);
+
+  // the message is validated once its last byte arrived
+  expect_reads_in_chunks({ 7, static_cast<ssize_t>(network_buffer_offset_) - 7 });
+  EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, _, _)).Times(2).
+                                                WillRepeatedly(Invoke([](int, void*, size_t len) {
+                                                  return static_cast<ssize_t>(len);
+                                                }));
+
+  for (int i = 0; i < 2; ++i) {
+    ASSERT_FALSE(handshake_done_);
+    int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
+                                           handshake_done_, &report_bytes_read, false,
+                                           connection_state_.get());
+    ASSERT_EQ(0, result);
+  }
+  ASSERT_TRUE(handshake_done_);
 }
 
 TEST_F(XProtocolTest, CopyPacketsHandshakeReadPartialMessageFails)
@@ -457,16 +542,22 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeReadPartialMessageFails)
 
   auto warn_msg = create_warning_msg(100, "Warning message");
 
-  serialize_protobuf_msg_to_buffer(network_buffer_, network_buffer_offset_, warn_msg,
+  messages_.resize(network_buffer_.size());
+  serialize_protobuf_msg_to_buffer(messages_, network_buffer_offset_, warn_msg,
                                    Mysqlx::ServerMessages::NOTICE);
 
-  EXPECT_CALL(*mock_socket_operations_, read(sender_socket_, _, _)).
-                                               Times(2).
-                                               WillOnce(Return(network_buffer_offset_-8)).
-                                               WillOnce(Return(-1));
+  const ssize_t first_chunk = static_cast<ssize_t>(network_buffer_offset_) - 8;
+  expect_reads_in_chunks({ first_chunk, -1 });
+  EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, _, _)).WillOnce(Return(first_chunk));
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, true);
+                                         handshake_done_, &report_bytes_read, true,
+                                         connection_state_.get());
+  ASSERT_EQ(0, result);
+
+  result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
+                                     handshake_done_, &report_bytes_read, true,
+                                     connection_state_.get());
 
   ASSERT_FALSE(handshake_done_);
   ASSERT_EQ(-1, result);
@@ -477,7 +568,6 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeMsgBiggerThanBuffer)
 {
   size_t report_bytes_read = 0xff;
 
-  Mysqlx::Connection::CapabilitiesSet capabilites_msg;
   // make the message bigger than the current network buffer size
   std::string msg;
   while (msg.size() <= routing::kDefaultNetBufferLength) {
@@ -497,12 +587,36 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeMsgBiggerThanBuffer)
 
   EXPECT_CALL(*mock_socket_operations_, read(sender_socket_, _, _)).Times(1).
                                              WillOnce(Return(network_buffer_.size()));
+  EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, _, network_buffer_.size())).
+                                             WillOnce(Return(network_buffer_.size()));
 
   int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
-                                         handshake_done_, &report_bytes_read, true);
+                                         handshake_done_, &report_bytes_read, true,
+                                         connection_state_.get());
 
   // the size of buffer passed to copy_packets should be untouched
   ASSERT_EQ(BUFFER_SIZE, network_buffer_.size());
+  // the type of the message is enough to know the server sent an error
+  ASSERT_TRUE(handshake_done_);
+  ASSERT_EQ(0, result);
+}
+
+TEST_F(XProtocolTest, CopyPacketsHandshakeClientMsgTooBig)
+{
+  size_t report_bytes_read = 0xff;
+
+  // only the header: the client announces a message bigger than allowed
+  const uint32_t msg_size = static_cast<uint32_t>(XProtocol::kMaxHandshakeMessageSize) + 2;
+  google::protobuf::io::CodedOutputStream::WriteLittleEndian32ToArray(msg_size, &network_buffer_[0]);
+  network_buffer_[4] = Mysqlx::ClientMessages::CON_CAPABILITIES_SET;
+
+  EXPECT_CALL(*mock_socket_operations_, read(sender_socket_, _, _)).WillOnce(Return(5));
+  EXPECT_CALL(*mock_socket_operations_, write(_, _, _)).Times(0);
+
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, true, network_buffer_, &curr_pktnr_,
+                                         handshake_done_, &report_bytes_read, false,
+                                         connection_state_.get());
+
   ASSERT_FALSE(handshake_done_);
   ASSERT_EQ(-1, result);
 }
@@ -0,0 +1,186 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// counts the heap allocations done while handling X protocol handshakes,
+// with the socket replaced by an in-memory one
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <google/protobuf/io/coded_stream.h>
+
+#include "mysqlrouter/routing.h"
+#include "protocol/x_protocol.h"
+#include "mysqlx.pb.h"
+
+namespace {
+std::atomic<bool> g_count_allocations(false);
+std::atomic<size_t> g_allocations(0);
+}
+
+void *operator new(size_t size) {
+  if (g_count_allocations.load(std::memory_order_relaxed)) {
+    ++g_allocations;
+  }
+  if (void *p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  std::free(p);
+}
+
+namespace {
+
+// counts the allocations done by the given function
+template<class Func>
+size_t count_allocations(Func func) {
+  g_allocations = 0;
+  g_count_allocations = true;
+  func();
+  g_count_allocations = false;
+  return g_allocations;
+}
+
+// reads return the same message over and over, writes are dropped
+class InMemorySocketOperations : public routing::SocketOperationsBase {
+ public:
+  explicit InMemorySocketOperations(const RoutingProtocolBuffer &message): message_(message) {}
+
+  int get_mysql_socket(mysqlrouter::TCPAddress, std::chrono::milliseconds, bool = true) noexcept override { return -1; }
+  ssize_t write(int, void *, size_t nbyte) override { return static_cast<ssize_t>(nbyte); }
+  ssize_t read(int, void *buffer, size_t nbyte) override {
+    const size_t len = std::min(nbyte, message_.size());
+    std::memcpy(buffer, message_.data(), len);
+    return static_cast<ssize_t>(len);
+  }
+  void close(int) override {}
+  void shutdown(int) override {}
+  void freeaddrinfo(addrinfo *) override {}
+  int getaddrinfo(const char *, const char *, const addrinfo *, addrinfo **) override { return -1; }
+  int bind(int, const struct sockaddr *, socklen_t) override { return -1; }
+  int socket(int, int, int) override { return -1; }
+  int setsockopt(int, int, int, const void *, socklen_t) override { return -1; }
+  int listen(int, int) override { return -1; }
+  int get_errno() override { return 0; }
+  void set_errno(int) override {}
+  int poll(struct pollfd *, nfds_t, std::chrono::milliseconds) override { return -1; }
+
+ private:
+  const RoutingProtocolBuffer &message_;
+};
+
+RoutingProtocolBuffer authenticate_start_message() {
+  Mysqlx::Session::AuthenticateStart msg;
+  msg.set_mech_name("MYSQL41");
+  msg.set_auth_data(std::string(200, 'a'));
+  msg.set_initial_response(std::string(64, 'r'));
+
+  const size_t msg_size = static_cast<size_t>(msg.ByteSize());
+  RoutingProtocolBuffer buffer(msg_size + 5);
+  google::protobuf::io::CodedOutputStream::WriteLittleEndian32ToArray(static_cast<uint32_t>(msg_size + 1),
+                                                                      &buffer[0]);
+  buffer[4] = Mysqlx::ClientMessages::SESS_AUTHENTICATE_START;
+  msg.SerializeToArray(&buffer[5], static_cast<int>(msg_size));
+  return buffer;
+}
+
+const int kHandshakes = 1000;
+
+// what protobuf allocates internally (default instances, string storage)
+// differs between versions and builds: don't expect exactly none, only
+// far less than a new message per handshake (6 allocations) or per error
+// message (4)
+const size_t kMaxAllocationsPerMessage = 2;
+
+} // namespace
+
+class XProtocolAllocationsTest : public ::testing::Test {
+ protected:
+  XProtocolAllocationsTest():
+      message_(authenticate_start_message()),
+      socket_operations_(message_),
+      x_protocol_(&socket_operations_),
+      network_buffer_(routing::kDefaultNetBufferLength) {}
+
+  // inspects the first message of the client like a new connection does
+  void handshake(ProtocolConnectionState *state) {
+    bool handshake_done = false;
+    size_t bytes_read = 0;
+    int pktnr = 0;
+    ASSERT_EQ(0, x_protocol_.copy_packets(1, 2, true, network_buffer_, &pktnr, handshake_done,
+                                          &bytes_read, false, state));
+    ASSERT_TRUE(handshake_done);
+  }
+
+  RoutingProtocolBuffer message_;
+  InMemorySocketOperations socket_operations_;
+  XProtocol x_protocol_;
+  RoutingProtocolBuffer network_buffer_;
+};
+
+TEST_F(XProtocolAllocationsTest, ValidatingHandshakeMessages) {
+  // warm up the pool of messages
+  for (int i = 0; i < 10; ++i) {
+    std::unique_ptr<ProtocolConnectionState> state = x_protocol_.create_connection_state();
+    handshake(state.get());
+  }
+
+  size_t per_connection_state = 0;
+  size_t validation = 0;
+  for (int i = 0; i < kHandshakes; ++i) {
+    std::unique_ptr<ProtocolConnectionState> state;
+    per_connection_state += count_allocations([&] { state = x_protocol_.create_connection_state(); });
+    validation += count_allocations([&] { handshake(state.get()); });
+  }
+
+  std::cout << "allocations per X handshake: "
+            << static_cast<double>(per_connection_state + validation) / kHandshakes
+            << " (connection state: " << static_cast<double>(per_connection_state) / kHandshakes
+            << ", message validation: " << static_cast<double>(validation) / kHandshakes << ")" << std::endl;
+
+  EXPECT_GE(kMaxAllocationsPerMessage * kHandshakes, validation);
+}
+
+TEST_F(XProtocolAllocationsTest, SendingErrors) {
+  const std::string message = "Too many connection errors from 127.0.0.1:3306";
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(x_protocol_.send_error(2, 1040, message, "HY000", "routing"));
+  }
+
+  size_t allocations = 0;
+  for (int i = 0; i < kHandshakes; ++i) {
+    allocations += count_allocations([&] {
+      ASSERT_TRUE(x_protocol_.send_error(2, 1040, message, "HY000", "routing"));
+    });
+  }
+
+  std::cout << "allocations per X error message: "
+            << static_cast<double>(allocations) / kHandshakes << std::endl;
+
+  EXPECT_GE(kMaxAllocationsPerMessage * kHandshakes, allocations);
+}
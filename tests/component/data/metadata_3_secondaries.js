@@ -162,6 +162,39 @@
                 ]
             }
         },
+        {
+            "stmt": "SELECT member_id, count_transactions_remote_in_applier_queue FROM performance_schema.replication_group_member_stats WHERE channel_name = 'group_replication_applier'",
+            "result": {
+                "columns": [
+                    {
+                        "name": "member_id",
+                        "type": "STRING"
+                    },
+                    {
+                        "name": "count_transactions_remote_in_applier_queue",
+                        "type": "LONGLONG"
+                    }
+                ],
+                "rows": [
+                    [
+                        "37dbb0e3-cfc0-11e7-8039-080027d01fcd",
+                        "0"
+                    ],
+                    [
+                        "49cff431-cfc0-11e7-bb87-080027d01fcd",
+                        "0"
+                    ],
+                    [
+                        "56d0f99d-cfc0-11e7-bb0a-080027d01fcd",
+                        "0"
+                    ],
+                    [
+                        "6689460c-cfc0-11e7-907b-080027d01fcd",
+                        "0"
+                    ]
+                ]
+            }
+        },
         {
             "stmt": "select @@port",
             "result": {